@@ -369,6 +369,24 @@ struct GCEVENT
 
 EXTERN_C MIR_APP_DLL(int) Chat_Event(GCEVENT*);
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// Adds many users to the nicklist at once
+// Works like a sequence of GC_EVENT_JOIN (with time = 0) and GC_EVENT_SETCONTACTSTATUS
+// events, but the nicklist is sorted and redrawn only once. Users which are already in
+// the nicklist are skipped. ME_GC_HOOK_EVENT isn't called for these users.
+// Returns the number of users added
+
+struct GCUSER
+{
+	LPCTSTR ptszUID;               // unique user id, required
+	LPCTSTR ptszNick;              // user's nick, required
+	LPCTSTR ptszStatus;            // status group registered with Chat_AddGroup
+	WORD    wContactStatus;        // ID_STATUS_* value or 0
+	BOOL    bIsMe;                 // is this user the Miranda user?
+};
+
+EXTERN_C MIR_APP_DLL(int) Chat_AddUsers(const char *szModule, const wchar_t *wszId, const GCUSER *pUsers, int nUsers);
+
 EXTERN_C MIR_APP_DLL(void*) Chat_GetUserInfo(const char *szModule, const wchar_t *wszId);
 EXTERN_C MIR_APP_DLL(int) Chat_SetUserInfo(const char *szModule, const wchar_t *wszId, void *pItemData);
 
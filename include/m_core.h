@@ -91,6 +91,9 @@ typedef int (*MIRANDAHOOKPARAM)(WPARAM, LPARAM, LPARAM);
 typedef int (*MIRANDAHOOKOBJ)(void*, WPARAM, LPARAM);
 typedef int (*MIRANDAHOOKOBJPARAM)(void*, WPARAM, LPARAM, LPARAM);
 
+// receives the time spent by each subscriber, in QueryPerformanceCounter ticks
+typedef void (*MIRANDAHOOKTIMER)(HINSTANCE hOwner, __int64 iTicks);
+
 typedef INT_PTR (*MIRANDASERVICE)(WPARAM, LPARAM);
 typedef INT_PTR (*MIRANDASERVICEPARAM)(WPARAM, LPARAM, LPARAM);
 typedef INT_PTR (*MIRANDASERVICEOBJ)(void*, WPARAM, LPARAM);
@@ -109,6 +112,7 @@ MIR_CORE_DLL(int)     CallPluginEventHook(HINSTANCE hInst, HANDLE hEvent, WPARAM
 MIR_CORE_DLL(int)     CallObjectEventHook(void *pObject, HANDLE hEvent, WPARAM wParam = 0, LPARAM lParam = 0);
 MIR_CORE_DLL(int)     NotifyEventHooks(HANDLE hEvent, WPARAM wParam = 0, LPARAM lParam = 0);
 MIR_CORE_DLL(int)     NotifyFastHook(HANDLE hEvent, WPARAM wParam = 0, LPARAM lParam = 0);
+MIR_CORE_DLL(int)     NotifyEventHooksTimed(HANDLE hEvent, MIRANDAHOOKTIMER pfnTimer, WPARAM wParam = 0, LPARAM lParam = 0);
 
 MIR_CORE_DLL(HANDLE)  HookEvent(const char *name, MIRANDAHOOK hookProc);
 MIR_CORE_DLL(HANDLE)  HookEventParam(const char *name, MIRANDAHOOKPARAM hookProc, LPARAM lParam = 0);
@@ -232,6 +236,8 @@ MIR_CORE_DLL(int)         List_GetIndex(SortedList* p_list, void* p_value, int*
 MIR_CORE_DLL(int)         List_IndexOf(SortedList* p_list, void* p_value);
 MIR_CORE_DLL(int)         List_Insert(SortedList* p_list, void* p_value, int p_index);
 MIR_CORE_DLL(int)         List_InsertPtr(SortedList* list, void* p);
+MIR_CORE_DLL(int)         List_InsertMany(SortedList* p_list, void** p_items, int p_count);
+MIR_CORE_DLL(int)         List_Reserve(SortedList* p_list, int p_count);
 MIR_CORE_DLL(int)         List_Remove(SortedList* p_list, int index);
 MIR_CORE_DLL(int)         List_RemovePtr(SortedList* list, void* p);
 MIR_CORE_DLL(void)        List_Copy(SortedList* s, SortedList* d, size_t itemSize);
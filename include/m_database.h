@@ -552,6 +552,22 @@ EXTERN_C MIR_APP_DLL(HICON) DbEvent_GetIcon(DBEVENTINFO *dbei, int flags);
 
 EXTERN_C MIR_APP_DLL(wchar_t*) DbEvent_GetString(DBEVENTINFO *dbei, const char *str);
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// Full-text search over the message history
+// * hContact - a contact to search in, or INVALID_CONTACT_ID to search everywhere
+// * pwszQuery - words separated by spaces, all of them should be present in a message.
+//   A word followed by an asterisk matches as a prefix, words in double quotes should
+//   follow each other. The search is case insensitive
+// * pFunc is called for each event found in ascending order of event handles,
+//   returning nonzero from it stops the search
+//
+// Returns the number of events found or -1 if the index isn't built yet, in this case
+// a caller should fall back to scanning events
+
+typedef int (*DBEVENTSEARCHPROC)(MCONTACT hContact, MEVENT hDbEvent, void *param);
+
+EXTERN_C MIR_APP_DLL(int) DbEvent_Search(MCONTACT hContact, const wchar_t *pwszQuery, DBEVENTSEARCHPROC pFunc, void *param = nullptr);
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // Database events
 
@@ -582,6 +582,41 @@ public:
 
 EXTERN_C MIR_APP_DLL(NETLIBHTTPREQUEST*) Netlib_HttpTransaction(HNETLIBUSER hNlu, NETLIBHTTPREQUEST *pRequest);
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// Queue an HTTP transaction into the shared scheduler
+// The request is executed by a pool of worker threads, at most a few requests are sent
+// to the same host at once. Lower iPriority values are served first.
+// Failed transactions (no reply, 5xx or 429) are retried up to nRetries times with an
+// exponential backoff. If dwTimeout (in ms) is not 0, the request is dropped when it
+// cannot be completed in time.
+// pfnCallback is called exactly once from a worker thread, with pReply == NULL if the
+// request failed, expired or was cancelled. The reply is freed after the callback
+// returns, the request remains owned by the caller and can be freed in the callback.
+// Returns 0 on success, nonzero on error (the callback is not called then)
+// Errors: ERROR_INVALID_PARAMETER, ERROR_SHUTDOWN_IN_PROGRESS
+
+#define NLHA_INTERACTIVE 0
+#define NLHA_BACKGROUND  1
+
+typedef void (*NETLIBHTTPCALLBACK)(NETLIBHTTPREQUEST *pReply, NETLIBHTTPREQUEST *pRequest, void *param);
+
+struct NETLIBASYNCHTTP
+{
+	NETLIBHTTPREQUEST *pRequest;
+	NETLIBHTTPCALLBACK pfnCallback;
+	void *param;
+	int iPriority;      // NLHA_* constant or any other value
+	int nRetries;       // number of retries on failure
+	DWORD dwTimeout;    // overall deadline in ms, 0 = none
+};
+
+EXTERN_C MIR_APP_DLL(int) Netlib_HttpTransactionAsync(HNETLIBUSER hNlu, const NETLIBASYNCHTTP *pDescr);
+
+// Drops all queued requests of hNlu (their callbacks are called with NULL) and waits
+// for the running ones to complete. Called automatically by Netlib_CloseHandle()
+
+EXTERN_C MIR_APP_DLL(void) Netlib_CancelHttpRequests(HNETLIBUSER hNlu);
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // Send data over a connection
 //
@@ -659,6 +694,30 @@ struct NETLIBSELECTEX
 
 EXTERN_C MIR_APP_DLL(int) Netlib_SelectEx(NETLIBSELECTEX *nls);
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// Readiness notifications
+// Registers a connection once instead of passing it to Netlib_Select() on every wait.
+// The callback is called on one of netlib's I/O threads when the connection becomes
+// readable or writable, so it must not block. NLPOLL_ERROR is always reported; after it
+// the connection isn't watched until Netlib_PollModify() is called.
+// Netlib_CloseHandle() removes the registration automatically.
+// Returns 0 on success, nonzero on failure. HTTP gateway connections aren't supported.
+
+#define NLPOLL_READ   0x0001
+#define NLPOLL_WRITE  0x0002
+#define NLPOLL_ERROR  0x0004
+
+typedef void (*NETLIBPOLLCALLBACK)(HNETLIBCONN hConn, int iEvents, void *pUserInfo);
+
+EXTERN_C MIR_APP_DLL(int) Netlib_PollAdd(HNETLIBCONN hConn, int iEvents, NETLIBPOLLCALLBACK pfnCallback, void *pUserInfo);
+
+// changes the set of NLPOLL_* events being watched
+EXTERN_C MIR_APP_DLL(int) Netlib_PollModify(HNETLIBCONN hConn, int iEvents);
+
+// stops watching the connection. when called from another thread, waits for the running callback to return;
+// the main thread keeps processing messages meanwhile, so the callback may use CallFunctionSync()
+EXTERN_C MIR_APP_DLL(void) Netlib_PollRemove(HNETLIBCONN hConn);
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // Shutdown connection
 
@@ -722,6 +781,39 @@ EXTERN_C MIR_APP_DLL(int) Netlib_SetPollingTimeout(HNETLIBCONN hConnection, int
 
 EXTERN_C MIR_APP_DLL(int) Netlib_StartSsl(HNETLIBCONN hConnection, const char *host);
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// WebSocket client connections (RFC 6455)
+//
+// WebSocket_Connect() opens a connection to ws:// or wss:// url and performs the handshake.
+// Returns a connection handle on success, NULL on failure. The handle is closed by
+// Netlib_CloseHandle() and can be interrupted by Netlib_Shutdown() as usual.
+// szExtraHeaders, if present, must be a set of CRLF-terminated header lines
+
+#define WSOP_CONTINUATION 0x00
+#define WSOP_TEXT         0x01
+#define WSOP_BINARY       0x02
+#define WSOP_CLOSE        0x08
+#define WSOP_PING         0x09
+#define WSOP_PONG         0x0A
+
+#define NLWS_DEFLATE      0x0001   // negotiate the permessage-deflate extension (RFC 7692)
+#define NLWS_ZLIB_STREAM  0x0002   // binary messages are parts of one zlib stream, they're inflated &
+                                   // returned as WSOP_TEXT messages (Discord's zlib-stream transport compression)
+
+EXTERN_C MIR_APP_DLL(HNETLIBCONN) WebSocket_Connect(HNETLIBUSER nlu, const char *szUrl, int flags = 0, const char *szExtraHeaders = nullptr);
+
+// Sends one masked frame, data frames are compressed if permessage-deflate was negotiated
+// Returns the number of bytes sent on success, SOCKET_ERROR on failure
+
+EXTERN_C MIR_APP_DLL(int) WebSocket_Send(HNETLIBCONN hConnection, const void *pData, size_t dataLen, int opCode = WSOP_TEXT);
+
+// Receives the next complete (reassembled & decompressed) data message.
+// Pings are answered automatically, pongs are skipped, a close frame is confirmed.
+// Returns the message length, 0 if the connection was closed, SOCKET_ERROR on failure.
+// *ppData points to the internal buffer valid till the next call of WebSocket_Recv()
+
+EXTERN_C MIR_APP_DLL(int) WebSocket_Recv(HNETLIBCONN hConnection, const char **ppData, int *pOpCode = nullptr);
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // netlib log funcitons
 
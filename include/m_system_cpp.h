@@ -244,6 +244,11 @@ template<class T> struct LIST
 	__inline int  insert(T *p)          { return List_InsertPtr((SortedList*)this, p); }
 	__inline int  remove(T *p)          { return List_RemovePtr((SortedList*)this, p); }
 
+	// appends nItems items (sorted lists are kept sorted), returns the number of inserted items
+	__inline int  insertMany(T **p, int nItems) { return List_InsertMany((SortedList*)this, (void**)p, nItems); }
+	// preallocates memory for nItems items
+	__inline bool reserve(int nItems)   { return List_Reserve((SortedList*)this, nItems) != 0; }
+
 	__inline int  indexOf(T **p) const  { return int(p - items); }
 	__inline T* removeItem(T **p)
 	{
@@ -376,6 +381,39 @@ public:
 	void remove(size_t sz);
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// buffer for stream reassembly: grows geometrically, consumes data from the
+// beginning without moving it and gives direct access to the writable tail.
+// the data is always followed by a zero byte; data() of an empty buffer is
+// either nullptr or an empty string
+
+class MIR_CORE_EXPORT MStreamBuffer : public MNonCopyable
+{
+	char *m_buf;        // the beginning of data inside m_pBlock, i.e. the read cursor
+	size_t m_len;       // data length
+	char *m_pBlock;     // allocated memory block
+	size_t m_size;      // its size
+
+public:
+	MStreamBuffer();
+	~MStreamBuffer();
+
+	__forceinline char*  data() const { return m_buf; }
+	__forceinline bool   isEmpty() const { return m_len == 0; }
+	__forceinline size_t length() const { return m_len; }
+
+	// adds a buffer to the end
+	void append(void *pBuf, size_t bufLen);
+
+	// drops a part of buffer, doesn't move the rest of data
+	void remove(size_t sz);
+
+	// returns a pointer to at least bufLen writable bytes at the end of buffer,
+	// the data written there becomes a part of buffer after commit()
+	char* reserve(size_t bufLen);
+	void  commit(size_t bufLen);
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // parameter classes for XML, JSON & HTTP requests
 
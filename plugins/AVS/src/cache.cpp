@@ -43,8 +43,15 @@ static int CompareNodes(const CacheNode *p1, const CacheNode *p2)
 	return INT_PTR(p1->hContact) - INT_PTR(p2->hContact);
 }
 
+// maximum number of threads decoding avatars at the same time
+#define MAX_LOADER_THREADS 4
+
+// an avatar drawn during the last seconds is considered to be visible on the screen
+#define VISIBLE_TIMEOUT 3
+
 static OBJLIST<CacheNode> arCache(100, CompareNodes);
-static LIST<CacheNode> arQueue(10);
+static LIST<CacheNode> arQueue(10), arQueueVisible(10);
+static LIST<void> arOpenWindows(10, HandleKeySortT); // contacts with an open message window, protected by alloccs
 static mir_cs alloccs, cachecs;
 
 // allocate a cache block and add it to the list of blocks
@@ -55,13 +62,85 @@ void UnloadCache(void)
 	arCache.destroy();
 }
 
+// contacts being drawn right now or having an open message window are loaded first.
+// message windows are tracked by the main thread's window events, so that loaders
+// never need to ask SRMM. must be called under alloccs
+
+static bool IsContactVisible(const CacheNode *cc)
+{
+	if (DWORD(time(0)) - cc->t_lastAccess < VISIBLE_TIMEOUT)
+		return true;
+
+	return arOpenWindows.find((void*)cc->hContact) != nullptr;
+}
+
+int OnWindowEvent(WPARAM, LPARAM lParam)
+{
+	MessageWindowEventData *evt = (MessageWindowEventData*)lParam;
+	if (evt->uType != MSG_WINDOW_EVT_OPEN && evt->uType != MSG_WINDOW_EVT_CLOSE)
+		return 0;
+
+	CacheNode *cc;
+	{
+		mir_cslock lck(cachecs);
+		cc = arCache.find((CacheNode*)&evt->hContact);
+	}
+
+	mir_cslock lck(alloccs);
+	if (evt->uType == MSG_WINDOW_EVT_CLOSE) {
+		arOpenWindows.remove((void*)evt->hContact);
+		return 0;
+	}
+
+	arOpenWindows.insert((void*)evt->hContact);
+
+	// a request already waiting in the background queue goes first now
+	int idx = (cc) ? arQueue.indexOf(cc) : -1;
+	if (idx != -1) {
+		arQueue.remove(idx);
+		arQueueVisible.insert(cc, arQueueVisible.getCount());
+	}
+	return 0;
+}
+
 void PushAvatarRequest(CacheNode *cc)
 {
 	mir_cslock lck(alloccs);
-	int idx = arQueue.getCount();
-	if (idx > 0)
-		idx--;
-	arQueue.insert(cc, idx);
+	bool bVisible = IsContactVisible(cc);
+	if (arQueueVisible.indexOf(cc) != -1)
+		return;
+
+	int idx = arQueue.indexOf(cc);
+	if (idx != -1) {
+		if (!bVisible)
+			return;
+		arQueue.remove(idx);
+	}
+
+	if (bVisible)
+		arQueueVisible.insert(cc, arQueueVisible.getCount());
+	else
+		arQueue.insert(cc, arQueue.getCount());
+
+	// the event is set under the lock, so that no loader could miss it
+	SetEvent(hLoaderEvent);
+}
+
+static CacheNode* PopAvatarRequest(bool &bVisible)
+{
+	mir_cslock lck(alloccs);
+
+	bVisible = arQueueVisible.getCount() != 0;
+	LIST<CacheNode> &list = (bVisible) ? arQueueVisible : arQueue;
+	if (list.getCount() == 0) {
+		if (!g_shutDown)
+			ResetEvent(hLoaderEvent);
+		return nullptr;
+	}
+
+	CacheNode *node = list[0];
+	list.remove(0);
+	return node;
 }
 
 // link a new cache block with the already existing chain of blocks
@@ -80,7 +159,9 @@ CacheNode* FindAvatarInCache(MCONTACT hContact, bool add, bool findAny)
 		mir_cslock lck(cachecs);
 		cc = arCache.find((CacheNode*)&hContact);
 		if (cc) {
-			cc->t_lastAccess = time(0);
+			// lookups for drawing only, they're used to detect visible contacts
+			if (!findAny)
+				cc->t_lastAccess = time(0);
 			return (cc->loaded || findAny) ? cc : nullptr;
 		}
 
@@ -90,13 +171,14 @@ CacheNode* FindAvatarInCache(MCONTACT hContact, bool add, bool findAny)
 
 		cc = new CacheNode();
 		cc->hContact = hContact;
+		if (!findAny)
+			cc->t_lastAccess = time(0);
 		arCache.insert(cc);
 	}
 
 	switch (CreateAvatarInCache(hContact, cc, nullptr)) {
 	case -2:  // no avatar data in settings, retrieve
 		PushAvatarRequest(cc);
-		SetEvent(hLoaderEvent);    // wake him up
 		break;
 			
 	case 1: // loaded, everything is ok
@@ -214,30 +296,27 @@ int SetAvatarAttribute(MCONTACT hContact, DWORD attrib, int mode)
 	return 0;
 }
 
-// this thread scans the cache and handles nodes which have mustLoad set to > 0 (must be loaded/reloaded) or
-// nodes where mustLoad is < 0 (must be deleted).
-// its waken up by the event and tries to lock the cache only when absolutely necessary.
+// these threads take nodes from the request queues (visible contacts first) and load their pictures.
+// they're waken up by the event and lock the cache only when absolutely necessary.
 
-void PicLoader(LPVOID)
+static void PicLoader(LPVOID)
 {
 	Thread_SetName("AVS: PicLoader");
 
-	DWORD dwDelay = db_get_dw(NULL, AVS_MODULE, "picloader_sleeptime", 80);
-
-	if (dwDelay < 30)
-		dwDelay = 30;
-	else if (dwDelay > 100)
-		dwDelay = 100;
+	// the old global pause between two avatars is applied only if it was set explicitly,
+	// and only to background requests, visible contacts are never delayed
+	DWORD dwDelay = db_get_dw(NULL, AVS_MODULE, "picloader_sleeptime", 0);
+	if (dwDelay != 0) {
+		if (dwDelay < 30)
+			dwDelay = 30;
+		else if (dwDelay > 100)
+			dwDelay = 100;
+	}
 
 	while (!g_shutDown) {
 		while (!g_shutDown) {
-			CacheNode *node;
-			{
-				mir_cslock all(alloccs);
-				node = arQueue[0];
-				if (node)
-					arQueue.remove(0);
-			}
+			bool bVisible;
+			CacheNode *node = PopAvatarRequest(bVisible);
 			if (node == nullptr)
 				break;
 
@@ -257,10 +336,12 @@ void PicLoader(LPVOID)
 					result = CreateAvatarInCache(node->hContact, &ace_temp, nullptr);
 			}
 
+			// several loaders may process the same node, so the old picture is swapped under the lock
 			if (result == 1 && ace_temp.hbmPic != nullptr) { // Loaded
-				HBITMAP oldPic = node->hbmPic;
+				HBITMAP oldPic;
 				{
 					mir_cslock l(cachecs);
+					oldPic = node->hbmPic;
 					memcpy(node, &ace_temp, sizeof(AVATARCACHEENTRY));
 					node->loaded = TRUE;
 				}
@@ -269,9 +350,10 @@ void PicLoader(LPVOID)
 				NotifyMetaAware(node->hContact, node);
 			}
 			else if (result == 0 || result == -3) { // Has no avatar
-				HBITMAP oldPic = node->hbmPic;
+				HBITMAP oldPic;
 				{
 					mir_cslock l(cachecs);
+					oldPic = node->hbmPic;
 					memcpy(node, &ace_temp, sizeof(AVATARCACHEENTRY));
 					node->loaded = FALSE;
 				}
@@ -280,9 +362,24 @@ void PicLoader(LPVOID)
 				NotifyMetaAware(node->hContact, node);
 			}
 
-			mir_sleep(dwDelay);
+			if (dwDelay && !bVisible)
+				mir_sleep(dwDelay);
 		}
 		WaitForSingleObject(hLoaderEvent, INFINITE);
-		ResetEvent(hLoaderEvent);
 	}
 }
+
+void StartPicLoaders()
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+
+	int nThreads = si.dwNumberOfProcessors / 2;
+	if (nThreads < 1)
+		nThreads = 1;
+	else if (nThreads > MAX_LOADER_THREADS)
+		nThreads = MAX_LOADER_THREADS;
+
+	for (int i = 0; i < nThreads; i++)
+		SetThreadPriority(mir_forkthread(PicLoader), THREAD_PRIORITY_IDLE);
+}
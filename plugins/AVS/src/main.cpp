@@ -218,6 +218,7 @@ static int ShutdownProc(WPARAM, LPARAM)
 	g_shutDown = true;
 	SetEvent(hLoaderEvent);
 	SetEvent(hShutdownEvent);
+	ShutdownPolls();
 	CloseHandle(hShutdownEvent); hShutdownEvent = nullptr;
 	return 0;
 }
@@ -325,7 +326,8 @@ static int ModulesLoaded(WPARAM, LPARAM)
 	mir_snwprintf(szEventName, L"avs_loaderthread_%d", GetCurrentThreadId());
 	hLoaderEvent = CreateEvent(nullptr, TRUE, FALSE, szEventName);
 
-	SetThreadPriority(mir_forkthread(PicLoader), THREAD_PRIORITY_IDLE);
+	InitThumbCache();
+	StartPicLoaders();
 
 	// Folders plugin support
 	hMyAvatarsFolder = FoldersRegisterCustomPathT(LPGEN("Avatars"), LPGEN("My Avatars"), MIRANDA_USERDATAT L"\\Avatars");
@@ -369,6 +371,7 @@ int CMPlugin::Load()
 	HookEvent(ME_PROTO_ACK, ProtocolAck);
 	HookEvent(ME_MC_DEFAULTTCHANGED, MetaChanged);
 	HookEvent(ME_MC_SUBCONTACTSCHANGED, MetaChanged);
+	HookEvent(ME_MSG_WINDOWEVENT, OnWindowEvent);
 
 	hEventChanged = CreateHookableEvent(ME_AV_AVATARCHANGED);
 	hEventContactAvatarChanged = CreateHookableEvent(ME_AV_CONTACTAVATARCHANGED);
@@ -388,6 +391,7 @@ int CMPlugin::Unload()
 {
 	UninitPolls();
 	UnloadCache();
+	UninitThumbCache();
 
 	DestroyHookableEvent(hEventChanged);
 	DestroyHookableEvent(hEventContactAvatarChanged);
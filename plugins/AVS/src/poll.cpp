@@ -22,7 +22,9 @@ Boston, MA 02111-1307, USA.
 /*
 It has 1 queue:
 A queue to request items. One request is done at a time, REQUEST_WAIT_TIME miliseconts after it has beeing fired
-ACKRESULT_STATUS. This thread only requests the avatar (and maybe add it to the cache queue)
+ACKRESULT_STATUS. This thread only requests the avatar (and maybe add it to the cache queue).
+The thread sleeps until a new item is added or the nearest item is due, a protocol which
+returned GAIR_WAITFOR isn't asked again for REQUEST_DELAY, other protocols aren't affected
 */
 
 // Time to wait before re-requesting an avatar that failed
@@ -31,10 +33,7 @@ ACKRESULT_STATUS. This thread only requests the avatar (and maybe add it to the
 // Time to wait before re-requesting an avatar that received an wait for
 #define REQUEST_WAITFOR_WAIT_TIME (30 * 60 * 1000)
 
-// Number of mileseconds the threads wait until take a look if it is time to request another item
-#define POOL_DELAY 1000
-
-// Number of mileseconds the threads wait after a GAIR_WAITFOR is returned
+// Number of mileseconds a protocol isn't requested after a GAIR_WAITFOR is returned
 #define REQUEST_DELAY 18000
 
 
@@ -57,16 +56,43 @@ static int QueueSortItems(const QueueItem *p1, const QueueItem *p2)
 
 static OBJLIST<QueueItem> queue(20, QueueSortItems);
 static mir_cs cs;
+static HANDLE hRequestEvent;
+
+// Protocols that asked to wait, protected by cs
+struct ProtoDelay
+{
+	ProtoDelay(const char *_proto) : szProto(mir_strdup(_proto)) {}
+	~ProtoDelay() { mir_free(szProto); }
+
+	char *szProto;
+	DWORD dwNextRequest;
+};
+
+static int CompareDelays(const ProtoDelay *p1, const ProtoDelay *p2)
+{
+	return mir_strcmp(p1->szProto, p2->szProto);
+}
+
+static OBJLIST<ProtoDelay> arDelays(5, CompareDelays);
 
 void InitPolls()
 {
+	hRequestEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
 	// Init request queue
 	mir_forkthread(RequestThread);
 }
 
+void ShutdownPolls()
+{
+	SetEvent(hRequestEvent);
+}
+
 void UninitPolls()
 {
 	queue.destroy();
+	arDelays.destroy();
+	CloseHandle(hRequestEvent);
 }
 
 // Return true if this protocol can have avatar requested
@@ -125,6 +151,33 @@ void QueueAdd(MCONTACT hContact, int waitTime)
 	item->hContact = hContact;
 	item->check_time = GetTickCount() + waitTime;
 	queue.insert(item);
+
+	SetEvent(hRequestEvent);
+}
+
+// Returns the number of mileseconds to wait before requesting this protocol, or 0
+static DWORD GetProtoDelay(const char *szProto, DWORD dwNow)
+{
+	if (szProto == nullptr)
+		return 0;
+
+	ProtoDelay *p = arDelays.find((ProtoDelay*)&szProto);
+	if (p == nullptr || int(p->dwNextRequest - dwNow) <= 0)
+		return 0;
+
+	return p->dwNextRequest - dwNow;
+}
+
+static void SetProtoDelay(const char *szProto, DWORD dwDelay)
+{
+	if (szProto == nullptr)
+		return;
+
+	mir_cslock lck(cs);
+	ProtoDelay *p = arDelays.find((ProtoDelay*)&szProto);
+	if (p == nullptr)
+		arDelays.insert(p = new ProtoDelay(szProto));
+	p->dwNextRequest = GetTickCount() + dwDelay;
 }
 
 void ProcessAvatarInfo(MCONTACT hContact, int type, PROTO_AVATAR_INFORMATION *pai, const char *szProto)
@@ -208,39 +261,50 @@ static void RequestThread(void *)
 	Thread_SetName("AVS: RequestThread");
 
 	while (!g_shutDown) {
-		mir_cslockfull lck(cs);
-
-		if (queue.getCount() == 0) {
-			// No items, so suspend thread
-			lck.unlock();
-			mir_sleep(POOL_DELAY);
-			continue;
+		MCONTACT hContact = 0;
+		DWORD dwWait = INFINITE;
+		{
+			mir_cslock lck(cs);
+
+			// Items with higher priority are at end. Take the first due item whose protocol doesn't wait
+			DWORD dwNow = GetTickCount();
+			for (int i = queue.getCount() - 1; i >= 0; i--) {
+				QueueItem &qi = queue[i];
+				if (int(qi.check_time - dwNow) > 0) {
+					// Not time to request yet, all the rest items aren't due either
+					dwWait = min(dwWait, qi.check_time - dwNow);
+					break;
+				}
+
+				DWORD dwDelay = GetProtoDelay(GetContactProto(qi.hContact), dwNow);
+				if (dwDelay != 0) {
+					dwWait = min(dwWait, dwDelay);
+					continue;
+				}
+
+				// Will request this item
+				hContact = qi.hContact;
+				queue.remove(i);
+				break;
+			}
 		}
 
-		// Take a look at first item
-		QueueItem &qi = queue[queue.getCount() - 1];
-		if (qi.check_time > GetTickCount()) {
-			// Not time to request yet, wait...
-			lck.unlock();
-			mir_sleep(POOL_DELAY);
+		if (hContact == 0) {
+			// Nothing to do, sleep until an item is added or becomes due
+			WaitForSingleObject(hRequestEvent, dwWait);
 			continue;
 		}
 
-		// Will request this item
-		MCONTACT hContact = qi.hContact;
-		queue.remove(queue.getCount() - 1);
-		QueueRemove(hContact);
-		lck.unlock();
-
 		if (FetchAvatarFor(hContact) == GAIR_WAITFOR) {
 			// Mark to not request this contact avatar for more 30 min
-			lck.lock();
-			QueueRemove(hContact);
-			QueueAdd(hContact, REQUEST_WAITFOR_WAIT_TIME);
-			lck.unlock();
-
-			// Wait a little until requesting again
-			mir_sleep(REQUEST_DELAY);
+			{
+				mir_cslock lck(cs);
+				QueueRemove(hContact);
+				QueueAdd(hContact, REQUEST_WAITFOR_WAIT_TIME);
+			}
+
+			// Wait a little until requesting this protocol again
+			SetProtoDelay(GetContactProto(hContact), REQUEST_DELAY);
 		}
 	}
 }
@@ -30,6 +30,7 @@ struct QueueItem
 };
 
 void InitPolls();
+void ShutdownPolls();
 void UninitPolls();
 
 // Add an contact to a queue
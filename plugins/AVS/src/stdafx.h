@@ -41,6 +41,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <m_avatars.h>
 #include <m_acc.h>
 #include <m_imgsrvc.h>
+#include <m_message.h>
 #include <m_string.h>
 
 #include <m_folders.h>
@@ -144,9 +145,15 @@ void  MyPathToAbsolute(const wchar_t *ptszPath, wchar_t *ptszDest);
 HBITMAP LoadPNG(struct AVATARCACHEENTRY *ace, char *szFilename);
 
 void UnloadCache(void);
+
+void    InitThumbCache(void);
+void    UninitThumbCache(void);
+DWORD   GetThumbOptions(MCONTACT hContact);
+HBITMAP Thumb_Load(const wchar_t *pwszFile, DWORD dwOptions, DWORD &dwFlags);
+void    Thumb_Store(const wchar_t *pwszFile, DWORD dwOptions, HBITMAP hBmp, DWORD dwFlags);
 int  CreateAvatarInCache(MCONTACT hContact, AVATARCACHEENTRY *ace, const char *szProto);
 void DeleteAvatarFromCache(MCONTACT hContact, bool bForever);
-void PicLoader(LPVOID param);
+void StartPicLoaders(void);
 void NotifyMetaAware(MCONTACT hContact, CacheNode *node = nullptr, AVATARCACHEENTRY *ace = (AVATARCACHEENTRY*)-1);
 
 void InternalDrawAvatar(AVATARDRAWREQUEST *r, HBITMAP hbm, LONG bmWidth, LONG bmHeight, DWORD dwFlags);
@@ -156,6 +163,7 @@ void DeleteGlobalUserAvatar();
 int  FetchAvatarFor(MCONTACT hContact, char *szProto = nullptr);
 CacheNode* FindAvatarInCache(MCONTACT hContact, bool add, bool findAny = false);
 void PushAvatarRequest(CacheNode *cc);
+int  OnWindowEvent(WPARAM wParam, LPARAM lParam);
 int  SetAvatarAttribute(MCONTACT hContact, DWORD attrib, int mode);
 void SetIgnoreNotify(char *protocol, BOOL ignore);
 
@@ -0,0 +1,419 @@
+/*
+
+Miranda NG: the free IM client for Microsoft* Windows*
+
+Copyright (c) 2012-18 Miranda NG team (https://miranda-ng.org)
+all portions of this codebase are copyrighted to the people
+listed in contributors.txt.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "stdafx.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// persistent cache of contacts' avatars, ready to be blitted
+//
+// the file is a header followed by a sequence of records. each record holds the source
+// file's path, size & write time, the processing options, and the final 24 or 32-bit
+// pixels in the bottom-up DIB order. new records are only appended, a newer record for
+// the same path & options supersedes an older one. the file is mapped once at startup and
+// gets compacted when the superseded records take more than a half of it. records whose
+// source file was removed or changed are dropped by the compaction
+
+#define THUMB_SIGNATURE  0x48545641 // 'AVTH'
+#define THUMB_VERSION    2
+
+#define THUMB_FILE       L"AvatarThumbs.dat"
+#define THUMB_FILE_TMP   L"AvatarThumbs.tmp"
+
+// AVS_* flags which are stored together with pixels
+#define THUMB_FLAGS_MASK (AVS_CUSTOMTRANSPBKG | AVS_HASTRANSPARENCY | AVS_PREMULTIPLIED)
+
+struct ThumbHeader
+{
+	DWORD dwSignature, dwVersion;
+};
+
+struct ThumbRecord
+{
+	DWORD    cbRecord;     // size of the whole record, multiple of 4
+	FILETIME ftWrite;      // last write time of the source file
+	DWORD    dwFileSize;   // size of the source file
+	DWORD    dwOptions;    // processing options, see GetThumbOptions()
+	DWORD    dwFlags;      // AVS_* flags of the result
+	WORD     wWidth, wHeight;
+	WORD     cchPath;      // path length including the terminating zero
+	WORD     wBitsPixel;   // 24 or 32, the depth of the original bitmap
+
+	// the path padded to 4 bytes follows, then wHeight rows of pixels, each padded to 4 bytes
+
+	__forceinline const wchar_t* path() const { return (const wchar_t*)(this + 1); }
+	__forceinline const BYTE* pixels() const { return (const BYTE*)(this + 1) + ((cchPath * sizeof(wchar_t) + 3) & ~3); }
+	__forceinline size_t cbPixels() const { return GetThumbStride(wWidth, wBitsPixel) * wHeight; }
+
+	static size_t GetThumbStride(int iWidth, int iBitsPixel)
+	{
+		return ((iWidth * iBitsPixel + 31) / 32) * 4;
+	}
+};
+
+struct ThumbEntry
+{
+	ThumbEntry(const wchar_t *_path, DWORD _options) :
+		dwPathHash(mir_hashstrW(_path)),
+		dwOptions(_options),
+		wszPath(mir_wstrdup(_path))
+	{}
+
+	DWORD dwPathHash, dwOptions;
+	ptrW  wszPath;
+	FILETIME ftWrite;
+	DWORD dwFileSize;
+	const ThumbRecord *pRec;  // nullptr for records written during this session
+};
+
+static int CompareThumbs(const ThumbEntry *p1, const ThumbEntry *p2)
+{
+	if (p1->dwPathHash != p2->dwPathHash)
+		return (p1->dwPathHash < p2->dwPathHash) ? -1 : 1;
+	if (p1->dwOptions != p2->dwOptions)
+		return (p1->dwOptions < p2->dwOptions) ? -1 : 1;
+	return mir_wstrcmp(p1->wszPath, p2->wszPath);
+}
+
+static OBJLIST<ThumbEntry> arThumbs(100, CompareThumbs);
+static mir_cs csThumbs;
+
+static HANDLE hThumbFile = INVALID_HANDLE_VALUE, hThumbMap;
+static BYTE *pThumbView;
+static DWORD dwThumbSize;
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// reads the mapped file into the index, returns the size of superseded records
+
+static DWORD ScanThumbs()
+{
+	DWORD cbGarbage = 0;
+
+	for (DWORD ofs = sizeof(ThumbHeader); ofs + sizeof(ThumbRecord) <= dwThumbSize;) {
+		const ThumbRecord *pRec = (const ThumbRecord*)(pThumbView + ofs);
+		if (pRec->cbRecord < sizeof(ThumbRecord) || pRec->cbRecord > dwThumbSize - ofs || pRec->cchPath == 0)
+			break; // damaged tail, ignore it
+
+		if (pRec->wBitsPixel != 24 && pRec->wBitsPixel != 32)
+			break;
+
+		size_t cbData = (pRec->pixels() - (const BYTE*)pRec) + pRec->cbPixels();
+		if (cbData > pRec->cbRecord || pRec->path()[pRec->cchPath - 1] != 0)
+			break;
+
+		ThumbEntry *p = new ThumbEntry(pRec->path(), pRec->dwOptions);
+		ThumbEntry *pOld = arThumbs.find(p);
+		if (pOld != nullptr) {
+			cbGarbage += pOld->pRec->cbRecord;
+			delete p;
+			p = pOld;
+		}
+		else arThumbs.insert(p);
+
+		p->ftWrite = pRec->ftWrite;
+		p->dwFileSize = pRec->dwFileSize;
+		p->pRec = pRec;
+
+		ofs += pRec->cbRecord;
+	}
+
+	return cbGarbage;
+}
+
+static bool OpenThumbs(const wchar_t *pwszFile)
+{
+	hThumbFile = CreateFileW(pwszFile, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hThumbFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	dwThumbSize = GetFileSize(hThumbFile, nullptr);
+
+	ThumbHeader hdr;
+	DWORD dwRead = 0;
+	if (dwThumbSize < sizeof(hdr) || !ReadFile(hThumbFile, &hdr, sizeof(hdr), &dwRead, nullptr) || dwRead != sizeof(hdr)
+		|| hdr.dwSignature != THUMB_SIGNATURE || hdr.dwVersion != THUMB_VERSION) {
+		// new or incompatible file, start from scratch
+		hdr.dwSignature = THUMB_SIGNATURE;
+		hdr.dwVersion = THUMB_VERSION;
+
+		DWORD dwWritten;
+		SetFilePointer(hThumbFile, 0, nullptr, FILE_BEGIN);
+		WriteFile(hThumbFile, &hdr, sizeof(hdr), &dwWritten, nullptr);
+		SetEndOfFile(hThumbFile);
+		dwThumbSize = sizeof(hdr);
+		return true;
+	}
+
+	hThumbMap = CreateFileMapping(hThumbFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (hThumbMap != nullptr)
+		pThumbView = (BYTE*)MapViewOfFile(hThumbMap, FILE_MAP_READ, 0, 0, 0);
+	return pThumbView != nullptr;
+}
+
+static void CloseThumbs()
+{
+	arThumbs.destroy();
+
+	if (pThumbView) {
+		UnmapViewOfFile(pThumbView);
+		pThumbView = nullptr;
+	}
+	if (hThumbMap) {
+		CloseHandle(hThumbMap);
+		hThumbMap = nullptr;
+	}
+	if (hThumbFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(hThumbFile);
+		hThumbFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+static bool GetSourceInfo(const wchar_t *pwszFile, FILETIME &ftWrite, DWORD &dwFileSize)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW(pwszFile, GetFileExInfoStandard, &data) || data.nFileSizeHigh != 0)
+		return false;
+
+	ftWrite = data.ftLastWriteTime;
+	dwFileSize = data.nFileSizeLow;
+	return true;
+}
+
+// writes only the actual records into a new file and replaces the old one with it
+static bool CompactThumbs(const wchar_t *pwszFile)
+{
+	wchar_t wszTmp[MAX_PATH];
+	mir_snwprintf(wszTmp, L"%s%s", g_szDataPath, THUMB_FILE_TMP);
+
+	HANDLE hFile = CreateFileW(wszTmp, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD dwWritten;
+	ThumbHeader hdr = { THUMB_SIGNATURE, THUMB_VERSION };
+	bool bOk = WriteFile(hFile, &hdr, sizeof(hdr), &dwWritten, nullptr) != 0;
+
+	// keep the original order of records, skip the ones whose source is gone or was changed
+	LIST<ThumbRecord> arRecords(arThumbs.getCount(), PtrKeySortT);
+	for (auto &it : arThumbs) {
+		FILETIME ftWrite;
+		DWORD dwFileSize;
+		if (!GetSourceInfo(it->wszPath, ftWrite, dwFileSize) || CompareFileTime(&it->ftWrite, &ftWrite) || it->dwFileSize != dwFileSize)
+			continue;
+
+		arRecords.insert((ThumbRecord*)it->pRec);
+	}
+
+	for (auto &it : arRecords)
+		if (bOk)
+			bOk = WriteFile(hFile, it, it->cbRecord, &dwWritten, nullptr) != 0;
+
+	CloseHandle(hFile);
+
+	CloseThumbs();
+	if (!bOk || !MoveFileExW(wszTmp, pwszFile, MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileW(wszTmp);
+		return false;
+	}
+	return true;
+}
+
+void InitThumbCache()
+{
+	wchar_t wszFile[MAX_PATH];
+	mir_snwprintf(wszFile, L"%s%s", g_szDataPath, THUMB_FILE);
+
+	mir_cslock lck(csThumbs);
+	if (!OpenThumbs(wszFile)) {
+		CloseThumbs();
+		return;
+	}
+
+	if (pThumbView == nullptr)
+		return;
+
+	DWORD cbGarbage = ScanThumbs();
+	if (cbGarbage > dwThumbSize / 2 && dwThumbSize > 1024 * 1024) {
+		CompactThumbs(wszFile);
+		if (OpenThumbs(wszFile) && pThumbView != nullptr)
+			ScanThumbs();
+	}
+}
+
+void UninitThumbCache()
+{
+	mir_cslock lck(csThumbs);
+	CloseThumbs();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// options that change the result of CreateAvatarInCache() for a contact
+
+DWORD GetThumbOptions(MCONTACT hContact)
+{
+	DWORD dwOptions = 0;
+	if (db_get_b(0, AVS_MODULE, "RemoveAllTransparency", 0))
+		dwOptions |= 1;
+	if (db_get_b(0, AVS_MODULE, "MakeGrayscale", 0))
+		dwOptions |= 2;
+
+	if (db_get_b(hContact, "ContactPhoto", "MakeTransparentBkg", db_get_b(0, AVS_MODULE, "MakeTransparentBkg", 0))) {
+		dwOptions |= 4;
+		dwOptions |= (db_get_w(hContact, "ContactPhoto", "TranspBkgColorDiff", db_get_w(0, AVS_MODULE, "TranspBkgColorDiff", 10)) & 0xFF) << 8;
+		dwOptions |= (db_get_w(hContact, "ContactPhoto", "TranspBkgNumPoints", db_get_w(0, AVS_MODULE, "TranspBkgNumPoints", 5)) & 0xFF) << 16;
+	}
+	return dwOptions;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// returns a bitmap made from the cached pixels or nullptr if the source file was changed
+
+// the mapped file might become unreadable, so the copying is guarded
+static bool CopyPixels(void *pDest, const void *pSrc, size_t cbLen)
+{
+	__try {
+		memcpy(pDest, pSrc, cbLen);
+		return true;
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+		return false;
+	}
+}
+
+HBITMAP Thumb_Load(const wchar_t *pwszFile, DWORD dwOptions, DWORD &dwFlags)
+{
+	FILETIME ftWrite;
+	DWORD dwFileSize;
+	if (!GetSourceInfo(pwszFile, ftWrite, dwFileSize))
+		return nullptr;
+
+	ThumbEntry key(pwszFile, dwOptions);
+
+	mir_cslock lck(csThumbs);
+	ThumbEntry *p = arThumbs.find(&key);
+	if (p == nullptr || p->pRec == nullptr)
+		return nullptr;
+
+	if (CompareFileTime(&p->ftWrite, &ftWrite) || p->dwFileSize != dwFileSize)
+		return nullptr;
+
+	const ThumbRecord *pRec = p->pRec;
+
+	BITMAPINFO bmi = {};
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = pRec->wWidth;
+	bmi.bmiHeader.biHeight = pRec->wHeight;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = pRec->wBitsPixel;
+
+	BYTE *ptPixels;
+	HBITMAP hBmp = CreateDIBSection(nullptr, &bmi, DIB_RGB_COLORS, (void**)&ptPixels, nullptr, 0);
+	if (hBmp == nullptr)
+		return nullptr;
+
+	if (!CopyPixels(ptPixels, pRec->pixels(), pRec->cbPixels())) {
+		DeleteObject(hBmp);
+		return nullptr;
+	}
+
+	dwFlags = pRec->dwFlags;
+	return hBmp;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// appends the final picture to the cache, it will be available since the next start
+
+void Thumb_Store(const wchar_t *pwszFile, DWORD dwOptions, HBITMAP hBmp, DWORD dwFlags)
+{
+	{
+		mir_cslock lck(csThumbs);
+		if (hThumbFile == INVALID_HANDLE_VALUE)
+			return;
+	}
+
+	FILETIME ftWrite;
+	DWORD dwFileSize;
+	if (!GetSourceInfo(pwszFile, ftWrite, dwFileSize))
+		return;
+
+	// other depths would need a palette or conversion, such pictures aren't cached
+	BITMAP bmp;
+	if (!GetObject(hBmp, sizeof(bmp), &bmp) || bmp.bmWidth > 0xFFFF || bmp.bmHeight > 0xFFFF)
+		return;
+	if (bmp.bmBitsPixel != 24 && bmp.bmBitsPixel != 32)
+		return;
+
+	size_t cchPath = mir_wstrlen(pwszFile) + 1;
+	size_t cbPath = (cchPath * sizeof(wchar_t) + 3) & ~3;
+	size_t cbPixels = ThumbRecord::GetThumbStride(bmp.bmWidth, bmp.bmBitsPixel) * bmp.bmHeight;
+	size_t cbRecord = sizeof(ThumbRecord) + cbPath + cbPixels;
+
+	ThumbRecord *pRec = (ThumbRecord*)mir_calloc(cbRecord);
+	pRec->cbRecord = (DWORD)cbRecord;
+	pRec->ftWrite = ftWrite;
+	pRec->dwFileSize = dwFileSize;
+	pRec->dwOptions = dwOptions;
+	pRec->dwFlags = dwFlags & THUMB_FLAGS_MASK;
+	pRec->wWidth = (WORD)bmp.bmWidth;
+	pRec->wHeight = (WORD)bmp.bmHeight;
+	pRec->cchPath = (WORD)cchPath;
+	pRec->wBitsPixel = bmp.bmBitsPixel;
+	memcpy((void*)pRec->path(), pwszFile, cchPath * sizeof(wchar_t));
+
+	// bottom-up rows in the original depth, so a 24-bit picture doesn't get a zero alpha.
+	// the same layout as a DIB section created by Thumb_Load()
+	BITMAPINFO bmi = {};
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = bmp.bmWidth;
+	bmi.bmiHeader.biHeight = bmp.bmHeight;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = bmp.bmBitsPixel;
+
+	HDC hdc = CreateCompatibleDC(nullptr);
+	int nLines = GetDIBits(hdc, hBmp, 0, bmp.bmHeight, (void*)pRec->pixels(), &bmi, DIB_RGB_COLORS);
+	DeleteDC(hdc);
+
+	// the cache could be closed meanwhile
+	mir_cslock lck(csThumbs);
+	if (nLines == bmp.bmHeight && hThumbFile != INVALID_HANDLE_VALUE) {
+		ThumbEntry *p = new ThumbEntry(pwszFile, dwOptions);
+		ThumbEntry *pOld = arThumbs.find(p);
+		if (pOld != nullptr) {
+			delete p;
+			p = pOld;
+		}
+		else arThumbs.insert(p);
+
+		// another thread could store the same picture meanwhile
+		if (pOld == nullptr || CompareFileTime(&p->ftWrite, &ftWrite) || p->dwFileSize != dwFileSize) {
+			DWORD dwWritten;
+			SetFilePointer(hThumbFile, 0, nullptr, FILE_END);
+			if (WriteFile(hThumbFile, pRec, (DWORD)cbRecord, &dwWritten, nullptr) && dwWritten == cbRecord) {
+				p->ftWrite = ftWrite;
+				p->dwFileSize = dwFileSize;
+				p->pRec = nullptr;
+			}
+		}
+	}
+
+	mir_free(pRec);
+}
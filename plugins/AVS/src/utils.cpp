@@ -143,6 +143,29 @@ int CreateAvatarInCache(MCONTACT hContact, AVATARCACHEENTRY *ace, const char *sz
 	if (_waccess(tszFilename, 4) == -1)
 		return -2;
 
+	// contacts' avatars are taken from the thumbnail cache, if the source file wasn't changed
+	DWORD dwThumbOptions = 0;
+	bool bIsContact = hContact != 0 && hContact != INVALID_CONTACT_ID;
+	if (bIsContact) {
+		dwThumbOptions = GetThumbOptions(hContact);
+
+		DWORD dwFlags;
+		if (ace->hbmPic = Thumb_Load(tszFilename, dwThumbOptions, dwFlags)) {
+			BITMAP bminfo;
+			GetObject(ace->hbmPic, sizeof(bminfo), &bminfo);
+
+			ace->dwFlags = AVS_BITMAP_VALID | dwFlags;
+			if (db_get_b(hContact, "ContactPhoto", "Hidden", 0))
+				ace->dwFlags |= AVS_HIDEONCLIST;
+			ace->hContact = hContact;
+			ace->bmHeight = bminfo.bmHeight;
+			ace->bmWidth = bminfo.bmWidth;
+			ace->lpDIBSection = nullptr;
+			wcsncpy_s(ace->szFilename, tszFilename, _TRUNCATE);
+			return 1;
+		}
+	}
+
 	BOOL isTransparentImage = 0;
 	ace->hbmPic = BmpFilterLoadBitmap(&isTransparentImage, tszFilename);
 	ace->dwFlags = 0;
@@ -176,6 +199,9 @@ int CreateAvatarInCache(MCONTACT hContact, AVATARCACHEENTRY *ace, const char *sz
 			db_unset(hContact, "ContactPhoto", "TranspBkgColorDiff");
 
 			db_set_dw(hContact, "ContactPhoto", "ImageHash", imgHash);
+
+			// the picture is stored in the thumbnail cache with the options it was made with
+			dwThumbOptions = GetThumbOptions(hContact);
 		}
 
 		// Make transparent?
@@ -220,6 +246,9 @@ int CreateAvatarInCache(MCONTACT hContact, AVATARCACHEENTRY *ace, const char *sz
 			pAce->dwFlags |= AVS_OWNAVATAR;
 	}
 
+	if (bIsContact)
+		Thumb_Store(tszFilename, dwThumbOptions, ace->hbmPic, ace->dwFlags);
+
 	return 1;
 }
 
@@ -415,10 +444,8 @@ int ChangeAvatar(MCONTACT hContact, bool fLoad, bool fNotifyHist, int pa_format)
 		node->dwFlags |= AVH_MUSTNOTIFY;
 
 	node->pa_format = pa_format;
-	if (fLoad) {
+	if (fLoad)
 		PushAvatarRequest(node);
-		SetEvent(hLoaderEvent);
-	}
 	else
 		node->wipeInfo();
 
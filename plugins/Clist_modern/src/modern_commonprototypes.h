@@ -189,7 +189,7 @@ int     OnFrameTitleBarBackgroundChange(WPARAM wParam, LPARAM lParam);
 int     QueueAllFramesUpdating(bool);                                          //cluiframes.c
 int     RecursiveDeleteMenu(HMENU hMenu);                                       //clistmenus.c
 int     ModernSkinButtonRedrawAll();                                                //modern_button.c
-int     RegisterButtonByParce(char *ObjectName, char *Params);                     //mod_skin_selector.c
+int     RegisterButtonByParce(char *ObjectName, char *Params);                     //modern_skinengine.cpp
 int     RestoreAllContactData(ClcData *dat);                                 //cache_funcs.c
 
 int     SkinSelector_DeleteMask(MODERNMASK *mm);                                 //mod_skin_selector.c
@@ -0,0 +1,86 @@
+/*
+
+Miranda NG: the free IM client for Microsoft* Windows*
+
+Copyright (c) 2012-18 Miranda NG team (https://miranda-ng.org),
+all portions of this codebase are copyrighted to the people
+listed in contributors.txt.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "stdafx.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+	#include <emmintrin.h>
+#endif
+
+void px_PreMultiply(BYTE *pPixels, size_t nCount)
+{
+	size_t i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	// four pixels at once: channels are widened to 16 bits, multiplied by the alpha
+	// copied into every lane and divided by 255 the same way px_Div255 does it;
+	// the alpha lane is multiplied by 255, so it stays as is
+	const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+	const __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i alphaMult = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+	for (; i + 4 <= nCount; i += 4) {
+		__m128i *p = (__m128i*)(pPixels + i * 4);
+		__m128i v = _mm_loadu_si128(p);
+
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		__m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+		__m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+		alo = _mm_or_si128(_mm_and_si128(alo, colorMask), alphaMult);
+		ahi = _mm_or_si128(_mm_and_si128(ahi, colorMask), alphaMult);
+
+		lo = _mm_mullo_epi16(lo, alo);
+		hi = _mm_mullo_epi16(hi, ahi);
+		lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+
+		_mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (; i < nCount; i++) {
+		BYTE *pPixel = pPixels + i * 4;
+		pPixel[0] = px_Div255(pPixel[0] * pPixel[3]);
+		pPixel[1] = px_Div255(pPixel[1] * pPixel[3]);
+		pPixel[2] = px_Div255(pPixel[2] * pPixel[3]);
+	}
+}
+
+void px_FillAlpha(BYTE *pPixels, size_t nCount, BYTE alpha)
+{
+	size_t i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i alphaBits = _mm_set1_epi32((int)((DWORD)alpha << 24));
+
+	for (; i + 4 <= nCount; i += 4) {
+		__m128i *p = (__m128i*)(pPixels + i * 4);
+		_mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(p), colorMask), alphaBits));
+	}
+#endif
+
+	for (; i < nCount; i++)
+		pPixels[i * 4 + 3] = alpha;
+}
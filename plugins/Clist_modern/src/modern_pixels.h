@@ -0,0 +1,19 @@
+#ifndef modern_pixels_h__
+#define modern_pixels_h__
+
+// Pixel kernels for 32bpp BGRA bitmaps, with SSE2 paths on x86/x64.
+// The vector code gives exactly the same results as the scalar one.
+
+// exact value of t / 255 for any t <= 255 * 255
+__forceinline BYTE px_Div255(DWORD t)
+{
+	return (BYTE)((t + 1 + (t >> 8)) >> 8);
+}
+
+// multiplies color channels by alpha
+void px_PreMultiply(BYTE *pPixels, size_t nCount);
+
+// sets the alpha channel of every pixel, leaving colors intact
+void px_FillAlpha(BYTE *pPixels, size_t nCount, BYTE alpha);
+
+#endif // modern_pixels_h__
@@ -592,14 +592,12 @@ BOOL ske_SetRectOpaque(HDC memdc, RECT *fr, BOOL force)
 
 	int width = ex - sx;
 
-	BYTE* pLine = ((BYTE*)bits) + (bmp.bmHeight - sy - 1)*bmp.bmWidthBytes + (sx << 2) + 3;
-	for (int y = 0; y < (ey - sy); y++) {
-		BYTE * pColumn = pLine;
-		for (int x = 0; x < width; x++) {
-			*pColumn = 255;
-			pColumn += 4;
+	BYTE* pLine = ((BYTE*)bits) + (bmp.bmHeight - sy - 1)*bmp.bmWidthBytes + (sx << 2);
+	if (width > 0) {
+		for (int y = 0; y < (ey - sy); y++) {
+			px_FillAlpha(pLine, width, 255);
+			pLine -= bmp.bmWidthBytes;
 		}
-		pLine -= bmp.bmWidthBytes;
 	}
 	if (f) {
 		SetBitmapBits(hbmp, bmp.bmWidthBytes*bmp.bmHeight, bits);
@@ -1421,6 +1419,18 @@ INT_PTR ske_Service_DrawGlyph(WPARAM wParam, LPARAM lParam)
 	return ske_DrawSkinObject(preq, gl);
 }
 
+int SkinDrawGlyphMask(HDC hdc, RECT *rcSize, RECT *rcClip, MODERNMASK *ModernMask)
+{
+	if (!ModernMask) return 0;
+
+	SKINDRAWREQUEST rq;
+	rq.hDC = hdc;
+	rq.rcDestRect = *rcSize;
+	rq.rcClipRect = *rcClip;
+	strncpy_s(rq.szObjectID, "Masked draw", _TRUNCATE);
+	return ske_Service_DrawGlyph((WPARAM)&rq, (LPARAM)ModernMask);
+}
+
 
 void ske_PreMultiplyChannels(HBITMAP hbmp, BYTE Mult)
 {
@@ -1428,7 +1438,7 @@ void ske_PreMultiplyChannels(HBITMAP hbmp, BYTE Mult)
 	BOOL flag = FALSE;
 	BYTE * pBitmapBits;
 	DWORD Len;
-	int bh, bw, y, x;
+	int bh, bw;
 
 	GetObject(hbmp, sizeof(BITMAP), (LPSTR)&bmp);
 	bh = bmp.bmHeight;
@@ -1441,21 +1451,11 @@ void ske_PreMultiplyChannels(HBITMAP hbmp, BYTE Mult)
 	}
 	else
 		pBitmapBits = (BYTE*)bmp.bmBits;
-	for (y = 0; y < bh; ++y) {
-		BYTE *pPixel = pBitmapBits + bw * 4 * y;
-
-		for (x = 0; x < bw; ++x) {
-			if (Mult) {
-				pPixel[0] = pPixel[0] * pPixel[3] / 255;
-				pPixel[1] = pPixel[1] * pPixel[3] / 255;
-				pPixel[2] = pPixel[2] * pPixel[3] / 255;
-			}
-			else {
-				pPixel[3] = 255;
-			}
-			pPixel += 4;
-		}
-	}
+	// 32bpp rows have no padding, so the whole bitmap is processed at once
+	if (Mult)
+		px_PreMultiply(pBitmapBits, (size_t)bh * bw);
+	else
+		px_FillAlpha(pBitmapBits, (size_t)bh * bw, 255);
 	if (flag) {
 		Len = SetBitmapBits(hbmp, Len, pBitmapBits);
 		mir_free(pBitmapBits);
@@ -1786,6 +1786,133 @@ int ske_UnloadSkin(SKINOBJECTSLIST * Skin)
 	return 0;
 }
 
+// Parse DB string and add buttons
+int RegisterButtonByParce(char * ObjectName, char * Params)
+{
+	char buf[255];
+	GetParamN(Params, buf, _countof(buf), 0, ',', 0);
+
+	// Push type
+	char buf2[20] = { 0 };
+	char pServiceName[255] = { 0 };
+	char pStatusServiceName[255] = { 0 };
+	int Left, Top, Right, Bottom;
+	int MinWidth, MinHeight;
+	char TL[9] = { 0 };
+	wchar_t Hint[250] = { 0 };
+	char Section[250] = { 0 };
+	char Type[250] = { 0 };
+
+	DWORD alingnto;
+	int a = ((int)!mir_strcmpi(buf, "Switch")) * 2;
+
+	GetParamN(Params, pServiceName, _countof(pServiceName), 1, ',', 0);
+	// if (a) GetParamN(Params,pStatusServiceName, sizeof(pStatusServiceName),a+1,',',0);
+	Left = atoi(GetParamN(Params, buf2, _countof(buf2), a + 2, ',', 0));
+	Top = atoi(GetParamN(Params, buf2, _countof(buf2), a + 3, ',', 0));
+	Right = atoi(GetParamN(Params, buf2, _countof(buf2), a + 4, ',', 0));
+	Bottom = atoi(GetParamN(Params, buf2, _countof(buf2), a + 5, ',', 0));
+	GetParamN(Params, TL, _countof(TL), a + 6, ',', 0);
+
+	MinWidth = atoi(GetParamN(Params, buf2, _countof(buf2), a + 7, ',', 0));
+	MinHeight = atoi(GetParamN(Params, buf2, _countof(buf2), a + 8, ',', 0));
+	GetParamNT(Params, Hint, _countof(Hint), a + 9, ',', 0);
+	if (a) {
+		GetParamN(Params, Section, _countof(Section), 2, ',', 0);
+		GetParamN(Params, Type, _countof(Type), 3, ',', 0);
+	}
+	alingnto = ((TL[0] == 'R') ? SBF_ALIGN_TL_RIGHT : 0)
+		+ ((TL[0] == 'C') ? SBF_ALIGN_TL_HCENTER : 0)
+		+ ((TL[1] == 'B') ? SBF_ALIGN_TL_BOTTOM : 0)
+		+ ((TL[1] == 'C') ? SBF_ALIGN_TL_VCENTER : 0)
+		+ ((TL[2] == 'R') ? SBF_ALIGN_BR_RIGHT : 0)
+		+ ((TL[2] == 'C') ? SBF_ALIGN_BR_HCENTER : 0)
+		+ ((TL[3] == 'B') ? SBF_ALIGN_BR_BOTTOM : 0)
+		+ ((TL[3] == 'C') ? SBF_ALIGN_BR_VCENTER : 0)
+		+ ((TL[4] == 'I') ? SBF_CALL_ON_PRESS : 0);
+	if (a)
+		return ModernSkinButton_AddButton(g_clistApi.hwndContactList, ObjectName + 1, pServiceName, pStatusServiceName, "\0", Left, Top, Right, Bottom, alingnto, TranslateW(Hint), Section, Type, MinWidth, MinHeight);
+	return ModernSkinButton_AddButton(g_clistApi.hwndContactList, ObjectName + 1, pServiceName, pStatusServiceName, "\0", Left, Top, Right, Bottom, alingnto, TranslateW(Hint), nullptr, nullptr, MinWidth, MinHeight);
+}
+
+//Parse DB string and add object
+// Params is:
+// Glyph,None
+// Glyph,Solid, < ColorR>, < ColorG>, < ColorB>, < Alpha>
+// Glyph,Image,Filename,(TileBoth|TileVert|TileHor|StretchBoth), < MarginLeft>, < MarginTop>, < MarginRight>, < MarginBottom>, < Alpha>
+int RegisterObjectByParce(char *ObjectName, char *Params)
+{
+	if (!ObjectName || !Params) return 0;
+
+	SKINOBJECTDESCRIPTOR obj = { 0 };
+	char buf[250];
+	obj.szObjectID = mir_strdup(ObjectName);
+	GetParamN(Params, buf, _countof(buf), 0, ',', 0);
+	if (!mir_strcmpi(buf, "Glyph"))
+		obj.bType = OT_GLYPHOBJECT;
+	else if (!mir_strcmpi(buf, "Font"))
+		obj.bType = OT_FONTOBJECT;
+
+	if (obj.bType == OT_GLYPHOBJECT) {
+		GLYPHOBJECT gl = { 0 };
+		GetParamN(Params, buf, _countof(buf), 1, ',', 0);
+		if (!mir_strcmpi(buf, "Solid")) {
+			// Solid
+			gl.Style = ST_BRUSH;
+			int r = atoi(GetParamN(Params, buf, _countof(buf), 2, ',', 0));
+			int g = atoi(GetParamN(Params, buf, _countof(buf), 3, ',', 0));
+			int b = atoi(GetParamN(Params, buf, _countof(buf), 4, ',', 0));
+			gl.dwAlpha = atoi(GetParamN(Params, buf, _countof(buf), 5, ',', 0));
+			gl.dwColor = RGB(r, g, b);
+		}
+		else if (!mir_strcmpi(buf, "Image")) {
+			// Image
+			gl.Style = ST_IMAGE;
+			gl.szFileName = mir_strdup(GetParamN(Params, buf, _countof(buf), 2, ',', 0));
+			gl.dwLeft = atoi(GetParamN(Params, buf, _countof(buf), 4, ',', 0));
+			gl.dwTop = atoi(GetParamN(Params, buf, _countof(buf), 5, ',', 0));
+			gl.dwRight = atoi(GetParamN(Params, buf, _countof(buf), 6, ',', 0));
+			gl.dwBottom = atoi(GetParamN(Params, buf, _countof(buf), 7, ',', 0));
+			gl.dwAlpha = atoi(GetParamN(Params, buf, _countof(buf), 8, ',', 0));
+			GetParamN(Params, buf, _countof(buf), 3, ',', 0);
+			if (!mir_strcmpi(buf, "TileBoth")) gl.FitMode = FM_TILE_BOTH;
+			else if (!mir_strcmpi(buf, "TileVert")) gl.FitMode = FM_TILE_VERT;
+			else if (!mir_strcmpi(buf, "TileHorz")) gl.FitMode = FM_TILE_HORZ;
+			else gl.FitMode = 0;
+		}
+		else if (!mir_strcmpi(buf, "Fragment")) {
+			// Image
+			gl.Style = ST_FRAGMENT;
+			gl.szFileName = mir_strdup(GetParamN(Params, buf, _countof(buf), 2, ',', 0));
+
+			gl.clipArea.x = atoi(GetParamN(Params, buf, _countof(buf), 3, ',', 0));
+			gl.clipArea.y = atoi(GetParamN(Params, buf, _countof(buf), 4, ',', 0));
+			gl.szclipArea.cx = atoi(GetParamN(Params, buf, _countof(buf), 5, ',', 0));
+			gl.szclipArea.cy = atoi(GetParamN(Params, buf, _countof(buf), 6, ',', 0));
+
+			gl.dwLeft = atoi(GetParamN(Params, buf, _countof(buf), 8, ',', 0));
+			gl.dwTop = atoi(GetParamN(Params, buf, _countof(buf), 9, ',', 0));
+			gl.dwRight = atoi(GetParamN(Params, buf, _countof(buf), 10, ',', 0));
+			gl.dwBottom = atoi(GetParamN(Params, buf, _countof(buf), 11, ',', 0));
+			gl.dwAlpha = atoi(GetParamN(Params, buf, _countof(buf), 12, ',', 0));
+			GetParamN(Params, buf, _countof(buf), 7, ',', 0);
+			if (!mir_strcmpi(buf, "TileBoth")) gl.FitMode = FM_TILE_BOTH;
+			else if (!mir_strcmpi(buf, "TileVert")) gl.FitMode = FM_TILE_VERT;
+			else if (!mir_strcmpi(buf, "TileHorz")) gl.FitMode = FM_TILE_HORZ;
+			else gl.FitMode = 0;
+		}
+		else gl.Style = ST_SKIP; // None
+
+		obj.Data = &gl;
+		int res = ske_AddDescriptorToSkinObjectList(&obj, nullptr);
+		mir_free_and_nil(obj.szObjectID);
+		mir_free_and_nil(gl.szFileName);
+		return res;
+	}
+
+	return 0;
+}
+
 static void RegisterMaskByParce(const char *szSetting, char *szValue, SKINOBJECTSLIST *pSkin)
 {
 	size_t i, val_len = mir_strlen(szValue);
@@ -1922,6 +2049,7 @@ static int ske_GetSkinFromDB(char *, SKINOBJECTSLIST *Skin)
 
 	SortMaskList(pCurrentSkin->pMaskList);
 	ske_LinkSkinObjects(pCurrentSkin);
+	CompileMaskList(pCurrentSkin->pMaskList);
 
 	// Load Masks
 	return 0;
@@ -2163,7 +2291,7 @@ static bool ske_DrawTextEffect(BYTE* destPt, BYTE* maskPt, DWORD width, DWORD he
 						b1 = bd; r1 = rd; g1 = gd; a1 = ad; sign = -1;
 					}
 
-					absVal = absVal*a1 / 255;
+					absVal = px_Div255(absVal*a1);
 
 					destline[0] = ((destline[0] * (128 - absVal)) + absVal*b1) >> 7;
 					destline[1] = ((destline[1] * (128 - absVal)) + absVal*g1) >> 7;
@@ -2368,9 +2496,9 @@ static int ske_AlphaTextOut(HDC hDC, LPCTSTR lpString, int nCount, RECT *lpRect,
 							//Normalize components to gray
 							BYTE axx = 255 - ((r + g + b) >> 2); // Coefficient of grayance, more white font - more gray edges
 							WORD atx = ax * (255 - axx);
-							bx = (atx + bx * axx) / 255;
-							gx = (atx + gx * axx) / 255;
-							rx = (atx + rx * axx) / 255;
+							bx = px_Div255(atx + bx * axx);
+							gx = px_Div255(atx + gx * axx);
+							rx = px_Div255(atx + rx * axx);
 
 							short brx = (short)((b - pix[0])*bx / 255);
 							short grx = (short)((g - pix[1])*gx / 255);
@@ -2379,7 +2507,7 @@ static int ske_AlphaTextOut(HDC hDC, LPCTSTR lpString, int nCount, RECT *lpRect,
 							pix[0] += brx;
 							pix[1] += grx;
 							pix[2] += rrx;
-							pix[3] = (BYTE)(ax + (BYTE)(255 - ax)*pix[3] / 255);
+							pix[3] = (BYTE)(ax + px_Div255((BYTE)(255 - ax)*pix[3]));
 						}
 					}
 				}
@@ -29,6 +29,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 /// IMPLEMENTATIONS
 
+static void DropMaskIndex(LISTMODERNMASK *mmList);
+
 int SkinSelector_DeleteMask(MODERNMASK *mm)
 {
 	if (!mm->pl_Params) return 0;
@@ -55,6 +57,7 @@ DWORD mod_CalcHash(const char *szStr)
 static int AddModernMaskToList(MODERNMASK *mm, LISTMODERNMASK * mmTemplateList)
 {
 	if (!mmTemplateList || !mm) return -1;
+	DropMaskIndex(mmTemplateList);
 	mmTemplateList->pl_Masks = (MODERNMASK *)mir_realloc(mmTemplateList->pl_Masks, sizeof(MODERNMASK)*(mmTemplateList->dwMaskCnt + 1));
 	memmove(&(mmTemplateList->pl_Masks[mmTemplateList->dwMaskCnt]), mm, sizeof(MODERNMASK));
 	mmTemplateList->dwMaskCnt++;
@@ -64,6 +67,7 @@ static int AddModernMaskToList(MODERNMASK *mm, LISTMODERNMASK * mmTemplateList)
 int ClearMaskList(LISTMODERNMASK * mmTemplateList)
 {
 	if (!mmTemplateList) return -1;
+	DropMaskIndex(mmTemplateList);
 	if (!mmTemplateList->pl_Masks) return -1;
 	for (int i = 0; i < (int)mmTemplateList->dwMaskCnt; i++)
 		SkinSelector_DeleteMask(&(mmTemplateList->pl_Masks[i]));
@@ -76,6 +80,7 @@ static int DeleteMaskByItID(DWORD mID, LISTMODERNMASK *mmTemplateList)
 {
 	if (!mmTemplateList) return -1;
 	if (mID >= mmTemplateList->dwMaskCnt) return -1;
+	DropMaskIndex(mmTemplateList);
 	if (mmTemplateList->dwMaskCnt == 1) {
 		SkinSelector_DeleteMask(&(mmTemplateList->pl_Masks[0]));
 		mir_free_and_nil(mmTemplateList->pl_Masks);
@@ -116,6 +121,7 @@ int SortMaskList(LISTMODERNMASK * mmList)
 {
 	DWORD pos = 1;
 	if (mmList->dwMaskCnt < 2) return 0;
+	DropMaskIndex(mmList);
 	do {
 		if (mmList->pl_Masks[pos].dwMaskId < mmList->pl_Masks[pos - 1].dwMaskId) {
 			ExchangeMasksByID(pos, pos - 1, mmList);
@@ -322,6 +328,242 @@ BOOL CompareStrWithModernMask(char *szValue, MODERNMASK *mmTemplate)
 	else return 0;
 };
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// Compiled mask list
+//
+// Every mask gets a key: a hashed parameter checked before any negative one, so that
+// a request without this very parameter/value pair cannot match the mask. Masks are
+// grouped by their keys, and a request is compared only with the groups it has keys
+// for plus the masks without a key, in the list order, so the first matching mask is
+// the same one the linear search would give. Results of string requests are memoized.
+
+#define MASK_MEMO_SIZE 256
+
+struct MASKKEY
+{
+	DWORD dwId, dwValueHash;
+};
+
+struct MASKBUCKET
+{
+	MASKKEY key;            // must be the first member, see CompareKeys
+	DWORD  *pl_Masks;       // mask numbers in the ascending order
+	DWORD   dwMaskCnt;
+};
+
+struct MASKMEMO
+{
+	char *szRequest;
+	int   iMask;            // first matching mask or -1
+};
+
+struct MASKINDEX
+{
+	MASKBUCKET *pl_Buckets; // sorted by key
+	DWORD       dwBucketCnt;
+	DWORD      *pl_Generic; // masks without a key, they are checked for every request
+	DWORD       dwGenericCnt;
+	MASKMEMO    memo[MASK_MEMO_SIZE];
+};
+
+static mir_cs csMaskIndex;
+
+static int CompareKeys(const void *p1, const void *p2)
+{
+	const MASKKEY *k1 = (const MASKKEY*)p1, *k2 = (const MASKKEY*)p2;
+	if (k1->dwId != k2->dwId)
+		return (k1->dwId < k2->dwId) ? -1 : 1;
+	if (k1->dwValueHash != k2->dwValueHash)
+		return (k1->dwValueHash < k2->dwValueHash) ? -1 : 1;
+	return 0;
+}
+
+// collects the hashed parameters which any matching request must contain
+static int GetMaskKeys(MODERNMASK *mm, MASKKEY *pKeys)
+{
+	int nKeys = 0;
+	for (DWORD i = 0; i < mm->dwParamCnt; i++) {
+		MASKPARAM &p = mm->pl_Params[i];
+		if (p.bMaskParamFlag & MPF_DIFF) // parameters after a negative one might be never checked
+			break;
+
+		if (p.bMaskParamFlag & MPF_HASHED) {
+			pKeys[nKeys].dwId = p.dwId;
+			pKeys[nKeys].dwValueHash = p.dwValueHash;
+			nKeys++;
+		}
+	}
+	return nKeys;
+}
+
+static void DropMaskIndex(LISTMODERNMASK *mmList)
+{
+	mir_cslock lck(csMaskIndex);
+
+	MASKINDEX *pIndex = mmList->pIndex;
+	if (pIndex == nullptr)
+		return;
+
+	for (DWORD i = 0; i < pIndex->dwBucketCnt; i++)
+		mir_free(pIndex->pl_Buckets[i].pl_Masks);
+	mir_free(pIndex->pl_Buckets);
+	mir_free(pIndex->pl_Generic);
+	for (auto &it : pIndex->memo)
+		mir_free(it.szRequest);
+	mir_free(pIndex);
+	mmList->pIndex = nullptr;
+}
+
+int CompileMaskList(LISTMODERNMASK *mmList)
+{
+	if (!mmList) return -1;
+
+	mir_cslock lck(csMaskIndex);
+	DropMaskIndex(mmList);
+
+	DWORD nMasks = mmList->dwMaskCnt, nAll = 0, nMaxParams = 0;
+	for (DWORD i = 0; i < nMasks; i++) {
+		nAll += mmList->pl_Masks[i].dwParamCnt;
+		nMaxParams = max(nMaxParams, mmList->pl_Masks[i].dwParamCnt);
+	}
+
+	// count how often every key is used, the rarer key filters better
+	MASKKEY *pAll = (MASKKEY*)mir_alloc(sizeof(MASKKEY) * (nAll + 1));
+	MASKKEY *pKeys = (MASKKEY*)mir_alloc(sizeof(MASKKEY) * (nMaxParams + 1));
+	nAll = 0;
+	for (DWORD i = 0; i < nMasks; i++)
+		nAll += GetMaskKeys(&mmList->pl_Masks[i], pAll + nAll);
+	qsort(pAll, nAll, sizeof(MASKKEY), CompareKeys);
+
+	MASKBUCKET *pBuckets = (MASKBUCKET*)mir_calloc(sizeof(MASKBUCKET) * (nAll + 1));
+	DWORD nBuckets = 0;
+	for (DWORD i = 0; i < nAll; i++) {
+		if (nBuckets && !CompareKeys(&pBuckets[nBuckets - 1].key, &pAll[i]))
+			pBuckets[nBuckets - 1].dwMaskCnt++;
+		else {
+			pBuckets[nBuckets].key = pAll[i];
+			pBuckets[nBuckets].dwMaskCnt = 1;
+			nBuckets++;
+		}
+	}
+
+	// choose the rarest key of every mask
+	int *pChoice = (int*)mir_alloc(sizeof(int) * (nMasks + 1));
+	for (DWORD i = 0; i < nMasks; i++) {
+		pChoice[i] = -1;
+		int nKeys = GetMaskKeys(&mmList->pl_Masks[i], pKeys);
+		for (int k = 0; k < nKeys; k++) {
+			MASKBUCKET *b = (MASKBUCKET*)bsearch(&pKeys[k], pBuckets, nBuckets, sizeof(MASKBUCKET), CompareKeys);
+			if (pChoice[i] == -1 || b->dwMaskCnt < pBuckets[pChoice[i]].dwMaskCnt)
+				pChoice[i] = int(b - pBuckets);
+		}
+	}
+
+	// fill the groups, mask numbers come in the ascending order
+	MASKINDEX *pIndex = (MASKINDEX*)mir_calloc(sizeof(MASKINDEX));
+	for (DWORD i = 0; i < nBuckets; i++)
+		pBuckets[i].dwMaskCnt = 0;
+	for (DWORD i = 0; i < nMasks; i++) {
+		if (pChoice[i] == -1)
+			pIndex->dwGenericCnt++;
+		else
+			pBuckets[pChoice[i]].dwMaskCnt++;
+	}
+
+	pIndex->pl_Generic = (DWORD*)mir_alloc(sizeof(DWORD) * (pIndex->dwGenericCnt + 1));
+	pIndex->dwGenericCnt = 0;
+	for (DWORD i = 0; i < nBuckets; i++) {
+		pBuckets[i].pl_Masks = (DWORD*)mir_alloc(sizeof(DWORD) * (pBuckets[i].dwMaskCnt + 1));
+		pBuckets[i].dwMaskCnt = 0;
+	}
+	for (DWORD i = 0; i < nMasks; i++) {
+		if (pChoice[i] == -1)
+			pIndex->pl_Generic[pIndex->dwGenericCnt++] = i;
+		else {
+			MASKBUCKET &b = pBuckets[pChoice[i]];
+			b.pl_Masks[b.dwMaskCnt++] = i;
+		}
+	}
+
+	// drop the keys nobody has chosen, the order remains sorted
+	DWORD nUsed = 0;
+	for (DWORD i = 0; i < nBuckets; i++) {
+		if (pBuckets[i].dwMaskCnt)
+			pBuckets[nUsed++] = pBuckets[i];
+		else
+			mir_free(pBuckets[i].pl_Masks);
+	}
+
+	pIndex->pl_Buckets = pBuckets;
+	pIndex->dwBucketCnt = nUsed;
+	mmList->pIndex = pIndex;
+
+	mir_free(pChoice);
+	mir_free(pKeys);
+	mir_free(pAll);
+	return nUsed;
+}
+
+// returns the number of the first mask matching the request, or -1
+static int FindMaskIndex(MODERNMASK *mm, LISTMODERNMASK *mmList)
+{
+	if (mmList->pIndex == nullptr)
+		CompileMaskList(mmList);
+
+	// an empty request matches any mask
+	if (mm->dwParamCnt == 0)
+		return mmList->dwMaskCnt ? 0 : -1;
+
+	MASKINDEX *pIndex = mmList->pIndex;
+	DWORD **pLists = (DWORD**)_alloca(sizeof(DWORD*) * (mm->dwParamCnt + 1));
+	DWORD *pCounts = (DWORD*)_alloca(sizeof(DWORD) * (mm->dwParamCnt + 1));
+	DWORD *pPos = (DWORD*)_alloca(sizeof(DWORD) * (mm->dwParamCnt + 1));
+
+	DWORD nLists = 0;
+	if (pIndex->dwGenericCnt) {
+		pLists[nLists] = pIndex->pl_Generic;
+		pCounts[nLists] = pIndex->dwGenericCnt;
+		nLists++;
+	}
+
+	for (DWORD i = 0; i < mm->dwParamCnt; i++) {
+		MASKPARAM &p = mm->pl_Params[i];
+		if (p.bMaskParamFlag == 0) // CompareModernMask stops there too
+			break;
+
+		// only the first parameter with this name is compared
+		DWORD j;
+		for (j = 0; j < i; j++)
+			if (mm->pl_Params[j].dwId == p.dwId)
+				break;
+		if (j < i)
+			continue;
+
+		MASKKEY key = { p.dwId, p.dwValueHash };
+		MASKBUCKET *b = (MASKBUCKET*)bsearch(&key, pIndex->pl_Buckets, pIndex->dwBucketCnt, sizeof(MASKBUCKET), CompareKeys);
+		if (b) {
+			pLists[nLists] = b->pl_Masks;
+			pCounts[nLists] = b->dwMaskCnt;
+			nLists++;
+		}
+	}
+
+	// merge the candidates back into the list order
+	memset(pPos, 0, sizeof(DWORD) * nLists);
+	while (true) {
+		int iBest = -1;
+		for (DWORD l = 0; l < nLists; l++)
+			if (pPos[l] < pCounts[l] && (iBest == -1 || pLists[l][pPos[l]] < pLists[iBest][pPos[iBest]]))
+				iBest = l;
+		if (iBest == -1)
+			return -1;
+
+		DWORD iMask = pLists[iBest][pPos[iBest]++];
+		if (CompareModernMask(mm, &mmList->pl_Masks[iMask]))
+			return iMask;
+	}
+}
+
 // AddingMask
 int AddStrModernMaskToList(DWORD maskID, char *szStr, char *objectName, LISTMODERNMASK *mmTemplateList)
 {
@@ -341,11 +583,9 @@ int AddStrModernMaskToList(DWORD maskID, char *szStr, char *objectName, LISTMODE
 
 SKINOBJECTDESCRIPTOR* skin_FindObjectByMask(MODERNMASK *mm, LISTMODERNMASK *mmTemplateList)
 {
-	for (DWORD i = 0; i < mmTemplateList->dwMaskCnt; i++)
-		if (CompareModernMask(mm, &(mmTemplateList->pl_Masks[i])))
-			return (SKINOBJECTDESCRIPTOR*)mmTemplateList->pl_Masks[i].pObject;
-
-	return nullptr;
+	mir_cslock lck(csMaskIndex);
+	int iMask = FindMaskIndex(mm, mmTemplateList);
+	return (iMask < 0) ? nullptr : (SKINOBJECTDESCRIPTOR*)mmTemplateList->pl_Masks[iMask].pObject;
 }
 
 SKINOBJECTDESCRIPTOR* skin_FindObjectByRequest(char *szValue, LISTMODERNMASK *mmTemplateList)
@@ -356,11 +596,20 @@ SKINOBJECTDESCRIPTOR* skin_FindObjectByRequest(char *szValue, LISTMODERNMASK *mm
 	if (!mmTemplateList)
 		return nullptr;
 
-	MODERNMASK mm = {};
-	ParseToModernMask(&mm, szValue);
-	SKINOBJECTDESCRIPTOR *res = skin_FindObjectByMask(&mm, mmTemplateList);
-	SkinSelector_DeleteMask(&mm);
-	return res;
+	mir_cslock lck(csMaskIndex);
+	if (mmTemplateList->pIndex == nullptr)
+		CompileMaskList(mmTemplateList);
+
+	MASKMEMO &memo = mmTemplateList->pIndex->memo[mir_hashstr(szValue) % MASK_MEMO_SIZE];
+	if (memo.szRequest == nullptr || mir_strcmp(memo.szRequest, szValue)) {
+		MODERNMASK mm = {};
+		ParseToModernMask(&mm, szValue);
+		memo.iMask = FindMaskIndex(&mm, mmTemplateList);
+		SkinSelector_DeleteMask(&mm);
+		replaceStr(memo.szRequest, szValue);
+	}
+
+	return (memo.iMask < 0) ? nullptr : (SKINOBJECTDESCRIPTOR*)mmTemplateList->pl_Masks[memo.iMask].pObject;
 }
 
 wchar_t* GetParamNT(char *string, wchar_t *buf, int buflen, BYTE paramN, char Delim, BOOL SkipSpaces)
@@ -423,143 +672,3 @@ char* GetParamN(char *string, char *buf, int buflen, BYTE paramN, char Delim, BO
 	else buf[0] = '\0';
 	return buf;
 }
-
-// Parse DB string and add buttons
-int RegisterButtonByParce(char * ObjectName, char * Params)
-{
-	char buf[255];
-	GetParamN(Params, buf, _countof(buf), 0, ',', 0);
-
-	// Push type
-	char buf2[20] = { 0 };
-	char pServiceName[255] = { 0 };
-	char pStatusServiceName[255] = { 0 };
-	int Left, Top, Right, Bottom;
-	int MinWidth, MinHeight;
-	char TL[9] = { 0 };
-	wchar_t Hint[250] = { 0 };
-	char Section[250] = { 0 };
-	char Type[250] = { 0 };
-
-	DWORD alingnto;
-	int a = ((int)!mir_strcmpi(buf, "Switch")) * 2;
-
-	GetParamN(Params, pServiceName, _countof(pServiceName), 1, ',', 0);
-	// if (a) GetParamN(Params,pStatusServiceName, sizeof(pStatusServiceName),a+1,',',0);
-	Left = atoi(GetParamN(Params, buf2, _countof(buf2), a + 2, ',', 0));
-	Top = atoi(GetParamN(Params, buf2, _countof(buf2), a + 3, ',', 0));
-	Right = atoi(GetParamN(Params, buf2, _countof(buf2), a + 4, ',', 0));
-	Bottom = atoi(GetParamN(Params, buf2, _countof(buf2), a + 5, ',', 0));
-	GetParamN(Params, TL, _countof(TL), a + 6, ',', 0);
-
-	MinWidth = atoi(GetParamN(Params, buf2, _countof(buf2), a + 7, ',', 0));
-	MinHeight = atoi(GetParamN(Params, buf2, _countof(buf2), a + 8, ',', 0));
-	GetParamNT(Params, Hint, _countof(Hint), a + 9, ',', 0);
-	if (a) {
-		GetParamN(Params, Section, _countof(Section), 2, ',', 0);
-		GetParamN(Params, Type, _countof(Type), 3, ',', 0);
-	}
-	alingnto = ((TL[0] == 'R') ? SBF_ALIGN_TL_RIGHT : 0)
-		+ ((TL[0] == 'C') ? SBF_ALIGN_TL_HCENTER : 0)
-		+ ((TL[1] == 'B') ? SBF_ALIGN_TL_BOTTOM : 0)
-		+ ((TL[1] == 'C') ? SBF_ALIGN_TL_VCENTER : 0)
-		+ ((TL[2] == 'R') ? SBF_ALIGN_BR_RIGHT : 0)
-		+ ((TL[2] == 'C') ? SBF_ALIGN_BR_HCENTER : 0)
-		+ ((TL[3] == 'B') ? SBF_ALIGN_BR_BOTTOM : 0)
-		+ ((TL[3] == 'C') ? SBF_ALIGN_BR_VCENTER : 0)
-		+ ((TL[4] == 'I') ? SBF_CALL_ON_PRESS : 0);
-	if (a)
-		return ModernSkinButton_AddButton(g_clistApi.hwndContactList, ObjectName + 1, pServiceName, pStatusServiceName, "\0", Left, Top, Right, Bottom, alingnto, TranslateW(Hint), Section, Type, MinWidth, MinHeight);
-	return ModernSkinButton_AddButton(g_clistApi.hwndContactList, ObjectName + 1, pServiceName, pStatusServiceName, "\0", Left, Top, Right, Bottom, alingnto, TranslateW(Hint), nullptr, nullptr, MinWidth, MinHeight);
-}
-
-//Parse DB string and add object
-// Params is:
-// Glyph,None
-// Glyph,Solid, < ColorR>, < ColorG>, < ColorB>, < Alpha>
-// Glyph,Image,Filename,(TileBoth|TileVert|TileHor|StretchBoth), < MarginLeft>, < MarginTop>, < MarginRight>, < MarginBottom>, < Alpha>
-int RegisterObjectByParce(char *ObjectName, char *Params)
-{
-	if (!ObjectName || !Params) return 0;
-
-	SKINOBJECTDESCRIPTOR obj = { 0 };
-	char buf[250];
-	obj.szObjectID = mir_strdup(ObjectName);
-	GetParamN(Params, buf, _countof(buf), 0, ',', 0);
-	if (!mir_strcmpi(buf, "Glyph"))
-		obj.bType = OT_GLYPHOBJECT;
-	else if (!mir_strcmpi(buf, "Font"))
-		obj.bType = OT_FONTOBJECT;
-
-	if (obj.bType == OT_GLYPHOBJECT) {
-		GLYPHOBJECT gl = { 0 };
-		GetParamN(Params, buf, _countof(buf), 1, ',', 0);
-		if (!mir_strcmpi(buf, "Solid")) {
-			// Solid
-			gl.Style = ST_BRUSH;
-			int r = atoi(GetParamN(Params, buf, _countof(buf), 2, ',', 0));
-			int g = atoi(GetParamN(Params, buf, _countof(buf), 3, ',', 0));
-			int b = atoi(GetParamN(Params, buf, _countof(buf), 4, ',', 0));
-			gl.dwAlpha = atoi(GetParamN(Params, buf, _countof(buf), 5, ',', 0));
-			gl.dwColor = RGB(r, g, b);
-		}
-		else if (!mir_strcmpi(buf, "Image")) {
-			// Image
-			gl.Style = ST_IMAGE;
-			gl.szFileName = mir_strdup(GetParamN(Params, buf, _countof(buf), 2, ',', 0));
-			gl.dwLeft = atoi(GetParamN(Params, buf, _countof(buf), 4, ',', 0));
-			gl.dwTop = atoi(GetParamN(Params, buf, _countof(buf), 5, ',', 0));
-			gl.dwRight = atoi(GetParamN(Params, buf, _countof(buf), 6, ',', 0));
-			gl.dwBottom = atoi(GetParamN(Params, buf, _countof(buf), 7, ',', 0));
-			gl.dwAlpha = atoi(GetParamN(Params, buf, _countof(buf), 8, ',', 0));
-			GetParamN(Params, buf, _countof(buf), 3, ',', 0);
-			if (!mir_strcmpi(buf, "TileBoth")) gl.FitMode = FM_TILE_BOTH;
-			else if (!mir_strcmpi(buf, "TileVert")) gl.FitMode = FM_TILE_VERT;
-			else if (!mir_strcmpi(buf, "TileHorz")) gl.FitMode = FM_TILE_HORZ;
-			else gl.FitMode = 0;
-		}
-		else if (!mir_strcmpi(buf, "Fragment")) {
-			// Image
-			gl.Style = ST_FRAGMENT;
-			gl.szFileName = mir_strdup(GetParamN(Params, buf, _countof(buf), 2, ',', 0));
-
-			gl.clipArea.x = atoi(GetParamN(Params, buf, _countof(buf), 3, ',', 0));
-			gl.clipArea.y = atoi(GetParamN(Params, buf, _countof(buf), 4, ',', 0));
-			gl.szclipArea.cx = atoi(GetParamN(Params, buf, _countof(buf), 5, ',', 0));
-			gl.szclipArea.cy = atoi(GetParamN(Params, buf, _countof(buf), 6, ',', 0));
-
-			gl.dwLeft = atoi(GetParamN(Params, buf, _countof(buf), 8, ',', 0));
-			gl.dwTop = atoi(GetParamN(Params, buf, _countof(buf), 9, ',', 0));
-			gl.dwRight = atoi(GetParamN(Params, buf, _countof(buf), 10, ',', 0));
-			gl.dwBottom = atoi(GetParamN(Params, buf, _countof(buf), 11, ',', 0));
-			gl.dwAlpha = atoi(GetParamN(Params, buf, _countof(buf), 12, ',', 0));
-			GetParamN(Params, buf, _countof(buf), 7, ',', 0);
-			if (!mir_strcmpi(buf, "TileBoth")) gl.FitMode = FM_TILE_BOTH;
-			else if (!mir_strcmpi(buf, "TileVert")) gl.FitMode = FM_TILE_VERT;
-			else if (!mir_strcmpi(buf, "TileHorz")) gl.FitMode = FM_TILE_HORZ;
-			else gl.FitMode = 0;
-		}
-		else gl.Style = ST_SKIP; // None
-
-		obj.Data = &gl;
-		int res = ske_AddDescriptorToSkinObjectList(&obj, nullptr);
-		mir_free_and_nil(obj.szObjectID);
-		mir_free_and_nil(gl.szFileName);
-		return res;
-	}
-
-	return 0;
-}
-
-
-int SkinDrawGlyphMask(HDC hdc, RECT *rcSize, RECT *rcClip, MODERNMASK *ModernMask)
-{
-	if (!ModernMask) return 0;
-
-	SKINDRAWREQUEST rq;
-	rq.hDC = hdc;
-	rq.rcDestRect = *rcSize;
-	rq.rcClipRect = *rcClip;
-	strncpy_s(rq.szObjectID, "Masked draw", _TRUNCATE);
-	return ske_Service_DrawGlyph((WPARAM)&rq, (LPARAM)ModernMask);
-}
@@ -55,16 +55,20 @@ struct MODERNMASK
 	BOOL				bObjectFound;
 };
 
+struct MASKINDEX;
+
 struct LISTMODERNMASK
 {
 	MODERNMASK*	pl_Masks;
 	DWORD			dwMaskCnt;
+	MASKINDEX*	pIndex;	// compiled lookup structure, see CompileMaskList
 };
 
 /// PROTOTYPES
 int AddStrModernMaskToList(DWORD maskID, char *szStr, char *objectName, LISTMODERNMASK *mmTemplateList);
 int SortMaskList(LISTMODERNMASK *mmList);
 int ClearMaskList(LISTMODERNMASK *mmTemplateList);
+int CompileMaskList(LISTMODERNMASK *mmList);
 
 BOOL CompareStrWithModernMask(char *szValue, MODERNMASK *mmTemplate);
 DWORD mod_CalcHash(const char *a);
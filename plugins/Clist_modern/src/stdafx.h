@@ -117,6 +117,7 @@ struct CMPlugin : public PLUGIN<CMPlugin>
 #include "modern_row.h"
 #include "modern_skinselector.h"
 #include "modern_skinengine.h"
+#include "modern_pixels.h"
 #include "modern_statusbar.h"
 #include "cluiframes.h"
 #include "modern_commonprototypes.h"
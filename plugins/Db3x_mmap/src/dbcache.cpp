@@ -179,6 +179,84 @@ int CDb3Mmap::InitMap(void)
 	return 0;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// settings index
+
+// returns an absolute offset of the setting's record or 0
+DWORD DBSettingsGroupIndex::Find(const char *szSetting, int cbLen) const
+{
+	auto it = arSettings.find(std::string(szSetting, cbLen));
+	return (it == arSettings.end()) ? 0 : ofsBlob() + it->second;
+}
+
+// a new record was appended to the end of the blob
+void DBSettingsGroupIndex::Insert(const char *szSetting, int cbLen, DWORD cbRecord)
+{
+	arSettings[std::string(szSetting, cbLen)] = cbUsed;
+	cbUsed += cbRecord;
+}
+
+// a record was cut from the blob, all the following ones were moved back
+void DBSettingsGroupIndex::Remove(const char *szSetting, int cbLen, DWORD cbRecord)
+{
+	auto it = arSettings.find(std::string(szSetting, cbLen));
+	if (it == arSettings.end())
+		return;
+
+	DWORD ofsCut = it->second;
+	arSettings.erase(it);
+
+	for (auto &p : arSettings)
+		if (p.second > ofsCut)
+			p.second -= cbRecord;
+	cbUsed -= cbRecord;
+}
+
+DBSettingsIndex& CDb3Mmap::GetSettingsIndex(DWORD ofsContact, const DBContact *dbc)
+{
+	auto it = m_settingsIndex.find(ofsContact);
+	if (it != m_settingsIndex.end())
+		return it->second;
+
+	DBSettingsIndex &idx = m_settingsIndex[ofsContact];
+	for (DWORD ofsThis = dbc->ofsFirstSettings; ofsThis != 0;) {
+		DBContactSettings *dbcs = (DBContactSettings*)DBRead(ofsThis, nullptr);
+		if (dbcs->signature != DBCONTACTSETTINGS_SIGNATURE) DatabaseCorruption(nullptr);
+		DWORD ofsNext = dbcs->ofsNext;
+
+		// the first group of a module wins, exactly as in GetSettingsGroupOfsByModuleNameOfs
+		auto res = idx.emplace(dbcs->ofsModuleName, DBSettingsGroupIndex());
+		if (res.second) {
+			DBSettingsGroupIndex &grp = res.first->second;
+			grp.ofsGroup = ofsThis;
+
+			int bytesRemaining;
+			DWORD ofsBlobPtr = grp.ofsBlob();
+			PBYTE pBlob = DBRead(ofsBlobPtr, &bytesRemaining);
+			while (pBlob[0]) {
+				NeedBytes(1 + pBlob[0]);
+				grp.arSettings.emplace(std::string((char*)pBlob + 1, pBlob[0]), ofsBlobPtr - grp.ofsBlob());
+				MoveAlong(1 + pBlob[0]);
+				NeedBytes(3);
+				MoveAlong(1 + GetSettingValueLength(pBlob));
+				NeedBytes(1);
+			}
+			grp.cbUsed = ofsBlobPtr - grp.ofsBlob();
+		}
+		ofsThis = ofsNext;
+	}
+	return idx;
+}
+
+DBSettingsGroupIndex* CDb3Mmap::FindSettingsGroup(DWORD ofsContact, const DBContact *dbc, DWORD ofsModuleName)
+{
+	DBSettingsIndex &idx = GetSettingsIndex(ofsContact, dbc);
+	auto it = idx.find(ofsModuleName);
+	return (it == idx.end()) ? nullptr : &it->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
 DWORD CDb3Mmap::GetSettingsGroupOfsByModuleNameOfs(DBContact *dbc, DWORD ofsModuleName)
 {
 	DWORD ofsThis = dbc->ofsFirstSettings;
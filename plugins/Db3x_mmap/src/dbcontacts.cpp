@@ -61,6 +61,8 @@ STDMETHODIMP_(LONG) CDb3Mmap::DeleteContact(MCONTACT contactID)
 	lck.lock();
 
 	// delete settings chain
+	m_settingsIndex.erase(ofsContact);
+
 	DWORD ofsThis = dbc->ofsFirstSettings;
 	DWORD ofsFirstEvent = dbc->ofsFirstEvent;
 	while (ofsThis) {
@@ -183,6 +183,24 @@ struct DBCachedContact : public DBCachedContactBase
 	DWORD dwOfsContact;
 };
 
+// in-memory index of one settings group, maps a setting name to the offset of its record.
+// offsets are counted from the beginning of the group's blob, so they survive group moves
+struct DBSettingsGroupIndex
+{
+	DWORD ofsGroup;         // offset of DBContactSettings
+	DWORD cbUsed;           // offset of the blob's terminating zero
+	std::unordered_map<std::string, DWORD> arSettings;
+
+	__forceinline DWORD ofsBlob() const { return ofsGroup + offsetof(DBContactSettings, blob); }
+
+	DWORD Find(const char *szSetting, int cbLen) const;
+	void  Insert(const char *szSetting, int cbLen, DWORD cbRecord);
+	void  Remove(const char *szSetting, int cbLen, DWORD cbRecord);
+};
+
+// module name offset -> settings group, built on the first access to a contact
+typedef std::unordered_map<DWORD, DBSettingsGroupIndex> DBSettingsIndex;
+
 struct CDb3Mmap : public MDatabaseCommon, public MZeroedObject
 {
 	CDb3Mmap(const wchar_t *tszFileName, int mode);
@@ -248,6 +266,11 @@ protected:
 	DWORD GetSettingsGroupOfsByModuleNameOfs(DBContact *dbc, DWORD ofsModuleName);
 	void  InvalidateSettingsGroupOfsCacheEntry(DWORD) {}
 
+	std::unordered_map<DWORD, DBSettingsIndex> m_settingsIndex; // contact offset -> its settings
+
+	DBSettingsIndex& GetSettingsIndex(DWORD ofsContact, const DBContact *dbc);
+	DBSettingsGroupIndex* FindSettingsGroup(DWORD ofsContact, const DBContact *dbc, DWORD ofsModuleName);
+
 	void  DBMoveChunk(DWORD ofsDest, DWORD ofsSource, int bytes);
 	PBYTE DBRead(DWORD ofs, int *bytesAvail);
 	void  DBWrite(DWORD ofs, PVOID pData, int bytes);
@@ -98,111 +98,101 @@ LBL_Seek:
 	if (dbc.signature != DBCONTACT_SIGNATURE)
 		return 1;
 
-	DWORD ofsSettingsGroup = GetSettingsGroupOfsByModuleNameOfs(&dbc, ofsModuleName);
-	if (ofsSettingsGroup) {
+	DBSettingsGroupIndex *grp = FindSettingsGroup(ofsContact, &dbc, ofsModuleName);
+	DWORD ofsBlobPtr = (grp) ? grp->Find(szSetting, settingNameLen) : 0;
+	if (ofsBlobPtr) {
 		int bytesRemaining;
 		unsigned varLen;
-		DWORD ofsBlobPtr = ofsSettingsGroup + offsetof(DBContactSettings, blob);
 		PBYTE pBlob = DBRead(ofsBlobPtr, &bytesRemaining);
-		while (pBlob[0]) {
-			NeedBytes(1 + settingNameLen);
-			if (pBlob[0] == settingNameLen && !memcmp(pBlob + 1, szSetting, settingNameLen)) {
-				MoveAlong(1 + settingNameLen);
-				NeedBytes(5);
-				if (isStatic && (pBlob[0] & DBVTF_VARIABLELENGTH) && VLT(dbv->type) != VLT(pBlob[0]))
-					return 1;
+		MoveAlong(1 + settingNameLen);
+		NeedBytes(5);
+		if (isStatic && (pBlob[0] & DBVTF_VARIABLELENGTH) && VLT(dbv->type) != VLT(pBlob[0]))
+			return 1;
 
-				BYTE iType = dbv->type = pBlob[0];
-				switch (iType) {
-				case DBVT_DELETED: /* this setting is deleted */
-					dbv->type = DBVT_DELETED;
-					return 2;
+		BYTE iType = dbv->type = pBlob[0];
+		switch (iType) {
+		case DBVT_DELETED: /* this setting is deleted */
+			dbv->type = DBVT_DELETED;
+			return 2;
 
-				case DBVT_BYTE:  dbv->bVal = pBlob[1]; break;
-				case DBVT_WORD:  memmove(&(dbv->wVal), (PWORD)(pBlob + 1), 2); break;
-				case DBVT_DWORD: memmove(&(dbv->dVal), (PDWORD)(pBlob + 1), 4); break;
+		case DBVT_BYTE:  dbv->bVal = pBlob[1]; break;
+		case DBVT_WORD:  memmove(&(dbv->wVal), (PWORD)(pBlob + 1), 2); break;
+		case DBVT_DWORD: memmove(&(dbv->dVal), (PDWORD)(pBlob + 1), 4); break;
 
-				case DBVT_UTF8:
-				case DBVT_ASCIIZ:
-					varLen = *(PWORD)(pBlob + 1);
-					NeedBytes(int(3 + varLen));
-					if (isStatic) {
-						dbv->cchVal--;
-						if (varLen < dbv->cchVal)
-							dbv->cchVal = varLen;
-						memmove(dbv->pszVal, pBlob + 3, dbv->cchVal); // decode
-						dbv->pszVal[dbv->cchVal] = 0;
-						dbv->cchVal = varLen;
-					}
-					else {
-						dbv->pszVal = (char*)mir_alloc(1 + varLen);
-						memmove(dbv->pszVal, pBlob + 3, varLen);
-						dbv->pszVal[varLen] = 0;
-					}
-					break;
+		case DBVT_UTF8:
+		case DBVT_ASCIIZ:
+			varLen = *(PWORD)(pBlob + 1);
+			NeedBytes(int(3 + varLen));
+			if (isStatic) {
+				dbv->cchVal--;
+				if (varLen < dbv->cchVal)
+					dbv->cchVal = varLen;
+				memmove(dbv->pszVal, pBlob + 3, dbv->cchVal); // decode
+				dbv->pszVal[dbv->cchVal] = 0;
+				dbv->cchVal = varLen;
+			}
+			else {
+				dbv->pszVal = (char*)mir_alloc(1 + varLen);
+				memmove(dbv->pszVal, pBlob + 3, varLen);
+				dbv->pszVal[varLen] = 0;
+			}
+			break;
 
-				case DBVT_BLOB:
-					varLen = *(PWORD)(pBlob + 1);
-					NeedBytes(int(3 + varLen));
-					if (isStatic) {
-						if (varLen < dbv->cpbVal)
-							dbv->cpbVal = varLen;
-						memmove(dbv->pbVal, pBlob + 3, dbv->cpbVal);
-					}
-					else {
-						dbv->pbVal = (BYTE *)mir_alloc(varLen);
-						memmove(dbv->pbVal, pBlob + 3, varLen);
-					}
+		case DBVT_BLOB:
+			varLen = *(PWORD)(pBlob + 1);
+			NeedBytes(int(3 + varLen));
+			if (isStatic) {
+				if (varLen < dbv->cpbVal)
 					dbv->cpbVal = varLen;
-					break;
+				memmove(dbv->pbVal, pBlob + 3, dbv->cpbVal);
+			}
+			else {
+				dbv->pbVal = (BYTE *)mir_alloc(varLen);
+				memmove(dbv->pbVal, pBlob + 3, varLen);
+			}
+			dbv->cpbVal = varLen;
+			break;
 
-				case DBVT_ENCRYPTED:
-					if (m_crypto == nullptr)
-						return 1;
-					else {
-						varLen = *(PWORD)(pBlob + 1);
-						NeedBytes(int(3 + varLen));
-						size_t realLen;
-						ptrA decoded(m_crypto->decodeString(pBlob + 3, varLen, &realLen));
-						if (decoded == nullptr)
-							return 1;
-
-						varLen = (WORD)realLen;
-						dbv->type = DBVT_UTF8;
-						if (isStatic) {
-							dbv->cchVal--;
-							if (varLen < dbv->cchVal)
-								dbv->cchVal = varLen;
-							memmove(dbv->pszVal, decoded, dbv->cchVal);
-							dbv->pszVal[dbv->cchVal] = 0;
-							dbv->cchVal = varLen;
-						}
-						else {
-							dbv->pszVal = (char*)mir_alloc(1 + varLen);
-							memmove(dbv->pszVal, decoded, varLen);
-							dbv->pszVal[varLen] = 0;
-						}
-					}
-					break;
-				}
+		case DBVT_ENCRYPTED:
+			if (m_crypto == nullptr)
+				return 1;
+			else {
+				varLen = *(PWORD)(pBlob + 1);
+				NeedBytes(int(3 + varLen));
+				size_t realLen;
+				ptrA decoded(m_crypto->decodeString(pBlob + 3, varLen, &realLen));
+				if (decoded == nullptr)
+					return 1;
 
-				/**** add to cache **********************/
-				if (iType != DBVT_BLOB && iType != DBVT_ENCRYPTED) {
-					pCachedValue = m_cache->GetCachedValuePtr(contactID, szCachedSettingName, 1);
-					if (pCachedValue != nullptr) {
-						m_cache->SetCachedVariant(dbv, pCachedValue);
-						log3("set cached [%08p] %s (%p)", hContact, szCachedSettingName, pCachedValue);
-					}
+				varLen = (WORD)realLen;
+				dbv->type = DBVT_UTF8;
+				if (isStatic) {
+					dbv->cchVal--;
+					if (varLen < dbv->cchVal)
+						dbv->cchVal = varLen;
+					memmove(dbv->pszVal, decoded, dbv->cchVal);
+					dbv->pszVal[dbv->cchVal] = 0;
+					dbv->cchVal = varLen;
+				}
+				else {
+					dbv->pszVal = (char*)mir_alloc(1 + varLen);
+					memmove(dbv->pszVal, decoded, varLen);
+					dbv->pszVal[varLen] = 0;
 				}
+			}
+			break;
+		}
 
-				return 0;
+		/**** add to cache **********************/
+		if (iType != DBVT_BLOB && iType != DBVT_ENCRYPTED) {
+			pCachedValue = m_cache->GetCachedValuePtr(contactID, szCachedSettingName, 1);
+			if (pCachedValue != nullptr) {
+				m_cache->SetCachedVariant(dbv, pCachedValue);
+				log3("set cached [%08p] %s (%p)", hContact, szCachedSettingName, pCachedValue);
 			}
-			NeedBytes(1);
-			MoveAlong(pBlob[0] + 1);
-			NeedBytes(3);
-			MoveAlong(1 + GetSettingValueLength(pBlob));
-			NeedBytes(1);
 		}
+
+		return 0;
 	}
 
 	// try to get the missing mc setting from the active sub
@@ -346,7 +336,8 @@ STDMETHODIMP_(BOOL) CDb3Mmap::WriteContactSetting(MCONTACT contactID, DBCONTACTW
 	PBYTE pBlob;
 	int bytesRequired, bytesRemaining;
 	DBContactSettings dbcs;
-	DWORD ofsSettingsGroup = GetSettingsGroupOfsByModuleNameOfs(&dbc, ofsModuleName);
+	DBSettingsGroupIndex *grp = FindSettingsGroup(ofsContact, &dbc, ofsModuleName);
+	DWORD ofsSettingsGroup = (grp) ? grp->ofsGroup : 0;
 	if (ofsSettingsGroup == 0) {  //module group didn't exist - make it
 		switch (dbcwWork.value.type) {
 		case DBVT_ASCIIZ: case DBVT_UTF8:
@@ -369,25 +360,22 @@ STDMETHODIMP_(BOOL) CDb3Mmap::WriteContactSetting(MCONTACT contactID, DBCONTACTW
 		dbc.ofsFirstSettings = ofsSettingsGroup;
 		DBWrite(ofsContact, &dbc, sizeof(DBContact));
 		DBWrite(ofsSettingsGroup, &dbcs, sizeof(DBContactSettings));
-		ofsBlobPtr = ofsSettingsGroup + offsetof(DBContactSettings, blob);
+
+		grp = &GetSettingsIndex(ofsContact, &dbc)[ofsModuleName];
+		grp->ofsGroup = ofsSettingsGroup;
+		grp->cbUsed = 0;
+
+		ofsBlobPtr = grp->ofsBlob();
 		pBlob = (PBYTE)DBRead(ofsBlobPtr, &bytesRemaining);
 	}
 	else {
 		dbcs = *(DBContactSettings*)DBRead(ofsSettingsGroup, &bytesRemaining);
 
-		// find if the setting exists
-		ofsBlobPtr = ofsSettingsGroup + offsetof(DBContactSettings, blob);
+		// find if the setting exists, otherwise point to the end of list
+		ofsBlobPtr = grp->Find(dbcwWork.szSetting, settingNameLen);
+		if (ofsBlobPtr == 0)
+			ofsBlobPtr = grp->ofsBlob() + grp->cbUsed;
 		pBlob = (PBYTE)DBRead(ofsBlobPtr, &bytesRemaining);
-		while (pBlob[0]) {
-			NeedBytes(settingNameLen + 1);
-			if (pBlob[0] == settingNameLen && !memcmp(pBlob + 1, dbcwWork.szSetting, settingNameLen))
-				break;
-			NeedBytes(1);
-			MoveAlong(pBlob[0] + 1);
-			NeedBytes(3);
-			MoveAlong(1 + GetSettingValueLength(pBlob));
-			NeedBytes(1);
-		}
 
 		// setting already existed, and up to end of name is in cache
 		if (pBlob[0]) {
@@ -403,15 +391,9 @@ STDMETHODIMP_(BOOL) CDb3Mmap::WriteContactSetting(MCONTACT contactID, DBCONTACTW
 				int nameLen = 1 + settingNameLen;
 				int valLen = 1 + GetSettingValueLength(pBlob);
 				DWORD ofsSettingToCut = ofsBlobPtr - nameLen;
-				MoveAlong(valLen);
-				NeedBytes(1);
-				while (pBlob[0]) {
-					MoveAlong(pBlob[0] + 1);
-					NeedBytes(3);
-					MoveAlong(1 + GetSettingValueLength(pBlob));
-					NeedBytes(1);
-				}
+				ofsBlobPtr = grp->ofsBlob() + grp->cbUsed;
 				DBMoveChunk(ofsSettingToCut, ofsSettingToCut + nameLen + valLen, ofsBlobPtr + 1 - ofsSettingToCut);
+				grp->Remove(dbcwWork.szSetting, settingNameLen, nameLen + valLen);
 				ofsBlobPtr -= nameLen + valLen;
 				pBlob = (PBYTE)DBRead(ofsBlobPtr, &bytesRemaining);
 			}
@@ -495,11 +477,12 @@ STDMETHODIMP_(BOOL) CDb3Mmap::WriteContactSetting(MCONTACT contactID, DBCONTACTW
 			DBWrite(ofsDbcsPrev, dbcsPrev, offsetof(DBContactSettings, blob));
 		}
 		ofsBlobPtr += ofsNew - ofsSettingsGroup;
-		ofsSettingsGroup = ofsNew;
+		ofsSettingsGroup = grp->ofsGroup = ofsNew;
 		pBlob = (PBYTE)DBRead(ofsBlobPtr, &bytesRemaining);
 	}
 
 	// we now have a place to put it and enough space: make it
+	DWORD ofsNewSetting = ofsBlobPtr;
 	DBWrite(ofsBlobPtr, &settingNameLen, 1);
 	DBWrite(ofsBlobPtr + 1, (PVOID)dbcwWork.szSetting, settingNameLen);
 	MoveAlong(1 + settingNameLen);
@@ -531,6 +514,7 @@ STDMETHODIMP_(BOOL) CDb3Mmap::WriteContactSetting(MCONTACT contactID, DBCONTACTW
 
 	BYTE zero = 0;
 	DBWrite(ofsBlobPtr, &zero, 1);
+	grp->Insert(dbcwWork.szSetting, settingNameLen, ofsBlobPtr - ofsNewSetting);
 
 	// quit
 	DBFlush(1);
@@ -574,26 +558,17 @@ STDMETHODIMP_(BOOL) CDb3Mmap::DeleteContactSetting(MCONTACT contactID, LPCSTR sz
 				return 1;
 
 			// make sure the module group exists
-			DWORD ofsSettingsGroup = GetSettingsGroupOfsByModuleNameOfs(dbc, ofsModuleName);
-			if (ofsSettingsGroup == 0)
+			DBSettingsGroupIndex *grp = FindSettingsGroup(ofsContact, dbc, ofsModuleName);
+			if (grp == nullptr)
 				return 1;
 
 			// find if the setting exists
-			DWORD ofsBlobPtr = ofsSettingsGroup + offsetof(DBContactSettings, blob);
+			DWORD ofsBlobPtr = grp->Find(szSetting, settingNameLen);
+			if (ofsBlobPtr == 0) //setting didn't exist
+				return 1;
+
 			int bytesRemaining;
 			PBYTE pBlob = (PBYTE)DBRead(ofsBlobPtr, &bytesRemaining);
-			while (pBlob[0]) {
-				NeedBytes(settingNameLen + 1);
-				if (pBlob[0] == settingNameLen && !memcmp(pBlob + 1, szSetting, settingNameLen))
-					break;
-				NeedBytes(1);
-				MoveAlong(pBlob[0] + 1);
-				NeedBytes(3);
-				MoveAlong(1 + GetSettingValueLength(pBlob));
-				NeedBytes(1);
-			}
-			if (!pBlob[0]) //setting didn't exist
-				return 1;
 
 			// bin it
 			MoveAlong(1 + settingNameLen);
@@ -601,15 +576,9 @@ STDMETHODIMP_(BOOL) CDb3Mmap::DeleteContactSetting(MCONTACT contactID, LPCSTR sz
 			int nameLen = 1 + settingNameLen;
 			int valLen = 1 + GetSettingValueLength(pBlob);
 			DWORD ofsSettingToCut = ofsBlobPtr - nameLen;
-			MoveAlong(valLen);
-			NeedBytes(1);
-			while (pBlob[0]) {
-				MoveAlong(pBlob[0] + 1);
-				NeedBytes(3);
-				MoveAlong(1 + GetSettingValueLength(pBlob));
-				NeedBytes(1);
-			}
+			ofsBlobPtr = grp->ofsBlob() + grp->cbUsed;
 			DBMoveChunk(ofsSettingToCut, ofsSettingToCut + nameLen + valLen, ofsBlobPtr + 1 - ofsSettingToCut);
+			grp->Remove(szSetting, settingNameLen, nameLen + valLen);
 			DBFlush(1);
 
 			// remove a value from cache anyway
@@ -647,11 +616,11 @@ STDMETHODIMP_(BOOL) CDb3Mmap::EnumContactSettings(MCONTACT contactID, DBSETTINGE
 		return -1;
 
 	DWORD ofsModuleName = GetModuleNameOfs(szModule);
-	DWORD ofsSettings = GetSettingsGroupOfsByModuleNameOfs(dbc, ofsModuleName);
-	if (!ofsSettings)
+	DBSettingsGroupIndex *grp = FindSettingsGroup(ofsContact, dbc, ofsModuleName);
+	if (grp == nullptr)
 		return -1;
 
-	DWORD ofsBlobPtr = ofsSettings + offsetof(DBContactSettings, blob);
+	DWORD ofsBlobPtr = grp->ofsBlob();
 	int bytesRemaining;
 	PBYTE pBlob = (PBYTE)DBRead(ofsBlobPtr, &bytesRemaining);
 	if (pBlob[0] == 0)
@@ -32,6 +32,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <time.h>
 #include <process.h>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 #include <newpluginapi.h>
 #include <win2k.h>
@@ -72,6 +72,9 @@ LONG CDbxMDBX::DeleteContact(MCONTACT contactID)
 
 		if (trnlck.commit() != MDBX_SUCCESS)
 			return 1;
+
+		mir_cslock lck(m_csDbAccess);
+		m_dwSettingsGen++;
 	}
 
 	// finally remove the contact itself
@@ -126,7 +129,7 @@ void CDbxMDBX::GatherContactHistory(MCONTACT hContact, OBJLIST<EventItem> &list)
 	MDBX_val key = { &keyVal, sizeof(keyVal) }, data;
 
 	txn_ptr_ro trnlck(m_txn_ro);
-	cursor_ptr_ro cursor(m_curEventsSort);
+	cursor_ptr_ro cursor(trnlck.cursor(CUR_EVENTSSORT));
 
 	for (int res = mdbx_cursor_get(cursor, &key, &data, MDBX_SET_RANGE); res == MDBX_SUCCESS; res = mdbx_cursor_get(cursor, &key, &data, MDBX_NEXT)) {
 		const DBEventSortingKey *pKey = (const DBEventSortingKey*)key.iov_base;
@@ -263,7 +266,7 @@ void CDbxMDBX::FillContacts()
 {
 	{
 		txn_ptr_ro trnlck(m_txn_ro);
-		cursor_ptr_ro cursor(m_curContacts);
+		cursor_ptr_ro cursor(trnlck.cursor(CUR_CONTACTS));
 
 		MDBX_val key, data;
 		while (mdbx_cursor_get(cursor, &key, &data, MDBX_NEXT) == MDBX_SUCCESS) {
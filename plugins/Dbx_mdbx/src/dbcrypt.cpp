@@ -172,7 +172,7 @@ int CDbxMDBX::EnableEncryption(bool bEncrypted)
 		std::vector<MEVENT> lstEvents;
 		lstEvents.reserve(st.ms_entries);
 		{
-			cursor_ptr_ro cursor(m_curEvents);
+			cursor_ptr_ro cursor(txnro.cursor(CUR_EVENTS));
 			MDBX_val key, data;
 			while (mdbx_cursor_get(cursor, &key, &data, MDBX_NEXT) == MDBX_SUCCESS) {
 				const MEVENT hDbEvent = *(const MEVENT*)key.iov_base;
@@ -438,30 +438,71 @@ MCONTACT CDbxMDBX::GetEventContact(MEVENT hDbEvent)
 	return ((const DBEvent*)data.iov_base)->contactID;
 }
 
-///////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// the last event returned by Find* in this thread and its timestamp, to avoid
+// reading an event again when enumerating history. event ids are unique only
+// inside one database, so the hint is valid only for the database that set it
 
-MEVENT CDbxMDBX::FindFirstEvent(MCONTACT contactID)
+struct FindEventHint
 {
-	DBCachedContact *cc;
-	if (contactID != 0) {
-		cc = m_cache->GetCachedContact(contactID);
-		if (cc == nullptr)
-			return 0;
+	const CDbxMDBX *pDb;
+	MEVENT hEvent;
+	uint64_t ts;
+};
+
+static thread_local FindEventHint t_hint;
+
+static MEVENT SetFindHint(const CDbxMDBX *pDb, MCONTACT contactID, const DBEventSortingKey *pKey)
+{
+	t_hint.pDb = pDb;
+	t_hint.ts = pKey->ts;
+	return t_hint.hEvent = (pKey->hContact == contactID) ? pKey->hEvent : 0;
+}
+
+static MEVENT ResetFindHint()
+{
+	t_hint.pDb = nullptr;
+	return t_hint.hEvent = 0;
+}
+
+// positions the sorting cursor at hDbEvent. the hint's timestamp is tried first,
+// if it misses (the event was edited or the hint is stale) the event is read
+
+bool CDbxMDBX::SeekSortingKey(const txn_ptr_ro &txn, MDBX_cursor *cursor, MCONTACT contactID, MEVENT hDbEvent)
+{
+	DBEventSortingKey keyVal = { contactID, hDbEvent, 0 };
+	MDBX_val key = { &keyVal, sizeof(keyVal) };
+
+	if (t_hint.pDb == this && t_hint.hEvent == hDbEvent) {
+		keyVal.ts = t_hint.ts;
+		if (mdbx_cursor_get(cursor, &key, nullptr, MDBX_SET) == MDBX_SUCCESS)
+			return true;
 	}
-	else cc = &m_ccDummy;
+
+	MDBX_val key2 = { &hDbEvent, sizeof(MEVENT) }, data;
+	if (mdbx_get(txn, m_dbEvents, &key2, &data) != MDBX_SUCCESS)
+		return false;
+
+	keyVal.ts = ((const DBEvent*)data.iov_base)->timestamp;
+	key.iov_base = &keyVal; key.iov_len = sizeof(keyVal);
+	return mdbx_cursor_get(cursor, &key, nullptr, MDBX_SET) == MDBX_SUCCESS;
+}
+
+MEVENT CDbxMDBX::FindFirstEvent(MCONTACT contactID)
+{
+	if (contactID != 0 && m_cache->GetCachedContact(contactID) == nullptr)
+		return 0;
 
 	DBEventSortingKey keyVal = { contactID, 0, 0 };
 	MDBX_val key = { &keyVal, sizeof(keyVal) }, data;
 
 	txn_ptr_ro txn(m_txn_ro);
 
-	cursor_ptr_ro cursor(m_curEventsSort);
+	cursor_ptr_ro cursor(txn.cursor(CUR_EVENTSSORT));
 	if (mdbx_cursor_get(cursor, &key, &data, MDBX_SET_RANGE) != MDBX_SUCCESS)
-		return cc->t_evLast = 0;
+		return ResetFindHint();
 
-	const DBEventSortingKey *pKey = (const DBEventSortingKey*)key.iov_base;
-	cc->t_tsLast = pKey->ts;
-	return cc->t_evLast = (pKey->hContact == contactID) ? pKey->hEvent : 0;
+	return SetFindHint(this, contactID, (const DBEventSortingKey*)key.iov_base);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -476,110 +517,69 @@ MEVENT CDbxMDBX::FindFirstUnreadEvent(MCONTACT contactID)
 
 MEVENT CDbxMDBX::FindLastEvent(MCONTACT contactID)
 {
-	DBCachedContact *cc;
-	if (contactID != 0) {
-		cc = m_cache->GetCachedContact(contactID);
-		if (cc == nullptr)
-			return 0;
-	}
-	else cc = &m_ccDummy;
+	if (contactID != 0 && m_cache->GetCachedContact(contactID) == nullptr)
+		return 0;
 
 	DBEventSortingKey keyVal = { contactID, 0xFFFFFFFF, 0xFFFFFFFFFFFFFFFF };
 	MDBX_val key = { &keyVal, sizeof(keyVal) }, data;
 
 	txn_ptr_ro txn(m_txn_ro);
-	cursor_ptr_ro cursor(m_curEventsSort);
+	cursor_ptr_ro cursor(txn.cursor(CUR_EVENTSSORT));
 
 	if (mdbx_cursor_get(cursor, &key, &data, MDBX_SET_RANGE) != MDBX_SUCCESS) {
 		if (mdbx_cursor_get(cursor, &key, &data, MDBX_LAST) != MDBX_SUCCESS)
-			return cc->t_evLast = 0;
+			return ResetFindHint();
 	}
 	else {
 		if (mdbx_cursor_get(cursor, &key, &data, MDBX_PREV) != MDBX_SUCCESS)
-			return cc->t_evLast = 0;
+			return ResetFindHint();
 	}
 
-	const DBEventSortingKey *pKey = (const DBEventSortingKey*)key.iov_base;
-	cc->t_tsLast = pKey->ts;
-	return cc->t_evLast = (pKey->hContact == contactID) ? pKey->hEvent : 0;
+	return SetFindHint(this, contactID, (const DBEventSortingKey*)key.iov_base);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 MEVENT CDbxMDBX::FindNextEvent(MCONTACT contactID, MEVENT hDbEvent)
 {
-	DBCachedContact *cc;
-	if (contactID != 0) {
-		cc = m_cache->GetCachedContact(contactID);
-		if (cc == nullptr)
-			return 0;
-	}
-	else cc = &m_ccDummy;
+	if (contactID != 0 && m_cache->GetCachedContact(contactID) == nullptr)
+		return 0;
 
 	if (hDbEvent == 0)
-		return cc->t_evLast = 0;
+		return ResetFindHint();
 
 	txn_ptr_ro txn(m_txn_ro);
 
-	if (cc->t_evLast != hDbEvent) {
-		MDBX_val key = { &hDbEvent, sizeof(MEVENT) }, data;
-		if (mdbx_get(txn, m_dbEvents, &key, &data) != MDBX_SUCCESS)
-			return 0;
-		cc->t_tsLast = ((DBEvent*)data.iov_base)->timestamp;
-	}
-
-	DBEventSortingKey keyVal = { contactID, hDbEvent, cc->t_tsLast };
-	MDBX_val key = { &keyVal, sizeof(keyVal) }, data;
-
-	cursor_ptr_ro cursor(m_curEventsSort);
-	if (mdbx_cursor_get(cursor, &key, nullptr, MDBX_SET) != MDBX_SUCCESS)
-		return cc->t_evLast = 0;
+	cursor_ptr_ro cursor(txn.cursor(CUR_EVENTSSORT));
+	if (!SeekSortingKey(txn, cursor, contactID, hDbEvent))
+		return ResetFindHint();
 
+	MDBX_val key, data;
 	if (mdbx_cursor_get(cursor, &key, &data, MDBX_NEXT) != MDBX_SUCCESS)
-		return cc->t_evLast = 0;
+		return ResetFindHint();
 
-	const DBEventSortingKey *pKey = (const DBEventSortingKey*)key.iov_base;
-	cc->t_tsLast = pKey->ts;
-	return cc->t_evLast = (pKey->hContact == contactID) ? pKey->hEvent : 0;
+	return SetFindHint(this, contactID, (const DBEventSortingKey*)key.iov_base);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 MEVENT CDbxMDBX::FindPrevEvent(MCONTACT contactID, MEVENT hDbEvent)
 {
-	DBCachedContact *cc;
-	if (contactID != 0) {
-		cc = m_cache->GetCachedContact(contactID);
-		if (cc == nullptr)
-			return 0;
-	}
-	else cc = &m_ccDummy;
+	if (contactID != 0 && m_cache->GetCachedContact(contactID) == nullptr)
+		return 0;
 
 	if (hDbEvent == 0)
-		return cc->t_evLast = 0;
-
-	MDBX_val data;
+		return ResetFindHint();
 
 	txn_ptr_ro txn(m_txn_ro);
 
-	if (cc->t_evLast != hDbEvent) {
-		MDBX_val key = { &hDbEvent, sizeof(MEVENT) };
-		if (mdbx_get(txn, m_dbEvents, &key, &data) != MDBX_SUCCESS)
-			return 0;
-		cc->t_tsLast = ((DBEvent*)data.iov_base)->timestamp;
-	}
-
-	DBEventSortingKey keyVal = { contactID, hDbEvent, cc->t_tsLast };
-	MDBX_val key = { &keyVal, sizeof(keyVal) };
-
-	cursor_ptr_ro cursor(m_curEventsSort);
-	if (mdbx_cursor_get(cursor, &key, nullptr, MDBX_SET) != MDBX_SUCCESS)
-		return cc->t_evLast = 0;
+	cursor_ptr_ro cursor(txn.cursor(CUR_EVENTSSORT));
+	if (!SeekSortingKey(txn, cursor, contactID, hDbEvent))
+		return ResetFindHint();
 
+	MDBX_val key, data;
 	if (mdbx_cursor_get(cursor, &key, &data, MDBX_PREV) != MDBX_SUCCESS)
-		return cc->t_evLast = 0;
+		return ResetFindHint();
 
-	const DBEventSortingKey *pKey = (const DBEventSortingKey*)key.iov_base;
-	cc->t_tsLast = pKey->ts;
-	return cc->t_evLast = (pKey->hContact == contactID) ? pKey->hEvent : 0;
+	return SetFindHint(this, contactID, (const DBEventSortingKey*)key.iov_base);
 }
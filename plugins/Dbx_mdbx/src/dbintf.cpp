@@ -42,6 +42,7 @@ CDbxMDBX::CDbxMDBX(const TCHAR *tszFileName, int iMode) :
 
 CDbxMDBX::~CDbxMDBX()
 {
+	m_txn_ro.destroy();
 	mdbx_env_close(m_env);
 
 	if (!m_bReadOnly)
@@ -105,21 +106,17 @@ int CDbxMDBX::Load()
 		trnlck.commit();
 	}
 
-	mdbx_txn_begin(m_env, nullptr, MDBX_RDONLY, &m_txn_ro);
-	mdbx_cursor_open(m_txn_ro, m_dbEvents, &m_curEvents);
-	mdbx_cursor_open(m_txn_ro, m_dbEventIds, &m_curEventIds);
-	mdbx_cursor_open(m_txn_ro, m_dbEventsSort, &m_curEventsSort);
-	mdbx_cursor_open(m_txn_ro, m_dbSettings, &m_curSettings);
-	mdbx_cursor_open(m_txn_ro, m_dbModules, &m_curModules);
-	mdbx_cursor_open(m_txn_ro, m_dbContacts, &m_curContacts);
-
-	MDBX_val key, val;
-	if (mdbx_cursor_get(m_curEvents, &key, &val, MDBX_LAST) == MDBX_SUCCESS)
-		m_dwMaxEventId = *(MEVENT*)key.iov_base;
-	if (mdbx_cursor_get(m_curContacts, &key, &val, MDBX_LAST) == MDBX_SUCCESS)
-		m_maxContactId = *(MCONTACT*)key.iov_base;
+	const MDBX_dbi dbis[CUR_COUNT] = { m_dbEvents, m_dbEventIds, m_dbEventsSort, m_dbSettings, m_dbModules, m_dbContacts };
+	m_txn_ro.init(m_env, dbis);
+	{
+		txn_ptr_ro txn(m_txn_ro);
 
-	mdbx_txn_reset(m_txn_ro);
+		MDBX_val key, val;
+		if (mdbx_cursor_get(txn.cursor(CUR_EVENTS), &key, &val, MDBX_LAST) == MDBX_SUCCESS)
+			m_dwMaxEventId = *(MEVENT*)key.iov_base;
+		if (mdbx_cursor_get(txn.cursor(CUR_CONTACTS), &key, &val, MDBX_LAST) == MDBX_SUCCESS)
+			m_maxContactId = *(MCONTACT*)key.iov_base;
+	}
 
 	if (InitModules()) return EGROKPRF_DAMAGED;
 	if (InitCrypt())   return EGROKPRF_DAMAGED;
@@ -162,11 +159,24 @@ BOOL CDbxMDBX::Compact()
 		return 1;
 	}
 
-	mir_cslock lck(m_csDbAccess);
+	// lock-free readers may still use the pooled transactions, so the pool is drained before
+	// the environment is closed. a reader might wait for m_csDbAccess meanwhile, hence both
+	// locks are only tried and released again until they're taken together
+	CRITICAL_SECTION &csDbAccess = m_csDbAccess;
+	while (true) {
+		if (m_txn_ro.lock(50)) {
+			if (TryEnterCriticalSection(&csDbAccess))
+				break;
+			m_txn_ro.unlock();
+		}
+		Sleep(1);
+	}
+
 	int res = mdbx_env_copy2fd(m_env, pFile, MDBX_CP_COMPACT);
 	CloseHandle(pFile);
 
 	if (res == MDBX_SUCCESS) {
+		m_txn_ro.destroy();
 		mdbx_env_close(m_env);
 
 		DeleteFileW(m_tszProfileName);
@@ -174,9 +184,14 @@ BOOL CDbxMDBX::Compact()
 
 		Map();
 		Load();
+
+		// values read from the old file must not get into the cache
+		m_dwSettingsGen++;
 	}
 	else DeleteFileW(wszTmpFile);
 
+	m_txn_ro.unlock();
+	LeaveCriticalSection(&csDbAccess);
 	return 0;
 }
 
@@ -251,7 +266,7 @@ int CDbxMDBX::Map()
 	if (rc != MDBX_SUCCESS)
 		return EGROKPRF_CANTREAD;
 
-	unsigned int mode = MDBX_NOSUBDIR | MDBX_MAPASYNC | MDBX_WRITEMAP | MDBX_NOSYNC | MDBX_COALESCE | MDBX_EXCLUSIVE;
+	unsigned int mode = MDBX_NOSUBDIR | MDBX_MAPASYNC | MDBX_WRITEMAP | MDBX_NOSYNC | MDBX_COALESCE | MDBX_EXCLUSIVE | MDBX_NOTLS;
 	if (m_bReadOnly)
 		mode |= MDBX_RDONLY;
 
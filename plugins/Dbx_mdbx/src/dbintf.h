@@ -122,8 +122,6 @@ struct DBCachedContact : public DBCachedContactBase
 	void Revert();
 	
 	DBContact dbc, tmp_dbc;
-	uint64_t t_tsLast;
-	MEVENT t_evLast;
 };
 
 struct EventItem
@@ -175,7 +173,7 @@ class CDbxMDBX : public MDatabaseCommon, public MZeroedObject
 	// settings
 
 	MDBX_dbi  m_dbSettings;
-	MDBX_cursor *m_curSettings;
+	uint32_t  m_dwSettingsGen; // changed on every write, protected by m_csDbAccess
 
 	HANDLE   hService[2], hHook;
 
@@ -183,7 +181,6 @@ class CDbxMDBX : public MDatabaseCommon, public MZeroedObject
 	// contacts
 
 	MDBX_dbi	    m_dbContacts;
-	MDBX_cursor *m_curContacts;
 
 	MCONTACT m_maxContactId;
 
@@ -193,16 +190,15 @@ class CDbxMDBX : public MDatabaseCommon, public MZeroedObject
 	// events
 
 	MDBX_dbi	    m_dbEvents, m_dbEventsSort, m_dbEventIds;
-	MDBX_cursor *m_curEvents, *m_curEventsSort, *m_curEventIds;
 	MEVENT       m_dwMaxEventId;
 
 	void     FindNextUnread(const txn_ptr &_txn, DBCachedContact *cc, DBEventSortingKey &key2);
+	bool     SeekSortingKey(const txn_ptr_ro &txn, MDBX_cursor *cursor, MCONTACT contactID, MEVENT hDbEvent);
 
 	////////////////////////////////////////////////////////////////////////////
 	// modules
 
 	MDBX_dbi	m_dbModules;
-	MDBX_cursor *m_curModules;
 
 	std::map<uint32_t, std::string> m_Modules;
 
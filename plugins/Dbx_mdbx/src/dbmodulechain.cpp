@@ -26,7 +26,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 int CDbxMDBX::InitModules()
 {
 	txn_ptr_ro trnlck(m_txn_ro);
-	cursor_ptr_ro cursor(m_curModules);
+	cursor_ptr_ro cursor(trnlck.cursor(CUR_MODULES));
 	
 	MDBX_val key, data;
 	while (mdbx_cursor_get(cursor, &key, &data, MDBX_NEXT) == MDBX_SUCCESS) {
@@ -44,7 +44,7 @@ int CDbxMDBX::GetContactSettingWorker(MCONTACT contactID, LPCSTR szModule, LPCST
 	size_t settingNameLen = strlen(szSetting);
 	size_t moduleNameLen = strlen(szModule);
 
-	mir_cslock lck(m_csDbAccess);
+	mir_cslockfull lck(m_csDbAccess);
 
 LBL_Seek:
 	char *szCachedSettingName = m_cache->GetCachedSetting(szModule, szSetting, moduleNameLen, settingNameLen);
@@ -82,120 +82,131 @@ LBL_Seek:
 	if (szCachedSettingName[-1] != 0)
 		return 1;
 
-	int res;
-	const BYTE *pBlob;
 	DBCachedContact *cc = (contactID) ? m_cache->GetCachedContact(contactID) : nullptr;
+
+	DBSettingKey *keyVal = (DBSettingKey *)_alloca(sizeof(DBSettingKey) + settingNameLen);
+	keyVal->hContact = contactID;
+	keyVal->dwModuleId = GetModuleID(szModule);
+	memcpy(&keyVal->szSettingName, szSetting, settingNameLen + 1);
+
+	// the database itself is read without the lock, readers don't block each other.
+	// if a setting was written meanwhile, the value read isn't put into the cache
+	uint32_t dwGen = m_dwSettingsGen;
+	lck.unlock();
+
+	BYTE iType;
 	{
 		txn_ptr_ro trnlck(m_txn_ro);
 
-		DBSettingKey *keyVal = (DBSettingKey *)_alloca(sizeof(DBSettingKey) + settingNameLen);
-		keyVal->hContact = contactID;
-		keyVal->dwModuleId = GetModuleID(szModule);
-		memcpy(&keyVal->szSettingName, szSetting, settingNameLen + 1);
-
 		MDBX_val key = { keyVal,  sizeof(DBSettingKey) + settingNameLen }, data;
-		res = mdbx_get(trnlck, m_dbSettings, &key, &data);
-		pBlob = (const BYTE*)data.iov_base;
-	}
-	if (res != MDBX_SUCCESS) {
-		// try to get the missing mc setting from the active sub
-		if (cc && cc->IsMeta() && ValidLookupName(szModule, szSetting)) {
-			if (contactID = db_mc_getDefault(contactID)) {
-				if (szModule = GetContactProto(contactID)) {
-					moduleNameLen = strlen(szModule);
-					goto LBL_Seek;
+		if (mdbx_get(trnlck, m_dbSettings, &key, &data) != MDBX_SUCCESS) {
+			// try to get the missing mc setting from the active sub
+			if (cc && cc->IsMeta() && ValidLookupName(szModule, szSetting)) {
+				if (contactID = db_mc_getDefault(contactID)) {
+					if (szModule = GetContactProto(contactID)) {
+						moduleNameLen = strlen(szModule);
+						goto LBL_SeekSub;
+					}
 				}
 			}
+			return 1;
 		}
-		return 1;
-	}
 
-	if (isStatic && (pBlob[0] & DBVTF_VARIABLELENGTH) && VLT(dbv->type) != VLT(pBlob[0]))
-		return 1;
-
-	int varLen;
-	BYTE iType = dbv->type = pBlob[0]; pBlob++;
-	switch (iType) {
-	case DBVT_DELETED: /* this setting is deleted */
-		dbv->type = DBVT_DELETED;
-		return 2;
-
-	case DBVT_BYTE:  dbv->bVal = *pBlob; break;
-	case DBVT_WORD:  dbv->wVal = *(WORD*)pBlob; break;
-	case DBVT_DWORD: dbv->dVal = *(DWORD*)pBlob; break;
+		const BYTE *pBlob = (const BYTE*)data.iov_base;
+		if (isStatic && (pBlob[0] & DBVTF_VARIABLELENGTH) && VLT(dbv->type) != VLT(pBlob[0]))
+			return 1;
 
-	case DBVT_UTF8:
-	case DBVT_ASCIIZ:
-		varLen = *(WORD*)pBlob;
-		pBlob += 2;
-		if (isStatic) {
-			dbv->cchVal--;
-			if (varLen < dbv->cchVal)
+		int varLen;
+		iType = dbv->type = pBlob[0]; pBlob++;
+		switch (iType) {
+		case DBVT_DELETED: /* this setting is deleted */
+			dbv->type = DBVT_DELETED;
+			return 2;
+
+		case DBVT_BYTE:  dbv->bVal = *pBlob; break;
+		case DBVT_WORD:  dbv->wVal = *(WORD*)pBlob; break;
+		case DBVT_DWORD: dbv->dVal = *(DWORD*)pBlob; break;
+
+		case DBVT_UTF8:
+		case DBVT_ASCIIZ:
+			varLen = *(WORD*)pBlob;
+			pBlob += 2;
+			if (isStatic) {
+				dbv->cchVal--;
+				if (varLen < dbv->cchVal)
+					dbv->cchVal = varLen;
+				memcpy(dbv->pszVal, pBlob, dbv->cchVal); // decode
+				dbv->pszVal[dbv->cchVal] = 0;
 				dbv->cchVal = varLen;
-			memcpy(dbv->pszVal, pBlob, dbv->cchVal); // decode
-			dbv->pszVal[dbv->cchVal] = 0;
-			dbv->cchVal = varLen;
-		}
-		else {
-			dbv->pszVal = (char*)mir_alloc(1 + varLen);
-			memcpy(dbv->pszVal, pBlob, varLen);
-			dbv->pszVal[varLen] = 0;
-		}
-		break;
-
-	case DBVT_BLOB:
-		varLen = *(WORD*)pBlob;
-		pBlob += 2;
-		if (isStatic) {
-			if (varLen < dbv->cpbVal)
-				dbv->cpbVal = varLen;
-			memcpy(dbv->pbVal, pBlob, dbv->cpbVal);
-		}
-		else {
-			dbv->pbVal = (BYTE *)mir_alloc(varLen);
-			memcpy(dbv->pbVal, pBlob, varLen);
-		}
-		dbv->cpbVal = varLen;
-		break;
+			}
+			else {
+				dbv->pszVal = (char*)mir_alloc(1 + varLen);
+				memcpy(dbv->pszVal, pBlob, varLen);
+				dbv->pszVal[varLen] = 0;
+			}
+			break;
 
-	case DBVT_ENCRYPTED:
-		if (m_crypto == nullptr)
-			return 1;
+		case DBVT_BLOB:
+			varLen = *(WORD*)pBlob;
+			pBlob += 2;
+			if (isStatic) {
+				if (varLen < dbv->cpbVal)
+					dbv->cpbVal = varLen;
+				memcpy(dbv->pbVal, pBlob, dbv->cpbVal);
+			}
+			else {
+				dbv->pbVal = (BYTE *)mir_alloc(varLen);
+				memcpy(dbv->pbVal, pBlob, varLen);
+			}
+			dbv->cpbVal = varLen;
+			break;
 
-		varLen = *(WORD*)pBlob;
-		pBlob += 2;
+		case DBVT_ENCRYPTED:
+			varLen = *(WORD*)pBlob;
+			pBlob += 2;
 
-		size_t realLen;
-		ptrA decoded(m_crypto->decodeString(pBlob, varLen, &realLen));
-		if (decoded == nullptr)
-			return 1;
+			// the crypto provider is created and rekeyed under the lock
+			size_t realLen;
+			lck.lock();
+			ptrA decoded((m_crypto == nullptr) ? nullptr : m_crypto->decodeString(pBlob, varLen, &realLen));
+			lck.unlock();
+			if (decoded == nullptr)
+				return 1;
 
-		varLen = (WORD)realLen;
-		dbv->type = DBVT_UTF8;
-		if (isStatic) {
-			dbv->cchVal--;
-			if (varLen < dbv->cchVal)
+			varLen = (WORD)realLen;
+			dbv->type = DBVT_UTF8;
+			if (isStatic) {
+				dbv->cchVal--;
+				if (varLen < dbv->cchVal)
+					dbv->cchVal = varLen;
+				memcpy(dbv->pszVal, decoded, dbv->cchVal);
+				dbv->pszVal[dbv->cchVal] = 0;
 				dbv->cchVal = varLen;
-			memcpy(dbv->pszVal, decoded, dbv->cchVal);
-			dbv->pszVal[dbv->cchVal] = 0;
-			dbv->cchVal = varLen;
-		}
-		else {
-			dbv->pszVal = (char*)mir_alloc(1 + varLen);
-			memcpy(dbv->pszVal, decoded, varLen);
-			dbv->pszVal[varLen] = 0;
+			}
+			else {
+				dbv->pszVal = (char*)mir_alloc(1 + varLen);
+				memcpy(dbv->pszVal, decoded, varLen);
+				dbv->pszVal[varLen] = 0;
+			}
+			break;
 		}
-		break;
 	}
 
 	/**** add to cache **********************/
 	if (iType != DBVT_BLOB && iType != DBVT_ENCRYPTED) {
-		pCachedValue = m_cache->GetCachedValuePtr(contactID, szCachedSettingName, 1);
-		if (pCachedValue != nullptr)
-			m_cache->SetCachedVariant(dbv, pCachedValue);
+		lck.lock();
+		if (dwGen == m_dwSettingsGen) {
+			pCachedValue = m_cache->GetCachedValuePtr(contactID, szCachedSettingName, 1);
+			if (pCachedValue != nullptr)
+				m_cache->SetCachedVariant(dbv, pCachedValue);
+		}
 	}
 
 	return 0;
+
+LBL_SeekSub:
+	lck.lock();
+	goto LBL_Seek;
 }
 
 BOOL CDbxMDBX::WriteContactSetting(MCONTACT contactID, DBCONTACTWRITESETTING *dbcws)
@@ -345,6 +356,7 @@ LBL_WriteString:
 		if (trnlck.commit() != MDBX_SUCCESS)
 			return 1;
 	}
+	m_dwSettingsGen++;
 
 	// notify
 	lck.unlock();
@@ -378,6 +390,7 @@ BOOL CDbxMDBX::DeleteContactSetting(MCONTACT contactID, LPCSTR szModule, LPCSTR
 				return 1;
 			if (trnlck.commit() != MDBX_SUCCESS)
 				return 1;
+			m_dwSettingsGen++;
 		}
 
 		m_cache->GetCachedValuePtr(contactID, szCachedSettingName, -1);
@@ -400,7 +413,7 @@ BOOL CDbxMDBX::EnumContactSettings(MCONTACT hContact, DBSETTINGENUMPROC pfnEnumP
 	{
 		DBSettingKey keyVal = { hContact, GetModuleID(szModule), 0 };
 		txn_ptr_ro txn(m_txn_ro);
-		cursor_ptr_ro cursor(m_curSettings);
+		cursor_ptr_ro cursor(txn.cursor(CUR_SETTINGS));
 
 		MDBX_val key = { &keyVal, sizeof(keyVal) }, data;
 
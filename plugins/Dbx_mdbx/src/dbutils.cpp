@@ -56,34 +56,150 @@ int DBSettingKey::Compare(const MDBX_val *ax, const MDBX_val *bx)
 
 /////////////////////////////////////////////////////////////////////////////////////////
 
-txn_ptr_ro::txn_ptr_ro(CMDBX_txn_ro &_txn) : 
-	txn(_txn),
-	lock(txn.cs)
+CMDBX_txn_ro::CMDBX_txn_ro()
 {
-	for (int nRetries = 0; nRetries < 5; nRetries++) {
-		int rc = mdbx_txn_renew(txn);
-		if (rc == MDBX_SUCCESS)
+	InitializeSListHead(&m_idle);
+}
+
+CMDBX_txn_ro::~CMDBX_txn_ro()
+{
+	destroy();
+}
+
+void CMDBX_txn_ro::init(MDBX_env *env, const MDBX_dbi *dbis)
+{
+	destroy();
+
+	m_env = env;
+	memcpy(m_dbis, dbis, sizeof(m_dbis));
+	unlock();
+}
+
+// all readers must be idle at this moment, see lock()
+void CMDBX_txn_ro::destroy()
+{
+	InterlockedFlushSList(&m_idle);
+
+	mir_cslock lck(m_csAll);
+	while (CMDBX_reader *p = m_pAll) {
+		m_pAll = p->pNext;
+
+		for (auto &it : p->cursors)
+			if (it)
+				mdbx_cursor_close(it);
+		if (p->txn)
+			mdbx_txn_abort(p->txn);
+		_aligned_free(p);
+	}
+	m_env = nullptr;
+}
+
+// holds new readers back and waits until the active ones are released. gives up after
+// dwTimeout ms, because an active reader might wait for a lock held by the caller
+bool CMDBX_txn_ro::lock(DWORD dwTimeout)
+{
+	InterlockedExchange(&m_bLocked, 1);
+
+	for (DWORD dwStart = GetTickCount(); m_nActive != 0; Sleep(1)) {
+		if (GetTickCount() - dwStart > dwTimeout) {
+			unlock();
+			return false;
+		}
+	}
+	return true;
+}
+
+void CMDBX_txn_ro::unlock()
+{
+	InterlockedExchange(&m_bLocked, 0);
+}
+
+// returns a renewed transaction
+CMDBX_reader* CMDBX_txn_ro::acquire()
+{
+	// a reader is counted before the lock flag is checked, so that lock() either sees it
+	// or the reader sees the flag and steps back
+	while (true) {
+		InterlockedIncrement(&m_nActive);
+		if (!m_bLocked)
 			break;
 
-		#ifdef _DEBUG
-			DebugBreak();
-		#endif
-		Netlib_Logf(nullptr, "txn_ptr_ro::txn_ptr_ro failed with error=%d, retrying...", rc);
-		Sleep(0);
+		InterlockedDecrement(&m_nActive);
+		Sleep(1);
+	}
+
+	CMDBX_reader *p = (CMDBX_reader*)InterlockedPopEntrySList(&m_idle);
+	if (p != nullptr) {
+		for (int nRetries = 0; nRetries < 5; nRetries++) {
+			int rc = mdbx_txn_renew(p->txn);
+			if (rc == MDBX_SUCCESS)
+				break;
+
+			#ifdef _DEBUG
+				DebugBreak();
+			#endif
+			Netlib_Logf(nullptr, "CMDBX_txn_ro::acquire failed with error=%d, retrying...", rc);
+			Sleep(0);
+		}
+		return p;
+	}
+
+	// no idle readers, create a new one. a fresh transaction is already active
+	p = (CMDBX_reader*)_aligned_malloc(sizeof(CMDBX_reader), MEMORY_ALLOCATION_ALIGNMENT);
+	memset(p, 0, sizeof(CMDBX_reader));
+
+	int rc;
+	while ((rc = mdbx_txn_begin(m_env, nullptr, MDBX_RDONLY, &p->txn)) != MDBX_SUCCESS) {
+		// usually the reader table is full: wait until another reader returns to the pool and take it
+		Netlib_Logf(nullptr, "CMDBX_txn_ro::acquire: mdbx_txn_begin failed with error=%d, waiting for an idle reader", rc);
+		Sleep(1);
+
+		CMDBX_reader *pIdle = (CMDBX_reader*)InterlockedPopEntrySList(&m_idle);
+		if (pIdle != nullptr && mdbx_txn_renew(pIdle->txn) == MDBX_SUCCESS) {
+			_aligned_free(p);
+			return pIdle;
+		}
+		if (pIdle != nullptr)
+			InterlockedPushEntrySList(&m_idle, &pIdle->entry);
 	}
+
+	for (int i = 0; i < CUR_COUNT; i++)
+		mdbx_cursor_open(p->txn, m_dbis[i], &p->cursors[i]);
+
+	mir_cslock lck(m_csAll);
+	p->pNext = m_pAll;
+	m_pAll = p;
+	return p;
 }
 
-txn_ptr_ro::~txn_ptr_ro()
+// resets a transaction and puts it back to the pool
+void CMDBX_txn_ro::release(CMDBX_reader *p)
 {
 	for (int nRetries = 0; nRetries < 5; nRetries++) {
-		int rc = mdbx_txn_reset(txn);
+		int rc = mdbx_txn_reset(p->txn);
 		if (rc == MDBX_SUCCESS)
 			break;
 
 		#ifdef _DEBUG
 			DebugBreak();
 		#endif
-		Netlib_Logf(nullptr, "txn_ptr_ro::~txn_ptr_ro failed with error=%d, retrying...", rc);
+		Netlib_Logf(nullptr, "CMDBX_txn_ro::release failed with error=%d, retrying...", rc);
 		Sleep(0);
 	}
+
+	InterlockedPushEntrySList(&m_idle, &p->entry);
+	InterlockedDecrement(&m_nActive);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+txn_ptr_ro::txn_ptr_ro(CMDBX_txn_ro &_txn) : 
+	txn(_txn),
+	reader(_txn.acquire())
+{
+}
+
+txn_ptr_ro::~txn_ptr_ro()
+{
+	txn.release(reader);
 }
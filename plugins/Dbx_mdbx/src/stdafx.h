@@ -94,25 +94,61 @@ public:
 	}
 };
 
-struct CMDBX_txn_ro
+// cursors opened in every read-only transaction
+enum { CUR_EVENTS, CUR_EVENTIDS, CUR_EVENTSSORT, CUR_SETTINGS, CUR_MODULES, CUR_CONTACTS, CUR_COUNT };
+
+// a read-only transaction together with its cursors. it's kept reset while idle,
+// so it doesn't hold any snapshot, and renewed when taken from the pool
+struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) CMDBX_reader
+{
+	SLIST_ENTRY entry;         // must be the first member
+	CMDBX_reader *pNext;       // list of all readers, for cleanup
+	MDBX_txn *txn;
+	MDBX_cursor *cursors[CUR_COUNT];
+};
+
+// pool of read-only transactions. readers never wait for each other: a thread takes
+// an idle transaction from the lock-free stack or creates a new one, so there are never
+// more of them than threads reading at the same moment. the environment is opened with
+// MDBX_NOTLS, so that a transaction isn't bound to the thread which created it.
+// the pool can be locked to replace the environment: new readers wait until it's unlocked
+class CMDBX_txn_ro
 {
-	MDBX_txn *txn = nullptr;
-	mir_cs cs;
+	SLIST_HEADER m_idle;
+	MDBX_env *m_env = nullptr;
+	MDBX_dbi m_dbis[CUR_COUNT];
+
+	mir_cs m_csAll;            // only taken when a new reader is created
+	CMDBX_reader *m_pAll = nullptr;
 
-	__forceinline operator MDBX_txn* () { return txn; }
-	__forceinline MDBX_txn** operator &() { return &txn; }
+	volatile LONG m_nActive = 0; // readers taken from the pool and not released yet
+	volatile LONG m_bLocked = 0;
+
+public:
+	CMDBX_txn_ro();
+	~CMDBX_txn_ro();
+
+	void init(MDBX_env *env, const MDBX_dbi *dbis);
+	void destroy();
+
+	bool lock(DWORD dwTimeout);
+	void unlock();
+
+	CMDBX_reader* acquire();
+	void release(CMDBX_reader *pReader);
 };
 
 class txn_ptr_ro
 {
 	CMDBX_txn_ro &txn;
-	mir_cslock lock;
+	CMDBX_reader *reader;
 
 public:
 	txn_ptr_ro(CMDBX_txn_ro &_txn);
 	~txn_ptr_ro();
 
-	__forceinline operator MDBX_txn*() const { return txn; }
+	__forceinline operator MDBX_txn*() const { return reader->txn; }
+	__forceinline MDBX_cursor* cursor(int idx) const { return reader->cursors[idx]; }
 };
 
 class cursor_ptr
@@ -69,6 +69,8 @@ MCONTACT CDbxSQLite::AddContact()
 	MCONTACT hContact = INVALID_CONTACT_ID;
 	{
 		mir_cslock lock(m_csDbAccess);
+		BeginWrite();
+
 		sqlite3_stmt *stmt = ctc_stmts_prep[SQL_CTC_STMT_ADD];
 		int rc = sqlite3_step(stmt);
 		assert(rc == SQLITE_ROW || rc == SQLITE_DONE);
@@ -94,6 +96,8 @@ LONG CDbxSQLite::DeleteContact(MCONTACT hContact)
 
 	{
 		mir_cslock lock(m_csDbAccess);
+		BeginWrite();
+
 		sqlite3_stmt *stmt = ctc_stmts_prep[SQL_CTC_STMT_DELETE];
 		sqlite3_bind_int64(stmt, 1, hContact);
 		int rc = sqlite3_step(stmt);
@@ -140,7 +144,8 @@ void DBCachedContact::AddEvent(MEVENT hDbEvent, uint32_t timestamp, bool unread)
 		m_unread = hDbEvent;
 		m_unreadTimestamp = timestamp;
 	}
-	if (m_lastTimestamp <= timestamp) {
+	// an unknown last event stays unknown, the history may have later ones
+	if (m_last != 0 && m_lastTimestamp <= timestamp) {
 		m_last = hDbEvent;
 		m_lastTimestamp = timestamp;
 	}
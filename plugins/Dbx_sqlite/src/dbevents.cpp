@@ -35,8 +35,8 @@ static char *evt_stmts[SQL_EVT_STMT_NUM] = {
 	"select id, timestamp from events where contact_id = ? order by timestamp, id limit 1;",
 	"select id, timestamp from events where contact_id = ? and (flags & ?) = 0 order by timestamp, id limit 1;",
 	"select id, timestamp from events where contact_id = ? order by timestamp desc, id desc limit 1;",
-	"select id, timestamp from events where contact_id = ?1 and id <> ?2 and timestamp > (select timestamp from events where contact_id = ?1 and id = ?2 limit 1) order by timestamp, id limit 1;",
-	"select id, timestamp from events where contact_id = ?1 and id <> ?2 and timestamp < (select timestamp from events where contact_id = ?1 and id = ?2 limit 1) order by timestamp desc, id desc limit 1;",
+	"select id, timestamp from events where contact_id = ?1 and (timestamp, id) > ((select timestamp from events where id = ?2), ?2) order by timestamp, id;",
+	"select id, timestamp from events where contact_id = ?1 and (timestamp, id) < ((select timestamp from events where id = ?2), ?2) order by timestamp desc, id desc;",
 	"select id, timestamp from events where module = ? and server_id = ? limit 1;",
 	"update events set server_id = ? where id = ?;",
 	"insert into contact_events(contact_id, event_id, timestamp) select ?1, event_id, timestamp from contact_events where contact_id = ?2 order by timestamp, event_id;",
@@ -45,6 +45,51 @@ static char *evt_stmts[SQL_EVT_STMT_NUM] = {
 
 static sqlite3_stmt *evt_stmts_prep[SQL_EVT_STMT_NUM] = { 0 };
 
+// FINDNEXT & FINDPREV statements are kept open between calls, so walking through
+// a history costs one step per event instead of a new query every time
+struct EventCursor
+{
+	int iStmt;
+	MCONTACT hContact;
+	MEVENT hLast;
+};
+
+static EventCursor evt_cursors[] = {
+	{ SQL_EVT_STMT_FINDNEXT },
+	{ SQL_EVT_STMT_FINDPREV }
+};
+
+static MEVENT StepCursor(EventCursor &cursor, MCONTACT hContact, MEVENT hDbEvent)
+{
+	sqlite3_stmt *stmt = evt_stmts_prep[cursor.iStmt];
+	if (cursor.hLast == 0 || cursor.hLast != hDbEvent || cursor.hContact != hContact) {
+		sqlite3_reset(stmt);
+		sqlite3_bind_int64(stmt, 1, hContact);
+		sqlite3_bind_int64(stmt, 2, hDbEvent);
+		cursor.hContact = hContact;
+	}
+
+	int rc = sqlite3_step(stmt);
+	assert(rc == SQLITE_ROW || rc == SQLITE_DONE);
+	if (rc != SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		cursor.hLast = 0;
+		return 0;
+	}
+	cursor.hLast = sqlite3_column_int64(stmt, 0);
+	return cursor.hLast;
+}
+
+// any change may move the rows under an open statement
+void CDbxSQLite::ResetEventCursors()
+{
+	for (auto &it : evt_cursors) {
+		if (it.hLast)
+			sqlite3_reset(evt_stmts_prep[it.iStmt]);
+		it.hLast = 0;
+	}
+}
+
 void CDbxSQLite::InitEvents()
 {
 	for (size_t i = 0; i < SQL_EVT_STMT_NUM; i++)
@@ -161,6 +206,8 @@ MEVENT CDbxSQLite::AddEvent(MCONTACT hContact, DBEVENTINFO *dbei)
 	MEVENT hDbEvent = 0;
 	{
 		mir_cslock lock(m_csDbAccess);
+		BeginWrite();
+
 		sqlite3_stmt *stmt = evt_stmts_prep[SQL_EVT_STMT_ADDEVENT];
 		sqlite3_bind_int64(stmt, 1, hContact);
 		sqlite3_bind_text(stmt, 2, dbei->szModule, mir_strlen(dbei->szModule), nullptr);
@@ -203,9 +250,10 @@ BOOL CDbxSQLite::DeleteEvent(MCONTACT hContact, MEVENT hDbEvent)
 
 	{
 		mir_cslock lock(m_csDbAccess);
+		BeginWrite();
+
 		sqlite3_stmt *stmt = evt_stmts_prep[SQL_EVT_STMT_DELETE];
-		sqlite3_bind_int64(stmt, 1, hContact);
-		sqlite3_bind_int64(stmt, 2, hDbEvent);
+		sqlite3_bind_int64(stmt, 1, hDbEvent);
 		int rc = sqlite3_step(stmt);
 		assert(rc == SQLITE_ROW || rc == SQLITE_DONE);
 		sqlite3_reset(stmt);
@@ -238,6 +286,8 @@ BOOL CDbxSQLite::EditEvent(MCONTACT hContact, MEVENT hDbEvent, DBEVENTINFO *dbei
 
 	{
 		mir_cslock lock(m_csDbAccess);
+		BeginWrite();
+
 		sqlite3_stmt *stmt = evt_stmts_prep[SQL_EVT_STMT_EDIT];
 		sqlite3_bind_text(stmt, 1, dbei->szModule, mir_strlen(dbei->szModule), nullptr);
 		sqlite3_bind_int64(stmt, 2, dbei->timestamp);
@@ -357,6 +407,8 @@ BOOL CDbxSQLite::MarkEventRead(MCONTACT hContact, MEVENT hDbEvent)
 	flags |= DBEF_READ;
 	{
 		mir_cslock lock(m_csDbAccess);
+		BeginWrite();
+
 		sqlite3_stmt *stmt = evt_stmts_prep[SQL_EVT_STMT_SETFLAGS];
 		sqlite3_bind_int(stmt, 1, flags);
 		sqlite3_bind_int64(stmt, 2, hDbEvent);
@@ -567,6 +619,8 @@ MEVENT CDbxSQLite::FindNextEvent(MCONTACT hContact, MEVENT hDbEvent)
 	if (cc == nullptr)
 		return 0;
 
+	mir_cslock lock(m_csDbAccess);
+
 	if (cc->IsMeta()) {
 		if (cc->nSubs == 0)
 			return 0;
@@ -596,18 +650,7 @@ MEVENT CDbxSQLite::FindNextEvent(MCONTACT hContact, MEVENT hDbEvent)
 		return hDbEvent;
 	}
 
-	sqlite3_stmt *stmt = evt_stmts_prep[SQL_EVT_STMT_FINDNEXT];
-	sqlite3_bind_int64(stmt, 1, hContact);
-	sqlite3_bind_int64(stmt, 2, hDbEvent);
-	int rc = sqlite3_step(stmt);
-	assert(rc == SQLITE_ROW || rc == SQLITE_DONE);
-	if (rc != SQLITE_ROW) {
-		sqlite3_reset(stmt);
-		return 0;
-	}
-	hDbEvent = sqlite3_column_int64(stmt, 0);
-	sqlite3_reset(stmt);
-	return hDbEvent;
+	return StepCursor(evt_cursors[0], hContact, hDbEvent);
 }
 
 MEVENT CDbxSQLite::FindPrevEvent(MCONTACT hContact, MEVENT hDbEvent)
@@ -650,18 +693,7 @@ MEVENT CDbxSQLite::FindPrevEvent(MCONTACT hContact, MEVENT hDbEvent)
 		return hDbEvent;
 	}
 
-	sqlite3_stmt *stmt = evt_stmts_prep[SQL_EVT_STMT_FINDPREV];
-	sqlite3_bind_int64(stmt, 1, hContact);
-	sqlite3_bind_int64(stmt, 2, hDbEvent);
-	int rc = sqlite3_step(stmt);
-	assert(rc == SQLITE_ROW || rc == SQLITE_DONE);
-	if (rc != SQLITE_ROW) {
-		sqlite3_reset(stmt);
-		return 0;
-	}
-	hDbEvent = sqlite3_column_int64(stmt, 0);
-	sqlite3_reset(stmt);
-	return hDbEvent;
+	return StepCursor(evt_cursors[1], hContact, hDbEvent);
 }
 
 MEVENT CDbxSQLite::GetEventById(LPCSTR szModule, LPCSTR szId)
@@ -690,6 +722,8 @@ BOOL CDbxSQLite::SetEventId(LPCSTR, MEVENT hDbEvent, LPCSTR szId)
 		return 1;
 
 	mir_cslock lock(m_csDbAccess);
+	BeginWrite();
+
 	sqlite3_stmt *stmt = evt_stmts_prep[SQL_EVT_STMT_SETSRVID];
 	sqlite3_bind_text(stmt, 1, szId, mir_strlen(szId), nullptr);
 	sqlite3_bind_int64(stmt, 2, hDbEvent);
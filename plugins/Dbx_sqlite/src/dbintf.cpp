@@ -1,14 +1,29 @@
 #include "stdafx.h"
 
+#define COMMIT_DELAY 50   // ms to wait for more writes before the commit
+#define MAX_BATCH 10000   // writes per transaction in the bulk mode
+
 CDbxSQLite::CDbxSQLite(sqlite3 *database)
 	: m_db(database),
 	m_safetyMode(true),
 	m_modules(1, strcmp)
 {
+	m_hCommitEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	m_hCommitThread = mir_forkthreadex(CommitThread, this);
 }
 
 CDbxSQLite::~CDbxSQLite()
 {
+	m_bShutdown = true;
+	SetEvent(m_hCommitEvent);
+	if (m_hCommitThread) {
+		WaitForSingleObject(m_hCommitThread, INFINITE);
+		CloseHandle(m_hCommitThread);
+	}
+	CloseHandle(m_hCommitEvent);
+
+	DBFlush();
+
 	UninitEvents();
 	UninitContacts();
 	UninitSettings();
@@ -85,9 +100,12 @@ MDatabaseCommon* CDbxSQLite::Load(const wchar_t *profile, int readonly)
 	sqlite3_exec(database, "pragma locking_mode = EXCLUSIVE;", nullptr, nullptr, nullptr);
 	sqlite3_exec(database, "pragma synchronous = NORMAL;", nullptr, nullptr, nullptr);
 	sqlite3_exec(database, "pragma foreign_keys = OFF;", nullptr, nullptr, nullptr);
-	sqlite3_exec(database, "pragma journal_mode = OFF;", nullptr, nullptr, nullptr);
 	sqlite3_exec(database, "commit;", nullptr, nullptr, nullptr);
 
+	// journal mode cannot be changed inside a transaction
+	if (!readonly)
+		sqlite3_exec(database, "pragma journal_mode = WAL;", nullptr, nullptr, nullptr);
+
 	CDbxSQLite *db = new CDbxSQLite(database);
 	db->InitSettings();
 	db->InitContacts();
@@ -97,6 +115,9 @@ MDatabaseCommon* CDbxSQLite::Load(const wchar_t *profile, int readonly)
 
 BOOL CDbxSQLite::Compact()
 {
+	mir_cslock lock(m_csDbAccess);
+	DBFlush();
+
 	sqlite3_exec(m_db, "pragma optimize;", nullptr, nullptr, nullptr);
 	sqlite3_exec(m_db, "vacuum;", nullptr, nullptr, nullptr);
 	return 0;
@@ -111,6 +132,7 @@ BOOL CDbxSQLite::Backup(const wchar_t *profile)
 		return FALSE;
 
 	mir_cslock lock(m_csDbAccess);
+	DBFlush();
 
 	sqlite3_backup *backup = sqlite3_backup_init(database, "main", m_db, "main");
 	if (backup) {
@@ -135,4 +157,59 @@ void CDbxSQLite::SetCacheSafetyMode(BOOL value)
 	else
 		sqlite3_exec(m_db, "pragma synchronous = NORMAL;", nullptr, nullptr, nullptr);
 	m_safetyMode = value != FALSE;
+
+	// the bulk mode is over, commit its last batch
+	if (m_safetyMode)
+		DBFlush();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// group commit
+
+// must be called with m_csDbAccess locked, before any change is made
+void CDbxSQLite::BeginWrite()
+{
+	ResetEventCursors();
+
+	// the bulk mode commits by itself, not to let the transaction grow forever
+	if (!m_safetyMode && m_nPending >= MAX_BATCH)
+		DBFlush();
+
+	if (!m_bTransaction) {
+		sqlite3_exec(m_db, "begin transaction;", nullptr, nullptr, nullptr);
+		m_bTransaction = true;
+	}
+	m_nPending++;
+
+	if (m_safetyMode)
+		SetEvent(m_hCommitEvent);
+}
+
+void CDbxSQLite::DBFlush()
+{
+	mir_cslock lock(m_csDbAccess);
+	if (!m_bTransaction)
+		return;
+
+	ResetEventCursors();
+	sqlite3_exec(m_db, "commit;", nullptr, nullptr, nullptr);
+	m_bTransaction = false;
+	m_nPending = 0;
+}
+
+unsigned __stdcall CDbxSQLite::CommitThread(void *param)
+{
+	Thread_SetName("Dbx_sqlite: commit thread");
+
+	CDbxSQLite *db = (CDbxSQLite*)param;
+	while (WaitForSingleObject(db->m_hCommitEvent, INFINITE) == WAIT_OBJECT_0) {
+		if (db->m_bShutdown)
+			break;
+
+		// let the writes coming right after this one join the same transaction
+		Sleep(COMMIT_DELAY);
+		if (db->m_safetyMode)
+			db->DBFlush();
+	}
+	return 0;
 }
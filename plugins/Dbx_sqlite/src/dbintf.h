@@ -35,6 +35,16 @@ private:
 
 	bool m_safetyMode;
 
+	// group commit: writes share one transaction, the commit thread closes it
+	// a moment after the last change, or every MAX_BATCH writes in the bulk mode
+	bool m_bTransaction, m_bShutdown;
+	int m_nPending;
+	HANDLE m_hCommitEvent, m_hCommitThread;
+
+	static unsigned __stdcall CommitThread(void *param);
+	void BeginWrite();
+	void DBFlush();
+
 	CDbxSQLite(sqlite3 *database);
 
 	void InitContacts();
@@ -43,6 +53,7 @@ private:
 	LIST<char> m_modules;
 	void InitEvents();
 	void UninitEvents();
+	void ResetEventCursors();
 
 	void InitSettings();
 	void UninitSettings();
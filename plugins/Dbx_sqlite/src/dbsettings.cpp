@@ -252,6 +252,8 @@ BOOL CDbxSQLite::WriteContactSetting(MCONTACT hContact, DBCONTACTWRITESETTING *d
 	}
 	else m_cache->GetCachedValuePtr(hContact, cachedSettingName, -1);
 
+	BeginWrite();
+
 	sqlite3_stmt *stmt = settings_stmts_prep[SQL_SET_STMT_REPLACE];
 	sqlite3_bind_int64(stmt, 1, hContact);
 	sqlite3_bind_text(stmt, 2, dbcwWork.szModule, mir_strlen(dbcwWork.szModule), nullptr);
@@ -302,6 +304,8 @@ BOOL CDbxSQLite::DeleteContactSetting(MCONTACT hContact, LPCSTR szModule, LPCSTR
 	if (szCachedSettingName[-1] == 0)  // it's not a resident variable
 	{
 		mir_cslock lock(m_csDbAccess);
+		BeginWrite();
+
 		sqlite3_stmt *stmt = settings_stmts_prep[SQL_SET_STMT_DELETE];
 		sqlite3_bind_int64(stmt, 1, hContact);
 		sqlite3_bind_text(stmt, 2, szModule, mir_strlen(szModule), nullptr);
@@ -22,6 +22,7 @@
 
 #include <windows.h>
 #include <windowsx.h>
+#include <mswsock.h>
 #include <commctrl.h>
 #include <time.h>
 #include <string>
@@ -70,6 +71,7 @@ extern HNETLIBUSER hNetlibUser;
 
 extern bool bShutdownInProgress;
 bool bWriteConfigurationFile();
+void __cdecl HandleNewConnection(CLHttpUser *pclUser);
 
 void LogEvent(const char * pszTitle, const char * pszLog);
 bool bOpenLogFile();
@@ -17,6 +17,12 @@
 
 #include "Glob.h"
 
+// Unlimited transfers are handed to TransmitFile in slices of this size
+#define TRANSMIT_SLICE_SIZE (1024 * 1024)
+
+// An idle kept-alive connection is closed after this many ms
+#define KEEP_ALIVE_TIMEOUT 15000
+
 /////////////////////////////////////////////////////////////////////
 // Member Function : FileTimeToUnixTime
 // Type            : Global
@@ -146,6 +152,8 @@ CLHttpUser::CLHttpUser(HNETLIBCONN hCon, in_addr stAdd) : CLShareUser(hCon, stAd
 {
 	memset(apszParam, 0, sizeof(apszParam));
 	hFile = INVALID_HANDLE_VALUE;
+	bKeepAlive = bPolled = false;
+	hIdleTimer = nullptr;
 }
 
 
@@ -164,6 +172,8 @@ CLHttpUser::CLHttpUser(HNETLIBCONN hCon, in_addr stAdd) : CLShareUser(hCon, stAd
 
 CLHttpUser::~CLHttpUser()
 {
+	StopWaiting();
+
 	if (hFile != INVALID_HANDLE_VALUE)
 		CloseHandle(hFile);
 }
@@ -352,6 +362,75 @@ static void strmcat(char* pszDest, const char* pszSrc, int iMaxLength)
 	*pszDest = '\0';
 }
 
+/////////////////////////////////////////////////////////////////////
+// Upload limit: a token bucket shared by all transfers, refilled at
+// nMaxUploadSpeed bytes per second and holding at most one second of data.
+// Returns the number of bytes that may be sent now, or 0 and the number
+// of ms to wait in dwWait. nMaxUploadSpeed == 0 pauses limited transfers
+/////////////////////////////////////////////////////////////////////
+
+static mir_cs csUploadBucket;
+static int nUploadTokens = 0;
+static DWORD dwUploadRefill = 0;
+
+static DWORD dwTakeUploadTokens(DWORD dwWanted, DWORD &dwWait)
+{
+	mir_cslock lck(csUploadBucket);
+
+	int nSpeed = nMaxUploadSpeed;
+	if (nSpeed <= 0) {
+		dwWait = 1000;
+		return 0;
+	}
+
+	DWORD dwNow = GetTickCount();
+	DWORD dwElapsed = dwNow - dwUploadRefill;
+	if (dwElapsed >= 1000) {
+		nUploadTokens = nSpeed;
+		dwUploadRefill = dwNow;
+	}
+	else {
+		int nAdd = (int)(((__int64)dwElapsed * nSpeed) / 1000);
+		if (nAdd > 0) {
+			nUploadTokens = min(nUploadTokens + nAdd, nSpeed);
+			// only account for the time that actually produced tokens
+			dwUploadRefill += (DWORD)(((__int64)nAdd * 1000) / nSpeed);
+		}
+	}
+
+	if (nUploadTokens > 0) {
+		DWORD dwGranted = min(dwWanted, (DWORD)nUploadTokens);
+		nUploadTokens -= dwGranted;
+		return dwGranted;
+	}
+
+	// wait exactly as long as it takes to refill the requested amount
+	dwWanted = min(dwWanted, (DWORD)nSpeed);
+	dwWait = max((DWORD)(((__int64)dwWanted * 1000) / nSpeed), 1);
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Zero copy send of a file range: the data goes from the file system cache
+// directly to the socket. Netlib sockets are overlapped, so the call may
+// complete asynchronously and hEvent is used to wait for it
+/////////////////////////////////////////////////////////////////////
+
+static bool bTransmitFileRange(SOCKET s, HANDLE hFile, DWORD dwOffset, DWORD dwLength, HANDLE hEvent)
+{
+	OVERLAPPED ov = {};
+	ov.Offset = dwOffset;
+	ov.hEvent = hEvent;
+	if (TransmitFile(s, hFile, dwLength, 0, &ov, nullptr, 0))
+		return true;
+
+	if (WSAGetLastError() != WSA_IO_PENDING)
+		return false;
+
+	DWORD dwSent, dwFlags;
+	return WSAGetOverlappedResult(s, &ov, &dwSent, TRUE, &dwFlags) && dwSent == dwLength;
+}
+
 /////////////////////////////////////////////////////////////////////
 // Member Function : bProcessGetRequest
 // Type            : Global
@@ -367,12 +446,23 @@ static void strmcat(char* pszDest, const char* pszSrc, int iMaxLength)
 // Developer       : KN, Houdini
 // Changed         : 27 January 2005 by Vampik
 // Changed         : 21 January 2006 by Vampik
+// Remarks         : bKeepAlive is set only when the whole response has
+//                   been sent and the client allows to reuse the connection
 /////////////////////////////////////////////////////////////////////
 
 bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 {
 	//LogEvent("Request", pszRequest);
 
+	// reset the state left by the previous request on this connection
+	bKeepAlive = false;
+	memset(apszParam, 0, sizeof(apszParam));
+	if (hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+	}
+	dwCurrentDL = dwSpeed = 0;
+
 	int nUriLength = nUnescapedURI(pszRequest);
 	if (nUriLength <= 0)
 		return false;
@@ -390,6 +480,11 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 		return false;
 	}
 
+	// HTTP/1.1 keeps the connection by default, HTTP/1.0 only on request
+	bool bClientKeepAlive = (strstr(pszRequest, " HTTP/1.0") == nullptr) ?
+		(!apszParam[eConnection] || _stricmp(apszParam[eConnection], "close")) :
+		(apszParam[eConnection] && !_stricmp(apszParam[eConnection], "keep-alive"));
+
 	DWORD dwRemoteIP = ntohl(stAddr.S_un.S_addr);
 	for (CLFileShareNode * pclCur = pclFirstNode; pclCur; pclCur = pclCur->pclNext) {
 		if ((pclCur->st.dwAllowedIP ^ dwRemoteIP) & pclCur->st.dwAllowedMask)
@@ -621,6 +716,7 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 			// for data transfer.
 			// We will use a multiply of this to always send optimal sized packages.
 			char szBuf[1460 * 4];
+			const char *pszConnection = bClientKeepAlive ? "Keep-Alive" : "close";
 
 			if (dwFileStart > 0 || dwDataToSend != nDataSize) {
 				if (SetFilePointer(hFile, dwFileStart, nullptr, FILE_BEGIN) == INVALID_SET_FILE_POINTER) {
@@ -630,7 +726,7 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 
 				dwBytesToWrite = mir_snprintf(szBuf, 
 					"HTTP/1.1 206 Partial Content\r\n"
-					"Connection: Keep-Alive\r\n"
+					"Connection: %s\r\n"
 					"Date: %s\r\n"
 					"Server: MirandaWeb/%s\r\n"
 					"Accept-Ranges: bytes\r\n"
@@ -640,13 +736,13 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 					"Content-Range: bytes %d-%d/%d\r\n"
 					"Last-Modified: %s\r\n"
 					"\r\n",
-					szCurTime, __VERSION_STRING_DOTS, szETag, dwDataToSend, pszGetMimeType(pszRealPath),
+					pszConnection, szCurTime, __VERSION_STRING_DOTS, szETag, dwDataToSend, pszGetMimeType(pszRealPath),
 					dwFileStart, (dwFileStart + dwDataToSend - 1), nDataSize, szFileTime);
 			}
 			else {
 				dwBytesToWrite = mir_snprintf(szBuf,
 					"HTTP/1.1 200 OK\r\n"
-					"Connection: Keep-Alive\r\n"
+					"Connection: %s\r\n"
 					"Date: %s\r\n"
 					"Server: MirandaWeb/%s\r\n"
 					"Accept-Ranges: bytes\r\n"
@@ -655,31 +751,22 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 					"Content-Type: %s\r\n"
 					"Last-Modified: %s\r\n"
 					"\r\n",
-					szCurTime, __VERSION_STRING_DOTS, szETag, nDataSize, pszGetMimeType(pszRealPath), szFileTime);
+					pszConnection, szCurTime, __VERSION_STRING_DOTS, szETag, nDataSize, pszGetMimeType(pszRealPath), szFileTime);
 			}
 
-			Netlib_Send(hConnection, szBuf, dwBytesToWrite, 0);
-
-			if (bIsGetCommand) {
-				static int nThreadCount = 0;
-				nThreadCount++;
+			if (Netlib_Send(hConnection, szBuf, dwBytesToWrite, 0) != (int)dwBytesToWrite)
+				return true;
 
+			if (!bIsGetCommand)
+				bKeepAlive = bClientKeepAlive;
+			else {
 				DWORD dwLastUpdate = GetTickCount();
 				DWORD dwLastCurrentDL = 0;
-				/*
-
-				dwLastDLSTickCount = dwCurTick;
-				dwCurrentDL;*/
 
-				//DWORD dwMaxSpeed = 8192;// Byte pr Sek
-				//DWORD dwMaxSpeed = 20000;// Byte pr Sek
-				//DWORD dwMaxSpeed = 163840;// Byte pr Sek
-				//DWORD dwMaxSpeed = 4096;// Byte pr Sek
+				SOCKET s = Netlib_GetSocket(hConnection);
+				HANDLE hTransmitEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
 
-				DWORD dwLastResetTime = GetTickCount();
-				int nMaxBytesToSend = nMaxUploadSpeed / nThreadCount;
-
-				for (;;) {
+				while (dwCurrentDL < dwDataToSend && !bShutdownInProgress) {
 					{
 						DWORD dwCurTick = GetTickCount();
 						if (dwCurTick - dwLastUpdate >= 1000) {
@@ -689,48 +776,50 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 						}
 					}
 
-					if (nMaxUploadSpeed == 0) {
-						Sleep(1000);
+					bool bSpeedLimit = (nMaxUploadSpeed >= 0) && (bIsOnline || !bLimitOnlyWhenOnline);
+					DWORD dwLeft = dwDataToSend - dwCurrentDL;
+
+					if (!bSpeedLimit && s != INVALID_SOCKET && hTransmitEvent) {
+						// unlimited transfer: let the kernel move the data, in slices
+						// so that the speed statistics and the limit state stay current
+						DWORD dwChunk = min(dwLeft, TRANSMIT_SLICE_SIZE);
+						if (!bTransmitFileRange(s, hFile, dwFileStart + dwCurrentDL, dwChunk, hTransmitEvent))
+							break;
+						dwCurrentDL += dwChunk;
 						continue;
 					}
 
-					bool bSpeedLimit = (nMaxUploadSpeed >= 0) && (bIsOnline || !bLimitOnlyWhenOnline);
-
-					DWORD dwCurOpr = sizeof(szBuf);
-					if (bSpeedLimit)
-						dwCurOpr = min(nMaxBytesToSend, sizeof(szBuf));
+					DWORD dwCurOpr = min(dwLeft, sizeof(szBuf));
+					if (bSpeedLimit) {
+						DWORD dwWait;
+						dwCurOpr = dwTakeUploadTokens(dwCurOpr, dwWait);
+						if (dwCurOpr == 0) {
+							Sleep(dwWait);
+							continue;
+						}
+					}
 
-					if (!ReadFile(hFile, szBuf, dwCurOpr, &dwBytesToWrite, nullptr))
+					// an explicit offset keeps us independent from the file pointer
+					OVERLAPPED ov = {};
+					ov.Offset = dwFileStart + dwCurrentDL;
+					if (!ReadFile(hFile, szBuf, dwCurOpr, &dwBytesToWrite, &ov))
 						break;
 
 					if (dwBytesToWrite <= 0)
 						break;
 
-					if (dwCurrentDL + dwBytesToWrite > dwDataToSend)
-						dwBytesToWrite = dwDataToSend - dwCurrentDL;
-
-					if (bSpeedLimit)
-						nMaxBytesToSend -= dwBytesToWrite;
-
 					DWORD dwSend = Netlib_Send(hConnection, szBuf, dwBytesToWrite, MSG_NODUMP);
 					if (dwSend == SOCKET_ERROR)
 						break;
 					dwCurrentDL += dwSend;
 					if (dwSend != dwBytesToWrite)
 						break;
+				}
 
-					if (dwCurrentDL >= dwDataToSend)
-						break;
+				if (hTransmitEvent)
+					CloseHandle(hTransmitEvent);
 
-					if (bSpeedLimit && nMaxBytesToSend <= 0) {
-						// we have reached the limmit
-						DWORD dwTimeUsed = GetTickCount() - dwLastResetTime;
-						if (dwTimeUsed < 1000)
-							Sleep(1000 - dwTimeUsed);
-						dwLastResetTime = GetTickCount();
-						nMaxBytesToSend = nMaxUploadSpeed / nThreadCount;
-					}
-				}
+				bKeepAlive = bClientKeepAlive && dwCurrentDL == dwDataToSend;
 
 				// file is always closed in destructor 
 				if (szTempfile[0] != '\0') {
@@ -741,7 +830,6 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 					DeleteFile(szTempfile);
 				}
 				clCritSection.Lock();
-				nThreadCount--;
 
 				bool bNeedToWriteConfig = false;
 
@@ -795,11 +883,153 @@ bool CLHttpUser::bProcessGetRequest(char * pszRequest, bool bIsGetCommand)
 	return false;
 }
 
-void CLHttpUser::HandleNewConnection()
+/////////////////////////////////////////////////////////////////////
+// Idle connections
+// Between two requests a kept-alive connection has no thread, it's registered
+// with Netlib_PollAdd and a new thread is started when the next request comes.
+// Idle connections are closed by a timer after KEEP_ALIVE_TIMEOUT
+/////////////////////////////////////////////////////////////////////
+
+static LIST<CLHttpUser> arIdleUsers(10, PtrKeySortT);
+static mir_cs csIdleUsers;
+
+/////////////////////////////////////////////////////////////////////
+// Closes a connection which stayed idle for KEEP_ALIVE_TIMEOUT
+/////////////////////////////////////////////////////////////////////
+
+void CALLBACK CLHttpUser::IdleTimerProc(void *pParam, BOOLEAN)
+{
+	// the poll callback gets called, the request handler sees a closed connection
+	Netlib_Shutdown(((CLHttpUser*)pParam)->hConnection);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Poll callback: the next request arrives, a thread is started to serve it
+/////////////////////////////////////////////////////////////////////
+
+void CLHttpUser::OnReadable(HNETLIBCONN hConn, int, void *pUserInfo)
 {
+	// no more notifications until the request is served, then bWaitForRequest() enables them again
+	Netlib_PollModify(hConn, 0);
+	mir_forkThread<CLHttpUser>(HandleNewConnection, (CLHttpUser*)pUserInfo);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Makes the connection idle. Returns false if it can't wait and must be closed
+/////////////////////////////////////////////////////////////////////
+
+bool CLHttpUser::bWaitForRequest()
+{
+	// the lock also keeps the handler started by OnReadable() waiting until we're done here
+	mir_cslock lck(csIdleUsers);
+	if (bShutdownInProgress)
+		return false;
+
+	if (!CreateTimerQueueTimer(&hIdleTimer, nullptr, IdleTimerProc, this, KEEP_ALIVE_TIMEOUT, 0, WT_EXECUTEONLYONCE)) {
+		hIdleTimer = nullptr;
+		return false;
+	}
+
+	int iRet = bPolled ? Netlib_PollModify(hConnection, NLPOLL_READ) : Netlib_PollAdd(hConnection, NLPOLL_READ, OnReadable, this);
+	if (iRet) {
+		DeleteTimerQueueTimer(nullptr, hIdleTimer, INVALID_HANDLE_VALUE);
+		hIdleTimer = nullptr;
+		return false;
+	}
+
+	bPolled = true;
+	arIdleUsers.insert(this);
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Takes the connection out of the idle list before a request is served
+/////////////////////////////////////////////////////////////////////
+
+void CLHttpUser::StopWaiting()
+{
+	mir_cslock lck(csIdleUsers);
+	arIdleUsers.remove(this);
+
+	// waits for a running timer callback
+	if (hIdleTimer) {
+		DeleteTimerQueueTimer(nullptr, hIdleTimer, INVALID_HANDLE_VALUE);
+		hIdleTimer = nullptr;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Closes all idle connections on shutdown
+/////////////////////////////////////////////////////////////////////
+
+void CLHttpUser::CloseIdleConnections()
+{
+	mir_cslock lck(csIdleUsers);
+	for (auto &it : arIdleUsers)
+		Netlib_Shutdown(it->hConnection);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Serves requests on the connection until the client closes it or asks to
+// close it. Pipelined requests already received are served without waiting
+// for the socket. Returns true if the connection went idle waiting for the
+// next request, false if it's done and the object can be deleted
+/////////////////////////////////////////////////////////////////////
+
+bool CLHttpUser::bHandleRequests()
+{
+	StopWaiting();
+
 	char szBuf[1000];
-	int nCurPos = 0;
-	while (sizeof(szBuf) - nCurPos > 10 && !bShutdownInProgress) {
+	int nCurPos = 0, nScanPos = 4; // scan forward from end of "GET " to locate the end of request
+
+	while (!bShutdownInProgress) {
+		if (nCurPos > 5) {
+			bool bIsGetCommand = memcmp(szBuf, "GET ", 4) == 0;
+			if (!bIsGetCommand && memcmp(szBuf, "HEAD ", 5) != 0) {
+				SendError(501, "Not Implemented");
+				break; // We only support GET and HEAD commands !!
+			}
+
+			int nEnd = -1;
+			for (; nScanPos < nCurPos; nScanPos++) {
+				if (szBuf[nScanPos - 2] == '\n' && szBuf[nScanPos - 1] == '\r' && szBuf[nScanPos] == '\n') {
+					nEnd = nScanPos;
+					break;
+				}
+			}
+
+			if (nEnd != -1) {
+				// we have a walid request !!! scan to see if we have this file
+				szBuf[nEnd] = NULL;
+				bProcessGetRequest(&szBuf[bIsGetCommand ? 4 : 5], bIsGetCommand);
+				if (!bKeepAlive)
+					break;
+
+				// keep what the client already sent of the next request
+				nCurPos -= nEnd + 1;
+				memmove(szBuf, &szBuf[nEnd + 1], nCurPos);
+				nScanPos = 4;
+
+				// nothing of the next request yet, release the thread
+				if (nCurPos == 0 && bWaitForRequest())
+					return true;
+				continue;
+			}
+		}
+
+		if (sizeof(szBuf) - nCurPos <= 10)
+			break; // request is too long
+
+		if (nCurPos == 0 && bKeepAlive && !bPolled) {
+			// idle between two requests and netlib can't watch the connection for us
+			NETLIBSELECT nls = {};
+			nls.dwTimeout = KEEP_ALIVE_TIMEOUT;
+			nls.hReadConns[0] = hConnection;
+			if (Netlib_Select(&nls) <= 0)
+				break;
+		}
+
 		int nBytesRead = Netlib_Recv(hConnection, &szBuf[nCurPos], sizeof(szBuf) - nCurPos, 0);
 		if (!nBytesRead) {
 			// socket closed gracefully
@@ -810,32 +1040,8 @@ void CLHttpUser::HandleNewConnection()
 			// WSAGetLastError();
 			break;
 		}
-		int nOldCurPos = nCurPos;
 		nCurPos += nBytesRead;
-		if (nCurPos <= 5)
-			continue;
-
-		bool bIsGetCommand = memcmp(szBuf, "GET ", 4) == 0;
-		if (!bIsGetCommand && memcmp(szBuf, "HEAD ", 5) != 0) {
-			SendError(501, "Not Implemented");
-			break; // We only support GET and HEAD commands !!
-		}
-
-		if (nOldCurPos < 4)
-			nOldCurPos = 4; // scan forward from end of "GET " to locate the next space ' '
-
-		bool bBreakWhile = false;
-		for (; nOldCurPos < nCurPos; nOldCurPos++) {
-			if (szBuf[nOldCurPos - 2] == '\n' && szBuf[nOldCurPos - 1] == '\r' && szBuf[nOldCurPos] == '\n') {
-				// we have a walid request !!! scan to see if we have this file
-				szBuf[nOldCurPos] = NULL;
-				bProcessGetRequest(&szBuf[bIsGetCommand ? 4 : 5], bIsGetCommand);
-
-				bBreakWhile = true;
-				break;
-			}
-		}
-		if (bBreakWhile)
-			break;
 	}
+
+	return false;
 }
@@ -30,6 +30,7 @@ enum ENParamTypes {
 	eIfModifiedSince,
 	eUserAgent,
 	eHost,
+	eConnection,
 	eLastParam
 };
 
@@ -39,7 +40,8 @@ static char * szParmStr[eLastParam] = {
 	"Unless-Modified-Since: ",
 	"If-Modified-Since: ",
 	"User-Agent: ",
-	"Host: "
+	"Host: ",
+	"Connection: "
 };
 
 
@@ -58,10 +60,21 @@ public:
 	const char * pszCustomInfo() {
 		return apszParam[eUserAgent];
 	}
-	void HandleNewConnection();
+	bool bHandleRequests();
+
+	static void CloseIdleConnections();
 private:
 	HANDLE hFile;
 	char *apszParam[eLastParam];
+	bool bKeepAlive; // the connection can be reused for the next request
+	bool bPolled;    // the connection is registered with Netlib_PollAdd
+	HANDLE hIdleTimer;
+
+	bool bWaitForRequest();
+	void StopWaiting();
+
+	static void CALLBACK IdleTimerProc(void *pParam, BOOLEAN);
+	static void OnReadable(HNETLIBCONN hConn, int iEvents, void *pUserInfo);
 
 	void SendError(int iErrorCode, const char * pszError, const char * pszDescription = nullptr);
 	void SendRedir(int iErrorCode, const char * pszError, const char * pszDescription = nullptr, const char * pszRedirect = nullptr);
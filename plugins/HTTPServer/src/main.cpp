@@ -543,8 +543,9 @@ static INT_PTR nHttpGetAllShares(WPARAM /*wParam*/, LPARAM /*lParam*/)
 
 void __cdecl HandleNewConnection(CLHttpUser *pclUser)
 {
-	pclUser->HandleNewConnection();
-	delete pclUser;
+	// a kept-alive connection waits for the next request without a thread
+	if (!pclUser->bHandleRequests())
+		delete pclUser;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -735,6 +736,8 @@ int PreShutdown(WPARAM /*wparam*/, LPARAM /*lparam*/)
 		}
 	}
 
+	CLHttpUser::CloseIdleConnections();
+
 	if (hDirectBoundPort)
 		nToggelAcceptConnections(0, 0);
 
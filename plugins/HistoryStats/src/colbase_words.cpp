@@ -67,17 +67,13 @@ void ColBaseWords::addWord(WordMap* pWords, const ext::string& word, bool bOutgo
 		}
 	}
 
-	// insert, if we didn't get filtered
-	WordMap::iterator i = pWords->find(word);
+	// insert, if we didn't get filtered (single lookup, the map is only touched by the contact's reader thread)
+	WordMap::iterator i = pWords->lower_bound(word);
 
-	if (i != pWords->end())
-	{
-		(bOutgoing ? i->second.out : i->second.in)++;
-	}
-	else
-	{
-		pWords->insert(std::make_pair(word, bOutgoing ? InOut(0, 1) : InOut(1, 0)));
-	}
+	if (i == pWords->end() || pWords->key_comp()(word, i->first))
+		i = pWords->insert(i, std::make_pair(word, InOut()));
+
+	(bOutgoing ? i->second.out : i->second.in)++;
 }
 
 void ColBaseWords::parseMsg(WordMap* pWords, const ext::string& msg, bool bOutgoing) const
@@ -327,9 +323,11 @@ void ColBaseWords::impl_contactDataMerge(Contact& contact, const Contact& includ
 
 	citer_each_(WordMap, j, *pIncData)
 	{
-		if (pData->find(j->first) != pData->end())
-			(*pData)[j->first] += j->second;
+		WordMap::iterator i = pData->lower_bound(j->first);
+
+		if (i == pData->end() || pData->key_comp()(j->first, i->first))
+			pData->insert(i, *j);
 		else
-			pData->insert(*j);
+			i->second += j->second;
 	}
 }
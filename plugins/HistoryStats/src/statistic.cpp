@@ -364,6 +364,115 @@ bool Statistic::stepInit()
 	return true;
 }
 
+void Statistic::readContactHistory(MirandaContact& hisContact, Contact& curContact, Message& curMsg)
+{
+	// signal begin of history for this contact
+	hisContact.beginRead();
+	curContact.beginMessages();
+
+	// init data for chat detection
+	DWORD lastAddedTime = 0;
+	DWORD chatStartTime = 0;
+	bool bChatOutgoing = false;
+
+	// iterate through all events
+	while (hisContact.hasNext()) {
+		const DBEVENTINFO& dbei = hisContact.getNext();
+
+		bool bOutgoing = bool_(dbei.flags & DBEF_SENT);
+
+		// only messages, no URLs, files or anything else
+		// filter logged status messages from tabSRMM
+		if (dbei.eventType == etMessage) {
+			// convert to local time (everything in this plugin is done in local time)
+			DWORD localTimestamp = TimeZone_ToLocal(dbei.timestamp);
+
+			if (localTimestamp >= m_TimeMin && localTimestamp <= m_TimeMax) {
+				if (dbei.flags & DBEF_UTF) {
+					char* pUTF8Text = reinterpret_cast<char*>(dbei.pBlob);
+					int nUTF8Len = utils::getUTF8Len(pUTF8Text);
+
+					curMsg.assignTextFromUTF8(pUTF8Text, nUTF8Len);
+				}
+				else {
+					char* pAnsiText = reinterpret_cast<char*>(dbei.pBlob);
+					int nAnsiLenP1 = ext::a::strfunc::len(pAnsiText) + 1;
+
+					WCHAR* pWideText = reinterpret_cast<WCHAR*>(pAnsiText + nAnsiLenP1);
+					int nWideLen = 0;
+					int nWideMaxLen = (dbei.cbBlob - nAnsiLenP1) / sizeof(WCHAR);
+
+					if (dbei.cbBlob >= nAnsiLenP1 * 3) {
+						for (int i = 0; i < nWideMaxLen; ++i) {
+							if (!pWideText[i]) {
+								nWideLen = i;
+								break;
+							}
+						}
+					}
+
+					if (nWideLen > 0 && nWideLen < nAnsiLenP1)
+						curMsg.assignText(pWideText, nWideLen);
+					else
+						curMsg.assignText(pAnsiText, nAnsiLenP1 - 1);
+				}
+
+				curMsg.assignInfo(bOutgoing, localTimestamp);
+
+				// handle messages
+				handleAddMessage(curContact, curMsg);
+
+				// handle chats
+				if (localTimestamp - lastAddedTime >= (DWORD)m_Settings.m_ChatSessionTimeout || lastAddedTime == 0) {
+					// new chat started
+					if (chatStartTime != 0)
+						handleAddChat(curContact, bChatOutgoing, chatStartTime, lastAddedTime - chatStartTime);
+
+					chatStartTime = localTimestamp;
+					bChatOutgoing = bOutgoing;
+				}
+
+				lastAddedTime = localTimestamp;
+			}
+		}
+
+		// non-message events
+		if (dbei.eventType != etMessage)
+			curContact.addEvent(dbei.eventType, bOutgoing);
+
+		hisContact.readNext();
+	}
+
+	// post processing for chat detection
+	if (chatStartTime != 0)
+		handleAddChat(curContact, bChatOutgoing, chatStartTime, lastAddedTime - chatStartTime);
+
+	// signal end of history for this contact
+	curContact.endMessages();
+	hisContact.endRead();
+}
+
+void Statistic::readHistories()
+{
+	// MEMO: every contact is read by exactly one thread, so the per-contact column
+	// data in the slots never needs locking; columns only read their own members here
+	Message curMsg(m_Settings.m_FilterRawRTF && RTFFilter::available(), m_Settings.m_FilterBBCodes);
+
+	int nContacts = m_Contacts.size();
+
+	while (!shouldTerminate()) {
+		int contactIndex = InterlockedIncrement(&m_nReadNext) - 1;
+		if (contactIndex >= nContacts)
+			break;
+
+		InterlockedExchange(&m_nReadLast, contactIndex);
+
+		readContactHistory(m_pReadHistory->getContact(contactIndex), *m_Contacts[contactIndex], curMsg);
+
+		InterlockedIncrement(&m_nReadDone);
+	}
+}
+
 bool Statistic::stepReadDB()
 {
 	if (shouldTerminate())
@@ -377,105 +486,69 @@ bool Statistic::stepReadDB()
 	// prepare some data
 	MirandaHistory history(m_Settings);
 
-	setProgressMax(true, history.getContactCount());
+	int nContacts = history.getContactCount();
+
+	setProgressMax(true, nContacts);
 
-	upto_each_(contactIndex, history.getContactCount())
+	// create all contacts upfront, so their order doesn't depend on the readers
+	upto_each_(contactIndex, nContacts)
 	{
 		MirandaContact& hisContact = history.getContact(contactIndex);
 
-		setProgressLabel(true, hisContact.getNick());
-
-		Contact& curContact = addContact(hisContact.getNick(), hisContact.getProtocol(), hisContact.getGroup(), hisContact.getSources().size());
-
-		// signal begin of history for this contact
-		hisContact.beginRead();
-		curContact.beginMessages();
-
-		// init data for chat detection
-		DWORD lastAddedTime = 0;
-		DWORD chatStartTime = 0;
-		bool bChatOutgoing = false;
-		Message curMsg(m_Settings.m_FilterRawRTF && RTFFilter::available(), m_Settings.m_FilterBBCodes);
-
-		// iterate through all events
-		while (hisContact.hasNext()) {
-			const DBEVENTINFO& dbei = hisContact.getNext();
-
-			bool bOutgoing = bool_(dbei.flags & DBEF_SENT);
-
-			// only messages, no URLs, files or anything else
-			// filter logged status messages from tabSRMM
-			if (dbei.eventType == etMessage) {
-				// convert to local time (everything in this plugin is done in local time)
-				DWORD localTimestamp = TimeZone_ToLocal(dbei.timestamp);
+		addContact(hisContact.getNick(), hisContact.getProtocol(), hisContact.getGroup(), hisContact.getSources().size());
+	}
 
-				if (localTimestamp >= m_TimeMin && localTimestamp <= m_TimeMax) {
-					if (dbei.flags & DBEF_UTF) {
-						char* pUTF8Text = reinterpret_cast<char*>(dbei.pBlob);
-						int nUTF8Len = utils::getUTF8Len(pUTF8Text);
+	if (nContacts > 0) {
+		m_hReadDoneEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		if (m_hReadDoneEvent == nullptr)
+			return false;
 
-						curMsg.assignTextFromUTF8(pUTF8Text, nUTF8Len);
-					}
-					else {
-						char* pAnsiText = reinterpret_cast<char*>(dbei.pBlob);
-						int nAnsiLenP1 = ext::a::strfunc::len(pAnsiText) + 1;
-
-						WCHAR* pWideText = reinterpret_cast<WCHAR*>(pAnsiText + nAnsiLenP1);
-						int nWideLen = 0;
-						int nWideMaxLen = (dbei.cbBlob - nAnsiLenP1) / sizeof(WCHAR);
-
-						if (dbei.cbBlob >= nAnsiLenP1 * 3) {
-							for (int i = 0; i < nWideMaxLen; ++i) {
-								if (!pWideText[i]) {
-									nWideLen = i;
-									break;
-								}
-							}
-						}
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
 
-						if (nWideLen > 0 && nWideLen < nAnsiLenP1)
-							curMsg.assignText(pWideText, nWideLen);
-						else
-							curMsg.assignText(pAnsiText, nAnsiLenP1 - 1);
-					}
+		int nThreads = min(min((int)si.dwNumberOfProcessors, MaxReadThreads), nContacts);
+		if (nThreads < 1)
+			nThreads = 1;
 
-					curMsg.assignInfo(bOutgoing, localTimestamp);
+		m_pReadHistory = &history;
+		m_nReadNext = 0;
+		m_nReadLast = 0;
+		m_nReadDone = 0;
+		m_nReadThreads = nThreads;
 
-					// handle messages
-					handleAddMessage(curContact, curMsg);
+		upto_each_(i, nThreads)
+		{
+			if (mir_forkThread<Statistic>(threadProcReadDB, this) == nullptr)
+				if (InterlockedDecrement(&m_nReadThreads) == 0)
+					SetEvent(m_hReadDoneEvent);
+		}
 
-					// handle chats
-					if (localTimestamp - lastAddedTime >= (DWORD)m_Settings.m_ChatSessionTimeout || lastAddedTime == 0) {
-						// new chat started
-						if (chatStartTime != 0)
-							handleAddChat(curContact, bChatOutgoing, chatStartTime, lastAddedTime - chatStartTime);
+		// aggregate the progress of all readers until they are done
+		int nShown = 0;
+		int nShownLast = -1;
+		bool bDone = false;
 
-						chatStartTime = localTimestamp;
-						bChatOutgoing = bOutgoing;
-					}
+		while (!bDone) {
+			bDone = (WaitForSingleObject(m_hReadDoneEvent, 100) != WAIT_TIMEOUT);
 
-					lastAddedTime = localTimestamp;
-				}
+			int nLast = m_nReadLast;
+			if (nLast != nShownLast) {
+				setProgressLabel(true, m_Contacts[nLast]->getNick());
+				nShownLast = nLast;
 			}
 
-			// non-message events
-			if (dbei.eventType != etMessage)
-				curContact.addEvent(dbei.eventType, bOutgoing);
-
-			hisContact.readNext();
+			int nDone = m_nReadDone;
+			if (nDone > nShown) {
+				stepProgress(true, nDone - nShown);
+				nShown = nDone;
+			}
 		}
 
-		// post processing for chat detection
-		if (chatStartTime != 0)
-			handleAddChat(curContact, bChatOutgoing, chatStartTime, lastAddedTime - chatStartTime);
-
-		// signal end of history for this contact
-		curContact.endMessages();
-		hisContact.endRead();
-
-		stepProgress(true);
+		CloseHandle(m_hReadDoneEvent);
+		m_hReadDoneEvent = nullptr;
+		m_pReadHistory = nullptr;
 
-		if (shouldTerminate())
+		if (m_nReadDone < nContacts)
 			return false;
 	}
 
@@ -1186,7 +1259,13 @@ Statistic::Statistic(const Settings& settings, InvocationSource invokedFrom, HIN
 	m_TimeMax(0xFFFFFFFF),
 	m_bHistoryTimeAvailable(false),
 	m_nFirstTime(0),
-	m_nLastTime(0)
+	m_nLastTime(0),
+	m_pReadHistory(nullptr),
+	m_hReadDoneEvent(nullptr),
+	m_nReadNext(0),
+	m_nReadLast(0),
+	m_nReadDone(0),
+	m_nReadThreads(0)
 {
 	m_TimeStarted = TimeZone_ToLocal(time(0));
 	m_MSecStarted = GetTickCount();
@@ -1195,8 +1274,8 @@ Statistic::Statistic(const Settings& settings, InvocationSource invokedFrom, HIN
 
 bool Statistic::createStatistics()
 {
-	// Prepare event for cancel.
-	m_hCancelEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	// Prepare event for cancel (manual reset, as it's polled by all reader threads).
+	m_hCancelEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
 	if (m_hCancelEvent == nullptr)
 		return false;
 
@@ -1332,6 +1411,18 @@ void __cdecl Statistic::threadProcSteps(Statistic *pStats)
 	pStats->createStatisticsSteps();
 }
 
+void __cdecl Statistic::threadProcReadDB(Statistic *pStats)
+{
+	Thread_SetName("HistoryStats: Statistic::threadProcReadDB");
+	if (pStats->m_Settings.m_ThreadLowPriority)
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+	pStats->readHistories();
+
+	if (InterlockedDecrement(&pStats->m_nReadThreads) == 0)
+		SetEvent(pStats->m_hReadDoneEvent);
+}
+
 INT_PTR CALLBACK Statistic::staticConflictProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
 	if (uMsg == WM_INITDIALOG) {
@@ -13,6 +13,8 @@
 #include "message.h"
 
 class Contact; // forward declaration instead of #include "contact.h"
+class MirandaContact; // forward declaration instead of #include "mirandacontact.h"
+class MirandaHistory; // forward declaration instead of #include "mirandahistory.h"
 
 class Statistic
 	: private pattern::NotCopyable<Statistic>
@@ -63,6 +65,9 @@ public:
 private:
 	static bool m_bRunning;
 
+	// maximum number of threads reading histories in parallel
+	static const int MaxReadThreads = 8;
+
 private:
 	// settings and the like
 	Settings m_Settings;
@@ -122,6 +127,14 @@ private:
 	// misc data
 	DWORD m_AverageMinTime;
 
+	// parallel reading of histories (only valid during 'read db'-step)
+	MirandaHistory* m_pReadHistory;
+	HANDLE m_hReadDoneEvent;
+	volatile LONG m_nReadNext;    // next contact to be picked up by a reader
+	volatile LONG m_nReadLast;    // contact most recently picked up (for progress label)
+	volatile LONG m_nReadDone;    // contacts completely read
+	volatile LONG m_nReadThreads; // readers still running
+
 private:
 	// contact handling
 	void prepareColumns();
@@ -136,6 +149,8 @@ private:
 	bool shouldTerminate() { return (WaitForSingleObject(m_hCancelEvent, 0) == WAIT_OBJECT_0) || bool_(Miranda_IsTerminated()); }
 	void handleAddMessage(Contact& contact, Message& msg);
 	void handleAddChat(Contact& contact, bool bOutgoing, DWORD localTimestampStarted, DWORD duration);
+	void readContactHistory(MirandaContact& hisContact, Contact& curContact, Message& curMsg);
+	void readHistories();
 
 	// progress dialog handling
 	static INT_PTR CALLBACK staticProgressProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -162,6 +177,7 @@ private:
 	void createStatisticsSteps();
 	static void __cdecl threadProc(Statistic *pStats);
 	static void __cdecl threadProcSteps(Statistic *pStats);
+	static void __cdecl threadProcReadDB(Statistic *pStats);
 
 public:
 	~Statistic();
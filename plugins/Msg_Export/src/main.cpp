@@ -83,6 +83,7 @@ static INT_PTR ShowExportHistory(WPARAM wParam, LPARAM /*lParam*/)
 int nSystemShutdown(WPARAM /*wparam*/, LPARAM /*lparam*/)
 {
 	WindowList_Broadcast(hInternalWindowList, WM_CLOSE, 0, 0);
+	UninitExportFiles();
 	return 0;
 }
 
@@ -104,10 +105,12 @@ int MainInit(WPARAM /*wparam*/, LPARAM /*lparam*/)
 {
 	bReadMirandaDirAndPath();
 	UpdateFileToColWidth();
+	InitExportFiles();
 
 	HookEvent(ME_DB_EVENT_ADDED, nExportEvent);
 	HookEvent(ME_DB_EVENT_EDITED, nExportEvent);
 	HookEvent(ME_DB_CONTACT_DELETED, nContactDeleted);
+	HookEvent(ME_DB_CONTACT_SETTINGCHANGED, nSettingChanged);
 	HookEvent(ME_OPT_INITIALISE, OptionsInitialize);
 
 	if (!g_bReplaceHistory) {
@@ -190,5 +193,6 @@ int CMPlugin::Unload()
 {
 	WindowList_Destroy(hInternalWindowList);
 	bUseInternalViewer(false);
+	ResetExportFiles();
 	return 0;
 }
@@ -134,8 +134,8 @@ void __cdecl exportContactsMessages(ExportDialogData *data)
 	SendMessage(hProg, PBM_SETRANGE, 0, MAKELPARAM(0, data->contacts.size() - 1));
 	SetWindowText(hStatus, TranslateT("Reading database information (Phase 1 of 2)"));
 
-	// map with list to stored all DB history before it is exported 
-	map<wstring, list< CLDBEvent >, less<wstring> > AllEvents;
+	// map with the contacts written to each file
+	map<wstring, list<MCONTACT>, less<wstring> > AllFiles;
 	{
 		// reading from the database !!! 
 		int nCur = 0;
@@ -144,13 +144,7 @@ void __cdecl exportContactsMessages(ExportDialogData *data)
 			if (!bIsExportEnabled(hContact))
 				continue;
 
-			list<CLDBEvent> &rclCurList = AllEvents[GetFilePathFromUser(hContact)];
-
-			MEVENT hDbEvent = db_event_first(hContact);
-			while (hDbEvent) {
-				rclCurList.push_back(CLDBEvent(hContact, hDbEvent));
-				hDbEvent = db_event_next(hContact, hDbEvent);
-			}
+			AllFiles[GetFilePathFromUser(hContact)].push_back(hContact);
 
 			SendMessage(hProg, PBM_SETPOS, nCur, 0);
 			RedrawWindow(hDlg, nullptr, nullptr, RDW_ALLCHILDREN | RDW_UPDATENOW);
@@ -164,39 +158,41 @@ void __cdecl exportContactsMessages(ExportDialogData *data)
 
 	// window text update 
 	SetWindowText(hStatus, TranslateT("Sorting and writing database information (Phase 2 of 2)"));
-	SendMessage(hProg, PBM_SETRANGE, 0, MAKELPARAM(0, AllEvents.size() - 1));
+	SendMessage(hProg, PBM_SETRANGE, 0, MAKELPARAM(0, AllFiles.size() - 1));
 	SendMessage(hProg, PBM_SETPOS, 0, 0);
 
 	// time to write to files !!!
 	int nCur = 0;
-	for (auto &F : AllEvents) {
-		F.second.sort(); // Sort is preformed here !!
-		// events with same time will not be swaped, they will 
-		// remain in there original order
-
-		// Open/create file for writing
-		wstring sFilePath = F.first;
-		HANDLE hFile = openCreateFile(sFilePath);
-		if (hFile == INVALID_HANDLE_VALUE) {
-			DisplayErrorDialog(LPGENW("Failed to open or create file:\n"), sFilePath, nullptr);
-			continue;
+	for (auto &F : AllFiles) {
+		const wstring &sFilePath = F.first;
+
+		// the output is buffered, only full buffers are written to the file
+		if (F.second.size() == 1) {
+			// one contact per file: the history is already in order, stream it in one pass
+			MCONTACT hContact = F.second.front();
+			for (MEVENT hDbEvent = db_event_first(hContact); hDbEvent; hDbEvent = db_event_next(hContact, hDbEvent))
+				if (!bExportEvent(hContact, hDbEvent, sFilePath, false))
+					break; // serious error, we should close the file and don't continue with it
 		}
-
-		// At first write we need to have this false (to write file header, etc.), for each next write to same file use true
-		bool bAppendOnly = false;
-
-		for (auto &E : F.second) {
-			MEVENT hDbEvent = E.hDbEvent;
-			MCONTACT hContact = E.hUser;
-			if (!bExportEvent(hContact, hDbEvent, hFile, sFilePath, bAppendOnly))
-				break; // serious error, we should close the file and don't continue with it
-
-			// Set this flag, because we're appending to same file now
-			bAppendOnly = true;
+		else {
+			// many contacts share this file, their events need to be merged by time
+			list<CLDBEvent> rclCurList;
+			for (auto &hContact : F.second)
+				for (MEVENT hDbEvent = db_event_first(hContact); hDbEvent; hDbEvent = db_event_next(hContact, hDbEvent))
+					rclCurList.push_back(CLDBEvent(hContact, hDbEvent));
+
+			rclCurList.sort(); // Sort is preformed here !!
+			// events with same time will not be swaped, they will 
+			// remain in there original order
+
+			for (auto &E : rclCurList)
+				if (!bExportEvent(E.hUser, E.hDbEvent, sFilePath, false))
+					break; // serious error, we should close the file and don't continue with it
 		}
 
-		// Close the file
-		CloseHandle(hFile);
+		// Close the file, that also writes the rest of the buffer
+		CloseExportFile(sFilePath);
+		UpdateFileViews(sFilePath.c_str());
 
 		SendMessage(hProg, PBM_SETPOS, ++nCur, 0);
 		RedrawWindow(hDlg, nullptr, nullptr, RDW_ALLCHILDREN | RDW_UPDATENOW);
@@ -331,6 +327,9 @@ public:
 
 		g_bUseLessAndGreaterInExport = IsDlgButtonChecked(m_hwnd, IDC_USE_LESS_AND_GREATER_IN_EXPORT) == BST_CHECKED;
 		g_plugin.setByte("UseLessAndGreaterInExport", g_bUseLessAndGreaterInExport);
+
+		// file names and formats may have changed
+		ResetExportFiles();
 		return true;
 	}
 
@@ -71,6 +71,132 @@ bool bIsUtf8Header(BYTE * pucByteOrder)
 	return memcmp(pucByteOrder, szUtf8ByteOrderHeader, 3) == 0;
 }
 
+/////////////////////////////////////////////////////////////////////
+// Export files are kept open between events and closed after they
+// were idle for a while. The output of one event is collected in memory
+// and written with a single WriteFile call. Other programs may edit, move
+// or delete an open file, so a text file is checked before it's written
+// again and reopened if it was changed by someone else
+
+#define EXPORT_FILE_BUFFER   65536
+#define EXPORT_FILE_IDLE     30000 // close files not used for 30 seconds
+
+struct CExportFile
+{
+	wstring sPath;       // must be the first member, used as a search key
+	HANDLE  hFile;
+	CMStringA buf;       // output not yet written to the file
+	DWORD   dwLastUse;
+	bool    bHeaderDone; // file header was written or checked already
+	bool    bUtf8;       // file contains UTF8 text
+
+	DWORD   dwVolume, dwIndexLow, dwIndexHigh; // identify the file opened
+	LONGLONG llSize;     // file size after our last write
+
+	CExportFile(const wstring &_path, HANDLE _file) :
+		sPath(_path),
+		hFile(_file),
+		dwLastUse(GetTickCount()),
+		bHeaderDone(false),
+		bUtf8(false)
+	{
+		BY_HANDLE_FILE_INFORMATION fi = {};
+		GetFileInformationByHandle(hFile, &fi);
+		dwVolume = fi.dwVolumeSerialNumber;
+		dwIndexLow = fi.nFileIndexLow;
+		dwIndexHigh = fi.nFileIndexHigh;
+		llSize = (LONGLONG(fi.nFileSizeHigh) << 32) | fi.nFileSizeLow;
+	}
+
+	~CExportFile()
+	{
+		Flush();
+		CloseHandle(hFile);
+	}
+
+	bool Write(const char *pszSrc, int nLen)
+	{
+		buf.Append(pszSrc, nLen);
+		return (buf.GetLength() < EXPORT_FILE_BUFFER) ? true : Flush();
+	}
+
+	bool Flush()
+	{
+		if (buf.IsEmpty())
+			return true;
+
+		// text is always appended, even if another program has appended something meanwhile
+		LARGE_INTEGER liZero = {}, liPos;
+		if (!g_bUseJson && !SetFilePointerEx(hFile, liZero, nullptr, FILE_END)) {
+			buf.Empty();
+			return false;
+		}
+
+		DWORD dwBytesWritten;
+		bool bOk = WriteFile(hFile, buf, buf.GetLength(), &dwBytesWritten, nullptr) && (dwBytesWritten == (DWORD)buf.GetLength());
+		buf.Empty();
+
+		if (SetFilePointerEx(hFile, liZero, &liPos, FILE_CURRENT))
+			llSize = liPos.QuadPart;
+		return bOk;
+	}
+
+	// returns false if the path leads to another file now, or if the file was
+	// truncated or extended by someone else since our last write
+	bool IsUnchanged() const
+	{
+		HANDLE h = CreateFile(sPath.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE)
+			return false;
+
+		BY_HANDLE_FILE_INFORMATION fi;
+		bool bOk = GetFileInformationByHandle(h, &fi) != 0;
+		CloseHandle(h);
+		if (!bOk || fi.dwVolumeSerialNumber != dwVolume || fi.nFileIndexLow != dwIndexLow || fi.nFileIndexHigh != dwIndexHigh)
+			return false;
+
+		return ((LONGLONG(fi.nFileSizeHigh) << 32) | fi.nFileSizeLow) == llSize;
+	}
+
+	// steps back over the last nBytes written, used to reopen the json array
+	bool Rewind(int nBytes)
+	{
+		if (buf.GetLength() >= nBytes) {
+			buf.Truncate(buf.GetLength() - nBytes);
+			return true;
+		}
+
+		if (!Flush())
+			return false;
+		return SetFilePointer(hFile, -nBytes, nullptr, FILE_CURRENT) != INVALID_SET_FILE_POINTER;
+	}
+};
+
+static int CompareExportFiles(const CExportFile *p1, const CExportFile *p2)
+{
+	return p1->sPath.compare(p2->sPath);
+}
+
+static OBJLIST<CExportFile> arExportFiles(10, CompareExportFiles);
+static mir_cs csExportFiles;
+
+static UINT_PTR idleTimerId;
+
+/////////////////////////////////////////////////////////////////////
+// Resolved file names are cached per contact, the cache entry is
+// dropped when a setting used in the file name template changes
+
+struct CFilePathCache
+{
+	MCONTACT hContact;   // must be the first member, used as a search key
+	wstring  sNoDBPath;  // template with the contact defines replaced
+	wstring  sFilePath;  // final path, if no time variables are used
+	bool     bTimeUsed;
+};
+
+static OBJLIST<CFilePathCache> arFilePaths(50, NumericKeySortT);
+static mir_cs csFilePaths;
+
 /////////////////////////////////////////////////////////////////////
 // Member Function : nGetFormatCount
 // Type            : Global
@@ -188,30 +314,29 @@ void LogLastError(const wchar_t *pszError)
 /////////////////////////////////////////////////////////////////////
 // Member Function : bWriteToFile
 // Type            : Global
-// Parameters      : hFile  - ?
+// Parameters      : file   - ?
 //                   pszSrc - in UTF8 or ANSII
 //                   nLen   - ?
 // Returns         : Returns true if all the data was written to the file
 
-static bool bWriteToFile(HANDLE hFile, const char *pszSrc, int nLen = -1)
+static bool bWriteToFile(CExportFile &file, const char *pszSrc, int nLen = -1)
 {
 	if (nLen < 0)
 		nLen = (int)mir_strlen(pszSrc);
 
-	DWORD dwBytesWritten;
-	return WriteFile(hFile, pszSrc, nLen, &dwBytesWritten, nullptr) && (dwBytesWritten == (DWORD)nLen);
+	return file.Write(pszSrc, nLen);
 }
 
 
 /////////////////////////////////////////////////////////////////////
 // Member Function : bWriteTextToFile
 // Type            : Global
-// Parameters      : hFile     - ?
+// Parameters      : file      - ?
 //                   pszSrc    - ?
 //                   bUtf8File - ?
 // Returns         : Returns true if 
 
-static bool bWriteTextToFile(HANDLE hFile, const wchar_t *pszSrc, bool bUtf8File, int nLen = -1)
+static bool bWriteTextToFile(CExportFile &file, const wchar_t *pszSrc, bool bUtf8File, int nLen = -1)
 {
 	if (nLen != -1) {
 		wchar_t *tmp = (wchar_t*)alloca(sizeof(wchar_t)*(nLen + 1));
@@ -222,17 +347,17 @@ static bool bWriteTextToFile(HANDLE hFile, const wchar_t *pszSrc, bool bUtf8File
 	if (!bUtf8File) {
 		// We need to downgrade text to ansi
 		ptrA pszAstr(mir_u2a(pszSrc));
-		return bWriteToFile(hFile, pszAstr, -1);
+		return bWriteToFile(file, pszAstr, -1);
 	}
 
-	return bWriteToFile(hFile, T2Utf(pszSrc), -1);
+	return bWriteToFile(file, T2Utf(pszSrc), -1);
 }
 
 
-static bool bWriteTextToFile(HANDLE hFile, const char *pszSrc, bool bUtf8File, int nLen = -1)
+static bool bWriteTextToFile(CExportFile &file, const char *pszSrc, bool bUtf8File, int nLen = -1)
 {
 	if (!bUtf8File)
-		return bWriteToFile(hFile, pszSrc, nLen);
+		return bWriteToFile(file, pszSrc, nLen);
 
 	if (nLen != -1) {
 		char *tmp = (char*)alloca(nLen + 1);
@@ -240,39 +365,39 @@ static bool bWriteTextToFile(HANDLE hFile, const char *pszSrc, bool bUtf8File, i
 		pszSrc = tmp;
 	}
 
-	return bWriteToFile(hFile, ptrA(mir_utf8encode(pszSrc)), -1);
+	return bWriteToFile(file, ptrA(mir_utf8encode(pszSrc)), -1);
 }
 
 /////////////////////////////////////////////////////////////////////
 // Member Function : bWriteNewLine
 // Type            : Global
-// Parameters      : hFile   - ?
+// Parameters      : file    - ?
 //                   nIndent - ?
 // Returns         : Returns true if all the data was written to the file
 
 const char szNewLineIndent[] = "\r\n                                                                                                   ";
-bool bWriteNewLine(HANDLE hFile, DWORD dwIndent)
+bool bWriteNewLine(CExportFile &file, DWORD dwIndent)
 {
 	if (dwIndent > sizeof(szNewLineIndent) - 2)
 		dwIndent = sizeof(szNewLineIndent) - 2;
 	
-	return bWriteToFile(hFile, szNewLineIndent, dwIndent + 2);
+	return bWriteToFile(file, szNewLineIndent, dwIndent + 2);
 }
 
 /////////////////////////////////////////////////////////////////////
 // Member Function : bWriteHexToFile
 // Type            : Global
-// Parameters      : hFile - ?
+// Parameters      : file  - ?
 //                         - ?
 //                   nSize - ?
 
-bool bWriteHexToFile(HANDLE hFile, void * pData, int nSize)
+bool bWriteHexToFile(CExportFile &file, void * pData, int nSize)
 {
 	char cBuf[10];
 	BYTE *p = (BYTE*)pData;
 	for (int n = 0; n < nSize; n++) {
 		mir_snprintf(cBuf, "%.2X ", p[n]);
-		if (!bWriteToFile(hFile, cBuf, 3))
+		if (!bWriteToFile(file, cBuf, 3))
 			return false;
 	}
 	return true;
@@ -328,6 +453,21 @@ void ReplaceDBPath(wstring &sRet)
 
 wstring GetFilePathFromUser(MCONTACT hContact)
 {
+	// fast path: the template was already expanded for this contact
+	{
+		mir_cslock lck(csFilePaths);
+		CFilePathCache *p = arFilePaths.find((CFilePathCache*)&hContact);
+		if (p != nullptr) {
+			if (!p->bTimeUsed)
+				return p->sFilePath;
+
+			wstring sFilePath = p->sNoDBPath;
+			ReplaceTimeVariables(sFilePath);
+			ReplaceDBPath(sFilePath);
+			return sFilePath;
+		}
+	}
+
 	wstring sFilePath = g_sExportDir + _DBGetStringW(hContact, MODULENAME, "FileName", g_sDefaultFile.c_str());
 
 	bool bNickUsed = sFilePath.find(L"%nick%") != string::npos;
@@ -375,6 +515,9 @@ wstring GetFilePathFromUser(MCONTACT hContact)
 					else bTryRename = true;
 
 					if (bTryRename) {
+						// the old file can't be moved while we keep it open
+						CloseExportFile(sPrevFileName);
+
 						if (!MoveFile(sPrevFileName.c_str(), sFilePath.c_str())) {
 							// this might be because the new path isn't created 
 							// so we will try to create it 
@@ -400,9 +543,54 @@ wstring GetFilePathFromUser(MCONTACT hContact)
 		db_set_ws(hContact, MODULENAME, "PrevFileName", sNoDBPath.c_str());
 	}
 
+	CFilePathCache *p = new CFilePathCache();
+	p->hContact = hContact;
+	p->sNoDBPath = sNoDBPath;
+	p->sFilePath = sFilePath;
+	p->bTimeUsed = sNoDBPath.find(L"%year%") != string::npos || sNoDBPath.find(L"%month%") != string::npos || sNoDBPath.find(L"%day%") != string::npos;
+
+	mir_cslock lck(csFilePaths);
+	arFilePaths.remove((CFilePathCache*)&hContact);
+	arFilePaths.insert(p);
 	return sFilePath;
 }
 
+/////////////////////////////////////////////////////////////////////
+// Member Function : nSettingChanged
+// Type            : Global
+// Parameters      : wparam - handle to contact
+//                   lparam - DBCONTACTWRITESETTING*
+// Returns         : int
+// Description     : Drops the cached file name when a setting used
+//                   by the file name template changes
+
+static const char *pszPathSettings[] = { "Nick", "FirstName", "LastName", "UIN", "e-mail", "jid" };
+
+int nSettingChanged(WPARAM hContact, LPARAM lParam)
+{
+	DBCONTACTWRITESETTING *cws = (DBCONTACTWRITESETTING*)lParam;
+
+	bool bDrop;
+	if (!mir_strcmp(cws->szModule, MODULENAME))
+		bDrop = !mir_strcmp(cws->szSetting, "FileName");
+	else if (!mir_strcmp(cws->szModule, "CList") || !mir_strcmp(cws->szModule, "Protocol"))
+		bDrop = true;
+	else {
+		bDrop = false;
+		for (auto &it : pszPathSettings)
+			if (!mir_strcmp(cws->szSetting, it)) {
+				bDrop = true;
+				break;
+			}
+	}
+
+	if (bDrop) {
+		mir_cslock lck(csFilePaths);
+		arFilePaths.remove((CFilePathCache*)&hContact);
+	}
+	return 0;
+}
+
 /////////////////////////////////////////////////////////////////////
 // Member Function : FileNickFromHandle
 // Type            : Global
@@ -570,7 +758,7 @@ void UpdateFileToColWidth()
 //                   sFile    - ?
 //                   dbei     - ?
 
-void DisplayErrorDialog(const wchar_t *pszError, wstring &sFilePath, DBEVENTINFO *dbei)
+void DisplayErrorDialog(const wchar_t *pszError, const wstring &sFilePath, DBEVENTINFO *dbei)
 {
 	wstring sError = TranslateW(pszError);
 	sError += sFilePath;
@@ -604,21 +792,21 @@ void DisplayErrorDialog(const wchar_t *pszError, wstring &sFilePath, DBEVENTINFO
 				CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
 				(HANDLE)nullptr); // file handle
 
-			bWriteTextToFile(hf, sError.c_str(), false);
+			CExportFile file(ofn.lpstrFile, hf); // closes the file when done
+			bWriteTextToFile(file, sError.c_str(), false);
 			if (dbei) {
-				bWriteToFile(hf, "\r\ndbei          :");
+				bWriteToFile(file, "\r\ndbei          :");
 
-				bWriteHexToFile(hf, dbei, sizeof(DBEVENTINFO));
+				bWriteHexToFile(file, dbei, sizeof(DBEVENTINFO));
 				if (dbei->pBlob) {
-					bWriteToFile(hf, "\r\ndbei.pBlob    :");
-					bWriteHexToFile(hf, dbei->pBlob, min(dbei->cbBlob, 10000));
+					bWriteToFile(file, "\r\ndbei.pBlob    :");
+					bWriteHexToFile(file, dbei->pBlob, min(dbei->cbBlob, 10000));
 				}
 				if (dbei->szModule) {
-					bWriteToFile(hf, "\r\ndbei.szModule :");
-					bWriteToFile(hf, dbei->szModule);
+					bWriteToFile(file, "\r\ndbei.szModule :");
+					bWriteToFile(file, dbei->szModule);
 				}
 			}
-			CloseHandle(hf);
 		}
 	}
 }
@@ -627,8 +815,7 @@ void DisplayErrorDialog(const wchar_t *pszError, wstring &sFilePath, DBEVENTINFO
 // Member Function : ExportDBEventInfo
 // Type            : Global
 // Parameters      : hContact  - handle to contact
-//                   hFile     - handle to file
-//                   sFilePath - path to file
+//                   file      - export file
 //                   dbei      - Event to export
 // Returns         : false on serious error, when file should be closed to not lost/overwrite any data
 
@@ -647,7 +834,7 @@ const char *pSettings[] =
 	LPGEN("About")
 };
 
-static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath, DBEVENTINFO &dbei, bool bAppendOnly)
+static bool ExportDBEventInfo(MCONTACT hContact, CExportFile &file, DBEVENTINFO &dbei)
 {
 	wstring sLocalUser;
 	wstring sRemoteUser;
@@ -661,7 +848,7 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 	else {
 		sLocalUser = ptrW(GetMyOwnNick(hContact));
 		sRemoteUser = Clist_GetContactDisplayName(hContact);
-		nFirstColumnWidth = max(sRemoteUser.size(), clFileTo1ColWidth[sFilePath]);
+		nFirstColumnWidth = max(sRemoteUser.size(), clFileTo1ColWidth[file.sPath]);
 		nFirstColumnWidth = max(sLocalUser.size(), nFirstColumnWidth);
 		nFirstColumnWidth += 2;
 	}
@@ -675,29 +862,31 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 		return false;
 	}
 
-	if (bAppendOnly) {
-		bWriteUTF8Format = g_bUseUtf8InNewFiles;
+	if (file.bHeaderDone) {
+		// the file is already open, just continue where the previous event ended
+		bWriteUTF8Format = file.bUtf8;
 
 		if (g_bUseJson) {
-			SetFilePointer(hFile, -3, nullptr, FILE_END);
-			bWriteToFile(hFile, ",", 1);
+			if (!file.Rewind(3))
+				return false;
+			bWriteToFile(file, ",", 1);
 		}
 	}
 	else {
 		DWORD dwHighSize = 0;
-		DWORD dwLowSize = GetFileSize(hFile, &dwHighSize);
+		DWORD dwLowSize = GetFileSize(file.hFile, &dwHighSize);
 		if (dwLowSize == INVALID_FILE_SIZE || dwLowSize != 0 || dwHighSize != 0) {
 			DWORD dwDataRead = 0;
 			BYTE ucByteOrder[3];
-			if (ReadFile(hFile, ucByteOrder, 3, &dwDataRead, nullptr))
+			if (ReadFile(file.hFile, ucByteOrder, 3, &dwDataRead, nullptr))
 				bWriteUTF8Format = bIsUtf8Header(ucByteOrder);
 
-			DWORD dwPtr = SetFilePointer(hFile, g_bUseJson ? -3 : 0, nullptr, FILE_END);
+			DWORD dwPtr = SetFilePointer(file.hFile, g_bUseJson ? -3 : 0, nullptr, FILE_END);
 			if (dwPtr == INVALID_SET_FILE_POINTER)
 				return false;
 
 			if (g_bUseJson)
-				bWriteToFile(hFile, ",", 1);		
+				bWriteToFile(file, ",", 1);		
 		}
 		else {
 			if (g_bUseJson) {
@@ -731,15 +920,15 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 				pRoot.push_back(pHist);
 
 				std::string output = pRoot.write_formatted();
-				if (!bWriteTextToFile(hFile, output.c_str(), false, (int)output.size()))
+				if (!bWriteTextToFile(file, output.c_str(), false, (int)output.size()))
 					return false;
 
-				SetFilePointer(hFile, -3, nullptr, FILE_CURRENT);
+				file.Rewind(3);
 			}
 			else {
 				bWriteUTF8Format = g_bUseUtf8InNewFiles;
 				if (bWriteUTF8Format)
-					if (!bWriteToFile(hFile, szUtf8ByteOrderHeader, sizeof(szUtf8ByteOrderHeader) - 1))
+					if (!bWriteToFile(file, szUtf8ByteOrderHeader, sizeof(szUtf8ByteOrderHeader) - 1))
 						return false;
 
 				CMStringW output = L"------------------------------------------------\r\n";
@@ -774,10 +963,13 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 
 				output += L"------------------------------------------------\r\n";
 
-				if (!bWriteTextToFile(hFile, output, bWriteUTF8Format, output.GetLength()))
+				if (!bWriteTextToFile(file, output, bWriteUTF8Format, output.GetLength()))
 					return false;
 			}
 		}
+
+		file.bHeaderDone = true;
+		file.bUtf8 = bWriteUTF8Format;
 	}
 
 	if (g_bUseJson) {
@@ -803,7 +995,7 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 		std::string output = pRoot.write_formatted();
 		output += "\n]}";
 
-		if (!bWriteTextToFile(hFile, output.c_str(), false, (int)output.size()))
+		if (!bWriteTextToFile(file, output.c_str(), false, (int)output.size()))
 			return false;
 
 		return true;
@@ -818,7 +1010,7 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 	szTemp[nIndent++] = ' ';
 
 	// Write first part of line with name and timestamp
-	if (!bWriteTextToFile(hFile, szTemp, bWriteUTF8Format, nIndent))
+	if (!bWriteTextToFile(file, szTemp, bWriteUTF8Format, nIndent))
 		return false;
 
 	if (dbei.pBlob != nullptr && dbei.cbBlob >= 2) {
@@ -826,7 +1018,7 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 
 		switch (dbei.eventType) {
 		case EVENTTYPE_MESSAGE:
-			bWriteIndentedToFile(hFile, nIndent, ptrW(DbEvent_GetTextW(&dbei, CP_ACP)), bWriteUTF8Format);
+			bWriteIndentedToFile(file, nIndent, ptrW(DbEvent_GetTextW(&dbei, CP_ACP)), bWriteUTF8Format);
 			break;
 
 		case EVENTTYPE_URL:
@@ -846,15 +1038,15 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 
 				int nLen = (int)mir_strlen(pszData);
 				if ((pszData - (char *)dbei.pBlob) + nLen < (int)dbei.cbBlob) {
-					if (bWriteTextToFile(hFile, pszType, bWriteUTF8Format) &&
-						bWriteIndentedToFile(hFile, nIndent, _A2T(pszData), bWriteUTF8Format)) {
+					if (bWriteTextToFile(file, pszType, bWriteUTF8Format) &&
+						bWriteIndentedToFile(file, nIndent, _A2T(pszData), bWriteUTF8Format)) {
 						pszData += nLen + 1;
 						if ((pszData - (char *)dbei.pBlob) < (int)dbei.cbBlob) {
 							nLen = (int)mir_strlen(pszData);
 							if ((pszData - (char *)dbei.pBlob) + nLen < (int)dbei.cbBlob) {
-								if (bWriteNewLine(hFile, nIndent) &&
-									bWriteTextToFile(hFile, LPGENW("Description: "), bWriteUTF8Format) &&
-									bWriteIndentedToFile(hFile, nIndent, _A2T(pszData), bWriteUTF8Format)) {
+								if (bWriteNewLine(file, nIndent) &&
+									bWriteTextToFile(file, LPGENW("Description: "), bWriteUTF8Format) &&
+									bWriteIndentedToFile(file, nIndent, _A2T(pszData), bWriteUTF8Format)) {
 								}
 							}
 						}
@@ -875,7 +1067,7 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 
 				if (dbei.cbBlob < 8 || dbei.cbBlob > 5000) {
 					int n = mir_snwprintf(szTemp, TranslateT("Invalid Database event received. Type %d, size %d"), dbei.eventType, dbei.cbBlob);
-					bWriteTextToFile(hFile, szTemp, bWriteUTF8Format, n);
+					bWriteTextToFile(file, szTemp, bWriteUTF8Format, n);
 					break;
 				}
 
@@ -895,18 +1087,18 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 					pszTitle = LPGENW("The following user added you to their contact list:");
 				}
 
-				if (bWriteTextToFile(hFile, pszTitle, bWriteUTF8Format) &&
-					bWriteNewLine(hFile, nIndent) &&
-					bWriteTextToFile(hFile, LPGENW("UIN       :"), bWriteUTF8Format)) {
+				if (bWriteTextToFile(file, pszTitle, bWriteUTF8Format) &&
+					bWriteNewLine(file, nIndent) &&
+					bWriteTextToFile(file, LPGENW("UIN       :"), bWriteUTF8Format)) {
 					DWORD uin = *((PDWORD)(dbei.pBlob));
 					int n = mir_snwprintf(szTemp, L"%d", uin);
-					if (bWriteTextToFile(hFile, szTemp, bWriteUTF8Format, n)) {
+					if (bWriteTextToFile(file, szTemp, bWriteUTF8Format, n)) {
 						char *pszEnd = (char *)(dbei.pBlob + sizeof(dbei));
 						for (int i = 0; i < nStringCount && pszCurBlobPos < pszEnd; i++) {
 							if (*pszCurBlobPos) {
-								if (!bWriteNewLine(hFile, nIndent) ||
-									!bWriteTextToFile(hFile, TranslateW(pszTypes[i]), bWriteUTF8Format) ||
-									!bWriteIndentedToFile(hFile, nIndent, _A2T(pszCurBlobPos), bWriteUTF8Format)) {
+								if (!bWriteNewLine(file, nIndent) ||
+									!bWriteTextToFile(file, TranslateW(pszTypes[i]), bWriteUTF8Format) ||
+									!bWriteIndentedToFile(file, nIndent, _A2T(pszCurBlobPos), bWriteUTF8Format)) {
 									break;
 								}
 								pszCurBlobPos += mir_strlen(pszCurBlobPos);
@@ -937,48 +1129,47 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 				const char* pszStr = (const char*)dbei.pBlob;
 
 				if (dbei.eventType == ICQEVENTTYPE_EMAILEXPRESS)
-					bWriteTextToFile(hFile, LPGENW("EmailExpress from:"), bWriteUTF8Format);
+					bWriteTextToFile(file, LPGENW("EmailExpress from:"), bWriteUTF8Format);
 				else
-					bWriteTextToFile(hFile, LPGENW("WebPager from:"), bWriteUTF8Format);
+					bWriteTextToFile(file, LPGENW("WebPager from:"), bWriteUTF8Format);
 
-				bWriteNewLine(hFile, nIndent);
+				bWriteNewLine(file, nIndent);
 
 				size_t nMsgLenght = mir_strlen(pszStr) + 1;
 				if (nMsgLenght < dbei.cbBlob) {
 					size_t nFriendlyLen = mir_strlen(&pszStr[nMsgLenght]);
-					bWriteTextToFile(hFile, &pszStr[nMsgLenght], bWriteUTF8Format, (int)nFriendlyLen);
+					bWriteTextToFile(file, &pszStr[nMsgLenght], bWriteUTF8Format, (int)nFriendlyLen);
 					size_t nEmailOffset = nMsgLenght + nFriendlyLen + 1;
 					if (nEmailOffset < dbei.cbBlob) {
-						bWriteTextToFile(hFile, L"<", bWriteUTF8Format);
+						bWriteTextToFile(file, L"<", bWriteUTF8Format);
 						size_t nEmailLen = mir_strlen(&pszStr[nEmailOffset]);
-						bWriteTextToFile(hFile, &pszStr[nEmailOffset], bWriteUTF8Format, (int)nEmailLen);
-						bWriteTextToFile(hFile, L">", bWriteUTF8Format);
+						bWriteTextToFile(file, &pszStr[nEmailOffset], bWriteUTF8Format, (int)nEmailLen);
+						bWriteTextToFile(file, L">", bWriteUTF8Format);
 					}
 				}
-				else bWriteTextToFile(hFile, LPGENW("No from address"), bWriteUTF8Format);
+				else bWriteTextToFile(file, LPGENW("No from address"), bWriteUTF8Format);
 
-				bWriteNewLine(hFile, nIndent);
-				bWriteIndentedToFile(hFile, nIndent, _A2T(pszStr), bWriteUTF8Format);
+				bWriteNewLine(file, nIndent);
+				bWriteIndentedToFile(file, nIndent, _A2T(pszStr), bWriteUTF8Format);
 			}
 			break;
 
 		case ICQEVENTTYPE_SMS:
-			bWriteIndentedToFile(hFile, nIndent, _A2T((const char*)dbei.pBlob), bWriteUTF8Format);
+			bWriteIndentedToFile(file, nIndent, _A2T((const char*)dbei.pBlob), bWriteUTF8Format);
 			break;
 
 		default:
 			int n = mir_snwprintf(szTemp, TranslateT("Unknown event type %d, size %d"), dbei.eventType, dbei.cbBlob);
-			bWriteTextToFile(hFile, szTemp, bWriteUTF8Format, n);
+			bWriteTextToFile(file, szTemp, bWriteUTF8Format, n);
 			break;
 		}
 	}
 	else {
 		int n = mir_snwprintf(szTemp, TranslateT("Unknown event type %d, size %d"), dbei.eventType, dbei.cbBlob);
-		bWriteTextToFile(hFile, szTemp, bWriteUTF8Format, n);
+		bWriteTextToFile(file, szTemp, bWriteUTF8Format, n);
 	}
 
-	bWriteToFile(hFile, g_bAppendNewLine ? "\r\n\r\n" : "\r\n");
-	UpdateFileViews(sFilePath.c_str());
+	bWriteToFile(file, g_bAppendNewLine ? "\r\n\r\n" : "\r\n");
 	return true;
 }
 
@@ -991,24 +1182,89 @@ static bool ExportDBEventInfo(MCONTACT hContact, HANDLE hFile, wstring sFilePath
 // Description     : Called when an event is added to the DB
 //                   Or from the Export All funktion
 
-HANDLE openCreateFile(wstring sFilePath)
+static HANDLE openCreateFile(wstring sFilePath)
 {
 	if (g_bUseJson)
 		sFilePath += L".json";
 
 	SetLastError(0);
 
-	HANDLE hFile = CreateFile(sFilePath.c_str(), GENERIC_WRITE | GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	// the file stays open for a while, so other programs must still be able to edit, move or delete it
+	DWORD dwShareMode = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+	HANDLE hFile = CreateFile(sFilePath.c_str(), GENERIC_WRITE | GENERIC_READ, dwShareMode, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
 	if (hFile == INVALID_HANDLE_VALUE) {
 		// this might be because the path isent created 
 		// so we will try to create it 
 		if (!CreatePathToFileW(sFilePath.c_str()))
-			hFile = CreateFile(sFilePath.c_str(), GENERIC_WRITE | GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			hFile = CreateFile(sFilePath.c_str(), GENERIC_WRITE | GENERIC_READ, dwShareMode, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
 	}
 
 	return hFile;
 }
 
+// must be called inside csExportFiles
+static CExportFile* GetExportFile(const wstring &sFilePath)
+{
+	CExportFile *pFile = arExportFiles.find((CExportFile*)&sFilePath);
+	if (pFile == nullptr) {
+		HANDLE hFile = openCreateFile(sFilePath);
+		if (hFile == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		pFile = new CExportFile(sFilePath, hFile);
+		arExportFiles.insert(pFile);
+	}
+
+	pFile->dwLastUse = GetTickCount();
+	return pFile;
+}
+
+void CloseExportFile(const wstring &sFilePath)
+{
+	mir_cslock lck(csExportFiles);
+
+	CExportFile *pFile = arExportFiles.find((CExportFile*)&sFilePath);
+	if (pFile)
+		arExportFiles.remove(pFile);
+}
+
+static void CALLBACK CloseIdleExportFiles(HWND, UINT, UINT_PTR, DWORD)
+{
+	mir_cslock lck(csExportFiles);
+
+	DWORD dwNow = GetTickCount();
+	for (auto &it : arExportFiles.rev_iter())
+		if (dwNow - it->dwLastUse > EXPORT_FILE_IDLE)
+			arExportFiles.remove(arExportFiles.indexOf(&it));
+}
+
+void InitExportFiles()
+{
+	idleTimerId = SetTimer(nullptr, 0, EXPORT_FILE_IDLE / 3, CloseIdleExportFiles);
+}
+
+void UninitExportFiles()
+{
+	if (idleTimerId) {
+		KillTimer(nullptr, idleTimerId);
+		idleTimerId = 0;
+	}
+
+	ResetExportFiles();
+}
+
+// drops everything derived from the settings: cached file names and open files
+void ResetExportFiles()
+{
+	{
+		mir_cslock lck(csFilePaths);
+		arFilePaths.destroy();
+	}
+
+	mir_cslock lck(csExportFiles);
+	arExportFiles.destroy();
+}
+
 bool bIsExportEnabled(MCONTACT hContact)
 {
 	if (!db_get_b(hContact, MODULENAME, "EnableLog", 1))
@@ -1028,24 +1284,15 @@ int nExportEvent(WPARAM hContact, LPARAM hDbEvent)
 	if (!bIsExportEnabled(hContact))
 		return 0;
 	
-	// Open/create file for writing
+	// Write the event and flush it at once, so that file viewers see it
 	wstring sFilePath = GetFilePathFromUser(hContact);
-	HANDLE hFile = openCreateFile(sFilePath);
-	if (hFile == INVALID_HANDLE_VALUE) {
-		DisplayErrorDialog(LPGENW("Failed to open or create file:\n"), sFilePath, nullptr);
-		return 0;
-	}
-
-	// Write the event
-	bExportEvent((MCONTACT)hContact, (MEVENT)hDbEvent, hFile, sFilePath, false);
-
-	// Close the file
-	CloseHandle(hFile);
+	if (bExportEvent((MCONTACT)hContact, (MEVENT)hDbEvent, sFilePath, true))
+		UpdateFileViews(sFilePath.c_str());
 
 	return 0;
 }
 
-bool bExportEvent(MCONTACT hContact, MEVENT hDbEvent, HANDLE hFile, wstring sFilePath, bool bAppendOnly)
+bool bExportEvent(MCONTACT hContact, MEVENT hDbEvent, const wstring &sFilePath, bool bFlush)
 {
 	DBEVENTINFO dbei = {};
 	int nSize = db_event_getBlobSize(hDbEvent);
@@ -1063,8 +1310,32 @@ bool bExportEvent(MCONTACT hContact, MEVENT hDbEvent, HANDLE hFile, wstring sFil
 		if (db_mc_isMeta(hContact))
 			hContact = db_event_getContact(hDbEvent);
 
-		// Write the event
-		result = ExportDBEventInfo(hContact, hFile, sFilePath, dbei, bAppendOnly);
+		// Open/create file for writing
+		mir_cslockfull lck(csExportFiles);
+		CExportFile *pFile = GetExportFile(sFilePath);
+
+		// a text file changed by someone else is reopened, its header is checked again.
+		// during a full export it's checked whenever the buffered data was flushed
+		if (pFile != nullptr && !g_bUseJson && pFile->bHeaderDone && pFile->buf.IsEmpty() && !pFile->IsUnchanged()) {
+			arExportFiles.remove(pFile);
+			pFile = GetExportFile(sFilePath);
+		}
+
+		if (pFile == nullptr) {
+			lck.unlock();
+			DisplayErrorDialog(LPGENW("Failed to open or create file:\n"), sFilePath, nullptr);
+			result = false;
+		}
+		else {
+			// Write the event
+			result = ExportDBEventInfo(hContact, *pFile, dbei);
+			if (result && bFlush)
+				result = pFile->Flush();
+
+			// serious error, close the file to not lose/overwrite any data
+			if (!result)
+				arExportFiles.remove(pFile);
+		}
 	}
 	if (dbei.pBlob)
 		free(dbei.pBlob);
@@ -1074,12 +1345,12 @@ bool bExportEvent(MCONTACT hContact, MEVENT hDbEvent, HANDLE hFile, wstring sFil
 /////////////////////////////////////////////////////////////////////
 // Member Function : bWriteIndentedToFile
 // Type            : Global
-// Parameters      : hFile   - ?
+// Parameters      : file    - ?
 //                   nIndent - ?
 //                   pszSrc  - 
 // Returns         : Returns true if 
 
-bool bWriteIndentedToFile(HANDLE hFile, int nIndent, const wchar_t *pszSrc, bool bUtf8File)
+bool bWriteIndentedToFile(CExportFile &file, int nIndent, const wchar_t *pszSrc, bool bUtf8File)
 {
 	if (pszSrc == nullptr)
 		return true;
@@ -1123,10 +1394,10 @@ bool bWriteIndentedToFile(HANDLE hFile, int nIndent, const wchar_t *pszSrc, bool
 		// nLineLen should contain the number af chars we need to write to the file 
 		if (nLineLen > 0) {
 			if (!bFirstLine)
-				if (!bWriteNewLine(hFile, nIndent))
+				if (!bWriteNewLine(file, nIndent))
 					bOk = false;
 
-			if (!bWriteTextToFile(hFile, pszSrc, bUtf8File, nLineLen))
+			if (!bWriteTextToFile(file, pszSrc, bUtf8File, nLineLen))
 				bOk = false;
 		}
 		bFirstLine = false;
@@ -1163,10 +1434,18 @@ int nContactDeleted(WPARAM hContact, LPARAM)
 	if (hInternalWindow)
 		CloseWindow(hInternalWindow);
 
-	if (g_enDeleteAction == eDANothing)
+	auto dropCachedPath = [hContact]() {
+		mir_cslock lck(csFilePaths);
+		arFilePaths.remove((CFilePathCache*)&hContact);
+	};
+
+	if (g_enDeleteAction == eDANothing) {
+		dropCachedPath();
 		return 0;
+	}
 
 	wstring sFilePath = GetFilePathFromUser(hContact);
+	dropCachedPath();
 
 	// Test if there is another user using this file
 	for (auto &hOtherContact : Contacts())
@@ -1182,6 +1461,7 @@ int nContactDeleted(WPARAM hContact, LPARAM)
 		mir_snwprintf(szTemp, L"%s\r\n%s", TranslateT("User has been deleted. Do you want to delete the file?"), sFilePath.c_str());
 
 		if (g_enDeleteAction == eDAAutomatic || MessageBox(nullptr, szTemp, MSG_BOX_TITEL, MB_YESNO) == IDYES) {
+			CloseExportFile(sFilePath);
 			if (!DeleteFile(sFilePath.c_str())) {
 				mir_snwprintf(szTemp, L"%s\r\n%s", TranslateT("Failed to delete the file"), sFilePath.c_str());
 				LogLastError(szTemp);
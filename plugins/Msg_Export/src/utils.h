@@ -43,15 +43,22 @@ extern bool g_bUseLessAndGreaterInExport;
 
 extern bool g_bReplaceHistory;
 
+struct CExportFile;
+
 void LogLastError(const wchar_t *pszError);
-void DisplayErrorDialog(const wchar_t *pszError, wstring &sFilePath, DBEVENTINFO *dbei);
+void DisplayErrorDialog(const wchar_t *pszError, const wstring &sFilePath, DBEVENTINFO *dbei);
 
 bool bIsExportEnabled(MCONTACT hContact);
-HANDLE openCreateFile(wstring sFilePath);
-bool bExportEvent(MCONTACT hContact, MEVENT hDbEvent, HANDLE hFile, wstring sFilePath, bool bAppendOnly);
+bool bExportEvent(MCONTACT hContact, MEVENT hDbEvent, const wstring &sFilePath, bool bFlush);
+
+void InitExportFiles();
+void UninitExportFiles();
+void CloseExportFile(const wstring &sFilePath);
+void ResetExportFiles();
 
 int nExportEvent(WPARAM wparam, LPARAM lparam);
 int nContactDeleted(WPARAM wparam, LPARAM lparam);
+int nSettingChanged(WPARAM wparam, LPARAM lparam);
 
 wchar_t* GetMyOwnNick(MCONTACT hContact);
 
@@ -65,8 +72,8 @@ wstring GetFilePathFromUser(MCONTACT hContact);
 void ReplaceDefines(MCONTACT hContact, wstring & sTarget);
 void ReplaceTimeVariables(wstring &sRet);
 
-bool bWriteIndentedToFile(HANDLE hFile, int nIndent, const wchar_t *pszSrc, bool bUtf8File);
-bool bWriteNewLine(HANDLE hFile, DWORD dwIndent);
+bool bWriteIndentedToFile(CExportFile &file, int nIndent, const wchar_t *pszSrc, bool bUtf8File);
+bool bWriteNewLine(CExportFile &file, DWORD dwIndent);
 bool bIsUtf8Header(BYTE * pucByteOrder);
 
 #endif
@@ -1,7 +1,5 @@
 #include "stdafx.h"
 
-void CacheThreadFunc(void *arg);
-
 // Event
 bool HistoryArray::ItemData::load(EventLoadMode mode)
 {
@@ -118,137 +116,186 @@ HistoryArray::ItemData::~ItemData()
 }
 
 // Array
-HistoryArray::HistoryArray()
+HistoryArray::HistoryArray() :
+	cache(CACHE_SIZE, NumericKeySortT)
 {
-	head = tail = 0;
-	caching = false;
-	caching_complete = true;
-	InitializeCriticalSection(&csItems);
+	ids = 0;
+	itemFlags = 0;
+	count = allocated = 0;
+	ranges = 0;
+	rangeCount = 0;
+	useCounter = 0;
 }
 
 HistoryArray::~HistoryArray()
 {
-	DeleteCriticalSection(&csItems);
 	clear();
 }
 
-bool HistoryArray::allocateBlock(int count)
+bool HistoryArray::reserve(int newCount)
 {
-	ItemBlock *newBlock = new ItemBlock;
-	newBlock->items = new ItemData[count];
-	newBlock->count = count;
-	newBlock->prev = tail;
-	newBlock->next = 0;
+	if (newCount <= allocated)
+		return true;
 
-	if (tail)
-	{
-		tail->next = newBlock;
-	} else
-	{
-		head = newBlock;
-	}
-	tail = newBlock;
+	int newSize = max(newCount, allocated * 2);
+	MEVENT *newIds = (MEVENT *)mir_realloc(ids, sizeof(MEVENT) * newSize);
+	if (!newIds)
+		return false;
+	ids = newIds;
+
+	BYTE *newFlags = (BYTE *)mir_realloc(itemFlags, newSize);
+	if (!newFlags)
+		return false;
+	itemFlags = newFlags;
 
+	allocated = newSize;
 	return true;
 }
 
-void HistoryArray::clear()
+void HistoryArray::addRange(MCONTACT hContact)
+{
+	if (rangeCount && (ranges[rangeCount-1].hContact == hContact))
+		return;
+
+	ranges = (ContactRange *)mir_realloc(ranges, sizeof(ContactRange) * (rangeCount+1));
+	ranges[rangeCount].first = count;
+	ranges[rangeCount].hContact = hContact;
+	rangeCount++;
+}
+
+MCONTACT HistoryArray::getContact(int id)
 {
-	while (head)
+	if (!rangeCount)
+		return 0;
+
+	// the last range which starts not after id
+	int lo = 0, hi = rangeCount-1;
+	while (lo < hi)
 	{
-		ItemBlock *next = head->next;
-//		for (int i = 0; i < head->count; ++i)
-//			destroyEvent(head->items[i]);
-		delete [] head->items;
-		head = next;
+		int mid = (lo + hi + 1) / 2;
+		if (ranges[mid].first <= id)
+			lo = mid;
+		else
+			hi = mid - 1;
 	}
+	return ranges[lo].hContact;
+}
+
+void HistoryArray::clear()
+{
+	for (auto &it : cache)
+		delete it;
+	cache.destroy();
+
+	mir_free(ids);
+	mir_free(itemFlags);
+	mir_free(ranges);
 
-	head = tail = 0;
-	preBlock = 0;
-	preIndex = 0;
+	ids = 0;
+	itemFlags = 0;
+	count = allocated = 0;
+	ranges = 0;
+	rangeCount = 0;
 }
 
-bool HistoryArray::addHistory(MCONTACT hContact, EventLoadMode mode)
+bool HistoryArray::addHistory(MCONTACT hContact, EventLoadMode)
 {
-	int count = db_event_count(hContact);
-	allocateBlock(count);
+	// only ids are collected here, events are read when they're shown
+	if (!reserve(count + db_event_count(hContact)))
+		return false;
 
-	int i = 0;
-	MEVENT hEvent = db_event_first(hContact);
-	while (hEvent)
+	addRange(hContact);
+
+	for (MEVENT hEvent = db_event_first(hContact); hEvent; hEvent = db_event_next(hContact, hEvent))
 	{
-		tail->items[i].hContact = hContact;
-		tail->items[i].hEvent = hEvent;
+		if (!reserve(count + 1))
+			return false;
 
-		++i;
-		hEvent = db_event_next(hEvent, 0);
+		ids[count] = hEvent;
+		itemFlags[count] = 0;
+		count++;
 	}
-	char buf[666];
 
 	return true;
 }
 
 bool HistoryArray::addEvent(MCONTACT hContact, MEVENT hEvent, EventLoadMode mode)
 {
-	allocateBlock(1);
-	tail->items[0].hContact = hContact;
-	tail->items[0].hEvent = hEvent;
+	if (!reserve(count + 1))
+		return false;
+
+	addRange(hContact);
+	ids[count] = hEvent;
+	itemFlags[count] = 0;
+	count++;
+
 	if (mode != ELM_NOTHING)
-		tail->items[0].load(mode);
+		get(count-1, mode);
 
 	return true;
 }
-/*
-bool HistoryArray::preloadEvents(int count)
+
+HistoryArray::ItemData *HistoryArray::fetch(int id, EventLoadMode mode)
 {
-	for (int i = 0; i < count; ++i)
+	ItemData *item = cache.find((ItemData *)&id);
+	if (!item)
 	{
-		preBlock->items[preIndex].load(ELM_DATA);
-		if (++preIndex == preBlock->count)
+		item = new ItemData;
+		item->index = id;
+		item->hContact = getContact(id);
+		item->hEvent = ids[id];
+		cache.insert(item);
+	}
+
+	item->lastUse = ++useCounter;
+	if (mode != ELM_NOTHING)
+		item->loadInline(mode);
+	return item;
+}
+
+static int __cdecl CompareStamps(const void *p1, const void *p2)
+{
+	DWORD s1 = *(DWORD *)p1, s2 = *(DWORD *)p2;
+	return (s1 < s2) ? -1 : (s1 > s2);
+}
+
+void HistoryArray::shrinkCache()
+{
+	if (cache.getCount() <= CACHE_SIZE)
+		return;
+
+	// drop the oldest quarter at once, not to do that on every request
+	int nItems = cache.getCount(), nDrop = nItems - CACHE_SIZE * 3 / 4;
+	DWORD *stamps = (DWORD *)_alloca(sizeof(DWORD) * nItems);
+	for (int i = 0; i < nItems; i++)
+		stamps[i] = cache[i]->lastUse;
+	qsort(stamps, nItems, sizeof(DWORD), CompareStamps);
+
+	DWORD threshold = stamps[nDrop-1];
+	for (auto &it : cache.rev_iter())
+		if (it->lastUse <= threshold)
 		{
-			preBlock = preBlock->next;
-			if (!preBlock)
-				return false;
-			preIndex = 0;
+			delete it;
+			cache.remove(cache.indexOf(&it));
 		}
-	}
-	return true;
 }
-*/
+
 HistoryArray::ItemData *HistoryArray::get(int id, EventLoadMode mode)
 {
-	caching = false;
-	if (caching) EnterCriticalSection(&csItems);
-	int offset = 0;
-	for (ItemBlock *p = head; p; p = p->next)
-	{
-		if (id < offset + p->count)
-		{
-			if (mode != ELM_NOTHING)
-				p->items[id - offset].load(mode);
+	if ((id < 0) || (id >= count))
+		return 0;
 
-			if (caching)
-			{
-				if (caching_complete) caching = false;
-				LeaveCriticalSection(&csItems);
-			}
-			return p->items + id - offset;
-		}
-		offset += p->count;
-	}
-	if (caching)
+	// a new area is requested, load the neighbours at once
+	if ((mode != ELM_NOTHING) && !cache.find((ItemData *)&id))
 	{
-		if (caching_complete) caching = false;
-		LeaveCriticalSection(&csItems);
+		int first = max(0, id - PREFETCH_MARGIN), last = min(count-1, id + PREFETCH_MARGIN);
+		for (int i = first; i <= last; i++)
+			if (i != id)
+				fetch(i, mode);
 	}
-	return 0;
-}
 
-///////////////////////////////////////////////////////////
-// Cache data
-void HistoryArray::CacheThreadFunc(void *arg)
-{
-	HistoryArray *_this = (HistoryArray *)arg;
-	_this->caching_complete = true;
-	_endthread();
-}
\ No newline at end of file
+	// the requested item is the most recent one, so it survives the shrinking
+	ItemData *item = fetch(id, mode);
+	shrinkCache();
+	return item;
+}
@@ -32,7 +32,8 @@ class HistoryArray
 public:
 	struct ItemData
 	{
-		BYTE flags;
+		int index;        // position in the array, should be the first field (search key)
+		DWORD lastUse;    // for the LRU
 
 		MCONTACT hContact;
 		MEVENT hEvent;
@@ -46,7 +47,7 @@ public:
 
 		HANDLE data;
 
-		ItemData(): flags(0), hContact(0), hEvent(0), atext(0), wtext(0), atext_del(false), wtext_del(false), data(0), dbeOk(false) {}
+		ItemData(): index(0), lastUse(0), hContact(0), hEvent(0), atext(0), wtext(0), atext_del(false), wtext_del(false), data(0), dbeOk(false) {}
 		~ItemData();
 		bool load(EventLoadMode mode);
 		inline bool loadInline(EventLoadMode mode)
@@ -76,13 +77,6 @@ public:
 		}
 	};
 
-	struct ItemBlock
-	{
-		ItemData *items;
-		int count;
-		ItemBlock *prev, *next;
-	};
-
 	class Filter
 	{
 	public:
@@ -179,15 +173,36 @@ public:
 	};
 
 private:
-	ItemBlock *head, *tail;
-	ItemBlock *preBlock;
-	int preIndex;
-	bool allocateBlock(int count);
+	// the whole history is kept as a compact array of event ids, ItemData objects are
+	// created on demand for the requested items plus a prefetch margin, and the least
+	// recently used of them are dropped, so a huge history costs a few bytes per event
+	enum
+	{
+		PREFETCH_MARGIN = 16,   // items around the requested one that are loaded together
+		CACHE_SIZE      = 512,  // max number of decoded items
+	};
+
+	struct ContactRange
+	{
+		int first;              // index of the first event of this contact
+		MCONTACT hContact;
+	};
+
+	MEVENT *ids;
+	BYTE *itemFlags;
+	int count, allocated;
+
+	ContactRange *ranges;
+	int rangeCount;
+
+	LIST<ItemData> cache;
+	DWORD useCounter;
 
-	bool caching;
-	bool caching_complete;
-	CRITICAL_SECTION csItems;
-	static void CacheThreadFunc(void *arg);
+	bool reserve(int newCount);
+	void addRange(MCONTACT hContact);
+	MCONTACT getContact(int id);
+	ItemData *fetch(int id, EventLoadMode mode);
+	void shrinkCache();
 
 public:
 	HistoryArray();
@@ -197,9 +212,11 @@ public:
 	bool addHistory(MCONTACT hContact, EventLoadMode mode = ELM_NOTHING);
 	bool addEvent(MCONTACT hContact, MEVENT hEvent, EventLoadMode mode = ELM_NOTHING);
 
-//	bool preloadEvents(int count = 10);
-
+	// returns a decoded item, the pointer stays valid until CACHE_SIZE/4 other items are requested
 	ItemData *get(int id, EventLoadMode mode = ELM_NOTHING);
+
+	// item flags (HIF_*) are kept for every event, they don't require decoding
+	BYTE &flags(int id) { return itemFlags[id]; }
 	ItemData *operator[] (int id) { return get(id, ELM_DATA); }
 	ItemData *operator() (int id) { return get(id, ELM_INFO); }
 
@@ -214,13 +231,7 @@ public:
 	int FindNext(int id, Filter filter) { return FindRel(id, +1, filter); }
 	int FindPrev(int id, Filter filter) { return FindRel(id, -1, filter); }
 
-	int getCount()
-	{
-		int res = 0;
-		for (ItemBlock *p = head; p; p = p->next)
-			res += p->count;
-		return res;
-	}
+	int getCount() { return count; }
 };
 
 #endif // __history_array__
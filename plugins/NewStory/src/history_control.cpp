@@ -147,7 +147,7 @@ LRESULT CALLBACK NewstoryListWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
 				start ^= end;
 			}
 			for (int i = start; i <= end; ++i)
-				data->items.get(i, ELM_NOTHING)->flags |= HIF_SELECTED;
+				data->items.flags(i) |= HIF_SELECTED;
 			InvalidateRect(hwnd, 0, FALSE);
 			return 0;
 		}
@@ -164,12 +164,12 @@ LRESULT CALLBACK NewstoryListWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
 			}
 			for (int i = start; i <= end; ++i)
 			{
-				if (data->items.get(i, ELM_NOTHING)->flags & HIF_SELECTED)
+				if (data->items.flags(i) & HIF_SELECTED)
 				{
-					data->items.get(i, ELM_NOTHING)->flags &= ~HIF_SELECTED;
+					data->items.flags(i) &= ~HIF_SELECTED;
 				} else
 				{
-					data->items.get(i, ELM_NOTHING)->flags |= HIF_SELECTED;
+					data->items.flags(i) |= HIF_SELECTED;
 				}
 			}
 			InvalidateRect(hwnd, 0, FALSE);
@@ -191,10 +191,10 @@ LRESULT CALLBACK NewstoryListWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
 			{
 				if ((i >= start) && (i <= end))
 				{
-					data->items.get(i, ELM_NOTHING)->flags |= HIF_SELECTED;
+					data->items.flags(i) |= HIF_SELECTED;
 				} else
 				{
-					data->items.get(i, ELM_NOTHING)->flags &= ~((DWORD)HIF_SELECTED);
+					data->items.flags(i) &= ~HIF_SELECTED;
 				}
 			}
 			InvalidateRect(hwnd, 0, FALSE);
@@ -212,7 +212,7 @@ LRESULT CALLBACK NewstoryListWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
 				start ^= end;
 			}
 			for (int i = start; i <= end; ++i)
-				data->items.get(i, ELM_NOTHING)->flags &= ~((DWORD)HIF_SELECTED);
+				data->items.flags(i) &= ~HIF_SELECTED;
 			InvalidateRect(hwnd, 0, FALSE);
 			return 0;
 		}
@@ -292,9 +292,9 @@ LRESULT CALLBACK NewstoryListWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
 			int eventCount = data->items.getCount();
 			for (int i = 0; i < eventCount; i++)
 			{
-				HistoryArray::ItemData *item = data->items.get(i, ELM_NOTHING);
-				if (item->flags&HIF_SELECTED)
+				if (data->items.flags(i)&HIF_SELECTED)
 				{
+					HistoryArray::ItemData *item = data->items.get(i, ELM_DATA);
 					buf = TplFormatString(TPL_COPY_MESSAGE, item->hContact, item);
 					res = appendString(res, buf);
 					free(buf);
@@ -952,7 +952,7 @@ static int PaintItem(HDC hdc, HistoryArray *items, int index, int top, int width
 			break;
 	}
 	clText = fonts[fontid].cl;
-	if (item->flags & HIF_SELECTED)
+	if (items->flags(index) & HIF_SELECTED)
 	{
 		MTextSendMessage(0, item->data, EM_SETSEL, 0, -1);
 //		clText = colors[COLOR_SELTEXT].cl;
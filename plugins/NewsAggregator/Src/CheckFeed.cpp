@@ -110,7 +110,7 @@ LPCTSTR CheckFeed(wchar_t *tszURL, CFeedEditor *pEditDlg)
 	return nullptr;
 }
 
-static void XmlToMsg(MCONTACT hContact, CMStringW &title, CMStringW &link, CMStringW &descr, CMStringW &author, CMStringW &comments, CMStringW &guid, CMStringW &category, time_t stamp)
+static void XmlToMsg(MCONTACT hContact, CItemIndex &index, CMStringW &title, CMStringW &link, CMStringW &descr, CMStringW &author, CMStringW &comments, CMStringW &guid, CMStringW &category, time_t stamp)
 {
 	CMStringW message = db_get_wsa(hContact, MODULENAME, "MsgFormat");
 	if (!message)
@@ -151,35 +151,11 @@ static void XmlToMsg(MCONTACT hContact, CMStringW &title, CMStringW &link, CMStr
 	else
 		message.Replace(L"#<category>#", category);
 
-	DBEVENTINFO olddbei = {};
-	bool  MesExist = false;
-	T2Utf pszTemp(message);
-	DWORD cbMemoLen = 10000, cbOrigLen = (DWORD)mir_strlen(pszTemp);
-	BYTE *pbBuffer = (BYTE*)mir_alloc(cbMemoLen);
-	for (MEVENT hDbEvent = db_event_last(hContact); hDbEvent; hDbEvent = db_event_prev(hContact, hDbEvent)) {
-		olddbei.cbBlob = db_event_getBlobSize(hDbEvent);
-		if (olddbei.cbBlob > cbMemoLen)
-			pbBuffer = (PBYTE)mir_realloc(pbBuffer, (size_t)(cbMemoLen = olddbei.cbBlob));
-		olddbei.pBlob = pbBuffer;
-		db_event_get(hDbEvent, &olddbei);
-
-		// there's no need to look for the elder events
-		if (stamp > 0 && olddbei.timestamp < (DWORD)stamp)
-			break;
-
-		if ((DWORD)mir_strlen((char*)olddbei.pBlob) == cbOrigLen && !mir_strcmp((char*)olddbei.pBlob, pszTemp)) {
-			MesExist = true;
-			break;
-		}
-	}
-	mir_free(pbBuffer);
-
-	if (!MesExist) {
+	T2Utf pszMessage(message);
+	if (index.Register(pszMessage, guid, link)) {
 		if (stamp == 0)
 			stamp = time(0);
 
-		T2Utf pszMessage(message);
-
 		PROTORECVEVENT recv = { 0 };
 		recv.timestamp = (DWORD)stamp;
 		recv.szMessage = pszMessage;
@@ -199,8 +175,11 @@ void CheckCurrentFeed(MCONTACT hContact)
 
 	Netlib_LogfW(hNetlibUser, L"Started checking feed %s.", szURL);
 
+	FEEDVALIDATORS validators;
+	validators.Load(hContact);
+
 	char *szData = nullptr;
-	GetNewsData(szURL, &szData, hContact, nullptr);
+	GetNewsData(szURL, &szData, hContact, nullptr, &validators);
 	mir_free(szURL);
 
 	if (szData) {
@@ -214,6 +193,7 @@ void CheckCurrentFeed(MCONTACT hContact)
 
 		CMStringW szValue;
 		if (hXml != nullptr) {
+			CItemIndex index(hContact);
 			LPCTSTR codepage = nullptr;
 			int childcount = 0;
 			HXML node;
@@ -443,7 +423,7 @@ void CheckCurrentFeed(MCONTACT hContact)
 									ClearText(category, value);
 							}
 
-							XmlToMsg(hContact, title, link, descr, author, comments, guid, category, stamp);
+							XmlToMsg(hContact, index, title, link, descr, author, comments, guid, category, stamp);
 						}
 					}
 				}
@@ -592,13 +572,16 @@ void CheckCurrentFeed(MCONTACT hContact)
 								}
 							}
 
-							XmlToMsg(hContact, title, link, descr, author, comments, guid, category, stamp);
+							XmlToMsg(hContact, index, title, link, descr, author, comments, guid, category, stamp);
 						}
 					}
 				}
 				node = xmlGetChild(hXml, ++childcount);
 			}
 			xmlDestroyNode(hXml);
+
+			// the next check may get 304 now, so the validators are kept only for a parsed feed
+			validators.Save(hContact);
 		}
 	}
 	db_set_dw(hContact, MODULENAME, "LastCheck", (DWORD)time(0));
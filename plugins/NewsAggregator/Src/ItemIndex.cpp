@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2012 Mataes
+
+This is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+This is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Library General Public
+License along with this file; see the file license.txt.  If
+not, write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA 02111-1307, USA.
+*/
+
+#include "stdafx.h"
+
+CItemIndex::CItemIndex(MCONTACT hContact) :
+	m_hContact(hContact),
+	m_arSorted(100, PtrKeySortT),
+	m_arOrder(100)
+{
+	if (hContact == 0)
+		return;
+
+	DBVARIANT dbv;
+	if (!db_get(hContact, MODULENAME, "ItemIndex", &dbv)) {
+		if (dbv.type == DBVT_BLOB) {
+			DWORD *pHashes = (DWORD*)dbv.pbVal;
+			for (unsigned i = 0; i < dbv.cpbVal / sizeof(DWORD); i++)
+				AddHash(pHashes[i]);
+		}
+		db_free(&dbv);
+		return;
+	}
+
+	// no index yet: seed it once from the history received by older versions
+	DBEVENTINFO dbei = {};
+	DWORD cbMemoLen = 10000;
+	BYTE *pbBuffer = (BYTE*)mir_alloc(cbMemoLen);
+	for (MEVENT hDbEvent = db_event_first(hContact); hDbEvent; hDbEvent = db_event_next(hContact, hDbEvent)) {
+		int cbBlob = db_event_getBlobSize(hDbEvent);
+		if (cbBlob <= 0)
+			continue;
+
+		dbei.cbBlob = cbBlob;
+		if (dbei.cbBlob + 1 > cbMemoLen)
+			pbBuffer = (PBYTE)mir_realloc(pbBuffer, (size_t)(cbMemoLen = dbei.cbBlob + 1));
+		dbei.pBlob = pbBuffer;
+		if (db_event_get(hDbEvent, &dbei))
+			continue;
+
+		pbBuffer[dbei.cbBlob] = 0;
+		AddHash(mir_hashstr((char*)pbBuffer));
+	}
+	mir_free(pbBuffer);
+	m_bChanged = true;
+}
+
+CItemIndex::~CItemIndex()
+{
+	if (!m_bChanged || m_hContact == 0)
+		return;
+
+	// keep only the most recent hashes
+	int iFirst = max(0, m_arOrder.getCount() - MAX_INDEXED_ITEMS);
+	int nCount = m_arOrder.getCount() - iFirst;
+	DWORD *pHashes = (DWORD*)mir_alloc(sizeof(DWORD) * (nCount + 1));
+	for (int i = 0; i < nCount; i++)
+		pHashes[i] = (DWORD)(DWORD_PTR)m_arOrder[iFirst + i];
+	db_set_blob(m_hContact, MODULENAME, "ItemIndex", pHashes, sizeof(DWORD) * nCount);
+	mir_free(pHashes);
+}
+
+void CItemIndex::AddHash(unsigned int hash)
+{
+	void *key = MakeKey(hash);
+	if (m_arSorted.find(key) == nullptr) {
+		m_arSorted.insert(key);
+		m_arOrder.insert(key, m_arOrder.getCount());
+	}
+}
+
+bool CItemIndex::Register(const char *pszMessage, const CMStringW &guid, const CMStringW &link)
+{
+	unsigned int textHash = mir_hashstr(pszMessage), keyHash = 0;
+	if (!guid.IsEmpty())
+		keyHash = mir_hashstrW(guid);
+	else if (!link.IsEmpty())
+		keyHash = mir_hashstrW(link);
+
+	if (Contains(textHash) || (keyHash != 0 && Contains(keyHash)))
+		return false;
+
+	Add(textHash);
+	if (keyHash != 0)
+		Add(keyHash);
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+Copyright (C) 2012 Mataes
+
+This is free software; you can redistribute it and/or
+modify it under the terms of the GNU Library General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+This is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Library General Public
+License along with this file; see the file license.txt.  If
+not, write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA 02111-1307, USA.
+*/
+
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// per-feed index of already received items
+// stored as a blob of 32-bit hashes (in the order they were added) in the "ItemIndex" setting.
+// every item is registered twice: by its guid (or link) and by the text of its message,
+// so the feeds without guids and the history received before the index existed are still recognized.
+// an index created for contact 0 lives in memory only
+
+#define MAX_INDEXED_ITEMS 4000
+
+class CItemIndex
+{
+	MCONTACT m_hContact;
+	LIST<void> m_arSorted, m_arOrder;
+	bool m_bChanged = false;
+
+	static void* MakeKey(unsigned int hash)
+	{
+		return (void*)(DWORD_PTR)(hash ? hash : 1);
+	}
+
+	void AddHash(unsigned int hash);
+
+public:
+	CItemIndex(MCONTACT hContact);
+	~CItemIndex();
+
+	bool Contains(unsigned int hash) const
+	{
+		return m_arSorted.find(MakeKey(hash)) != nullptr;
+	}
+
+	void Add(unsigned int hash)
+	{
+		AddHash(hash);
+		m_bChanged = true;
+	}
+
+	// returns true and remembers the item if neither its key nor its text were seen before
+	bool Register(const char *pszMessage, const CMStringW &guid, const CMStringW &link);
+};
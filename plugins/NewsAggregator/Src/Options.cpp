@@ -845,6 +845,10 @@ void CFeedEditor::OnOk(CCtrlBase*)
 	db_set_dw(hContact, MODULENAME, "UpdateTime", (DWORD)m_checktime.GetInt());
 	db_set_ws(hContact, MODULENAME, "MsgFormat", strtagedit);
 	db_set_w(hContact, MODULENAME, "Status", Proto_GetStatus(MODULENAME));
+
+	// the feed settings might have changed, so the next check must fetch the full document
+	db_unset(hContact, MODULENAME, "ETag");
+	db_unset(hContact, MODULENAME, "LastModified");
 	if (m_useauth.IsChecked()) {
 		db_set_b(hContact, MODULENAME, "UseAuth", 1);
 		db_set_ws(hContact, MODULENAME, "Login", m_login.GetText());
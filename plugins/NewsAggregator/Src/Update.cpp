@@ -19,11 +19,32 @@ Boston, MA 02111-1307, USA.
 
 #include "stdafx.h"
 
+#define MAX_UPDATE_THREADS 4 // feeds checked simultaneously
+#define MAX_HOST_THREADS   2 // simultaneous requests to the same server
+
 // check if Feed is currently updating
 bool ThreadRunning;
 UPDATELIST *UpdateListHead = nullptr;
 UPDATELIST *UpdateListTail = nullptr;
 
+// feeds being checked right now with their hosts, protected by hUpdateMutex
+struct BusyFeed
+{
+	BusyFeed(MCONTACT _1, const CMStringA &_2) :
+		hContact(_1),
+		szHost(_2)
+	{}
+
+	MCONTACT hContact;
+	CMStringA szHost;
+};
+
+static OBJLIST<BusyFeed> arBusyFeeds(5);
+
+// signalled when a feed check finishes or a new feed is queued, workers that
+// have nothing to take wait for it
+static HANDLE hevQueueChanged;
+
 // main auto-update timer
 void CALLBACK timerProc(HWND, UINT, UINT_PTR, DWORD)
 {
@@ -66,33 +87,108 @@ void UpdateListAdd(MCONTACT hContact)
 
 	WaitForSingleObject(hUpdateMutex, INFINITE);
 
+	// the same feed queued twice would be checked by two workers at once
+	for (UPDATELIST *Item = UpdateListHead; Item != nullptr; Item = Item->next)
+		if (Item->hContact == hContact) {
+			ReleaseMutex(hUpdateMutex);
+			mir_free(newItem);
+			return;
+		}
+
 	if (UpdateListTail == nullptr)
 		UpdateListHead = newItem;
 	else UpdateListTail->next = newItem;
 	UpdateListTail = newItem;
 
+	if (hevQueueChanged)
+		SetEvent(hevQueueChanged);
+
 	ReleaseMutex(hUpdateMutex);
 }
 
-MCONTACT UpdateGetFirst()
+static CMStringA GetFeedHost(MCONTACT hContact)
 {
-	MCONTACT hContact = NULL;
+	CMStringA szHost;
+	ptrA szUrl(db_get_sa(hContact, MODULENAME, "URL"));
+	if (szUrl) {
+		const char *p = strstr(szUrl, "://");
+		p = (p) ? p + 3 : szUrl.get();
+		szHost.Append(p, (int)strcspn(p, "/:?#"));
+		szHost.MakeLower();
+	}
+	return szHost;
+}
+
+static bool IsFeedBusy(MCONTACT hContact)
+{
+	for (auto &it : arBusyFeeds)
+		if (it->hContact == hContact)
+			return true;
+	return false;
+}
+
+static int GetHostRequests(const CMStringA &szHost)
+{
+	int nCount = 0;
+	for (auto &it : arBusyFeeds)
+		if (it->szHost == szHost)
+			nCount++;
+	return nCount;
+}
+
+// takes the first queued feed that isn't being checked already and whose server isn't busy
+// with MAX_HOST_THREADS requests. returns false when the queue is empty, hContact = NULL
+// if all queued feeds have to wait
+static bool UpdateGetNext(MCONTACT &hContact, CMStringA &szHost)
+{
+	hContact = NULL;
 
 	WaitForSingleObject(hUpdateMutex, INFINITE);
 
-	if (UpdateListHead != nullptr) {
-		UPDATELIST* Item = UpdateListHead;
+	bool bHaveItems = (UpdateListHead != nullptr);
+	for (UPDATELIST *Prev = nullptr, *Item = UpdateListHead; Item != nullptr; Prev = Item, Item = Item->next) {
+		if (IsFeedBusy(Item->hContact))
+			continue;
+
+		szHost = GetFeedHost(Item->hContact);
+		if (GetHostRequests(szHost) >= MAX_HOST_THREADS)
+			continue;
+
 		hContact = Item->hContact;
-		UpdateListHead = Item->next;
+		if (Prev == nullptr)
+			UpdateListHead = Item->next;
+		else
+			Prev->next = Item->next;
+		if (UpdateListTail == Item)
+			UpdateListTail = Prev;
 		mir_free(Item);
 
-		if (UpdateListHead == nullptr)
-			UpdateListTail = nullptr;
+		arBusyFeeds.insert(new BusyFeed(hContact, szHost));
+		break;
 	}
 
+	// nothing to take now: the event is reset under the mutex, so a release or a new feed
+	// that comes right after unlocking still wakes the worker up
+	if (bHaveItems && hContact == NULL)
+		ResetEvent(hevQueueChanged);
+
 	ReleaseMutex(hUpdateMutex);
 
-	return hContact;
+	return bHaveItems;
+}
+
+static void UpdateReleaseFeed(MCONTACT hContact)
+{
+	WaitForSingleObject(hUpdateMutex, INFINITE);
+
+	for (auto &it : arBusyFeeds)
+		if (it->hContact == hContact) {
+			arBusyFeeds.remove(arBusyFeeds.indexOf(&it));
+			break;
+		}
+
+	SetEvent(hevQueueChanged);
+	ReleaseMutex(hUpdateMutex);
 }
 
 void DestroyUpdateList(void)
@@ -112,6 +208,31 @@ void DestroyUpdateList(void)
 	ReleaseMutex(hUpdateMutex);
 }
 
+static unsigned __stdcall UpdateWorkerProc(void *AvatarCheck)
+{
+	CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+
+	MCONTACT hContact;
+	CMStringA szHost;
+	while (!Miranda_IsTerminated() && UpdateGetNext(hContact, szHost)) {
+		// all the remaining feeds are busy or on the busy servers, wait until one is released
+		if (hContact == NULL) {
+			WaitForSingleObject(hevQueueChanged, INFINITE);
+			continue;
+		}
+
+		if (AvatarCheck != nullptr)
+			CheckCurrentFeedAvatar(hContact);
+		else
+			CheckCurrentFeed(hContact);
+
+		UpdateReleaseFeed(hContact);
+	}
+
+	CoUninitialize();
+	return 0;
+}
+
 void UpdateThreadProc(void *AvatarCheck)
 {
 	WaitForSingleObject(hUpdateMutex, INFINITE);
@@ -120,20 +241,29 @@ void UpdateThreadProc(void *AvatarCheck)
 		return;
 	}
 	ThreadRunning = TRUE;	// prevent 2 instance of this thread running
+	hevQueueChanged = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+	int nThreads = 0;
+	for (UPDATELIST *Item = UpdateListHead; Item != nullptr && nThreads < MAX_UPDATE_THREADS; Item = Item->next)
+		nThreads++;
 	ReleaseMutex(hUpdateMutex);
 
-	CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+	// check the feeds in parallel, each worker takes the next feed from the queue until the queue is empty
+	HANDLE hThreads[MAX_UPDATE_THREADS];
+	for (int i = 0; i < nThreads; i++)
+		hThreads[i] = mir_forkthreadex(UpdateWorkerProc, AvatarCheck);
 
-	// update news by getting the first station from the queue until the queue is empty
-	while (UpdateListHead != nullptr && !Miranda_IsTerminated()) {
-		if (AvatarCheck != nullptr)
-			CheckCurrentFeedAvatar(UpdateGetFirst());
-		else
-			CheckCurrentFeed(UpdateGetFirst());
+	if (nThreads) {
+		WaitForMultipleObjects(nThreads, hThreads, TRUE, INFINITE);
+		for (int i = 0; i < nThreads; i++)
+			CloseHandle(hThreads[i]);
 	}
 
+	WaitForSingleObject(hUpdateMutex, INFINITE);
+	CloseHandle(hevQueueChanged);
+	hevQueueChanged = nullptr;
+	ReleaseMutex(hUpdateMutex);
+
 	// exit the update thread
 	ThreadRunning = FALSE;
-
-	CoUninitialize();
 }
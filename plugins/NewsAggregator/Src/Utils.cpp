@@ -44,7 +44,35 @@ void NetlibUnInit()
 	hNetlibUser = nullptr;
 }
 
-void GetNewsData(wchar_t *tszUrl, char **szData, MCONTACT hContact, CFeedEditor *pEditDlg)
+static char* GetReplyHeader(NETLIBHTTPREQUEST *nlhrReply, const char *szName)
+{
+	for (int i = 0; i < nlhrReply->headersCount; i++)
+		if (!mir_strcmpi(nlhrReply->headers[i].szName, szName))
+			return nlhrReply->headers[i].szValue;
+
+	return nullptr;
+}
+
+void FEEDVALIDATORS::Load(MCONTACT hContact)
+{
+	szETag = ptrA(db_get_sa(hContact, MODULENAME, "ETag"));
+	szLastModified = ptrA(db_get_sa(hContact, MODULENAME, "LastModified"));
+}
+
+void FEEDVALIDATORS::Save(MCONTACT hContact) const
+{
+	if (!szETag.IsEmpty())
+		db_set_s(hContact, MODULENAME, "ETag", szETag);
+	else
+		db_unset(hContact, MODULENAME, "ETag");
+
+	if (!szLastModified.IsEmpty())
+		db_set_s(hContact, MODULENAME, "LastModified", szLastModified);
+	else
+		db_unset(hContact, MODULENAME, "LastModified");
+}
+
+void GetNewsData(wchar_t *tszUrl, char **szData, MCONTACT hContact, CFeedEditor *pEditDlg, FEEDVALIDATORS *pValidators)
 {
 	Netlib_LogfW(hNetlibUser, L"Getting feed data %s.", tszUrl);
 	NETLIBHTTPREQUEST nlhr = { 0 };
@@ -60,7 +88,7 @@ void GetNewsData(wchar_t *tszUrl, char **szData, MCONTACT hContact, CFeedEditor
 	nlhr.nlc = hNetlibHttp;
 
 	// change the header so the plugin is pretended to be IE 6 + WinXP
-	NETLIBHTTPHEADER headers[5];
+	NETLIBHTTPHEADER headers[7];
 	nlhr.headersCount = 4;
 	nlhr.headers = headers;
 	nlhr.headers[0].szName = "User-Agent";
@@ -74,10 +102,23 @@ void GetNewsData(wchar_t *tszUrl, char **szData, MCONTACT hContact, CFeedEditor
 	char auth[256];
 	if (db_get_b(hContact, MODULENAME, "UseAuth", 0) || (pEditDlg && pEditDlg->m_useauth.IsChecked()) /*IsDlgButtonChecked(hwndDlg, IDC_USEAUTH)*/) {
 		nlhr.headersCount++;
-		nlhr.headers[4].szName = "Authorization";
+		nlhr.headers[nlhr.headersCount - 1].szName = "Authorization";
 
 		CreateAuthString(auth, hContact, pEditDlg);
-		nlhr.headers[4].szValue = auth;
+		nlhr.headers[nlhr.headersCount - 1].szValue = auth;
+	}
+
+	// conditional request: the server answers 304 if the feed wasn't changed since the last check
+	if (pValidators != nullptr) {
+		if (!pValidators->szETag.IsEmpty()) {
+			nlhr.headers[nlhr.headersCount].szName = "If-None-Match";
+			nlhr.headers[nlhr.headersCount++].szValue = pValidators->szETag.GetBuffer();
+		}
+
+		if (!pValidators->szLastModified.IsEmpty()) {
+			nlhr.headers[nlhr.headersCount].szName = "If-Modified-Since";
+			nlhr.headers[nlhr.headersCount++].szValue = pValidators->szLastModified.GetBuffer();
+		}
 	}
 
 	// download the page
@@ -90,12 +131,20 @@ void GetNewsData(wchar_t *tszUrl, char **szData, MCONTACT hContact, CFeedEditor
 			*szData = (char *)mir_alloc((size_t)(nlhrReply->dataLength + 2));
 			memcpy(*szData, nlhrReply->pData, (size_t)nlhrReply->dataLength);
 			(*szData)[nlhrReply->dataLength] = 0;
+
+			// the caller stores them only when the feed gets parsed
+			if (pValidators != nullptr) {
+				pValidators->szETag = GetReplyHeader(nlhrReply, "ETag");
+				pValidators->szLastModified = GetReplyHeader(nlhrReply, "Last-Modified");
+			}
 		}
+		else if (nlhrReply->resultCode == 304)
+			Netlib_LogfW(hNetlibUser, L"Code 304: feed %s was not modified.", tszUrl);
 		else if (nlhrReply->resultCode == 401) {
 			Netlib_LogfW(hNetlibUser, L"Code 401: feed %s needs auth data.", tszUrl);
 
 			if (CAuthRequest(pEditDlg, hContact).DoModal() == IDOK)
-				GetNewsData(tszUrl, szData, hContact, pEditDlg);
+				GetNewsData(tszUrl, szData, hContact, pEditDlg, pValidators);
 		}
 		else Netlib_LogfW(hNetlibUser, L"Code %d: Failed getting feed data %s.", nlhrReply->resultCode, tszUrl);
 		
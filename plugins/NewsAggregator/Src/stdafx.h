@@ -51,6 +51,7 @@ Boston, MA 02111-1307, USA.
 #include <m_string.h>
 
 #include "Options.h"
+#include "ItemIndex.h"
 #include "version.h"
 #include "resource.h"
 
@@ -125,8 +126,19 @@ int      OnToolbarLoaded(WPARAM wParam, LPARAM lParam);
 void     CALLBACK timerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime);
 void     CALLBACK timerProc2(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime);
 
+//============  HTTP VALIDATORS OF A FEED  ============
+// sent with a conditional request, replaced with the server's ones on 200 OK
+
+struct FEEDVALIDATORS
+{
+	CMStringA szETag, szLastModified;
+
+	void Load(MCONTACT hContact);
+	void Save(MCONTACT hContact) const;
+};
+
 bool     IsMyContact(MCONTACT hContact);
-void     GetNewsData(wchar_t *szUrl, char **szData, MCONTACT hContact, CFeedEditor *pEditDlg);
+void     GetNewsData(wchar_t *szUrl, char **szData, MCONTACT hContact, CFeedEditor *pEditDlg, FEEDVALIDATORS *pValidators = nullptr);
 time_t   __stdcall DateToUnixTime(const wchar_t *stamp, bool FeedType);
 void     CheckCurrentFeed(MCONTACT hContact);
 void     CheckCurrentFeedAvatar(MCONTACT hContact);
@@ -21,6 +21,9 @@ Boston, MA 02111-1307, USA.
 
 #define UM_ERROR (WM_USER+1)
 
+#define MAX_DOWNLOAD_THREADS 4 // files downloaded simultaneously
+#define MAX_HASH_THREADS     8 // files hashed simultaneously
+
 static bool bShowDetails;
 static HWND hwndDialog;
 static HANDLE hCheckThread, hTimer;
@@ -41,6 +44,66 @@ static void SetStringText(HWND hWnd, size_t i, wchar_t *ptszText)
 	ListView_SetItemText(hWnd, i, 1, ptszText);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// downloads all enabled files using several connections at once
+
+struct DownloadQueue
+{
+	OBJLIST<FILEINFO> &todo;
+	HWND hwndList;
+	volatile LONG iNext, bFailed;
+};
+
+static unsigned __stdcall DownloadThread(void *param)
+{
+	DownloadQueue *q = (DownloadQueue*)param;
+	HNETLIBCONN nlc = nullptr;
+
+	for (LONG i; !q->bFailed && (i = InterlockedIncrement(&q->iNext) - 1) < q->todo.getCount();) {
+		FILEINFO &p = q->todo[i];
+		if (!p.bEnabled || p.bDeleteOnly)
+			continue;
+
+		if (q->hwndList) {
+			ListView_EnsureVisible(q->hwndList, i, FALSE);
+			SetStringText(q->hwndList, i, TranslateT("Downloading..."));
+		}
+
+		if (DownloadFile(&p.File, nlc)) {
+			if (q->hwndList)
+				SetStringText(q->hwndList, i, TranslateT("Succeeded."));
+		}
+		else {
+			if (q->hwndList)
+				SetStringText(q->hwndList, i, TranslateT("Failed!"));
+
+			// interrupt update as we require all components to be updated
+			InterlockedExchange(&q->bFailed, 1);
+		}
+	}
+
+	Netlib_CloseHandle(nlc);
+	return 0;
+}
+
+static bool DownloadUpdates(OBJLIST<FILEINFO> &todo, HWND hwndList)
+{
+	DownloadQueue q = { todo, hwndList, 0, 0 };
+
+	HANDLE hThreads[MAX_DOWNLOAD_THREADS];
+	int nThreads = min(todo.getCount(), MAX_DOWNLOAD_THREADS);
+	for (int i = 0; i < nThreads; i++)
+		hThreads[i] = mir_forkthreadex(DownloadThread, &q);
+
+	WaitForMultipleObjects(nThreads, hThreads, TRUE, INFINITE);
+	for (int i = 0; i < nThreads; i++)
+		CloseHandle(hThreads[i]);
+
+	return q.bFailed == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
 static void ApplyUpdates(void *param)
 {
 	Thread_SetName("PluginUpdater: ApplyUpdates");
@@ -67,33 +130,18 @@ static void ApplyUpdates(void *param)
 	SafeCreateDirectory(tszFileTemp);
 
 	// 2) Download all plugins
-	HNETLIBCONN nlc = nullptr;
 	for (int i=0; i < todo.getCount(); i++) {
-		ListView_EnsureVisible(hwndList, i, FALSE);
-		if (!todo[i].bEnabled) {
+		if (!todo[i].bEnabled)
 			SetStringText(hwndList, i, TranslateT("Skipped."));
-		}
-		else if (todo[i].bDeleteOnly) {
+		else if (todo[i].bDeleteOnly)
 			SetStringText(hwndList, i, TranslateT("Will be deleted!"));
-		}
-		else {
-			// download update
-			SetStringText(hwndList, i, TranslateT("Downloading..."));
-
-			FILEURL *pFileUrl = &todo[i].File;
-			if (!DownloadFile(pFileUrl, nlc)) {
-				SetStringText(hwndList, i, TranslateT("Failed!"));
+	}
 
-				// interrupt update as we require all components to be updated
-				Netlib_CloseHandle(nlc);
-				PostMessage(hDlg, UM_ERROR, 0, 0);
-				Skin_PlaySound("updatefailed");
-				return;
-			}
-			SetStringText(hwndList, i, TranslateT("Succeeded."));
-		}
+	if (!DownloadUpdates(todo, hwndList)) {
+		PostMessage(hDlg, UM_ERROR, 0, 0);
+		Skin_PlaySound("updatefailed");
+		return;
 	}
-	Netlib_CloseHandle(nlc);
 
 	// 3) Unpack all zips
 	VARSW tszMirandaPath(L"%miranda_path%");
@@ -402,24 +450,18 @@ static void DlgUpdateSilent(void *param)
 	SafeCreateDirectory(tszFileTemp);
 
 	// 2) Download all plugins
-	HNETLIBCONN nlc = nullptr;
 	// Count all updates that have been enabled
 	int count = 0;
-	for (auto &it : UpdateFiles) {
-		if (it->bEnabled && !it->bDeleteOnly) {
-			// download update
-			if (!DownloadFile(&it->File, nlc)) {
-				// interrupt update as we require all components to be updated
-				Netlib_CloseHandle(nlc);
-				Skin_PlaySound("updatefailed");
-				delete &UpdateFiles;
-				return;
-			}
+	for (auto &it : UpdateFiles)
+		if (it->bEnabled && !it->bDeleteOnly)
 			count++;
-		}
 
+	if (count && !DownloadUpdates(UpdateFiles, nullptr)) {
+		// interrupt update as we require all components to be updated
+		Skin_PlaySound("updatefailed");
+		delete &UpdateFiles;
+		return;
 	}
-	Netlib_CloseHandle(nlc);
 
 	// All available updates have been disabled
 	if (count == 0) {
@@ -616,8 +658,76 @@ static bool isValidDirectory(const wchar_t *ptszDirName)
 	return !_wcsicmp(ptszDirName, L"Plugins") || !_wcsicmp(ptszDirName, L"Icons") || !_wcsicmp(ptszDirName, L"Languages") || !_wcsicmp(ptszDirName, L"Libs") || !_wcsicmp(ptszDirName, L"Core");
 }
 
+// Files which hashes weren't found in cache, they're calculated after scanning in parallel
+struct HashJob
+{
+	wchar_t tszPath[MAX_PATH];
+	char szServerHash[33], szMyHash[33];
+	FILEINFO *pInfo;
+	bool bCalculated;
+};
+
+struct HashQueue
+{
+	OBJLIST<HashJob> &arJobs;
+	volatile LONG iNext;
+};
+
+static unsigned __stdcall HashThread(void *param)
+{
+	HashQueue *q = (HashQueue*)param;
+
+	for (LONG i; (i = InterlockedIncrement(&q->iNext) - 1) < q->arJobs.getCount();) {
+		HashJob &job = q->arJobs[i];
+		__try {
+			job.bCalculated = CalculateModuleHash(job.tszPath, job.szMyHash) == RESULT_OK;
+		}
+		__except (EXCEPTION_EXECUTE_HANDLER)
+		{
+			// smth went wrong, reload a file from scratch
+		}
+
+		if (job.bCalculated)
+			SetCachedModuleHash(job.tszPath, job.szMyHash);
+	}
+	return 0;
+}
+
+// Returns the number of counted files that are already up-to-date and were removed from the list
+static int CalculateHashes(OBJLIST<HashJob> &arJobs, OBJLIST<FILEINFO> *UpdateFiles)
+{
+	if (arJobs.getCount() == 0)
+		return 0;
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int nThreads = min(arJobs.getCount(), min((int)si.dwNumberOfProcessors, MAX_HASH_THREADS));
+
+	HashQueue q = { arJobs, 0 };
+	HANDLE hThreads[MAX_HASH_THREADS];
+	for (int i = 0; i < nThreads; i++)
+		hThreads[i] = mir_forkthreadex(HashThread, &q);
+
+	WaitForMultipleObjects(nThreads, hThreads, TRUE, INFINITE);
+	for (int i = 0; i < nThreads; i++)
+		CloseHandle(hThreads[i]);
+
+	int count = 0;
+	for (auto &it : arJobs) {
+		// hashes are the same, skipping
+		if (it->bCalculated && strcmp(it->szMyHash, it->szServerHash) == 0) {
+			Netlib_LogfW(hNetlibUser, L"File %s: Already up-to-date, skipping", it->pInfo->tszOldName);
+			if (!opts.bSilent || it->pInfo->bEnabled)
+				count++;
+			UpdateFiles->remove(UpdateFiles->indexOf(it->pInfo));
+		}
+		else Netlib_LogfW(hNetlibUser, L"File %s: Update available", it->pInfo->tszOldName);
+	}
+	return count;
+}
+
 // Scans folders recursively
-static int ScanFolder(const wchar_t *tszFolder, size_t cbBaseLen, const wchar_t *tszBaseUrl, SERVLIST &hashes, OBJLIST<FILEINFO> *UpdateFiles, int level = 0)
+static int ScanFolder(const wchar_t *tszFolder, size_t cbBaseLen, const wchar_t *tszBaseUrl, SERVLIST &hashes, OBJLIST<FILEINFO> *UpdateFiles, OBJLIST<HashJob> &arJobs, int level = 0)
 {
 	wchar_t tszBuf[MAX_PATH];
 	mir_snwprintf(tszBuf, L"%s\\*", tszFolder);
@@ -635,7 +745,7 @@ static int ScanFolder(const wchar_t *tszFolder, size_t cbBaseLen, const wchar_t
 			// Scan recursively all subfolders
 			if (isValidDirectory(ffd.cFileName)) {
 				mir_snwprintf(tszBuf, L"%s\\%s", tszFolder, ffd.cFileName);
-				count += ScanFolder(tszBuf, cbBaseLen, tszBaseUrl, hashes, UpdateFiles, level + 1);
+				count += ScanFolder(tszBuf, cbBaseLen, tszBaseUrl, hashes, UpdateFiles, arJobs, level + 1);
 			}
 		}
 		else if (isValidExtension(ffd.cFileName)) {
@@ -660,6 +770,7 @@ static int ScanFolder(const wchar_t *tszFolder, size_t cbBaseLen, const wchar_t
 
 			wchar_t *ptszUrl;
 			int MyCRC;
+			HashJob *pJob = nullptr;
 
 			bool bDeleteOnly = (tszNewName[0] == 0);
 			// this file is not marked for deletion
@@ -687,10 +798,9 @@ static int ScanFolder(const wchar_t *tszFolder, size_t cbBaseLen, const wchar_t
 
 				// No need to hash a file if we are forcing a redownload anyway
 				if (!opts.bForceRedownload) {
-					// try to hash the file
+					// try to take the hash from cache, otherwise calculate it later
 					char szMyHash[33];
-					__try {
-						CalculateModuleHash(tszBuf, szMyHash);
+					if (GetCachedModuleHash(tszBuf, szMyHash)) {
 						// hashes are the same, skipping
 						if (strcmp(szMyHash, item->m_szHash) == 0) {
 							Netlib_LogfW(hNetlibUser, L"File %s: Already up-to-date, skipping", ffd.cFileName);
@@ -699,9 +809,10 @@ static int ScanFolder(const wchar_t *tszFolder, size_t cbBaseLen, const wchar_t
 						else
 							Netlib_LogfW(hNetlibUser, L"File %s: Update available", ffd.cFileName);
 					}
-					__except (EXCEPTION_EXECUTE_HANDLER)
-					{
-						// smth went wrong, reload a file from scratch
+					else {
+						pJob = new HashJob();
+						wcsncpy_s(pJob->tszPath, tszBuf, _TRUNCATE);
+						strncpy_s(pJob->szServerHash, item->m_szHash, _TRUNCATE);
 					}
 				}
 				else Netlib_LogfW(hNetlibUser, L"File %s: Forcing redownload", ffd.cFileName);
@@ -747,6 +858,11 @@ static int ScanFolder(const wchar_t *tszFolder, size_t cbBaseLen, const wchar_t
 			FileInfo->File.CRCsum = MyCRC;
 			UpdateFiles->insert(FileInfo);
 
+			if (pJob) {
+				pJob->pInfo = FileInfo;
+				arJobs.insert(pJob);
+			}
+
 			// If we are in the silent mode, only count enabled plugins, otherwise count all
 			if (!opts.bSilent || FileInfo->bEnabled)
 				count++;
@@ -778,7 +894,9 @@ static void CheckUpdates(void *)
 	if (success) {
 		FILELIST *UpdateFiles = new FILELIST(20);
 		VARSW dirname(L"%miranda_path%");
-		int count = ScanFolder(dirname, lstrlen(dirname) + 1, baseUrl, hashes, UpdateFiles);
+		OBJLIST<HashJob> arJobs(50);
+		int count = ScanFolder(dirname, lstrlen(dirname) + 1, baseUrl, hashes, UpdateFiles, arJobs);
+		count -= CalculateHashes(arJobs, UpdateFiles);
 
 		// Show dialog
 		if (count == 0) {
@@ -267,7 +267,7 @@ bool DownloadFile(FILEURL *pFileURL, HNETLIBCONN &nlc)
 				else {
 					// try to write it via PU stub
 					wchar_t tszTempFile[MAX_PATH];
-					mir_snwprintf(tszTempFile, L"%s\\pulocal.tmp", g_tszTempPath);
+					mir_snwprintf(tszTempFile, L"%s\\pulocal%u.tmp", g_tszTempPath, GetCurrentThreadId());
 					hFile = CreateFile(tszTempFile, GENERIC_READ | GENERIC_WRITE, NULL, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
 					if (hFile != INVALID_HANDLE_VALUE) {
 						DWORD dwBytes;
@@ -519,6 +519,8 @@ bool PrepareEscalation()
 
 /////////////////////////////////////////////////////////////////////////////////////////
 
+static mir_cs csPipe;
+
 int TransactPipe(int opcode, const wchar_t *p1, const wchar_t *p2)
 {
 	BYTE buf[1024];
@@ -536,6 +538,9 @@ int TransactPipe(int opcode, const wchar_t *p1, const wchar_t *p2)
 	}
 	else *dst++ = 0;
 
+	// the stub serves one request at a time
+	mir_cslock lck(csPipe);
+
 	DWORD dwBytes = 0, dwError;
 	if ( WriteFile(hPipe, buf, (DWORD)((BYTE*)dst - buf), &dwBytes, nullptr) == 0)
 		return 0;
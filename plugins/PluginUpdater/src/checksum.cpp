@@ -263,3 +263,52 @@ LBL_NotPE:
 	bin2hex(digest, sizeof(digest), szDest);
 	return RESULT_OK;
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// persistent cache of module hashes
+// setting name is a hash of the file path, value is "size:mtime:md5"
+
+static bool GetHashCacheKey(const wchar_t *filename, char *szSetting, size_t cbSetting, CMStringA &szStamp)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &fad))
+		return false;
+
+	wchar_t tszPath[MAX_PATH];
+	wcsncpy_s(tszPath, filename, _TRUNCATE);
+	_wcslwr(tszPath);
+	mir_snprintf(szSetting, cbSetting, "%08x", mir_hashstrW(tszPath));
+
+	szStamp.Format("%08x%08x:%08x%08x:", fad.nFileSizeHigh, fad.nFileSizeLow, fad.ftLastWriteTime.dwHighDateTime, fad.ftLastWriteTime.dwLowDateTime);
+	return true;
+}
+
+bool GetCachedModuleHash(const wchar_t *filename, char *szDest)
+{
+	char szSetting[20];
+	CMStringA szStamp;
+	if (!GetHashCacheKey(filename, szSetting, sizeof(szSetting), szStamp))
+		return false;
+
+	ptrA szValue(db_get_sa(NULL, DB_MODULE_HASHES, szSetting));
+	if (szValue == nullptr || strncmp(szValue, szStamp, szStamp.GetLength()))
+		return false;
+
+	// file wasn't changed since the last calculation
+	const char *pszHash = szValue + szStamp.GetLength();
+	if (strlen(pszHash) != 32)
+		return false;
+
+	strncpy_s(szDest, 33, pszHash, _TRUNCATE);
+	return true;
+}
+
+void SetCachedModuleHash(const wchar_t *filename, const char *szHash)
+{
+	char szSetting[20];
+	CMStringA szStamp;
+	if (GetHashCacheKey(filename, szSetting, sizeof(szSetting), szStamp)) {
+		szStamp.Append(szHash);
+		db_set_s(NULL, DB_MODULE_HASHES, szSetting, szStamp);
+	}
+}
@@ -142,6 +142,7 @@ extern struct PlugOptions
 #define DB_SETTING_CHANGEPLATFORM	"ChangePlatform"
 #define DB_MODULE_FILES				MODULENAME "Files"
 #define DB_MODULE_NEW_FILES         MODULENAME "NewFiles"
+#define DB_MODULE_HASHES            MODULENAME "Hashes"
 
 #define MAX_RETRIES   3
 
@@ -244,6 +245,8 @@ bool unzip(const wchar_t *ptszZipFile, wchar_t *ptszDestPath, wchar_t *ptszBackP
 ///////////////////////////////////////////////////////////////////////////////
 
 int CalculateModuleHash(const wchar_t *tszFileName, char *dest);
+bool GetCachedModuleHash(const wchar_t *tszFileName, char *dest);
+void SetCachedModuleHash(const wchar_t *tszFileName, const char *szHash);
 
 BOOL IsProcessElevated();
 bool PrepareEscalation();
@@ -1730,6 +1730,8 @@ panel_found:
 
 		// mir_free private theme...
 		if (pContainer->theme.isPrivate) {
+			FreeCompiledTemplates(pContainer->ltr_templates);
+			FreeCompiledTemplates(pContainer->rtl_templates);
 			mir_free(pContainer->ltr_templates);
 			mir_free(pContainer->rtl_templates);
 			mir_free(pContainer->theme.logFonts);
@@ -110,6 +110,7 @@ void  TSAPI DrawAlpha(HDC hdcwnd, PRECT rc, DWORD basecolor, int alpha, DWORD ba
 
 void  TSAPI CacheMsgLogIcons();
 void  TSAPI CacheLogFonts();
+void  TSAPI FreeCompiledTemplates(const TTemplateSet *pSet);
 void  TSAPI LoadIconTheme();
 
 int DbEventIsForMsgWindow(DBEVENTINFO *dbei);
@@ -117,6 +117,18 @@ const wchar_t* CMimAPI::getUserDir()
 	return m_userDir;
 }
 
+void CMimAPI::startTimer()
+{
+	::QueryPerformanceCounter((LARGE_INTEGER *)&m_tStart);
+}
+
+void CMimAPI::stopTimer(const char *szMsg)
+{
+	::QueryPerformanceCounter((LARGE_INTEGER *)&m_tStop);
+	if (szMsg)
+		_DebugTraceW(L"%S: %.3f ms", szMsg, getMsec());
+}
+
 void CMimAPI::InitPaths()
 {
 	const wchar_t *szUserdataDir = getUserDir();
@@ -28,6 +28,10 @@
 
 #include "stdafx.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+	#include <emmintrin.h>
+#endif
+
 struct TCpTable cpTable[] = {
 	{ 874, LPGENW("Thai") },
 	{ 932, LPGENW("Japanese") },
@@ -233,12 +237,66 @@ static int TSAPI GetColorIndex(char *rtffont)
 	return 0;
 }
 
+// plain printable ASCII, which goes to RTF as is
+__forceinline bool IsPlainRtfChar(wchar_t c)
+{
+	return c >= 0x20 && c < 0x7F && c != '\\' && c != '{' && c != '}';
+}
+
+// copies a run of plain characters into str, returns the first character that needs escaping
+static const wchar_t* AppendPlainRun(CMStringA &str, const wchar_t *line)
+{
+	char buf[256];
+	size_t n = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	// eight characters at once, as long as the 16 byte load stays inside the page
+	const __m128i lo = _mm_set1_epi16(0x1F), hi = _mm_set1_epi16(0x7F);
+	const __m128i bs = _mm_set1_epi16('\\'), ob = _mm_set1_epi16('{'), cb = _mm_set1_epi16('}');
+	while ((((UINT_PTR)line) & 0xFFF) <= 0x1000 - sizeof(__m128i)) {
+		__m128i v = _mm_loadu_si128((const __m128i*)line);
+		__m128i special = _mm_or_si128(_mm_cmpeq_epi16(v, bs), _mm_or_si128(_mm_cmpeq_epi16(v, ob), _mm_cmpeq_epi16(v, cb)));
+		__m128i plain = _mm_andnot_si128(special, _mm_and_si128(_mm_cmpgt_epi16(v, lo), _mm_cmplt_epi16(v, hi)));
+		if (_mm_movemask_epi8(plain) != 0xFFFF)
+			break;
+
+		_mm_storel_epi64((__m128i*)(buf + n), _mm_packus_epi16(v, v));
+		line += 8;
+		n += 8;
+		if (n > _countof(buf) - 8) {
+			str.Append(buf, (int)n);
+			n = 0;
+		}
+	}
+#endif
+
+	for (; IsPlainRtfChar(*line); line++) {
+		buf[n++] = (char)*line;
+		if (n == _countof(buf)) {
+			str.Append(buf, (int)n);
+			n = 0;
+		}
+	}
+
+	if (n)
+		str.Append(buf, (int)n);
+	return line;
+}
+
 static int AppendUnicodeToBuffer(CMStringA &str, const wchar_t *line, int mode)
 {
 	str.Append("{\\uc1 ");
 
 	int textCharsCount = 0;
 	for (; *line; line++, textCharsCount++) {
+		if (IsPlainRtfChar(*line)) {
+			const wchar_t *p = AppendPlainRun(str, line);
+			textCharsCount += int(p - line);
+			line = p;
+			if (*line == 0)
+				break;
+		}
+
 		if (*line == 127 && line[1] != 0) {
 			wchar_t code = line[2];
 			if (((code == '0' || code == '1') && line[3] == ' ') || (line[1] == 'c' && code == 'x')) {
@@ -363,12 +421,57 @@ static void Build_RTF_Header(CMStringA &str, CTabBaseDlg *dat)
 		str.AppendFormat("\\li%u\\ri%u\\fi%u\\tx%u", 2 * 15, 2 * 15, 0, 70 * 15);
 }
 
+// the header depends only on the theme fonts & colors, so the last few generated ones
+// are kept together with a snapshot of everything Build_RTF_Header() reads
+
+struct TRTFHeaderCache : public MZeroedObject
+{
+	MBinBuffer key;
+	CMStringA header;
+};
+
+static OBJLIST<TRTFHeaderCache> arHeaders(4);
+
+static void Build_RTF_HeaderKey(MBinBuffer &key, CTabBaseDlg *dat)
+{
+	TLogTheme *theme = &dat->m_pContainer->theme;
+
+	for (int i = 0; i <= MSGDLGFONTCOUNT; i++) {
+		key.append(&theme->logFonts[i].lfCharSet, sizeof(BYTE));
+		key.append(theme->logFonts[i].lfFaceName, mir_strlen(theme->logFonts[i].lfFaceName) + 1);
+	}
+	key.append(theme->fontColors, sizeof(COLORREF) * MSGDLGFONTCOUNT);
+
+	COLORREF colors[] = {
+		(GetSysColorBrush(COLOR_HOTLIGHT) == nullptr) ? RGB(0, 0, 255) : GetSysColor(COLOR_HOTLIGHT),
+		theme->inbg, theme->outbg, theme->bg, theme->hgrid, theme->oldinbg, theme->oldoutbg, theme->statbg,
+		(COLORREF)(dat->m_dwFlags & MWF_LOG_INDENT)
+	};
+	key.append(colors, sizeof(colors));
+	key.append(theme->custom_colors, sizeof(theme->custom_colors));
+
+	for (auto &p : Utils::rtf_clrs)
+		key.append(&p->clr, sizeof(p->clr));
+}
+
 // mir_free() the return value
 static char* CreateRTFHeader(CTabBaseDlg *dat)
 {
-	CMStringA str;
-	Build_RTF_Header(str, dat);
-	return str.Detach();
+	MBinBuffer key;
+	Build_RTF_HeaderKey(key, dat);
+
+	for (auto &p : arHeaders)
+		if (p->key.length() == key.length() && !memcmp(p->key.data(), key.data(), key.length()))
+			return mir_strdup(p->header);
+
+	if (arHeaders.getCount() == 4)
+		arHeaders.remove(0);
+
+	TRTFHeaderCache *pCache = new TRTFHeaderCache();
+	pCache->key.append(key.data(), key.length());
+	Build_RTF_Header(pCache->header, dat);
+	arHeaders.insert(pCache);
+	return mir_strdup(pCache->header);
 }
 
 static void AppendTimeStamp(wchar_t *szFinalTimestamp, int isSent, CMStringA &str, int skipFont, CTabBaseDlg *dat, int iFontIDOffset)
@@ -426,6 +529,168 @@ int DbEventIsForMsgWindow(DBEVENTINFO *dbei)
 	return et && (et->flags & DETF_MSGWINDOW);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// compiled templates
+// a template is parsed once into a list of placeholders. every placeholder owns the
+// literal text following it up to the next %, because that text is dropped together
+// with a skipped placeholder. literal text is kept already converted to RTF.
+// compiled templates are cached per template string of a template set, and a template
+// is compiled again only when its text in that set was changed
+
+#define TMPLCOND_HISTORY 0x01   // %# - old events only
+#define TMPLCOND_NEW     0x02   // %$ - new events only
+#define TMPLCOND_NORMAL  0x04   // %? - normal templates only
+#define TMPLCOND_SIMPLE  0x08   // %\ - simple templates only
+
+struct TCompiledTemplate;
+
+struct TTemplateOp : public MZeroedObject
+{
+	wchar_t code, arg;          // placeholder and its argument, arg is 0 if there's none
+	BYTE cond;                  // TMPLCOND_* which must hold to expand the placeholder
+	bool skipFont;              // %& - do not emit the font
+	CMStringA tail;             // literal text following the placeholder
+	TCompiledTemplate *pPass;   // modifiers followed by %: the rest of template if they hold
+
+	~TTemplateOp();
+};
+
+struct TCompiledTemplate : public MZeroedObject
+{
+	TCompiledTemplate() :
+		ops(10)
+	{}
+
+	const wchar_t *pszSlot;     // the template string in its template set, nullptr for pPass
+	wchar_t szSource[TEMPLATE_LENGTH];
+	CMStringA head;             // literal text before the first placeholder
+	OBJLIST<TTemplateOp> ops;
+};
+
+TTemplateOp::~TTemplateOp()
+{
+	delete pPass;
+}
+
+static int CompareTemplates(const TCompiledTemplate *p1, const TCompiledTemplate *p2)
+{
+	if (p1->pszSlot == p2->pszSlot)
+		return 0;
+	return (p1->pszSlot < p2->pszSlot) ? -1 : 1;
+}
+
+static OBJLIST<TCompiledTemplate> arTemplates(10, CompareTemplates);
+
+static void Template_AppendLiteral(CMStringA &str, const wchar_t *p, const wchar_t *pEnd)
+{
+	for (; p < pEnd; p++)
+		str.AppendFormat("{\\uc1\\u%d?}", (int)*p);
+}
+
+static TCompiledTemplate* Template_Parse(const wchar_t *szTemplate)
+{
+	TCompiledTemplate *pTemplate = new TCompiledTemplate();
+	wcsncpy_s(pTemplate->szSource, szTemplate, _TRUNCATE);
+
+	const wchar_t *p = pTemplate->szSource, *pEnd = p + mir_wstrlen(p);
+	CMStringA *pLiteral = &pTemplate->head;
+
+	while (p < pEnd) {
+		if (*p != '%') {
+			const wchar_t *pStart = p;
+			while (p < pEnd && *p != '%')
+				p++;
+			Template_AppendLiteral(*pLiteral, pStart, p);
+			continue;
+		}
+
+		TTemplateOp *op = new TTemplateOp();
+
+		// modifiers
+		for (p++;; p++) {
+			switch (*p) {
+			case '#':  op->cond |= TMPLCOND_HISTORY; continue;
+			case '$':  op->cond |= TMPLCOND_NEW; continue;
+			case '?':  op->cond |= TMPLCOND_NORMAL; continue;
+			case '\\': op->cond |= TMPLCOND_SIMPLE; continue;
+			case '&':  op->skipFont = true; continue;
+			}
+			break;
+		}
+
+		// a failed modifier skips the text up to the next %, so here that % starts the next
+		// placeholder. if the modifiers hold, the % is eaten and the text after it is parsed
+		// anew, so both ways are compiled: the rest of ops and a template for the rest of text
+		if (*p == '%' && op->cond) {
+			op->code = '%';
+			op->pPass = Template_Parse(p + 1);
+			pTemplate->ops.insert(op);
+			pLiteral = &op->tail;
+			continue;
+		}
+
+		op->code = *p;
+		if (p < pEnd)
+			p++;
+
+		// the placeholders with an argument consume it only if it is a valid one
+		wchar_t arg = *p;
+		switch (op->code) {
+		case '-':
+		case 'H':
+			if (arg >= '0' && arg <= '4')
+				op->arg = arg;
+			break;
+		case 'f':
+			if (arg && wcschr(L"dnmMs", arg))
+				op->arg = arg;
+			break;
+		case 'c':
+			if ((arg >= '0' && arg <= '4') || (arg && wcschr(L"dmns", arg)))
+				op->arg = arg;
+			break;
+		}
+		if (op->arg)
+			p++;
+
+		pTemplate->ops.insert(op);
+		pLiteral = &op->tail;
+	}
+
+	return pTemplate;
+}
+
+// szTemplate points to a template string inside a template set and identifies it.
+// the template editor changes the strings in place, so its previews replace the entry
+static TCompiledTemplate* Template_Compile(const wchar_t *szTemplate)
+{
+	TCompiledTemplate tmp;
+	tmp.pszSlot = szTemplate;
+	TCompiledTemplate *p = arTemplates.find(&tmp);
+	if (p != nullptr) {
+		if (!wcsncmp(p->szSource, szTemplate, TEMPLATE_LENGTH - 1))
+			return p;
+		arTemplates.remove(p);
+	}
+
+	p = Template_Parse(szTemplate);
+	p->pszSlot = szTemplate;
+	arTemplates.insert(p);
+	return p;
+}
+
+// drops the compiled templates of a template set that is going to be freed
+void TSAPI FreeCompiledTemplates(const TTemplateSet *pSet)
+{
+	if (pSet == nullptr)
+		return;
+
+	const wchar_t *pBegin = pSet->szTemplates[0], *pEnd = pSet->szTemplates[TMPL_ERRMSG + 1];
+	for (int i = arTemplates.getCount() - 1; i >= 0; i--)
+		if (arTemplates[i].pszSlot >= pBegin && arTemplates[i].pszSlot < pEnd)
+			arTemplates.remove(i);
+}
+
 static char* Template_CreateRTFFromDbEvent(CTabBaseDlg *dat, MCONTACT hContact, MEVENT hDbEvent, LogStreamData *streamData)
 {
 	HANDLE hTimeZone = nullptr;
@@ -545,7 +810,6 @@ static char* Template_CreateRTFFromDbEvent(CTabBaseDlg *dat, MCONTACT hContact,
 			szTemplate = isSent ? this_templateset->szTemplates[TMPL_MSGOUT] : this_templateset->szTemplates[TMPL_MSGIN];
 	}
 
-	size_t iTemplateLen = mir_wstrlen(szTemplate);
 	BOOL showTime = dwEffectiveFlags & MWF_LOG_SHOWTIME;
 	BOOL showDate = dwEffectiveFlags & MWF_LOG_SHOWDATES;
 
@@ -559,435 +823,386 @@ static char* Template_CreateRTFFromDbEvent(CTabBaseDlg *dat, MCONTACT hContact,
 
 	str.Append("\\ul0\\b0\\i0\\v0 ");
 
-	for (size_t i = 0; i < iTemplateLen;) {
-		wchar_t ci = szTemplate[i];
-		if (ci == '%') {
-			wchar_t cc = szTemplate[i + 1];
-			skipToNext = FALSE;
-			skipFont = FALSE;
-
-			// handle modifiers
-			while (cc == '#' || cc == '$' || cc == '&' || cc == '?' || cc == '\\') {
-				switch (cc) {
-				case '#':
-					if (!dat->m_bIsHistory) {
-						skipToNext = TRUE;
-						goto skip;
-					}
-					i++;
-					cc = szTemplate[i + 1];
-					continue;
+	TCompiledTemplate *pTemplate = Template_Compile(szTemplate);
+	str.Append(pTemplate->head);
+
+	for (int iOp = 0; iOp < pTemplate->ops.getCount(); iOp++) {
+		TTemplateOp *op = &pTemplate->ops[iOp];
+
+		// modifiers
+		if (op->cond) {
+			if ((op->cond & TMPLCOND_HISTORY) && !dat->m_bIsHistory)
+				continue;
+			if ((op->cond & TMPLCOND_NEW) && dat->m_bIsHistory)
+				continue;
+			if ((op->cond & TMPLCOND_NORMAL) && !(dwEffectiveFlags & MWF_LOG_NORMALTEMPLATES))
+				continue;
+			if ((op->cond & TMPLCOND_SIMPLE) && (dwEffectiveFlags & MWF_LOG_NORMALTEMPLATES))
+				continue;
+		}
 
-				case '$':
-					if (dat->m_bIsHistory) {
-						skipToNext = TRUE;
-						goto skip;
-					}
-					i++;
-					cc = szTemplate[i + 1];
-					continue;
+		// the modifiers hold and eat the following %, go on with the text after it
+		if (op->pPass) {
+			pTemplate = op->pPass;
+			str.Append(pTemplate->head);
+			iOp = -1;
+			continue;
+		}
 
-				case '&':
-					i++;
-					cc = szTemplate[i + 1];
-					skipFont = TRUE;
-					break;
+		wchar_t cc = op->code;
+		skipToNext = FALSE;
+		skipFont = op->skipFont;
 
-				case '?':
-					if (dwEffectiveFlags & MWF_LOG_NORMALTEMPLATES) {
-						i++;
-						cc = szTemplate[i + 1];
-						continue;
-					}
-					i++;
-					skipToNext = TRUE;
-					goto skip;
-
-				case '\\':
-					if (!(dwEffectiveFlags & MWF_LOG_NORMALTEMPLATES)) {
-						i++;
-						cc = szTemplate[i + 1];
-						continue;
+		wchar_t color, code;
+		switch (cc) {
+		case 'V':
+			//str.Append("\\fs0\\\expnd-40 ~-%d-~", hDbEvent);
+			break;
+		case 'I':
+			if (dwEffectiveFlags & MWF_LOG_SHOWICONS) {
+				int icon;
+				if ((dwEffectiveFlags & MWF_LOG_INOUTICONS) && dbei.eventType == EVENTTYPE_MESSAGE)
+					icon = isSent ? LOGICON_OUT : LOGICON_IN;
+				else {
+					switch (dbei.eventType) {
+					case EVENTTYPE_FILE:
+						icon = LOGICON_FILE;
+						break;
+					case EVENTTYPE_ERRMSG:
+						icon = LOGICON_ERROR;
+						break;
+					default:
+						icon = LOGICON_MSG;
+						break;
 					}
-					i++;
-					skipToNext = TRUE;
-					goto skip;
+					if (bIsStatusChangeEvent)
+						icon = LOGICON_STATUS;
 				}
+				str.AppendFormat("%s\\fs1  #~#%01d%c%s ", GetRTFFont(MSGFONTID_SYMBOLS_IN), icon, isSent ? '>' : '<', GetRTFFont(isSent ? MSGFONTID_MYMSG + iFontIDOffset : MSGFONTID_YOURMSG + iFontIDOffset));
 			}
-
-			wchar_t color, code;
-			switch (cc) {
-			case 'V':
-				//str.Append("\\fs0\\\expnd-40 ~-%d-~", hDbEvent);
-				break;
-			case 'I':
-				if (dwEffectiveFlags & MWF_LOG_SHOWICONS) {
-					int icon;
-					if ((dwEffectiveFlags & MWF_LOG_INOUTICONS) && dbei.eventType == EVENTTYPE_MESSAGE)
-						icon = isSent ? LOGICON_OUT : LOGICON_IN;
-					else {
-						switch (dbei.eventType) {
-						case EVENTTYPE_FILE:
-							icon = LOGICON_FILE;
-							break;
-						case EVENTTYPE_ERRMSG:
-							icon = LOGICON_ERROR;
-							break;
-						default:
-							icon = LOGICON_MSG;
-							break;
-						}
-						if (bIsStatusChangeEvent)
-							icon = LOGICON_STATUS;
-					}
-					str.AppendFormat("%s\\fs1  #~#%01d%c%s ", GetRTFFont(MSGFONTID_SYMBOLS_IN), icon, isSent ? '>' : '<', GetRTFFont(isSent ? MSGFONTID_MYMSG + iFontIDOffset : MSGFONTID_YOURMSG + iFontIDOffset));
-				}
-				else skipToNext = TRUE;
-				break;
-			case 'D': // long date
-				if (showTime && showDate) {
-					wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, 'D');
-					AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
-				}
-				else skipToNext = TRUE;
-				break;
-			case 'E': // short date...
-				if (showTime && showDate) {
-					wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, 'E');
-					AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
-				}
-				else skipToNext = TRUE;
-				break;
-			case 'a': // 12 hour
-			case 'h': // 24 hour
-				if (showTime) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					str.AppendFormat(cc == 'h' ? "%02d" : "%2d", cc == 'h' ? event_time.tm_hour : (event_time.tm_hour > 12 ? event_time.tm_hour - 12 : event_time.tm_hour));
-				}
-				else skipToNext = TRUE;
-				break;
-			case 'm': // minute
-				if (showTime) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					str.AppendFormat("%02d", event_time.tm_min);
-				}
-				else skipToNext = TRUE;
-				break;
-			case 's': //second
-				if (showTime && (dwEffectiveFlags & MWF_LOG_SHOWSECONDS)) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					str.AppendFormat("%02d", event_time.tm_sec);
-				}
-				else skipToNext = TRUE;
-				break;
-			case 'p': // am/pm symbol
-				if (showTime) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					str.Append(event_time.tm_hour > 11 ? "PM" : "AM");
-				}
-				else skipToNext = TRUE;
-				break;
-			case 'o':            // month
-				if (showTime && showDate) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					str.AppendFormat("%02d", event_time.tm_mon + 1);
+			else skipToNext = TRUE;
+			break;
+		case 'D': // long date
+			if (showTime && showDate) {
+				wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, 'D');
+				AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'E': // short date...
+			if (showTime && showDate) {
+				wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, 'E');
+				AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'a': // 12 hour
+		case 'h': // 24 hour
+			if (showTime) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 'O': // month (name)
-				if (showTime && showDate) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					AppendUnicodeToBuffer(str, TranslateW(months[event_time.tm_mon]), MAKELONG(isSent, dat->m_bIsHistory));
+				str.AppendFormat(cc == 'h' ? "%02d" : "%2d", cc == 'h' ? event_time.tm_hour : (event_time.tm_hour > 12 ? event_time.tm_hour - 12 : event_time.tm_hour));
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'm': // minute
+			if (showTime) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 'd': // day of month
-				if (showTime && showDate) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					str.AppendFormat("%02d", event_time.tm_mday);
+				str.AppendFormat("%02d", event_time.tm_min);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 's': //second
+			if (showTime && (dwEffectiveFlags & MWF_LOG_SHOWSECONDS)) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 'w': // day of week
-				if (showTime && showDate) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					AppendUnicodeToBuffer(str, TranslateW(weekDays[event_time.tm_wday]), MAKELONG(isSent, dat->m_bIsHistory));
+				str.AppendFormat("%02d", event_time.tm_sec);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'p': // am/pm symbol
+			if (showTime) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 'y': // year
-				if (showTime && showDate) {
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
-						str.AppendChar(' ');
-					}
-					str.AppendFormat("%04d", event_time.tm_year + 1900);
+				str.Append(event_time.tm_hour > 11 ? "PM" : "AM");
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'o':            // month
+			if (showTime && showDate) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 'R':
-			case 'r': // long date
-				if (showTime && showDate) {
-					wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, cc);
-					AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
+				str.AppendFormat("%02d", event_time.tm_mon + 1);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'O': // month (name)
+			if (showTime && showDate) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 't':
-			case 'T':
-				if (showTime) {
-					wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, (wchar_t)((dwEffectiveFlags & MWF_LOG_SHOWSECONDS) ? cc : (wchar_t)'t'));
-					AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
+				AppendUnicodeToBuffer(str, TranslateW(months[event_time.tm_mon]), MAKELONG(isSent, dat->m_bIsHistory));
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'd': // day of month
+			if (showTime && showDate) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 'S': // symbol
-				if (dwEffectiveFlags & MWF_LOG_SYMBOLS) {
-					int c;
-					if ((dwEffectiveFlags & MWF_LOG_INOUTICONS) && dbei.eventType == EVENTTYPE_MESSAGE)
-						c = isSent ? 0x37 : 0x38;
-					else {
-						switch (dbei.eventType) {
-						case EVENTTYPE_MESSAGE:
-							c = 0xaa;
-							break;
-						case EVENTTYPE_FILE:
-							c = 0xcd;
-							break;
-						case EVENTTYPE_ERRMSG:
-							c = 0x72;
-							break;
-						default:
-							c = 0xaa;
-							break;
-						}
-						if (bIsStatusChangeEvent)
-							c = 0x4e;
-					}
-					if (!skipFont) {
-						str.Append(GetRTFFont(isSent ? MSGFONTID_SYMBOLS_OUT : MSGFONTID_SYMBOLS_IN));
-						str.AppendChar(' ');
-					}
-					str.AppendFormat("%c%s ", c, GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
+				str.AppendFormat("%02d", event_time.tm_mday);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'w': // day of week
+			if (showTime && showDate) {
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
-			case 'n': // hard line break
-				str.Append(dbei.flags & DBEF_RTL ? "\\rtlpar\\par\\rtlpar" : "\\par\\ltrpar");
-				break;
-			case 'l': // soft line break
-				str.Append("\\line");
-				break;
-			case 'N': // nickname
+				AppendUnicodeToBuffer(str, TranslateW(weekDays[event_time.tm_wday]), MAKELONG(isSent, dat->m_bIsHistory));
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'y': // year
+			if (showTime && showDate) {
 				if (!skipFont) {
-					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME)));
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME)));
 					str.AppendChar(' ');
 				}
-				AppendUnicodeToBuffer(str, (isSent) ? szMyName : szYourName, MAKELONG(isSent, dat->m_bIsHistory));
-				break;
-			case 'U': // UIN
+				str.AppendFormat("%04d", event_time.tm_year + 1900);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'R':
+		case 'r': // long date
+			if (showTime && showDate) {
+				wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, cc);
+				AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 't':
+		case 'T':
+			if (showTime) {
+				wchar_t	*szFinalTimestamp = Template_MakeRelativeDate(hTimeZone, dbei.timestamp, (wchar_t)((dwEffectiveFlags & MWF_LOG_SHOWSECONDS) ? cc : (wchar_t)'t'));
+				AppendTimeStamp(szFinalTimestamp, isSent, str, skipFont, dat, iFontIDOffset);
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'S': // symbol
+			if (dwEffectiveFlags & MWF_LOG_SYMBOLS) {
+				int c;
+				if ((dwEffectiveFlags & MWF_LOG_INOUTICONS) && dbei.eventType == EVENTTYPE_MESSAGE)
+					c = isSent ? 0x37 : 0x38;
+				else {
+					switch (dbei.eventType) {
+					case EVENTTYPE_MESSAGE:
+						c = 0xaa;
+						break;
+					case EVENTTYPE_FILE:
+						c = 0xcd;
+						break;
+					case EVENTTYPE_ERRMSG:
+						c = 0x72;
+						break;
+					default:
+						c = 0xaa;
+						break;
+					}
+					if (bIsStatusChangeEvent)
+						c = 0x4e;
+				}
 				if (!skipFont) {
-					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME)));
+					str.Append(GetRTFFont(isSent ? MSGFONTID_SYMBOLS_OUT : MSGFONTID_SYMBOLS_IN));
 					str.AppendChar(' ');
 				}
-				AppendUnicodeToBuffer(str, (isSent) ? dat->m_myUin : dat->m_cache->getUIN(), MAKELONG(isSent, dat->m_bIsHistory));
-				break;
-			case 'e': // error message
-				str.Append(GetRTFFont(MSGFONTID_ERROR));
+				str.AppendFormat("%c%s ", c, GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
+			}
+			else skipToNext = TRUE;
+			break;
+		case 'n': // hard line break
+			str.Append(dbei.flags & DBEF_RTL ? "\\rtlpar\\par\\rtlpar" : "\\par\\ltrpar");
+			break;
+		case 'l': // soft line break
+			str.Append("\\line");
+			break;
+		case 'N': // nickname
+			if (!skipFont) {
+				str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME)));
 				str.AppendChar(' ');
-				AppendUnicodeToBuffer(str, LPCTSTR(dbei.szModule), MAKELONG(isSent, dat->m_bIsHistory));
-				break;
-			case 'M': // message
-				switch (dbei.eventType) {
-				case EVENTTYPE_MESSAGE:
-				case EVENTTYPE_ERRMSG:
-					if (bIsStatusChangeEvent || dbei.eventType == EVENTTYPE_ERRMSG) {
-						if (dbei.eventType == EVENTTYPE_ERRMSG && dbei.cbBlob == 0)
-							break;
-						if (dbei.eventType == EVENTTYPE_ERRMSG) {
-							if (!skipFont)
-								str.AppendFormat("\\line%s ", GetRTFFont(bIsStatusChangeEvent ? H_MSGFONTID_STATUSCHANGES : MSGFONTID_MYMSG));
-							else
-								str.Append("\\line ");
-						}
-						else if (!skipFont) {
-							str.Append(GetRTFFont(bIsStatusChangeEvent ? H_MSGFONTID_STATUSCHANGES : MSGFONTID_MYMSG));
-							str.AppendChar(' ');
-						}
+			}
+			AppendUnicodeToBuffer(str, (isSent) ? szMyName : szYourName, MAKELONG(isSent, dat->m_bIsHistory));
+			break;
+		case 'U': // UIN
+			if (!skipFont) {
+				str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME)));
+				str.AppendChar(' ');
+			}
+			AppendUnicodeToBuffer(str, (isSent) ? dat->m_myUin : dat->m_cache->getUIN(), MAKELONG(isSent, dat->m_bIsHistory));
+			break;
+		case 'e': // error message
+			str.Append(GetRTFFont(MSGFONTID_ERROR));
+			str.AppendChar(' ');
+			AppendUnicodeToBuffer(str, LPCTSTR(dbei.szModule), MAKELONG(isSent, dat->m_bIsHistory));
+			break;
+		case 'M': // message
+			switch (dbei.eventType) {
+			case EVENTTYPE_MESSAGE:
+			case EVENTTYPE_ERRMSG:
+				if (bIsStatusChangeEvent || dbei.eventType == EVENTTYPE_ERRMSG) {
+					if (dbei.eventType == EVENTTYPE_ERRMSG && dbei.cbBlob == 0)
+						break;
+					if (dbei.eventType == EVENTTYPE_ERRMSG) {
+						if (!skipFont)
+							str.AppendFormat("\\line%s ", GetRTFFont(bIsStatusChangeEvent ? H_MSGFONTID_STATUSCHANGES : MSGFONTID_MYMSG));
+						else
+							str.Append("\\line ");
 					}
 					else if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
+						str.Append(GetRTFFont(bIsStatusChangeEvent ? H_MSGFONTID_STATUSCHANGES : MSGFONTID_MYMSG));
 						str.AppendChar(' ');
 					}
-
-					AppendUnicodeToBuffer(str, msg, MAKELONG(isSent, dat->m_bIsHistory));
-					str.Append("\\b0\\ul0\\i0 ");
-					break;
-
-				case EVENTTYPE_FILE:
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMISC : MSGFONTID_YOURMISC)));
-						str.AppendChar(' ');
-					}
-					{
-						char *szFileName = (char *)dbei.pBlob + sizeof(DWORD);
-						ptrW tszFileName(DbEvent_GetString(&dbei, szFileName));
-
-						char *szDescr = szFileName + mir_strlen(szFileName) + 1;
-						if (*szDescr != 0) {
-							ptrW tszDescr(DbEvent_GetString(&dbei, szDescr));
-
-							wchar_t buf[1000];
-							mir_snwprintf(buf, L"%s (%s)", tszFileName, tszDescr);
-							AppendUnicodeToBuffer(str, buf, 0);
-						}
-						else AppendUnicodeToBuffer(str, tszFileName, 0);
-					}
-					break;
-
-				default:
-					if (!skipFont) {
-						str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
-						str.AppendChar(' ');
-					}
-
-					ptrW tszText(DbEvent_GetTextW(&dbei, CP_ACP));
-					AppendUnicodeToBuffer(str, tszText, 0);
 				}
-				break;
-			case '*':       // bold
-				str.Append(isBold ? "\\b0 " : "\\b ");
-				isBold = !isBold;
-				break;
-			case '/': // italic
-				str.Append(isItalic ? "\\i0 " : "\\i ");
-				isItalic = !isItalic;
-				break;
-			case '_': // italic
-				str.Append(isUnderline ? "\\ul0 " : "\\ul ");
-				isUnderline = !isUnderline;
-				break;
-			case '-': // grid line
-				color = szTemplate[i + 2];
-				if (color >= '0' && color <= '4') {
-					str.AppendFormat("\\par\\sl-1\\slmult0\\highlight%d\\cf%d\\-\\par\\sl0", MSGDLGFONTCOUNT + 8 + (color - '0'), MSGDLGFONTCOUNT + 7 + (color - '0'));
-					i++;
+				else if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
+					str.AppendChar(' ');
 				}
-				else str.AppendFormat("\\par\\sl-1\\slmult0\\highlight%d\\cf%d\\-\\par\\sl0", MSGDLGFONTCOUNT + 4, MSGDLGFONTCOUNT + 4);
-				break;
-			case '~':       // font break (switch to default font...)
-				str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
+
+				AppendUnicodeToBuffer(str, msg, MAKELONG(isSent, dat->m_bIsHistory));
+				str.Append("\\b0\\ul0\\i0 ");
 				break;
-			case 'H':        // highlight
-				color = szTemplate[i + 2];
-				if (color >= '0' && color <= '4') {
-					str.AppendFormat("\\highlight%d", MSGDLGFONTCOUNT + 8 + (color - '0'));
-					i++;
+
+			case EVENTTYPE_FILE:
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMISC : MSGFONTID_YOURMISC)));
+					str.AppendChar(' ');
 				}
-				else str.AppendFormat("\\highlight%d", (MSGDLGFONTCOUNT + (dat->m_bIsHistory ? 5 : 1) + ((isSent) ? 1 : 0)));
-				break;
-			case '|':       // tab
-				if (dwEffectiveFlags & MWF_LOG_INDENT)
-					str.Append("\\tab");
-				else
-					str.Append(" ");
-				break;
-			case 'f':      // font tag...
-				code = szTemplate[i + 2];
 				{
-					int fontindex = -1;
-					switch (code) {
-					case 'd':
-						fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME);
-						break;
-					case 'n':
-						fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME);
-						break;
-					case 'm':
-						fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG);
-						break;
-					case 'M':
-						fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYMISC : MSGFONTID_YOURMISC);
-						break;
-					case 's':
-						fontindex = isSent ? MSGFONTID_SYMBOLS_OUT : MSGFONTID_SYMBOLS_IN;
-						break;
-					}
-					if (fontindex != -1) {
-						i++;
-						str.Append(GetRTFFont(fontindex));
+					char *szFileName = (char *)dbei.pBlob + sizeof(DWORD);
+					ptrW tszFileName(DbEvent_GetString(&dbei, szFileName));
+
+					char *szDescr = szFileName + mir_strlen(szFileName) + 1;
+					if (*szDescr != 0) {
+						ptrW tszDescr(DbEvent_GetString(&dbei, szDescr));
+
+						wchar_t buf[1000];
+						mir_snwprintf(buf, L"%s (%s)", tszFileName, tszDescr);
+						AppendUnicodeToBuffer(str, buf, 0);
 					}
-					else skipToNext = TRUE;
+					else AppendUnicodeToBuffer(str, tszFileName, 0);
 				}
 				break;
 
-			case 'c':      // font color (using one of the predefined 5 colors) or one of the standard font colors (m = message, d = date/time, n = nick)
-				color = szTemplate[i + 2];
-				if (color >= '0' && color <= '4') {
-					str.AppendFormat("\\cf%d ", MSGDLGFONTCOUNT + 8 + (color - '0'));
-					i++;
-				}
-				else if (color == 'd') {
-					str.AppendFormat("\\cf%d ", iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME));
-					i++;
-				}
-				else if (color == 'm') {
-					str.AppendFormat("\\cf%d ", iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG));
-					i++;
-				}
-				else if (color == 'n') {
-					str.AppendFormat("\\cf%d ", iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME));
-					i++;
-				}
-				else if (color == 's') {
-					str.AppendFormat("\\cf%d ", isSent ? MSGFONTID_SYMBOLS_OUT : MSGFONTID_SYMBOLS_IN);
-					i++;
+			default:
+				if (!skipFont) {
+					str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
+					str.AppendChar(' ');
 				}
-				else skipToNext = TRUE;
-				break;
 
-			case '<':		// bidi tag
-				str.Append("\\rtlmark\\rtlch ");
-				break;
-			case '>':		// bidi tag
-				str.Append("\\ltrmark\\ltrch ");
-				break;
+				ptrW tszText(DbEvent_GetTextW(&dbei, CP_ACP));
+				AppendUnicodeToBuffer(str, tszText, 0);
 			}
-		skip:
-			if (skipToNext) {
-				i++;
-				while (szTemplate[i] != '%' && i < iTemplateLen) i++;
+			break;
+		case '*':       // bold
+			str.Append(isBold ? "\\b0 " : "\\b ");
+			isBold = !isBold;
+			break;
+		case '/': // italic
+			str.Append(isItalic ? "\\i0 " : "\\i ");
+			isItalic = !isItalic;
+			break;
+		case '_': // italic
+			str.Append(isUnderline ? "\\ul0 " : "\\ul ");
+			isUnderline = !isUnderline;
+			break;
+		case '-': // grid line
+			color = op->arg;
+			if (color >= '0' && color <= '4')
+				str.AppendFormat("\\par\\sl-1\\slmult0\\highlight%d\\cf%d\\-\\par\\sl0", MSGDLGFONTCOUNT + 8 + (color - '0'), MSGDLGFONTCOUNT + 7 + (color - '0'));
+			else str.AppendFormat("\\par\\sl-1\\slmult0\\highlight%d\\cf%d\\-\\par\\sl0", MSGDLGFONTCOUNT + 4, MSGDLGFONTCOUNT + 4);
+			break;
+		case '~':       // font break (switch to default font...)
+			str.Append(GetRTFFont(iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG)));
+			break;
+		case 'H':        // highlight
+			color = op->arg;
+			if (color >= '0' && color <= '4')
+				str.AppendFormat("\\highlight%d", MSGDLGFONTCOUNT + 8 + (color - '0'));
+			else str.AppendFormat("\\highlight%d", (MSGDLGFONTCOUNT + (dat->m_bIsHistory ? 5 : 1) + ((isSent) ? 1 : 0)));
+			break;
+		case '|':       // tab
+			if (dwEffectiveFlags & MWF_LOG_INDENT)
+				str.Append("\\tab");
+			else
+				str.Append(" ");
+			break;
+		case 'f':      // font tag...
+			code = op->arg;
+			{
+				int fontindex = -1;
+				switch (code) {
+				case 'd':
+					fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME);
+					break;
+				case 'n':
+					fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME);
+					break;
+				case 'm':
+					fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG);
+					break;
+				case 'M':
+					fontindex = iFontIDOffset + (isSent ? MSGFONTID_MYMISC : MSGFONTID_YOURMISC);
+					break;
+				case 's':
+					fontindex = isSent ? MSGFONTID_SYMBOLS_OUT : MSGFONTID_SYMBOLS_IN;
+					break;
+				}
+				if (fontindex != -1)
+					str.Append(GetRTFFont(fontindex));
+				else skipToNext = TRUE;
 			}
-			else i += 2;
-		}
-		else {
-			str.AppendFormat("{\\uc1\\u%d?}", (int)ci);
-			i++;
+			break;
+
+		case 'c':      // font color (using one of the predefined 5 colors) or one of the standard font colors (m = message, d = date/time, n = nick)
+			color = op->arg;
+			if (color >= '0' && color <= '4')
+				str.AppendFormat("\\cf%d ", MSGDLGFONTCOUNT + 8 + (color - '0'));
+			else if (color == 'd')
+				str.AppendFormat("\\cf%d ", iFontIDOffset + (isSent ? MSGFONTID_MYTIME : MSGFONTID_YOURTIME));
+			else if (color == 'm')
+				str.AppendFormat("\\cf%d ", iFontIDOffset + (isSent ? MSGFONTID_MYMSG : MSGFONTID_YOURMSG));
+			else if (color == 'n')
+				str.AppendFormat("\\cf%d ", iFontIDOffset + (isSent ? MSGFONTID_MYNAME : MSGFONTID_YOURNAME));
+			else if (color == 's')
+				str.AppendFormat("\\cf%d ", isSent ? MSGFONTID_SYMBOLS_OUT : MSGFONTID_SYMBOLS_IN);
+			else skipToNext = TRUE;
+			break;
+
+		case '<':		// bidi tag
+			str.Append("\\rtlmark\\rtlch ");
+			break;
+		case '>':		// bidi tag
+			str.Append("\\ltrmark\\ltrch ");
+			break;
 		}
+
+		// the literal text following a skipped placeholder is dropped with it
+		if (!skipToNext)
+			str.Append(op->tail);
 	}
 
 	if (dat->m_hHistoryEvents)
@@ -1301,7 +1516,15 @@ void CTabBaseDlg::StreamInEvents(MEVENT hDbEventFirst, int count, int fAppend, D
 	// begin to draw
 	m_log.SendMsg(WM_SETREDRAW, FALSE, 0);
 
+#ifdef _DEBUG
+	M.startTimer();
+#endif
 	m_log.SendMsg(EM_STREAMIN, fAppend ? SFF_SELECTION | SF_RTF : SFF_SELECTION | SF_RTF, (LPARAM)&stream);
+#ifdef _DEBUG
+	M.stopTimer();
+	if (count > 0)
+		_DebugTraceW(L"log: %d events streamed in %.2f ms (%.3f ms per event)", count, M.getMsec(), M.getMsec() / count);
+#endif
 	m_log.SendMsg(EM_EXSETSEL, 0, (LPARAM)&oldSel);
 	m_log.SendMsg(EM_HIDESELECTION, FALSE, 0);
 	m_hDbEventLast = streamData.hDbEventLast;
@@ -42,6 +42,152 @@ CMPlugin::CMPlugin() :
 	PLUGIN<CMPlugin>(MODULENAME, pluginInfoEx)
 {}
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// services, hooks & internal tokens; the formatting engine itself is in variables.cpp
+
+static HANDLE
+	hOptionsHook = nullptr,
+	hIconsChangedHook = nullptr;
+
+HCURSOR hCurSplitNS;
+
+/*
+	MS_VARS_FORMATSTRING
+*/
+static INT_PTR formatStringService(WPARAM wParam, LPARAM)
+{
+	FORMATINFO *pfi = (FORMATINFO*)wParam;
+	if (pfi->cbSize != sizeof(FORMATINFO))
+		return 0;
+
+	// prevent the original structure from being altered
+	FORMATINFO tmpfi = *pfi;
+	bool copied;
+	wchar_t *tszFormat, *tszSource;
+	if (tmpfi.flags & FIF_UNICODE) {
+		copied = false;
+		tszFormat = tmpfi.szFormat.w;
+		tszSource = tmpfi.szExtraText.w;
+	}
+	else {
+		copied = true;
+		tszFormat = mir_a2u(tmpfi.szFormat.a);
+		tszSource = mir_a2u(tmpfi.szExtraText.a);
+		for (int i = 0; i < tmpfi.cbTemporaryVarsSize; i++)
+			tmpfi.szTemporaryVars.w[i] = mir_a2u(tmpfi.szTemporaryVars.a[i]);
+	}
+
+	tmpfi.szFormat.w = tszFormat;
+	tmpfi.szExtraText.w = tszSource;
+
+	wchar_t *tRes = formatString(&tmpfi);
+
+	INT_PTR res;
+	if (!(tmpfi.flags & FIF_UNICODE)) {
+		res = (INT_PTR)mir_u2a(tRes);
+		mir_free(tRes);
+	}
+	else res = (INT_PTR)tRes;
+
+	if (copied) {
+		mir_free(tszFormat);
+		mir_free(tszSource);
+		for (int i = 0; i < tmpfi.cbTemporaryVarsSize; i++)
+			mir_free(tmpfi.szTemporaryVars.w);
+	}
+
+	((FORMATINFO *)wParam)->eCount = tmpfi.eCount;
+	((FORMATINFO *)wParam)->pCount = tmpfi.pCount;
+	return res;
+}
+
+int setParseOptions(struct ParseOptions *po)
+{
+	if (po == nullptr)
+		po = &gParseOpts;
+
+	memset(po, 0, sizeof(struct ParseOptions));
+	if (!db_get_b(NULL, MODULENAME, SETTING_STRIPALL, 0)) {
+		po->bStripEOL = db_get_b(NULL, MODULENAME, SETTING_STRIPCRLF, 0);
+		po->bStripWS = db_get_b(NULL, MODULENAME, SETTING_STRIPWS, 0);
+	}
+	else po->bStripAll = TRUE;
+
+	if (po == &gParseOpts)
+		invalidateFormatCache();
+	return 0;
+}
+
+static IconItem iconList[] = 
+{
+	{ LPGEN("Help"), "vars_help", IDI_V }
+};
+
+int LoadVarModule()
+{
+	if (initTokenRegister() != 0 || initContactModule() != 0)
+		return -1;
+
+	setParseOptions(nullptr);
+	CreateServiceFunction(MS_VARS_FORMATSTRING, formatStringService);
+	CreateServiceFunction(MS_VARS_REGISTERTOKEN, registerToken);
+	// help dialog
+	hCurSplitNS = LoadCursor(nullptr, IDC_SIZENS);
+
+	CreateServiceFunction(MS_VARS_SHOWHELP, showHelpService);
+	CreateServiceFunction(MS_VARS_SHOWHELPEX, showHelpExService);
+
+	g_plugin.registerIcon(LPGEN("Variables"), iconList);
+
+	hIconsChangedHook = HookEvent(ME_SKIN2_ICONSCHANGED, iconsChanged);
+
+	CreateServiceFunction(MS_VARS_GETSKINITEM, getSkinItemService);
+	hOptionsHook = HookEvent(ME_OPT_INITIALISE, OptionsInit);
+
+	// register internal tokens
+	registerExternalTokens();
+	registerLogicTokens();
+	registerMathTokens();
+	registerMirandaTokens();
+	registerStrTokens();
+	registerSystemTokens();
+	registerVariablesTokens();
+	registerRegExpTokens();
+	registerInetTokens();
+	registerAliasTokens();
+	registerMetaContactsTokens();
+
+	log_debugA("Variables: Internal tokens registered");
+
+	if (db_get_b(NULL, MODULENAME, SETTING_PARSEATSTARTUP, 0)) {
+		FORMATINFO fi = { 0 };
+		fi.cbSize = sizeof(fi);
+		fi.szFormat.w = db_get_wsa(NULL, MODULENAME, SETTING_STARTUPTEXT);
+		if (fi.szFormat.w != nullptr) {
+			mir_free(formatString(&fi));
+			mir_free(fi.szFormat.w);
+		}
+	}
+	log_debugA("Variables: Init done");
+
+	return 0;
+}
+
+int UnloadVarModule()
+{
+	UnhookEvent(hOptionsHook);
+	if (hIconsChangedHook != nullptr)
+		UnhookEvent(hIconsChangedHook);
+
+	DestroyCursor(hCurSplitNS);
+	deinitContactModule();
+	invalidateFormatCache();
+	deinitTokenRegister();
+	unregisterAliasTokens();
+	unregisterVariablesTokens();
+	return 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // Load - plugin's entry point
 
@@ -151,6 +151,9 @@ extern ParseOptions gParseOpts;
 // variables.c
 //int isValidTokenChar(char c);
 wchar_t *formatString(FORMATINFO *fi);
+wchar_t *parseString(FORMATINFO *fi, const wchar_t *szFormat);
+void invalidateFormatCache();
+// main.cpp
 int  setParseOptions(struct ParseOptions *po);
 int  LoadVarModule();
 int  UnloadVarModule();
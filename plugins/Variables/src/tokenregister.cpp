@@ -72,6 +72,7 @@ int deRegisterToken(wchar_t *token)
 
 		tokens.remove(tre);
 	}
+	invalidateFormatCache();
 
 	if (!(tre->tr.flags & TRF_PARSEFUNC) && tre->tr.szService != nullptr)
 		mir_free(tre->tr.szService);
@@ -131,8 +132,11 @@ INT_PTR registerToken(WPARAM, LPARAM lParam)
 	if ((newVr->flags & TRF_CLEANUP) && !(newVr->flags & TRF_CLEANUPFUNC) && newVr->szCleanupService != nullptr)
 		tre->tr.szCleanupService = mir_strdup(newVr->szCleanupService);
 
-	mir_cslock lck(csRegister);
-	tokens.insert(tre);
+	{
+		mir_cslock lck(csRegister);
+		tokens.insert(tre);
+	}
+	invalidateFormatCache();
 	return 0;
 }
 
@@ -19,13 +19,6 @@
 
 #include "stdafx.h"
 
-/* some handles */
-static HANDLE
-	hOptionsHook = nullptr,
-	hIconsChangedHook = nullptr;
-
-HCURSOR hCurSplitNS;
-
 struct ParseOptions gParseOpts;
 
 wchar_t* getArguments(wchar_t *string, TArgList &argv)
@@ -103,14 +96,11 @@ int isValidTokenChar(wchar_t tc)
 }
 
 /* pretty much the main loop */
-static wchar_t* replaceDynVars(FORMATINFO *fi)
+wchar_t* parseString(FORMATINFO *fi, const wchar_t *szFormat)
 {
-	if (fi->szFormat.w == nullptr)
-		return nullptr;
-
 	int i, scurPos, curPos, tmpVarPos;
 
-	wchar_t *string = mir_wstrdup(fi->szFormat.w);
+	wchar_t *string = mir_wstrdup(szFormat);
 	if (string == nullptr)
 		return nullptr;
 
@@ -297,151 +287,372 @@ static wchar_t* replaceDynVars(FORMATINFO *fi)
 	return (wchar_t*)mir_realloc(string, (mir_wstrlen(string) + 1)*sizeof(wchar_t));
 }
 
-/*
-	MS_VARS_FORMATSTRING
-*/
-static INT_PTR formatStringService(WPARAM wParam, LPARAM)
+/////////////////////////////////////////////////////////////////////////////////////////
+// compiled formats
+// a format string is split once into literal text and tokens, the result is cached by
+// the string itself plus the names of temporary variables. if a token's result has to be
+// parsed again or a token fails, the rest of the string goes through parseString() as
+// before, so that the output stays the same
+
+#define MAX_CACHED_FORMATS 500
+
+struct FormatNode
 {
-	FORMATINFO *pfi = (FORMATINFO*)wParam;
-	if (pfi->cbSize != sizeof(FORMATINFO))
-		return 0;
-
-	// prevent the original structure from being altered
-	FORMATINFO tmpfi = *pfi;
-	bool copied;
-	wchar_t *tszFormat, *tszSource;
-	if (tmpfi.flags & FIF_UNICODE) {
-		copied = false;
-		tszFormat = tmpfi.szFormat.w;
-		tszSource = tmpfi.szExtraText.w;
-	}
-	else {
-		copied = true;
-		tszFormat = mir_a2u(tmpfi.szFormat.a);
-		tszSource = mir_a2u(tmpfi.szExtraText.a);
-		for (int i = 0; i < tmpfi.cbTemporaryVarsSize; i++)
-			tmpfi.szTemporaryVars.w[i] = mir_a2u(tmpfi.szTemporaryVars.a[i]);
-	}
+	FormatNode() : tmpVarPos(-1), flags(0), nErrors(0), start(0), end(0) {}
+	~FormatNode() { argv.destroy(); }
+
+	CMStringW text;       // literal text before the token
+	CMStringW token;      // token name, empty for the trailing text
+	int tmpVarPos;        // index of a temporary variable or -1
+	int flags;            // TRF_* flags of the token
+	int nErrors;          // errors found by the parser before this token
+	wchar_t prefix;       // FIELD_CHAR, FUNC_CHAR or FUNC_ONCE_CHAR
+	int start, end;       // position of the token in the source string
+	TArgList argv;        // unparsed arguments of a function
+};
 
-	tmpfi.szFormat.w = tszFormat;
-	tmpfi.szExtraText.w = tszSource;
+struct CompiledFormat : public MZeroedObject
+{
+	CompiledFormat() : nodes(10) {}
 
-	wchar_t *tRes = formatString(&tmpfi);
+	DWORD hash;
+	CMStringW key, source;
+	OBJLIST<FormatNode> nodes;
+	LONG refs;
+};
 
-	INT_PTR res;
-	if (!(tmpfi.flags & FIF_UNICODE)) {
-		res = (INT_PTR)mir_u2a(tRes);
-		mir_free(tRes);
-	}
-	else res = (INT_PTR)tRes;
+static int CompareFormats(const CompiledFormat *p1, const CompiledFormat *p2)
+{
+	if (p1->hash != p2->hash)
+		return (p1->hash < p2->hash) ? -1 : 1;
+	return mir_wstrcmp(p1->key, p2->key);
+}
 
-	if (copied) {
-		mir_free(tszFormat);
-		mir_free(tszSource);
-		for (int i = 0; i < tmpfi.cbTemporaryVarsSize; i++)
-			mir_free(tmpfi.szTemporaryVars.w);
-	}
+static LIST<CompiledFormat> arFormats(50, CompareFormats);
+static mir_cs csFormats;
 
-	((FORMATINFO *)wParam)->eCount = tmpfi.eCount;
-	((FORMATINFO *)wParam)->pCount = tmpfi.pCount;
-	return res;
+static void releaseFormat(CompiledFormat *cf)
+{
+	if (InterlockedDecrement(&cf->refs) == 0)
+		delete cf;
 }
 
-wchar_t* formatString(FORMATINFO *fi)
+void invalidateFormatCache()
 {
-	if (fi == nullptr)
-		return nullptr;
-	/* the service to format a given string */
-	if ((fi->eCount + fi->pCount) > 5000) {
-		fi->eCount++;
-		fi->pCount++;
-		log_debugA("Variables: Overflow protection; %d parses", (fi->eCount + fi->pCount));
-		return nullptr;
+	mir_cslock lck(csFormats);
+	for (auto &it : arFormats)
+		releaseFormat(it);
+	arFormats.destroy();
+}
+
+// the same decisions as parseString() makes, but without touching the string
+static CompiledFormat* compileFormat(FORMATINFO *fi, const CMStringW &key)
+{
+	CompiledFormat *cf = new CompiledFormat();
+	cf->key = key;
+	cf->hash = mir_hashstrW(key);
+	cf->source = fi->szFormat.w;
+	cf->refs = 1;
+
+	wchar_t *string = cf->source.GetBuffer();
+	int len = cf->source.GetLength(), nErrors = 0;
+	FormatNode *node = new FormatNode();
+
+	for (int pos = 0; pos < len;) {
+		wchar_t *cur = string + pos;
+
+		if (*cur == DONTPARSE_CHAR) {
+			cur++;
+			if (*cur == DONTPARSE_CHAR) {
+				node->text.AppendChar(DONTPARSE_CHAR);
+				pos += 2;
+				continue;
+			}
+
+			wchar_t *scur = cur;
+			while ((*cur != DONTPARSE_CHAR) && (*cur != 0))
+				cur++;
+
+			node->text.Append(scur, int(cur - scur));
+			pos = int(cur - string) + (*cur != 0);
+			continue;
+		}
+
+		if ((!wcsncmp(cur, L"\r\n", 2)) && (gParseOpts.bStripEOL)) {
+			pos += 2;
+			continue;
+		}
+
+		if ((*cur == '\n' && gParseOpts.bStripEOL) || (*cur == ' ' && gParseOpts.bStripWS)) {
+			pos++;
+			continue;
+		}
+
+		if (!wcsncmp(cur, _A2W(COMMENT_STRING), _countof(COMMENT_STRING))) {
+			while (wcsncmp(cur, L"\r\n", 2) && *cur != '\n' && *cur != 0)
+				cur++;
+			if (*cur == 0)
+				break;
+
+			pos = int(cur - string);
+			continue;
+		}
+
+		if ((*cur != FIELD_CHAR) && (*cur != FUNC_CHAR) && (*cur != FUNC_ONCE_CHAR)) {
+			if (!gParseOpts.bStripAll)
+				node->text.AppendChar(*cur);
+			pos++;
+			continue;
+		}
+
+		wchar_t *scur = cur + 1, *tcur = scur;
+		while (isValidTokenChar(*tcur))
+			tcur++;
+
+		CMStringW token(scur, int(tcur - scur));
+		TOKENREGISTEREX *tr = nullptr;
+		int tmpVarPos = -1;
+		if (*cur == FIELD_CHAR) {
+			for (int i = 0; i < fi->cbTemporaryVarsSize; i += 2) {
+				if (!mir_wstrcmp(fi->szTemporaryVars.w[i], token)) {
+					tmpVarPos = i;
+					break;
+				}
+			}
+		}
+
+		if (tmpVarPos < 0)
+			tr = searchRegister(token.GetBuffer(), (*cur == FIELD_CHAR) ? TRF_FIELD : TRF_FUNCTION);
+
+		// unknown token, its first char stays in the text
+		if (tmpVarPos < 0 && tr == nullptr) {
+			nErrors++;
+			node->text.AppendChar(*cur);
+			pos++;
+			continue;
+		}
+
+		int tokenLen = (int)mir_wstrlen(tr != nullptr ? tr->szTokenString.w : fi->szTemporaryVars.w[tmpVarPos]);
+		if (pos + tokenLen + 1 > len) {
+			nErrors++;
+			node->text.AppendChar(*cur);
+			pos++;
+			continue;
+		}
+
+		wchar_t *end = cur + tokenLen + 1;
+		if (*cur == FIELD_CHAR) {
+			if (*end != FIELD_CHAR) { // the next char after the token should be %
+				nErrors++;
+				node->text.AppendChar(*cur);
+				pos++;
+				continue;
+			}
+			end++;
+		}
+		else {
+			wchar_t *argcur = getArguments(end, node->argv);
+			if (argcur == end || argcur == nullptr) {
+				node->argv.destroy();
+				nErrors++;
+				node->text.AppendChar(*cur);
+				pos++;
+				continue;
+			}
+			end = argcur;
+		}
+
+		node->prefix = *cur;
+		node->nErrors = nErrors;
+		node->tmpVarPos = tmpVarPos;
+		if (tr != nullptr) {
+			node->token = tr->szTokenString.w;
+			node->flags = tr->flags;
+		}
+		node->start = pos;
+		node->end = pos = int(end - string);
+		cf->nodes.insert(node, cf->nodes.getCount());
+
+		node = new FormatNode();
+		nErrors = 0;
 	}
 
-	return replaceDynVars(fi);
+	// trailing text & errors
+	node->nErrors = nErrors;
+	cf->nodes.insert(node, cf->nodes.getCount());
+	return cf;
 }
 
-int setParseOptions(struct ParseOptions *po)
+static CompiledFormat* getCompiledFormat(FORMATINFO *fi)
 {
-	if (po == nullptr)
-		po = &gParseOpts;
+	CMStringW key(fi->szFormat.w);
+	for (int i = 0; i < fi->cbTemporaryVarsSize; i += 2) {
+		key.AppendChar(1);
+		key.Append(fi->szTemporaryVars.w[i]);
+	}
+
+	CompiledFormat tmp;
+	tmp.key = key;
+	tmp.hash = mir_hashstrW(key);
+	{
+		mir_cslock lck(csFormats);
+		CompiledFormat *cf = arFormats.find(&tmp);
+		if (cf != nullptr) {
+			InterlockedIncrement(&cf->refs);
+			return cf;
+		}
+	}
+
+	CompiledFormat *cf = compileFormat(fi, key);
 
-	memset(po, 0, sizeof(struct ParseOptions));
-	if (!db_get_b(NULL, MODULENAME, SETTING_STRIPALL, 0)) {
-		po->bStripEOL = db_get_b(NULL, MODULENAME, SETTING_STRIPCRLF, 0);
-		po->bStripWS = db_get_b(NULL, MODULENAME, SETTING_STRIPWS, 0);
+	mir_cslock lck(csFormats);
+	if (CompiledFormat *p = arFormats.find(&tmp)) {
+		// another thread was faster
+		delete cf;
+		cf = p;
+	}
+	else {
+		if (arFormats.getCount() >= MAX_CACHED_FORMATS) {
+			for (auto &it : arFormats)
+				releaseFormat(it);
+			arFormats.destroy();
+		}
+		arFormats.insert(cf);
 	}
-	else po->bStripAll = TRUE;
 
-	return 0;
+	InterlockedIncrement(&cf->refs);
+	return cf;
 }
 
-static IconItem iconList[] = 
+// can a result be inserted as is instead of being parsed again?
+static bool isInertResult(const wchar_t *str)
 {
-	{ LPGEN("Help"), "vars_help", IDI_V }
-};
+	for (; *str; str++) {
+		if (*str == COMMENT_STRING[0])
+			return false;
+
+		switch (*str) {
+		case FIELD_CHAR:
+		case FUNC_CHAR:
+		case FUNC_ONCE_CHAR:
+		case DONTPARSE_CHAR:
+			return false;
+
+		case '\r':
+		case '\n':
+			if (gParseOpts.bStripEOL)
+				return false;
+			break;
+
+		case ' ':
+			if (gParseOpts.bStripWS)
+				return false;
+			break;
+		}
+	}
+	return true;
+}
 
-int LoadVarModule()
+static wchar_t* evalFormat(FORMATINFO *fi, CompiledFormat *cf)
 {
-	if (initTokenRegister() != 0 || initContactModule() != 0)
-		return -1;
-
-	setParseOptions(nullptr);
-	CreateServiceFunction(MS_VARS_FORMATSTRING, formatStringService);
-	CreateServiceFunction(MS_VARS_REGISTERTOKEN, registerToken);
-	// help dialog
-	hCurSplitNS = LoadCursor(nullptr, IDC_SIZENS);
-
-	CreateServiceFunction(MS_VARS_SHOWHELP, showHelpService);
-	CreateServiceFunction(MS_VARS_SHOWHELPEX, showHelpExService);
-
-	g_plugin.registerIcon(LPGEN("Variables"), iconList);
-
-	hIconsChangedHook = HookEvent(ME_SKIN2_ICONSCHANGED, iconsChanged);
-
-	CreateServiceFunction(MS_VARS_GETSKINITEM, getSkinItemService);
-	hOptionsHook = HookEvent(ME_OPT_INITIALISE, OptionsInit);
-
-	// register internal tokens
-	registerExternalTokens();
-	registerLogicTokens();
-	registerMathTokens();
-	registerMirandaTokens();
-	registerStrTokens();
-	registerSystemTokens();
-	registerVariablesTokens();
-	registerRegExpTokens();
-	registerInetTokens();
-	registerAliasTokens();
-	registerMetaContactsTokens();
-
-	log_debugA("Variables: Internal tokens registered");
-
-	if (db_get_b(NULL, MODULENAME, SETTING_PARSEATSTARTUP, 0)) {
-		FORMATINFO fi = { 0 };
-		fi.cbSize = sizeof(fi);
-		fi.szFormat.w = db_get_wsa(NULL, MODULENAME, SETTING_STARTUPTEXT);
-		if (fi.szFormat.w != nullptr) {
-			mir_free(formatString(&fi));
-			mir_free(fi.szFormat.w);
+	FORMATINFO afi;
+	memcpy(&afi, fi, sizeof(afi));
+
+	CMStringW res;
+	for (auto &node : cf->nodes) {
+		fi->eCount += node->nErrors;
+		res.Append(node->text);
+		if (node->token.IsEmpty() && node->tmpVarPos < 0)
+			continue;
+
+		ARGUMENTSINFO ai = { 0 };
+		ptrW parsedToken;
+		if (node->tmpVarPos < 0) {
+			TArgList argv;
+			for (auto &it : node->argv) {
+				if (node->flags & TRF_UNPARSEDARGS)
+					argv.insert(mir_wstrdup(it));
+				else {
+					afi.szFormat.w = it;
+					afi.eCount = afi.pCount = 0;
+					argv.insert(formatString(&afi));
+					fi->eCount += afi.eCount;
+					fi->pCount += afi.pCount;
+				}
+			}
+			argv.insert(mir_wstrdup(node->token), 0);
+
+			ai.cbSize = sizeof(ai);
+			ai.argc = argv.getCount();
+			ai.argv.w = argv.getArray();
+			ai.fi = fi;
+			if ((node->prefix == FUNC_ONCE_CHAR) || (node->prefix == FIELD_CHAR))
+				ai.flags |= AIF_DONTPARSE;
+
+			parsedToken = parseFromRegister(&ai);
+			argv.destroy();
+		}
+		else parsedToken = mir_wstrdup(fi->szTemporaryVars.w[node->tmpVarPos + 1]);
+
+		// the token stays in the string, parsing goes on from its second char
+		if (parsedToken == NULL) {
+			fi->eCount++;
+			res.AppendChar(node->prefix);
+			ptrW tail(parseString(fi, cf->source.c_str() + node->start + 1));
+			if (tail == NULL)
+				return nullptr;
+			res.Append(tail);
+			return mir_wstrdup(res);
+		}
+
+		if (ai.flags & AIF_FALSE)
+			fi->eCount++;
+		else
+			fi->pCount++;
+
+		if ((ai.flags & AIF_DONTPARSE) || node->tmpVarPos >= 0)
+			res.Append(parsedToken);
+		else if (isInertResult(parsedToken)) {
+			if (!gParseOpts.bStripAll)
+				res.Append(parsedToken);
+		}
+		else {
+			// the result is parsed again together with the rest of the string
+			CMStringW tmp(parsedToken);
+			tmp.Append(cf->source.c_str() + node->end);
+			ptrW tail(parseString(fi, tmp));
+			if (tail == NULL)
+				return nullptr;
+			res.Append(tail);
+			return mir_wstrdup(res);
 		}
 	}
-	log_debugA("Variables: Init done");
 
-	return 0;
+	return mir_wstrdup(res);
 }
 
-int UnloadVarModule()
+static wchar_t* replaceDynVars(FORMATINFO *fi)
+{
+	if (fi->szFormat.w == nullptr)
+		return nullptr;
+
+	CompiledFormat *cf = getCompiledFormat(fi);
+	wchar_t *res = evalFormat(fi, cf);
+	releaseFormat(cf);
+	return res;
+}
+
+wchar_t* formatString(FORMATINFO *fi)
 {
-	UnhookEvent(hOptionsHook);
-	if (hIconsChangedHook != nullptr)
-		UnhookEvent(hIconsChangedHook);
-
-	DestroyCursor(hCurSplitNS);
-	deinitContactModule();
-	deinitTokenRegister();
-	unregisterAliasTokens();
-	unregisterVariablesTokens();
-	return 0;
+	if (fi == nullptr)
+		return nullptr;
+	/* the service to format a given string */
+	if ((fi->eCount + fi->pCount) > 5000) {
+		fi->eCount++;
+		fi->pCount++;
+		log_debugA("Variables: Overflow protection; %d parses", (fi->eCount + fi->pCount));
+		return nullptr;
+	}
+
+	return replaceDynVars(fi);
 }
@@ -0,0 +1,244 @@
+/*
+Copyright (C) 2012-18 Miranda NG team (https://miranda-ng.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation version 2
+of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Clist_modern mask index: requests are replayed against the masks of the default skin
+// plus generated ones, and skin_FindObjectByRequest must return the very mask that the
+// old linear scan over CompareStrWithModernMask finds first
+
+#include "stdafx.h"
+
+SKINOBJECTSLIST g_SkinObjectList; // the only symbol modern_skinselector.cpp takes from the skin engine
+
+static int iErrors = 0;
+
+static DWORD dwSeed = 12345;
+
+static int rnd(int n)
+{
+	dwSeed = dwSeed * 1103515245 + 12345;
+	return (dwSeed >> 16) % n;
+}
+
+static const char *arTypes[] = { "Group", "Contact", "SubContact", "MetaContact", "Divider", "Info" };
+static const char *arIds[] = { "Row", "Row", "Row", "Background", "Avatar" };
+static const char *arBool[] = { "True", "False" };
+static const char *arPos[] = { "First", "Last", "Mid", "First-Single" };
+static const char *arNum[] = { "0", "1", "2", "3" };
+static const char *arStatus[] = { "Online", "Away", "Offline", "DND" };
+
+struct PARAMDEF
+{
+	const char *szName, **pValues;
+	int nValues;
+};
+
+static PARAMDEF arParams[] =
+{
+	{ "Open", arBool, _countof(arBool) },
+	{ "IsEmpty", arBool, _countof(arBool) },
+	{ "Hot", arBool, _countof(arBool) },
+	{ "Selected", arBool, _countof(arBool) },
+	{ "SubPos", arPos, _countof(arPos) },
+	{ "GroupPos", arPos, _countof(arPos) },
+	{ "Indent", arNum, _countof(arNum) },
+	{ "Index", arNum, _countof(arNum) },
+	{ "Status", arStatus, _countof(arStatus) },
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// masks of the default skin, "@<id> = s<object>:<mask>" lines of skin.msf
+
+static int LoadSkinMasks(const char *pszProjectDir, LISTMODERNMASK *pList)
+{
+	char szPath[MAX_PATH];
+	mir_snprintf(szPath, "%s..\\..\\Clist_modern\\res\\skin.msf", pszProjectDir);
+
+	FILE *in = fopen(szPath, "rt");
+	if (in == nullptr) {
+		printf("cannot open %s\n", szPath);
+		iErrors++;
+		return 0;
+	}
+
+	int nMasks = 0;
+	char szLine[1024];
+	while (fgets(szLine, _countof(szLine), in)) {
+		rtrim(szLine);
+		if (szLine[0] != '@')
+			continue;
+
+		char *p = strstr(szLine, " = s");
+		if (p == nullptr)
+			continue;
+
+		char *pszObject = p + 4, *pszMask = strchr(pszObject, ':');
+		if (pszMask == nullptr)
+			continue;
+
+		*pszMask++ = 0;
+		if (AddStrModernMaskToList(atoi(szLine + 1), pszMask, pszObject, pList) >= 0)
+			nMasks++;
+	}
+	fclose(in);
+	return nMasks;
+}
+
+// generated masks use the same vocabulary; wildcards go only to the parameters present
+// in every request, CompareModernMask does not stop at the end of a request otherwise
+static void AddRandomMasks(LISTMODERNMASK *pList, int nMasks)
+{
+	for (int i = 0; i < nMasks; i++) {
+		CMStringA szMask;
+		if (rnd(4))
+			szMask.Append("CL,");
+		if (rnd(3))
+			szMask.AppendFormat("ID=%s,", arIds[rnd(_countof(arIds))]);
+
+		switch (rnd(10)) {
+		case 0: case 1: break;
+		case 2: case 3: szMask.Append("Type=*Contact,"); break;
+		case 4: szMask.AppendFormat("Type^%s,", arTypes[rnd(_countof(arTypes))]); break;
+		default: szMask.AppendFormat("Type=%s,", arTypes[rnd(_countof(arTypes))]); break;
+		}
+
+		for (int n = rnd(4); n > 0; n--) {
+			PARAMDEF &p = arParams[rnd(_countof(arParams))];
+			szMask.AppendFormat(rnd(8) ? "%s = %s," : "%s^%s,", p.szName, p.pValues[rnd(p.nValues)]);
+		}
+		if (!szMask.IsEmpty())
+			szMask.Truncate(szMask.GetLength() - 1);
+
+		CMStringA szObject(FORMAT, "Random/%d", i);
+		AddStrModernMaskToList(rnd(3000), szMask.GetBuffer(), szObject.GetBuffer(), pList);
+	}
+}
+
+static CMStringA MakeRequest()
+{
+	CMStringA szRequest(FORMAT, "CL,ID=%s,Type=%s", arIds[rnd(_countof(arIds))], arTypes[rnd(_countof(arTypes))]);
+	for (int n = rnd(6); n > 0; n--) {
+		PARAMDEF &p = arParams[rnd(_countof(arParams))];
+		szRequest.AppendFormat(",%s=%s", p.szName, p.pValues[rnd(p.nValues)]);
+	}
+	return szRequest;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static int LinearScan(char *szRequest, LISTMODERNMASK *pList)
+{
+	for (DWORD i = 0; i < pList->dwMaskCnt; i++)
+		if (CompareStrWithModernMask(szRequest, &pList->pl_Masks[i]))
+			return i;
+
+	return -1;
+}
+
+static int Lookup(char *szRequest, LISTMODERNMASK *pList)
+{
+	void *pObject = skin_FindObjectByRequest(szRequest, pList);
+	for (DWORD i = 0; i < pList->dwMaskCnt; i++)
+		if (pList->pl_Masks[i].pObject == pObject)
+			return i;
+
+	return -1;
+}
+
+static void Replay(LISTMODERNMASK *pList, int nRequests, const char *pszStage)
+{
+	int nFailed = 0;
+	for (int i = 0; i < nRequests; i++) {
+		CMStringA szRequest(MakeRequest());
+
+		int iExpected = LinearScan(szRequest.GetBuffer(), pList);
+		for (int pass = 0; pass < 2; pass++) { // the second pass comes from the memo
+			int iFound = Lookup(szRequest.GetBuffer(), pList);
+			if (iFound != iExpected) {
+				if (nFailed++ < 10)
+					printf("%s: '%s' found mask %d, expected %d\n", pszStage, szRequest.c_str(), iFound, iExpected);
+				iErrors++;
+			}
+		}
+	}
+}
+
+static void Benchmark(LISTMODERNMASK *pList)
+{
+	const int nRequests = 1000;
+	CMStringA arRequests[nRequests];
+	for (auto &it : arRequests)
+		it = MakeRequest();
+
+	LARGE_INTEGER freq, t0, t1, t2;
+	QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&t0);
+	for (int pass = 0; pass < 100; pass++)
+		for (auto &it : arRequests)
+			LinearScan(it.GetBuffer(), pList);
+	QueryPerformanceCounter(&t1);
+	for (int pass = 0; pass < 100; pass++)
+		for (auto &it : arRequests)
+			skin_FindObjectByRequest(it.GetBuffer(), pList);
+	QueryPerformanceCounter(&t2);
+
+	printf("%d requests x100 over %u masks: linear %u ms, index %u ms\n", nRequests, UINT(pList->dwMaskCnt),
+		UINT((t1.QuadPart - t0.QuadPart) * 1000 / freq.QuadPart), UINT((t2.QuadPart - t1.QuadPart) * 1000 / freq.QuadPart));
+}
+
+static void FreeMasks(LISTMODERNMASK *pList)
+{
+	for (DWORD i = 0; i < pList->dwMaskCnt; i++)
+		mir_free(pList->pl_Masks[i].szObjectName);
+	ClearMaskList(pList);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *pszProjectDir = (argc > 1) ? argv[1] : "";
+	bool bBench = false;
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "-bench"))
+			bBench = true;
+
+	LISTMODERNMASK list = {};
+	int nSkin = LoadSkinMasks(pszProjectDir, &list);
+	SortMaskList(&list);
+	printf("%d masks loaded from skin.msf\n", nSkin);
+
+	// the default skin alone, with the index compiled the way the skin loader does it
+	CompileMaskList(&list);
+	Replay(&list, 5000, "skin");
+
+	// generated masks are added after the index was built, so it must be rebuilt
+	AddRandomMasks(&list, 500);
+	SortMaskList(&list);
+	Replay(&list, 20000, "skin + generated");
+
+	if (bBench)
+		Benchmark(&list);
+
+	FreeMasks(&list);
+
+	if (iErrors) {
+		printf("%d check(s) failed\n", iErrors);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+#include "../../../Clist_modern/src/stdafx.h"
@@ -0,0 +1,156 @@
+/*
+Copyright (C) 2012-18 Miranda NG team (https://miranda-ng.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation version 2
+of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Clist_modern pixel kernels: the SSE2 code must give exactly the results of the
+// per-pixel division it replaced, for every (channel, alpha) pair and every tail length
+
+#include "stdafx.h"
+
+static int iErrors = 0;
+
+#define CHECK(expr, ...) if (!(expr)) { printf(__VA_ARGS__); iErrors++; }
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// the loop ske_PreMultiplyChannels used before the kernels
+
+static void RefPreMultiply(BYTE *pPixels, size_t nCount)
+{
+	for (size_t i = 0; i < nCount; i++) {
+		BYTE *pPixel = pPixels + i * 4;
+		DWORD alpha = pPixel[3];
+		pPixel[0] = BYTE(pPixel[0] * alpha / 255);
+		pPixel[1] = BYTE(pPixel[1] * alpha / 255);
+		pPixel[2] = BYTE(pPixel[2] * alpha / 255);
+	}
+}
+
+static void FillPattern(BYTE *pPixels, size_t nCount)
+{
+	for (size_t i = 0; i < nCount; i++) {
+		BYTE c = BYTE(i), *pPixel = pPixels + i * 4;
+		pPixel[0] = c;
+		pPixel[1] = 255 - c;
+		pPixel[2] = BYTE(c * 7);
+		pPixel[3] = BYTE(i >> 8);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static void TestDiv255()
+{
+	for (DWORD t = 0; t <= 255 * 255; t++)
+		CHECK(px_Div255(t) == t / 255, "px_Div255(%u) = %u, expected %u\n", t, px_Div255(t), t / 255);
+}
+
+// all 65536 (channel, alpha) pairs, each buffer length from 0 to 7 extra pixels, at
+// every misalignment of the start address
+static void TestPreMultiply()
+{
+	const size_t nMax = 256 * 256 + 7;
+	BYTE *pBuf = (BYTE*)malloc(nMax * 4 + 16), *pRef = (BYTE*)malloc(nMax * 4);
+
+	for (size_t nTail = 0; nTail < 8; nTail++) {
+		size_t nCount = 256 * 256 + nTail;
+		BYTE *pPixels = pBuf + (nTail % 4) * 5;
+
+		FillPattern(pPixels, nCount);
+		memcpy(pRef, pPixels, nCount * 4);
+
+		px_PreMultiply(pPixels, nCount);
+		RefPreMultiply(pRef, nCount);
+
+		for (size_t i = 0; i < nCount * 4; i++)
+			if (pPixels[i] != pRef[i]) {
+				CHECK(false, "px_PreMultiply: byte %u of %u pixels is %u, expected %u\n", UINT(i), UINT(nCount), pPixels[i], pRef[i]);
+				break;
+			}
+	}
+
+	free(pRef);
+	free(pBuf);
+}
+
+static void TestFillAlpha()
+{
+	const size_t nMax = 1031;
+	BYTE *pBuf = (BYTE*)malloc(nMax * 4 + 16);
+
+	for (size_t nCount = 0; nCount <= nMax; nCount += 7) {
+		BYTE *pPixels = pBuf + 3;
+		FillPattern(pPixels, nCount);
+		px_FillAlpha(pPixels, nCount, 0x80);
+
+		for (size_t i = 0; i < nCount; i++) {
+			BYTE c = BYTE(i), *pPixel = pPixels + i * 4;
+			if (pPixel[0] != c || pPixel[1] != BYTE(255 - c) || pPixel[2] != BYTE(c * 7) || pPixel[3] != 0x80) {
+				CHECK(false, "px_FillAlpha: pixel %u of %u is wrong\n", UINT(i), UINT(nCount));
+				break;
+			}
+		}
+	}
+
+	free(pBuf);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// full screen bitmap, premultiplied a hundred times by both versions
+
+static void Benchmark()
+{
+	const size_t nCount = 1920 * 1080;
+	BYTE *pPixels = (BYTE*)malloc(nCount * 4);
+
+	LARGE_INTEGER freq, t0, t1, t2;
+	QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < 100; i++) {
+		FillPattern(pPixels, nCount);
+		RefPreMultiply(pPixels, nCount);
+	}
+	QueryPerformanceCounter(&t1);
+	for (int i = 0; i < 100; i++) {
+		FillPattern(pPixels, nCount);
+		px_PreMultiply(pPixels, nCount);
+	}
+	QueryPerformanceCounter(&t2);
+
+	printf("premultiply 1920x1080 x100: division %u ms, kernel %u ms\n",
+		UINT((t1.QuadPart - t0.QuadPart) * 1000 / freq.QuadPart), UINT((t2.QuadPart - t1.QuadPart) * 1000 / freq.QuadPart));
+
+	free(pPixels);
+}
+
+int main(int argc, char *argv[])
+{
+	TestDiv255();
+	TestPreMultiply();
+	TestFillAlpha();
+
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "-bench"))
+			Benchmark();
+
+	if (iErrors) {
+		printf("%d check(s) failed\n", iErrors);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
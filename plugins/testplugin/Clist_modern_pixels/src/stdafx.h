@@ -0,0 +1,7 @@
+#pragma once
+
+#include <windows.h>
+#include <stdio.h>
+#include <malloc.h>
+
+#include "../../../Clist_modern/src/modern_pixels.h"
@@ -0,0 +1,356 @@
+/*
+Copyright (C) 2012-18 Miranda NG team (https://miranda-ng.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation version 2
+of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Dbx_sqlite event cursors: FindNextEvent & FindPrevEvent must return the same events as
+// a history kept aside and ordered by (timestamp, id), when a walk goes through the whole
+// history, when walks of several contacts interleave, after random jumps, after writes in
+// the middle of a walk, and after the profile is opened again. Many events share their
+// timestamps, so that the id decides their order
+
+#include "stdafx.h"
+
+static int iErrors = 0;
+
+static DWORD dwSeed = 12345;
+
+static int rnd(int n)
+{
+	dwSeed = dwSeed * 1103515245 + 12345;
+	return (dwSeed >> 16) % n;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// the expected history of a contact
+
+struct TestEvent
+{
+	MEVENT hEvent;
+	DWORD timestamp;
+};
+
+static int CompareEvents(const TestEvent *p1, const TestEvent *p2)
+{
+	if (p1->timestamp != p2->timestamp)
+		return (p1->timestamp < p2->timestamp) ? -1 : 1;
+	if (p1->hEvent != p2->hEvent)
+		return (p1->hEvent < p2->hEvent) ? -1 : 1;
+	return 0;
+}
+
+struct TestContact
+{
+	TestContact() :
+		arEvents(100, CompareEvents)
+	{}
+
+	MCONTACT hContact;
+	OBJLIST<TestEvent> arEvents;
+
+	MEVENT next(int i) const { return (i + 1 < arEvents.getCount()) ? arEvents[i + 1].hEvent : 0; }
+	MEVENT prev(int i) const { return (i > 0) ? arEvents[i - 1].hEvent : 0; }
+
+	int find(MEVENT hEvent) const
+	{
+		for (int i = 0; i < arEvents.getCount(); i++)
+			if (arEvents[i].hEvent == hEvent)
+				return i;
+		return -1;
+	}
+};
+
+static MEVENT AddTestEvent(MDatabaseCommon *db, TestContact &tc, DWORD timestamp)
+{
+	DBEVENTINFO dbei = {};
+	dbei.szModule = "Test";
+	dbei.timestamp = timestamp;
+	dbei.flags = DBEF_READ;
+	dbei.eventType = EVENTTYPE_MESSAGE;
+	dbei.cbBlob = 5;
+	dbei.pBlob = (PBYTE)"test";
+
+	MEVENT hEvent = db->AddEvent(tc.hContact, &dbei);
+	if (hEvent == 0) {
+		printf("contact %u: event wasn't added\n", tc.hContact);
+		iErrors++;
+		return 0;
+	}
+
+	TestEvent *p = new TestEvent();
+	p->hEvent = hEvent;
+	p->timestamp = timestamp;
+	tc.arEvents.insert(p);
+	return hEvent;
+}
+
+static void DeleteTestEvent(MDatabaseCommon *db, TestContact &tc, int idx)
+{
+	if (db->DeleteEvent(tc.hContact, tc.arEvents[idx].hEvent)) {
+		printf("contact %u: event %u wasn't deleted\n", tc.hContact, tc.arEvents[idx].hEvent);
+		iErrors++;
+	}
+	tc.arEvents.remove(idx);
+}
+
+static void CheckEvent(const TestContact &tc, const char *pszWhat, MEVENT hFrom, MEVENT hResult, MEVENT hExpected)
+{
+	if (hResult != hExpected) {
+		printf("contact %u: %s(%u) returned %u instead of %u\n", tc.hContact, pszWhat, hFrom, hResult, hExpected);
+		iErrors++;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static void WalkForward(MDatabaseCommon *db, const TestContact &tc)
+{
+	MEVENT hEvent = db->FindFirstEvent(tc.hContact);
+	CheckEvent(tc, "FindFirstEvent", 0, hEvent, tc.arEvents.getCount() ? tc.arEvents[0].hEvent : 0);
+
+	for (int i = 0; hEvent != 0 && i < tc.arEvents.getCount(); i++) {
+		MEVENT hNext = db->FindNextEvent(tc.hContact, hEvent);
+		CheckEvent(tc, "FindNextEvent", hEvent, hNext, tc.next(i));
+		hEvent = tc.next(i);
+	}
+}
+
+static void WalkBackward(MDatabaseCommon *db, const TestContact &tc)
+{
+	int nCount = tc.arEvents.getCount();
+	MEVENT hEvent = db->FindLastEvent(tc.hContact);
+	CheckEvent(tc, "FindLastEvent", 0, hEvent, nCount ? tc.arEvents[nCount - 1].hEvent : 0);
+
+	for (int i = nCount - 1; hEvent != 0 && i >= 0; i--) {
+		MEVENT hPrev = db->FindPrevEvent(tc.hContact, hEvent);
+		CheckEvent(tc, "FindPrevEvent", hEvent, hPrev, tc.prev(i));
+		hEvent = tc.prev(i);
+	}
+}
+
+// the cursors are shared by all contacts, so every step here repositions them
+static void WalkInterleaved(MDatabaseCommon *db, const TestContact &tc1, const TestContact &tc2)
+{
+	int nSteps = max(tc1.arEvents.getCount(), tc2.arEvents.getCount());
+	for (int i = 0; i < nSteps; i++) {
+		if (i < tc1.arEvents.getCount())
+			CheckEvent(tc1, "FindNextEvent", tc1.arEvents[i].hEvent, db->FindNextEvent(tc1.hContact, tc1.arEvents[i].hEvent), tc1.next(i));
+
+		int j = tc2.arEvents.getCount() - 1 - i;
+		if (j >= 0)
+			CheckEvent(tc2, "FindPrevEvent", tc2.arEvents[j].hEvent, db->FindPrevEvent(tc2.hContact, tc2.arEvents[j].hEvent), tc2.prev(j));
+	}
+}
+
+static void RandomJumps(MDatabaseCommon *db, const TestContact &tc, int nJumps)
+{
+	if (tc.arEvents.getCount() == 0)
+		return;
+
+	for (int k = 0; k < nJumps; k++) {
+		int i = rnd(tc.arEvents.getCount());
+		MEVENT hEvent = tc.arEvents[i].hEvent;
+		if (rnd(2))
+			CheckEvent(tc, "FindNextEvent", hEvent, db->FindNextEvent(tc.hContact, hEvent), tc.next(i));
+		else
+			CheckEvent(tc, "FindPrevEvent", hEvent, db->FindPrevEvent(tc.hContact, hEvent), tc.prev(i));
+	}
+}
+
+// events are added around the current one and deleted anywhere else while walking forward
+static void WalkWithWrites(MDatabaseCommon *db, TestContact &tc)
+{
+	MEVENT hEvent = db->FindFirstEvent(tc.hContact);
+	while (hEvent != 0) {
+		int i = tc.find(hEvent);
+		if (i < 0) {
+			printf("contact %u: unknown event %u\n", tc.hContact, hEvent);
+			iErrors++;
+			return;
+		}
+
+		int iAction = rnd(8);
+		if (iAction == 0)
+			AddTestEvent(db, tc, tc.arEvents[i].timestamp + rnd(3) - 1);
+		else if (iAction == 1) {
+			int j = rnd(tc.arEvents.getCount());
+			if (j != i)
+				DeleteTestEvent(db, tc, j);
+		}
+
+		i = tc.find(hEvent);
+		MEVENT hNext = db->FindNextEvent(tc.hContact, hEvent);
+		CheckEvent(tc, "FindNextEvent", hEvent, hNext, tc.next(i));
+		hEvent = tc.next(i);
+	}
+}
+
+static void CheckAll(MDatabaseCommon *db, TestContact *arContacts, int nContacts)
+{
+	for (int i = 0; i < nContacts; i++) {
+		WalkForward(db, arContacts[i]);
+		WalkBackward(db, arContacts[i]);
+		RandomJumps(db, arContacts[i], 200);
+	}
+
+	for (int i = 0; i + 1 < nContacts; i++)
+		WalkInterleaved(db, arContacts[i], arContacts[i + 1]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static void DeleteProfile(const wchar_t *pwszProfile)
+{
+	DeleteFile(pwszProfile);
+	DeleteFile(CMStringW(pwszProfile) + L"-wal");
+	DeleteFile(CMStringW(pwszProfile) + L"-shm");
+}
+
+static MDatabaseCommon* OpenProfile(const wchar_t *pwszProfile)
+{
+	MDatabaseCommon *db = CDbxSQLite::Load(pwszProfile, false);
+	if (db == nullptr) {
+		printf("cannot open %S\n", pwszProfile);
+		iErrors++;
+	}
+	return db;
+}
+
+static void TestCursors(const wchar_t *pwszProfile)
+{
+	DeleteProfile(pwszProfile);
+	CDbxSQLite::Create(pwszProfile);
+
+	MDatabaseCommon *db = OpenProfile(pwszProfile);
+	if (db == nullptr)
+		return;
+
+	TestContact arContacts[3];
+	for (auto &it : arContacts)
+		it.hContact = db->AddContact();
+
+	// the histories are mixed, timestamps go back and forth and repeat
+	for (int i = 0; i < 900; i++)
+		AddTestEvent(db, arContacts[rnd(_countof(arContacts))], 1000 + rnd(60));
+
+	CheckAll(db, arContacts, _countof(arContacts));
+
+	for (auto &it : arContacts)
+		WalkWithWrites(db, it);
+
+	// once the last event is deleted, an earlier one added later must not become the last
+	TestContact &tc = arContacts[0];
+	DeleteTestEvent(db, tc, tc.arEvents.getCount() - 1);
+	AddTestEvent(db, tc, tc.arEvents[0].timestamp);
+
+	CheckAll(db, arContacts, _countof(arContacts));
+
+	// everything must be committed when the profile is closed
+	delete db;
+	if ((db = OpenProfile(pwszProfile)) == nullptr)
+		return;
+
+	CheckAll(db, arContacts, _countof(arContacts));
+	delete db;
+
+	DeleteProfile(pwszProfile);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static UINT Elapsed(LARGE_INTEGER &t0)
+{
+	LARGE_INTEGER freq, t1;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t1);
+	UINT res = UINT((t1.QuadPart - t0.QuadPart) * 1000 / freq.QuadPart);
+	t0 = t1;
+	return res;
+}
+
+static void Benchmark(const wchar_t *pwszProfile)
+{
+	DeleteProfile(pwszProfile);
+	CDbxSQLite::Create(pwszProfile);
+
+	MDatabaseCommon *db = OpenProfile(pwszProfile);
+	if (db == nullptr)
+		return;
+
+	TestContact tc;
+	tc.hContact = db->AddContact();
+
+	BYTE blob[100];
+	memset(blob, 'x', sizeof(blob));
+
+	DBEVENTINFO dbei = {};
+	dbei.szModule = "Test";
+	dbei.flags = DBEF_READ;
+	dbei.cbBlob = sizeof(blob);
+	dbei.pBlob = blob;
+
+	LARGE_INTEGER t0;
+	QueryPerformanceCounter(&t0);
+
+	// usual writes, joined by the group commit
+	for (int i = 0; i < 100000; i++) {
+		dbei.timestamp = 1000 + i;
+		db->AddEvent(tc.hContact, &dbei);
+	}
+	printf("100000 events added: %u ms\n", Elapsed(t0));
+
+	// the same amount in the bulk mode, as importers do
+	db->SetCacheSafetyMode(false);
+	for (int i = 0; i < 100000; i++) {
+		dbei.timestamp = 101000 + i;
+		db->AddEvent(tc.hContact, &dbei);
+	}
+	db->SetCacheSafetyMode(true);
+	printf("100000 events added in the bulk mode: %u ms\n", Elapsed(t0));
+
+	int nEvents = 0;
+	for (MEVENT hEvent = db->FindFirstEvent(tc.hContact); hEvent; hEvent = db->FindNextEvent(tc.hContact, hEvent))
+		nEvents++;
+	printf("%d events walked forward: %u ms\n", nEvents, Elapsed(t0));
+
+	nEvents = 0;
+	for (MEVENT hEvent = db->FindLastEvent(tc.hContact); hEvent; hEvent = db->FindPrevEvent(tc.hContact, hEvent))
+		nEvents++;
+	printf("%d events walked backward: %u ms\n", nEvents, Elapsed(t0));
+
+	delete db;
+	DeleteProfile(pwszProfile);
+}
+
+int main(int argc, char *argv[])
+{
+	wchar_t wszProfile[MAX_PATH];
+	GetTempPath(_countof(wszProfile), wszProfile);
+	wcsncat_s(wszProfile, L"dbx_sqlite_test.dat", _TRUNCATE);
+
+	TestCursors(wszProfile);
+
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "-bench"))
+			Benchmark(wszProfile);
+
+	if (iErrors) {
+		printf("%d check(s) failed\n", iErrors);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
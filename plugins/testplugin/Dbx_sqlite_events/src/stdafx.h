@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "../../../Dbx_sqlite/src/stdafx.h"
@@ -0,0 +1,189 @@
+/*
+Copyright (C) 2012-18 Miranda NG team (https://miranda-ng.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation version 2
+of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// IRCG names list: SplitWords must return the same words as the GetWord() loop which
+// OnIrc_ENDNAMES used before, and SkipModePrefixes must strip the same prefixes
+
+#include "stdafx.h"
+
+static int iErrors = 0;
+
+static DWORD dwSeed = 12345;
+
+static int rnd(int n)
+{
+	dwSeed = dwSeed * 1103515245 + 12345;
+	return (dwSeed >> 16) % n;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// GetWord from tools.cpp, the test doesn't link the protocol itself
+
+static CMStringW RefGetWord(const wchar_t *text, int index)
+{
+	if (text && *text) {
+		const wchar_t *p1 = text, *p2 = nullptr;
+		while (*p1 == ' ')
+			p1++;
+
+		if (*p1 != 0) {
+			for (int i = 0; i < index; i++) {
+				p2 = wcschr(p1, ' ');
+				if (!p2)
+					p2 = wcschr(p1, 0);
+				else
+					while (*p2 == ' ')
+						p2++;
+
+				p1 = p2;
+			}
+
+			p2 = wcschr(p1, ' ');
+			if (!p2)
+				p2 = wcschr(p1, 0);
+
+			if (p1 != p2)
+				return CMStringW(p1, p2 - p1);
+		}
+	}
+
+	return CMStringW();
+}
+
+// the loop the old code used to drop prefixes from a nick
+static const wchar_t* RefSkipPrefixes(const wchar_t *pszName, const wchar_t *pszPrefixes)
+{
+	int index = 0;
+	while (wcschr(pszPrefixes, pszName[index]))
+		index++;
+	return pszName + index;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static const wchar_t wszPrefixes[] = L"~&@%+";
+
+// a RPL_NAMREPLY-like list: nicks with zero to three prefixes, separated by runs of spaces,
+// with optional spaces at both ends
+static CMStringW MakeNamesList(int nNames)
+{
+	CMStringW res;
+	for (int i = rnd(3); i > 0; i--)
+		res.AppendChar(' ');
+
+	for (int i = 0; i < nNames; i++) {
+		if (i)
+			for (int j = rnd(4) ? 1 : 1 + rnd(3); j > 0; j--)
+				res.AppendChar(' ');
+
+		for (int j = rnd(5) ? 0 : 1 + rnd(3); j > 0; j--)
+			res.AppendChar(wszPrefixes[rnd(_countof(wszPrefixes) - 1)]);
+		res.AppendFormat(L"nick%d", rnd(100000));
+		if (!rnd(10))
+			res.AppendChar(wszPrefixes[rnd(_countof(wszPrefixes) - 1)]); // prefix chars inside a nick are kept
+	}
+
+	for (int i = rnd(3); i > 0; i--)
+		res.AppendChar(' ');
+	return res;
+}
+
+static void TestList(const CMStringW &wszList)
+{
+	ptrW pwszCopy(mir_wstrdup(wszList));
+	LIST<wchar_t> arWords(100);
+	int nWords = SplitWords(pwszCopy, arWords);
+	if (nWords != arWords.getCount()) {
+		printf("SplitWords returned %d for %d words\n", nWords, arWords.getCount());
+		iErrors++;
+	}
+
+	for (int i = 0; ; i++) {
+		CMStringW wszExpected = RefGetWord(wszList, i);
+		if (wszExpected.IsEmpty()) {
+			if (i != arWords.getCount()) {
+				printf("'%S': %d words, expected %d\n", wszList.c_str(), arWords.getCount(), i);
+				iErrors++;
+			}
+			break;
+		}
+
+		if (i >= arWords.getCount() || wszExpected != arWords[i]) {
+			printf("'%S': word %d is '%S', expected '%S'\n", wszList.c_str(), i, (i < arWords.getCount()) ? arWords[i] : L"", wszExpected.c_str());
+			iErrors++;
+			break;
+		}
+
+		if (mir_wstrcmp(SkipModePrefixes(arWords[i], wszPrefixes), RefSkipPrefixes(wszExpected, wszPrefixes))) {
+			printf("'%S': prefixes of '%S' are not removed properly\n", wszList.c_str(), wszExpected.c_str());
+			iErrors++;
+		}
+	}
+}
+
+static void Benchmark()
+{
+	CMStringW wszList(MakeNamesList(5000));
+
+	LARGE_INTEGER freq, t0, t1, t2;
+	QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; !RefGetWord(wszList, i).IsEmpty(); i++)
+		;
+	QueryPerformanceCounter(&t1);
+	ptrW pwszCopy(mir_wstrdup(wszList));
+	LIST<wchar_t> arWords(5000);
+	SplitWords(pwszCopy, arWords);
+	QueryPerformanceCounter(&t2);
+
+	printf("5000 names: GetWord loop %u ms, SplitWords %u ms\n",
+		UINT((t1.QuadPart - t0.QuadPart) * 1000 / freq.QuadPart), UINT((t2.QuadPart - t1.QuadPart) * 1000 / freq.QuadPart));
+}
+
+int main(int argc, char *argv[])
+{
+	// corner cases
+	TestList(L"");
+	TestList(L" ");
+	TestList(L"   ");
+	TestList(L"nick");
+	TestList(L" nick ");
+	TestList(L"@op +voice  normal   ~&owner");
+	TestList(L"@@x +y");
+
+	for (int i = 0; i < 2000; i++)
+		TestList(MakeNamesList(rnd(50)));
+
+	LIST<wchar_t> arWords(1);
+	if (SplitWords(nullptr, arWords) != 0 || arWords.getCount() != 0) {
+		printf("SplitWords(nullptr) returned words\n");
+		iErrors++;
+	}
+
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "-bench"))
+			Benchmark();
+
+	if (iErrors) {
+		printf("%d check(s) failed\n", iErrors);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+#include "../../../../protocols/IRCG/src/stdafx.h"
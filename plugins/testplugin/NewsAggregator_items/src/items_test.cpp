@@ -0,0 +1,139 @@
+/*
+Copyright (C) 2012-18 Miranda NG team (https://miranda-ng.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation version 2
+of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// NewsAggregator item index: recorded RSS 2.0 and Atom polls from the feeds folder are
+// replayed through CItemIndex::Register. Each document is a later poll of the previous
+// one (unless it starts a new feed), and only nNew of its items may be new: an edited
+// item keeps its guid, an item without guid is recognized by its link or text, reordered
+// and repeated entries are reported once
+
+#include "stdafx.h"
+
+static struct
+{
+	const char *pszFile;
+	bool bNewFeed;
+	int nNew;
+}
+arPolls[] =
+{
+	{ "rss_poll1.xml", true, 3 },
+	{ "rss_poll2.xml", false, 1 },
+	{ "rss_poll3.xml", false, 0 },
+	{ "atom_poll1.xml", true, 2 },
+	{ "atom_poll2.xml", false, 1 },
+};
+
+static wchar_t* LoadFeed(const char *pszProjectDir, const char *pszFile)
+{
+	char szPath[MAX_PATH];
+	mir_snprintf(szPath, "%sfeeds\\%s", pszProjectDir, pszFile);
+
+	FILE *in = fopen(szPath, "rb");
+	if (in == nullptr)
+		return nullptr;
+
+	long cbSize = _filelength(_fileno(in));
+	ptrA szBuf((char*)mir_alloc(cbSize + 1));
+	size_t cbRead = fread(szBuf, 1, cbSize, in);
+	fclose(in);
+
+	szBuf[cbRead] = 0;
+	return mir_utf8decodeW(szBuf);
+}
+
+// items are taken apart the same way CheckCurrentFeed does it
+static int CountNewItems(CItemIndex &index, HXML hXml)
+{
+	// the parser may return the root element itself or a node that holds it
+	HXML root = hXml;
+	for (int i = 0; root != nullptr && mir_wstrcmpi(xmlGetName(root), L"rss") && mir_wstrcmpi(xmlGetName(root), L"feed"); i++)
+		root = xmlGetChild(hXml, i);
+	if (root == nullptr)
+		return -1;
+
+	bool isAtom = !mir_wstrcmpi(xmlGetName(root), L"feed");
+	HXML chan = (isAtom) ? root : xmlGetChild(root, 0);
+
+	int nNew = 0;
+	for (int i = 0; i < xmlGetChildCount(chan); i++) {
+		HXML item = xmlGetChild(chan, i);
+		if (mir_wstrcmpi(xmlGetName(item), (isAtom) ? L"entry" : L"item"))
+			continue;
+
+		CMStringW message, guid, link;
+		for (int j = 0; j < xmlGetChildCount(item); j++) {
+			HXML itemval = xmlGetChild(item, j);
+			LPCTSTR szItemName = xmlGetName(itemval);
+			LPCTSTR szItemText = (isAtom && !mir_wstrcmpi(szItemName, L"link")) ? xmlGetAttrValue(itemval, L"href") : xmlGetText(itemval);
+			if (szItemText == nullptr)
+				continue;
+
+			if (!mir_wstrcmpi(szItemName, L"guid") || !mir_wstrcmpi(szItemName, L"id"))
+				guid = szItemText;
+			else if (!mir_wstrcmpi(szItemName, L"link"))
+				link = szItemText;
+			message.AppendFormat(L"%s: %s\n", szItemName, szItemText);
+		}
+
+		if (index.Register(T2Utf(message), guid, link))
+			nNew++;
+	}
+	return nNew;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *pszProjectDir = (argc > 1) ? argv[1] : "";
+	int iErrors = 0;
+
+	CItemIndex *pIndex = nullptr;
+	for (auto &it : arPolls) {
+		if (it.bNewFeed) {
+			delete pIndex;
+			pIndex = new CItemIndex(0);
+		}
+
+		ptrW pwszDocument(LoadFeed(pszProjectDir, it.pszFile));
+		if (pwszDocument == nullptr) {
+			printf("%s: cannot be read\n", it.pszFile);
+			iErrors++;
+			continue;
+		}
+
+		int bytesParsed = 0, nNew = -1;
+		HXML hXml = xmlParseString(pwszDocument, &bytesParsed, nullptr);
+		if (hXml != nullptr) {
+			nNew = CountNewItems(*pIndex, hXml);
+			xmlDestroyNode(hXml);
+		}
+
+		if (nNew != it.nNew) {
+			printf("%s: %d new items instead of %d\n", it.pszFile, nNew, it.nNew);
+			iErrors++;
+		}
+	}
+	delete pIndex;
+
+	if (iErrors) {
+		printf("%d check(s) failed\n", iErrors);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
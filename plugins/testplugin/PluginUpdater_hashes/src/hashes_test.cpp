@@ -0,0 +1,273 @@
+/*
+Copyright (C) 2012-18 Miranda NG team (https://miranda-ng.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation version 2
+of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// PluginUpdater hash cache: a module hash is taken from the cache only while the file
+// keeps its path, size and modification time. The profile is replaced by a small memory
+// database, the modules are copies of the test executable in a temporary folder
+
+#include "stdafx.h"
+
+static int iErrors = 0;
+
+#define CHECK(cond, msg) if (!(cond)) { printf("%s\n", msg); iErrors++; }
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// string settings of the NULL contact, that's all the cache stores
+
+struct DbSetting
+{
+	CMStringA szName, szValue;
+};
+
+static int CompareSettings(const DbSetting *p1, const DbSetting *p2)
+{
+	return mir_strcmp(p1->szName, p2->szName);
+}
+
+class CDbxMemory : public MDatabaseReadonly, public MZeroedObject
+{
+	OBJLIST<DbSetting> m_settings;
+
+	DbSetting* find(LPCSTR szModule, LPCSTR szSetting)
+	{
+		DbSetting tmp;
+		tmp.szName.Format("%s/%s", szModule, szSetting);
+		return m_settings.find(&tmp);
+	}
+
+public:
+	CDbxMemory() :
+		m_settings(50, CompareSettings)
+	{}
+
+	int getCount() const { return m_settings.getCount(); }
+
+	STDMETHODIMP_(LONG) GetContactCount(void) override { return 0; }
+	STDMETHODIMP_(LONG) GetEventCount(MCONTACT) override { return 0; }
+	STDMETHODIMP_(BOOL) GetEvent(MEVENT, DBEVENTINFO*) override { return 1; }
+	STDMETHODIMP_(MEVENT) FindFirstEvent(MCONTACT) override { return 0; }
+	STDMETHODIMP_(MEVENT) FindNextEvent(MCONTACT, MEVENT) override { return 0; }
+	STDMETHODIMP_(MEVENT) FindLastEvent(MCONTACT) override { return 0; }
+	STDMETHODIMP_(MEVENT) FindPrevEvent(MCONTACT, MEVENT) override { return 0; }
+
+	STDMETHODIMP_(BOOL) GetContactSettingWorker(MCONTACT hContact, LPCSTR szModule, LPCSTR szSetting, DBVARIANT *dbv, int isStatic) override
+	{
+		DbSetting *p = (hContact == 0 && !isStatic) ? find(szModule, szSetting) : nullptr;
+		if (p == nullptr)
+			return 1;
+
+		dbv->type = DBVT_ASCIIZ;
+		dbv->pszVal = mir_strdup(p->szValue);
+		return 0;
+	}
+
+	STDMETHODIMP_(BOOL) WriteContactSetting(MCONTACT hContact, DBCONTACTWRITESETTING *dbcws) override
+	{
+		if (hContact != 0 || dbcws->value.type != DBVT_ASCIIZ)
+			return 1;
+
+		DbSetting *p = find(dbcws->szModule, dbcws->szSetting);
+		if (p == nullptr) {
+			p = new DbSetting();
+			p->szName.Format("%s/%s", dbcws->szModule, dbcws->szSetting);
+			m_settings.insert(p);
+		}
+		p->szValue = dbcws->value.pszVal;
+		return 0;
+	}
+
+	STDMETHODIMP_(BOOL) DeleteContactSetting(MCONTACT hContact, LPCSTR szModule, LPCSTR szSetting) override
+	{
+		DbSetting *p = (hContact == 0) ? find(szModule, szSetting) : nullptr;
+		if (p == nullptr)
+			return 1;
+
+		m_settings.remove(p);
+		return 0;
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static bool IsCached(const wchar_t *pwszPath, const char *pszHash)
+{
+	char szHash[33];
+	return GetCachedModuleHash(pwszPath, szHash) && !strcmp(szHash, pszHash);
+}
+
+static void ShiftWriteTime(const wchar_t *pwszPath, int iSeconds)
+{
+	HANDLE hFile = CreateFile(pwszPath, FILE_WRITE_ATTRIBUTES, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+	FILETIME ft;
+	GetFileTime(hFile, nullptr, nullptr, &ft);
+	ULARGE_INTEGER li = { ft.dwLowDateTime, ft.dwHighDateTime };
+	li.QuadPart += LONGLONG(iSeconds) * 10000000;
+	ft.dwLowDateTime = li.LowPart; ft.dwHighDateTime = li.HighPart;
+	SetFileTime(hFile, nullptr, nullptr, &ft);
+	CloseHandle(hFile);
+}
+
+// one more byte at the end, the modification time stays as it was
+static void GrowFile(const wchar_t *pwszPath)
+{
+	HANDLE hFile = CreateFile(pwszPath, GENERIC_WRITE | FILE_WRITE_ATTRIBUTES, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+	FILETIME ft;
+	GetFileTime(hFile, nullptr, nullptr, &ft);
+	SetFilePointer(hFile, 0, nullptr, FILE_END);
+	DWORD dwWritten;
+	WriteFile(hFile, "", 1, &dwWritten, nullptr);
+	SetFileTime(hFile, nullptr, nullptr, &ft);
+	CloseHandle(hFile);
+}
+
+static void TestCache(const wchar_t *pwszFolder, CDbxMemory &db)
+{
+	wchar_t wszSelf[MAX_PATH], wszFile1[MAX_PATH], wszFile2[MAX_PATH], wszMissing[MAX_PATH];
+	GetModuleFileName(nullptr, wszSelf, _countof(wszSelf));
+	mir_snwprintf(wszFile1, L"%sfirst.dll", pwszFolder);
+	mir_snwprintf(wszFile2, L"%ssecond.dll", pwszFolder);
+	mir_snwprintf(wszMissing, L"%smissing.dll", pwszFolder);
+	CopyFile(wszSelf, wszFile1, FALSE);
+	CopyFile(wszSelf, wszFile2, FALSE);
+
+	char szHash[33], szHash2[33];
+	CHECK(!GetCachedModuleHash(wszFile1, szHash), "empty cache returned a hash");
+
+	if (CalculateModuleHash(wszFile1, szHash) != 0) {
+		printf("cannot hash %S\n", wszFile1);
+		iErrors++;
+		return;
+	}
+
+	SetCachedModuleHash(wszFile1, szHash);
+	CHECK(IsCached(wszFile1, szHash), "stored hash wasn't returned");
+	CHECK(!GetCachedModuleHash(wszFile2, szHash2), "hash of another file was returned");
+
+	// the path is compared case-insensitively, like the file system does
+	wchar_t wszUpper[MAX_PATH];
+	wcsncpy_s(wszUpper, wszFile1, _TRUNCATE);
+	_wcsupr(wszUpper);
+	CHECK(IsCached(wszUpper, szHash), "hash wasn't found by the upper case path");
+
+	// a new modification time makes the entry stale, a new calculation replaces it
+	ShiftWriteTime(wszFile1, 10);
+	CHECK(!GetCachedModuleHash(wszFile1, szHash2), "hash was returned after the file time changed");
+	SetCachedModuleHash(wszFile1, szHash);
+	CHECK(IsCached(wszFile1, szHash), "replaced hash wasn't returned");
+	CHECK(db.getCount() == 1, "replaced hash added a setting");
+
+	// the same goes for a new size with the old time
+	GrowFile(wszFile1);
+	CHECK(!GetCachedModuleHash(wszFile1, szHash2), "hash was returned after the file size changed");
+
+	// a damaged value is never returned
+	SetCachedModuleHash(wszFile2, szHash);
+	CHECK(IsCached(wszFile2, szHash), "hash of the second file wasn't returned");
+	SetCachedModuleHash(wszFile2, "0123");
+	CHECK(!GetCachedModuleHash(wszFile2, szHash2), "short hash was returned");
+
+	// nothing is stored for a file which doesn't exist
+	int nSettings = db.getCount();
+	SetCachedModuleHash(wszMissing, szHash);
+	CHECK(!GetCachedModuleHash(wszMissing, szHash2), "hash of a missing file was returned");
+	CHECK(db.getCount() == nSettings, "hash of a missing file was stored");
+
+	DeleteFile(wszFile1);
+	DeleteFile(wszFile2);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// cold scan: every module is hashed and stored, warm scan: every hash comes from the cache
+
+static void Benchmark(const wchar_t *pwszFolder)
+{
+	wchar_t wszMask[MAX_PATH];
+	mir_snwprintf(wszMask, L"%s\\*.dll", pwszFolder);
+
+	LIST<wchar_t> arFiles(100);
+	WIN32_FIND_DATA ffd;
+	HANDLE hFind = FindFirstFile(wszMask, &ffd);
+	if (hFind != INVALID_HANDLE_VALUE) {
+		do {
+			wchar_t wszPath[MAX_PATH];
+			mir_snwprintf(wszPath, L"%s\\%s", pwszFolder, ffd.cFileName);
+			arFiles.insert(mir_wstrdup(wszPath));
+		} while (arFiles.getCount() < 500 && FindNextFile(hFind, &ffd));
+		FindClose(hFind);
+	}
+
+	LARGE_INTEGER freq, t0, t1, t2;
+	QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&t0);
+	for (auto &it : arFiles) {
+		char szHash[33];
+		if (CalculateModuleHash(it, szHash) == 0)
+			SetCachedModuleHash(it, szHash);
+	}
+	QueryPerformanceCounter(&t1);
+	int nCached = 0;
+	for (auto &it : arFiles) {
+		char szHash[33];
+		if (GetCachedModuleHash(it, szHash))
+			nCached++;
+	}
+	QueryPerformanceCounter(&t2);
+
+	printf("%d modules in %S: cold scan %u ms, warm scan %u ms (%d cached)\n", arFiles.getCount(), pwszFolder,
+		UINT((t1.QuadPart - t0.QuadPart) * 1000 / freq.QuadPart), UINT((t2.QuadPart - t1.QuadPart) * 1000 / freq.QuadPart), nCached);
+
+	for (auto &it : arFiles)
+		mir_free(it);
+}
+
+// "-bench" takes an optional folder, the system folder is scanned by default
+int main(int argc, char *argv[])
+{
+	CDbxMemory db;
+	db_setCurrent(&db);
+
+	wchar_t wszFolder[MAX_PATH];
+	GetTempPath(_countof(wszFolder), wszFolder);
+	wcsncat_s(wszFolder, L"pu_hashes_test\\", _TRUNCATE);
+	CreateDirectory(wszFolder, nullptr);
+
+	TestCache(wszFolder, db);
+	RemoveDirectory(wszFolder);
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-bench"))
+			continue;
+
+		wchar_t wszBench[MAX_PATH];
+		if (i + 1 < argc && argv[i + 1][0] != '-')
+			mir_snwprintf(wszBench, L"%S", argv[++i]);
+		else
+			GetSystemDirectory(wszBench, _countof(wszBench));
+		Benchmark(wszBench);
+	}
+
+	db_setCurrent(nullptr);
+
+	if (iErrors) {
+		printf("%d check(s) failed\n", iErrors);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
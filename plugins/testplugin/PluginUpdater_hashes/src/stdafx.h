@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "../../../PluginUpdater/src/stdafx.h"
+
+#include <m_db_int.h>
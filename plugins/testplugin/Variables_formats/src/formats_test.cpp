@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2012-18 Miranda NG team (https://miranda-ng.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation version 2
+of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Variables: the compiled formats used by formatString() must give exactly what the
+// interpreting parser (parseString) gives, with the same error & parse counters, under
+// every combination of the parse options, both on the first call and from the cache
+
+#include "stdafx.h"
+
+static int iErrors = 0;
+
+static DWORD dwSeed = 12345;
+
+static int rnd(int n)
+{
+	dwSeed = dwSeed * 1103515245 + 12345;
+	return (dwSeed >> 16) % n;
+}
+
+// only tokens with deterministic output, so no contact, time or random tokens
+static const wchar_t *arFormats[] =
+{
+	L"plain text",
+	L"a  b\r\nc\nd  ",
+	L"# comment\r\ntext # another one\nend",
+	L"``quoted`` `%raw% ?add(1,2)` end `unterminated",
+	L"?add(1,2) ?upper(abc) !upper(def)",
+	L"?noop(?upper(x)) ?noop(a b) ?repeat(ab,3)",
+	L"?noop(`?add(1,2)`) ?noop(`%tmp%`)x",
+	L"?noop(`a # b`)?noop(`a\r\nb`)?noop(`a b`)",
+	L"?crlf()?tab(2)x?crlf()",
+	L"?if(%true%,yes,no) ?if(%false%,yes,no) %false%",
+	L"%tmp%%tmp% [%tmp%] ?len(%tmp%) !len(%tmp%)",
+	L"?unknown(1) %unknown% %tmp ?add(1 ?add() ?add",
+	L"%", L"?", L"!", L"`", L"%%", L"?noop(%)", L"%tmp",
+	L"%extratext% ?upper(%extratext%) ?noop(`%extratext%`)",
+};
+
+static const ParseOptions arOptions[] =
+{
+	{ FALSE, FALSE, FALSE }, { TRUE, FALSE, FALSE }, { FALSE, TRUE, FALSE }, { TRUE, TRUE, FALSE }, { FALSE, FALSE, TRUE }
+};
+
+// the cache key holds the names of the temporary variables, but not their values
+static wchar_t* arTmpVars[] = { (wchar_t*)L"tmp", (wchar_t*)L"value ?add(1,1)" };
+static wchar_t* arTmpVars2[] = { (wchar_t*)L"tmp", (wchar_t*)L"`other` %false%" };
+static wchar_t* arTmpVars3[] = { (wchar_t*)L"tm", (wchar_t*)L"short" };
+static wchar_t* arTmpVars4[] = { (wchar_t*)L"tm", (wchar_t*)L"short", (wchar_t*)L"extratext", (wchar_t*)L"shadowed" };
+
+static struct
+{
+	wchar_t **pVars;
+	int nVars;
+}
+arVarSets[] =
+{
+	{ nullptr, 0 },
+	{ arTmpVars, _countof(arTmpVars) },
+	{ arTmpVars2, _countof(arTmpVars2) },
+	{ arTmpVars3, _countof(arTmpVars3) },
+	{ arTmpVars4, _countof(arTmpVars4) }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static void CheckFormat(const wchar_t *pwszFormat, int iVarSet)
+{
+	FORMATINFO fi1 = {};
+	fi1.cbSize = sizeof(fi1);
+	fi1.flags = FIF_UNICODE;
+	fi1.szFormat.w = (wchar_t*)pwszFormat;
+	fi1.szExtraText.w = (wchar_t*)L"extra `text`";
+	fi1.szTemporaryVars.w = arVarSets[iVarSet].pVars;
+	fi1.cbTemporaryVarsSize = arVarSets[iVarSet].nVars;
+	FORMATINFO fi2 = fi1;
+
+	// twice, so that the second pass comes from the cache
+	for (int i = 0; i < 2; i++) {
+		fi1.eCount = fi1.pCount = fi2.eCount = fi2.pCount = 0;
+		ptrW res1(parseString(&fi1, pwszFormat)), res2(formatString(&fi2));
+		if (mir_wstrcmp(res1, res2) || fi1.eCount != fi2.eCount || fi1.pCount != fi2.pCount) {
+			printf("'%S' (options %d%d%d, variables %d, pass %d): parseString '%S' [%d/%d], formatString '%S' [%d/%d]\n",
+				pwszFormat, gParseOpts.bStripEOL, gParseOpts.bStripWS, gParseOpts.bStripAll, iVarSet, i + 1,
+				res1.get(), fi1.eCount, fi1.pCount, res2.get(), fi2.eCount, fi2.pCount);
+			iErrors++;
+		}
+	}
+}
+
+// glues random pieces of the corpus together, so that the tokens land at other offsets
+static CMStringW MakeFormat()
+{
+	CMStringW res;
+	for (int n = 1 + rnd(5); n > 0; n--) {
+		const wchar_t *p = arFormats[rnd(_countof(arFormats))];
+		int len = (int)mir_wstrlen(p), start = rnd(len + 1);
+		res.Append(p + start, rnd(len - start + 1));
+	}
+	return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// a cached format must be dropped when a token it uses is registered again
+
+static wchar_t* parseProbe(ARGUMENTSINFO *ai)
+{
+	return mir_wstrdup(ai->argc == 1 ? L"field" : L"function");
+}
+
+static void TestRegister()
+{
+	registerIntToken((wchar_t*)L"probe", parseProbe, TRF_FIELD, "probe");
+	CheckFormat(L"%probe% ?probe(x)", 0);
+
+	registerIntToken((wchar_t*)L"probe", parseProbe, TRF_FUNCTION, "probe");
+	CheckFormat(L"%probe% ?probe(x)", 0);
+
+	deRegisterToken((wchar_t*)L"probe");
+	CheckFormat(L"%probe% ?probe(x)", 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static void Benchmark()
+{
+	const wchar_t *pwszFormat = L"?if(%true%,?upper(%tmp%),no) # comment\r\n?noop(?add(1,2)) ?repeat(ab,3) `%raw%` %tmp%";
+
+	FORMATINFO fi = {};
+	fi.cbSize = sizeof(fi);
+	fi.flags = FIF_UNICODE;
+	fi.szFormat.w = (wchar_t*)pwszFormat;
+	fi.szTemporaryVars.w = arTmpVars;
+	fi.cbTemporaryVarsSize = _countof(arTmpVars);
+
+	LARGE_INTEGER freq, t0, t1, t2;
+	QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < 100000; i++) {
+		fi.eCount = fi.pCount = 0;
+		mir_free(parseString(&fi, pwszFormat));
+	}
+	QueryPerformanceCounter(&t1);
+	for (int i = 0; i < 100000; i++) {
+		fi.eCount = fi.pCount = 0;
+		mir_free(formatString(&fi));
+	}
+	QueryPerformanceCounter(&t2);
+
+	printf("100000 formats: parseString %u ms, formatString %u ms\n",
+		UINT((t1.QuadPart - t0.QuadPart) * 1000 / freq.QuadPart), UINT((t2.QuadPart - t1.QuadPart) * 1000 / freq.QuadPart));
+}
+
+int main(int argc, char *argv[])
+{
+	registerLogicTokens();
+	registerMathTokens();
+	registerStrTokens();
+
+	for (auto &opts : arOptions) {
+		gParseOpts = opts;
+		invalidateFormatCache();
+
+		for (auto &it : arFormats)
+			for (int i = 0; i < _countof(arVarSets); i++)
+				CheckFormat(it, i);
+
+		// more formats than the cache keeps, so that it's flushed on the way
+		for (int i = 0; i < 1000; i++)
+			CheckFormat(MakeFormat(), rnd(_countof(arVarSets)));
+	}
+
+	memset(&gParseOpts, 0, sizeof(gParseOpts));
+	invalidateFormatCache();
+	TestRegister();
+
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "-bench"))
+			Benchmark();
+
+	invalidateFormatCache();
+	deinitTokenRegister();
+
+	if (iErrors) {
+		printf("%d check(s) failed\n", iErrors);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
@@ -1243,23 +1243,17 @@ bool CIrcProto::OnIrc_NAMES(const CIrcMessage *pmsg)
 bool CIrcProto::OnIrc_ENDNAMES(const CIrcMessage *pmsg)
 {
 	if (pmsg->m_bIncoming && pmsg->parameters.getCount() > 1) {
-		CMStringW name = L"a";
-		int i = 0;
-		BOOL bFlag = false;
+		// split the collected RPL_NAMREPLY lists in one pass
+		ptrW pwszNames(mir_wstrdup(sNamesList));
+		LIST<wchar_t> arNames(100);
+		SplitWords(pwszNames, arNames);
 
 		// Is the user on the names list?
-		while (!name.IsEmpty()) {
-			name = GetWord(sNamesList, i);
-			i++;
-			if (!name.IsEmpty()) {
-				int index = 0;
-				while (wcschr(sUserModePrefixes, name[index]))
-					index++;
-
-				if (!mir_wstrcmpi(name.Mid(index), m_info.sNick)) {
-					bFlag = true;
-					break;
-				}
+		bool bFlag = false;
+		for (auto &it : arNames) {
+			if (!mir_wstrcmpi(SkipModePrefixes(it, sUserModePrefixes), m_info.sNick)) {
+				bFlag = true;
+				break;
 			}
 		}
 
@@ -1283,28 +1277,27 @@ bool CIrcProto::OnIrc_ENDNAMES(const CIrcMessage *pmsg)
 				Chat_AddGroup(m_szModuleName, sID, TranslateT("Voice"));
 				Chat_AddGroup(m_szModuleName, sID, TranslateT("Normal"));
 				{
-					int k = 0;
-					CMStringW sTemp = GetWord(sNamesList, k);
-					const wchar_t *pwszNormal = TranslateT("Normal");
+					// statuses of all known prefixes, the last one is for users without prefix
+					int nPrefixes = sUserModePrefixes.GetLength();
+					OBJLIST<CMStringW> arStatuses(nPrefixes + 1);
+					for (int j = 0; j < nPrefixes; j++)
+						arStatuses.insert(new CMStringW(PrefixToStatus(sUserModePrefixes[j])));
+					arStatuses.insert(new CMStringW(TranslateT("Normal")));
+
+					mir_ptr<GCUSER> pUsers((GCUSER*)mir_calloc(sizeof(GCUSER) * max(arNames.getCount(), 1)));
+					int nUsers = 0;
 
 					// Fill the nicklist
-					while (!sTemp.IsEmpty()) {
-						CMStringW sStat;
-						CMStringW sTemp2 = sTemp;
-						sStat = PrefixToStatus(sTemp[0]);
+					for (auto &it : arNames) {
+						const wchar_t *pPrefix = wcschr(sUserModePrefixes, it[0]);
+						const CMStringW &sStat = arStatuses[(*it && pPrefix) ? int(pPrefix - sUserModePrefixes.c_str()) : nPrefixes];
 
 						// fix for networks like freshirc where they allow more than one prefix
-						while (PrefixToStatus(sTemp[0]) != pwszNormal)
-							sTemp.Delete(0, 1);
-
-						GCEVENT gce = { m_szModuleName, sID, GC_EVENT_JOIN };
-						gce.ptszUID = sTemp;
-						gce.ptszNick = sTemp;
-						gce.ptszStatus = sStat;
-						gce.bIsMe = (!mir_wstrcmpi(gce.ptszNick, m_info.sNick)) ? TRUE : FALSE;
-						if (gce.bIsMe) {
+						wchar_t *pNick = SkipModePrefixes(it, sUserModePrefixes);
+
+						if (!mir_wstrcmpi(pNick, m_info.sNick)) {
 							char BitNr = -1;
-							switch (sTemp2[0]) {
+							switch (it[0]) {
 							case '+':   BitNr = 0;   break;
 							case '%':   BitNr = 1;   break;
 							case '@':   BitNr = 2;   break;
@@ -1315,25 +1308,37 @@ bool CIrcProto::OnIrc_ENDNAMES(const CIrcMessage *pmsg)
 								btOwnMode = (1 << BitNr);
 							else
 								btOwnMode = 0;
-						}
-						gce.time = gce.bIsMe ? time(0) : 0;
-						Chat_Event(&gce);
-						
-						DoEvent(GC_EVENT_SETCONTACTSTATUS, sChanName, sTemp, nullptr, nullptr, nullptr, ID_STATUS_ONLINE, FALSE, FALSE);
-						
-						// fix for networks like freshirc where they allow more than one prefix
-						if (PrefixToStatus(sTemp2[0]) != pwszNormal) {
-							sTemp2.Delete(0, 1);
-							sStat = PrefixToStatus(sTemp2[0]);
-							while (sStat != pwszNormal) {
-								DoEvent(GC_EVENT_ADDSTATUS, sID, sTemp, L"system", sStat, nullptr, NULL, false, false, 0);
-								sTemp2.Delete(0, 1);
-								sStat = PrefixToStatus(sTemp2[0]);
-							}
+
+							// our own join goes into the log, so it's sent as a normal event
+							GCEVENT gce = { m_szModuleName, sID, GC_EVENT_JOIN };
+							gce.ptszUID = pNick;
+							gce.ptszNick = pNick;
+							gce.ptszStatus = sStat;
+							gce.bIsMe = TRUE;
+							gce.time = time(0);
+							Chat_Event(&gce);
+
+							DoEvent(GC_EVENT_SETCONTACTSTATUS, sChanName, pNick, nullptr, nullptr, nullptr, ID_STATUS_ONLINE, FALSE, FALSE);
+							continue;
 						}
 
-						k++;
-						sTemp = GetWord(sNamesList, k);
+						GCUSER &u = pUsers[nUsers++];
+						u.ptszUID = pNick;
+						u.ptszNick = pNick;
+						u.ptszStatus = sStat;
+						u.wContactStatus = ID_STATUS_ONLINE;
+					}
+
+					Chat_AddUsers(m_szModuleName, sID, pUsers, nUsers);
+
+					// additional prefixes become additional statuses
+					for (auto &it : arNames) {
+						if (!*it || !wcschr(sUserModePrefixes, it[0]))
+							continue;
+
+						wchar_t *pNick = SkipModePrefixes(it, sUserModePrefixes);
+						for (wchar_t *p = it + 1; p < pNick; p++)
+							DoEvent(GC_EVENT_ADDSTATUS, sID, pNick, L"system", PrefixToStatus(*p), nullptr, NULL, false, false, 0);
 					}
 				}
 
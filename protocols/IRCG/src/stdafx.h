@@ -233,6 +233,10 @@ wchar_t*       __stdcall DoColorCodes(const wchar_t* text, bool bStrip, bool bRe
 
 CMStringA      __stdcall GetWord(const char* text, int index);
 
+// words.cpp
+int            __stdcall SplitWords(wchar_t* text, LIST<wchar_t> &arWords);
+wchar_t*       __stdcall SkipModePrefixes(wchar_t* pszName, const wchar_t* pszPrefixes);
+
 #pragma comment(lib,"comctl32.lib")
 
 #endif
@@ -0,0 +1,56 @@
+/*
+IRC plugin for Miranda IM
+
+Copyright (C) 2003-05 Jurgen Persson
+Copyright (C) 2007-09 George Hazan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "stdafx.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// splits a space separated list in place, in one pass; the words come in the same order
+// as GetWord(text, 0), GetWord(text, 1)... would return them
+
+int __stdcall SplitWords(wchar_t* text, LIST<wchar_t> &arWords)
+{
+	int nWords = 0;
+	for (wchar_t *p = text; p && *p;) {
+		while (*p == ' ')
+			p++;
+		if (*p == 0)
+			break;
+
+		arWords.insert(p);
+		nWords++;
+
+		while (*p && *p != ' ')
+			p++;
+		if (*p)
+			*p++ = 0;
+	}
+	return nWords;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// returns a nick from the NAMES list without its channel mode prefixes
+
+wchar_t* __stdcall SkipModePrefixes(wchar_t* pszName, const wchar_t* pszPrefixes)
+{
+	while (*pszName && wcschr(pszPrefixes, *pszName))
+		pszName++;
+	return pszName;
+}
@@ -31,29 +31,53 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "jabber_rc.h"
 
 static int CompareIqs(const CJabberIqInfo *p1, const CJabberIqInfo *p2)
-{	return p1->GetPriority() - p2->GetPriority();
+{
+	if (p1->GetIqId() != p2->GetIqId())
+		return (p1->GetIqId() < p2->GetIqId()) ? -1 : 1;
+	if (p1->GetPriority() != p2->GetPriority())
+		return (p1->GetPriority() < p2->GetPriority()) ? -1 : 1;
+	return 0;
 }
 
 static int ComparePermanent(const CJabberIqPermanentInfo *p1, const CJabberIqPermanentInfo *p2)
 {	return p1->getPriority() - p2->getPriority();
 }
 
+static int CompareOrder(const CJabberIqPermanentInfo *p1, const CJabberIqPermanentInfo *p2)
+{	return p1->getOrder() - p2->getOrder();
+}
+
+static int CompareBuckets(const CJabberIqHandlerBucket *p1, const CJabberIqHandlerBucket *p2)
+{
+	if (p1->uXmlnsHash != p2->uXmlnsHash)
+		return (p1->uXmlnsHash < p2->uXmlnsHash) ? -1 : 1;
+	if (p1->uTagHash != p2->uTagHash)
+		return (p1->uTagHash < p2->uTagHash) ? -1 : 1;
+	return 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // CJabberIqManager class
 
 CJabberIqManager::CJabberIqManager(CJabberProto *proto) :
 	m_arIqs(10, CompareIqs),
 	m_arHandlers(10, ComparePermanent),
+	m_arBuckets(10, CompareBuckets),
+	m_arAnyXmlns(1),
+	m_bIndexValid(false),
 	m_bExpirerThreadShutdownRequest(false)
 {
 	m_dwLastUsedHandle = 0;
 	m_hExpirerThread = nullptr;
+	m_hExpirerEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	m_dwNextExpire = GetTickCount() + JABBER_IQ_EXPIRER_MAX_WAIT;
 	ppro = proto;
 }
 
 CJabberIqManager::~CJabberIqManager()
 {
 	ExpireAll();
+	CloseHandle(m_hExpirerEvent);
 }
 
 bool CJabberIqManager::Start()
@@ -74,6 +98,7 @@ void CJabberIqManager::Shutdown()
 		return;
 
 	m_bExpirerThreadShutdownRequest = TRUE;
+	SetEvent(m_hExpirerEvent);
 
 	WaitForSingleObject(m_hExpirerThread, INFINITE);
 	CloseHandle(m_hExpirerThread);
@@ -140,17 +165,20 @@ void __cdecl CJabberProto::ExpirerThread(void* pParam)
 
 void CJabberIqManager::ExpirerThread()
 {
+	LIST<CJabberIqInfo> arExpired(10);
+
 	while (!m_bExpirerThreadShutdownRequest) {
-		CJabberIqInfo *pInfo = DetachExpired();
-		if (!pInfo) {
-			for (int i=0; !m_bExpirerThreadShutdownRequest && (i < 10); i++)
-				Sleep(50);
+		// one pass detaches everything that is already expired and tells us when to wake up next
+		DWORD dwWait = DetachExpired(arExpired);
+		for (auto &it : arExpired)
+			ExpireInfo(it);
+		arExpired.destroy();
 
-			// -1 thread :)
-			ppro->m_adhocManager.ExpireSessions();
-			continue;
-		}
-		ExpireInfo(pInfo);
+		// -1 thread :)
+		ppro->m_adhocManager.ExpireSessions();
+
+		// no polling: sleep until the nearest deadline or until Shutdown() wakes us up
+		WaitForSingleObject(m_hExpirerEvent, dwWait);
 	}
 
 	if (!m_bExpirerThreadShutdownRequest) {
@@ -216,6 +244,11 @@ CJabberIqInfo* CJabberIqManager::AddHandler(JABBER_IQ_HANDLER pHandler, int nIqT
 
 	mir_cslock lck(m_cs);
 	m_arIqs.insert(pInfo);
+
+	// wake the expirer up if it sleeps past the new deadline; a timeout shortened later
+	// by SetTimeout() is picked up on the next pass, at most JABBER_IQ_EXPIRER_MAX_WAIT later
+	if (int(pInfo->m_dwRequestTime + pInfo->m_dwTimeout - m_dwNextExpire) < 0)
+		SetEvent(m_hExpirerEvent);
 	return pInfo;
 }
 
@@ -287,9 +320,67 @@ bool CJabberIqManager::HandleIq(int nIqId, HXML pNode)
 	return true;
 }
 
+// permanent handlers are indexed by the hashes of their xmlns and tag, so an iq is matched
+// only against the handlers for its own xmlns & tag, for its xmlns and any tag, and the
+// handlers without xmlns. must be called inside m_cs
+void CJabberIqManager::BuildIndex()
+{
+	m_arBuckets.destroy();
+	m_arAnyXmlns.destroy();
+
+	int iOrder = 0;
+	for (auto &it : m_arHandlers) {
+		it->m_iOrder = iOrder++;
+		if (it->m_szXmlns == nullptr) {
+			m_arAnyXmlns.insert(it);
+			continue;
+		}
+
+		CJabberIqHandlerBucket tmp(it->m_uXmlnsHash, it->m_szTag ? it->m_uTagHash : 0);
+		CJabberIqHandlerBucket *pBucket = m_arBuckets.find(&tmp);
+		if (pBucket == nullptr)
+			m_arBuckets.insert(pBucket = new CJabberIqHandlerBucket(tmp.uXmlnsHash, tmp.uTagHash));
+		pBucket->arHandlers.insert(it);
+	}
+
+	m_bIndexValid = true;
+}
+
+void CJabberIqManager::AddCandidates(LIST<CJabberIqPermanentInfo> &arCandidates, unsigned uXmlnsHash, unsigned uTagHash)
+{
+	CJabberIqHandlerBucket tmp(uXmlnsHash, uTagHash);
+	if (CJabberIqHandlerBucket *pBucket = m_arBuckets.find(&tmp))
+		for (auto &it : pBucket->arHandlers)
+			arCandidates.insert(it);
+}
+
 bool CJabberIqManager::HandleIqPermanent(HXML pNode)
 {
-	for (auto &pInfo : m_arHandlers) {
+	HXML pFirstChild = XmlGetChild(pNode, 0);
+	if (!pFirstChild || !XmlGetName(pFirstChild))
+		return false;
+
+	// hashes are recalculated only when the tag name or xmlns string changes between iterations
+	const wchar_t *szHashedTag = XmlGetName(pFirstChild), *szHashedXmlns = XmlGetAttrValue(pFirstChild, L"xmlns");
+	unsigned uTagHash = mir_hashstrW(szHashedTag), uXmlnsHash = mir_hashstrW(szHashedXmlns);
+
+	// candidates are called in the order of m_arHandlers, i.e. by priority
+	LIST<CJabberIqPermanentInfo> arCandidates(10, CompareOrder);
+	{
+		mir_cslock lck(m_cs);
+		if (!m_bIndexValid)
+			BuildIndex();
+
+		for (auto &it : m_arAnyXmlns)
+			arCandidates.insert(it);
+		if (szHashedXmlns != nullptr) {
+			AddCandidates(arCandidates, uXmlnsHash, uTagHash);
+			if (uTagHash != 0)
+				AddCandidates(arCandidates, uXmlnsHash, 0);
+		}
+	}
+
+	for (auto &pInfo : arCandidates) {
 		// have to get all data here, in the loop, because there's always possibility that previous handler modified it
 		const wchar_t *szType = XmlGetAttrValue(pNode, L"type");
 		if (!szType)
@@ -313,30 +404,36 @@ bool CJabberIqManager::HandleIqPermanent(HXML pNode)
 
 		const wchar_t *szTagName = XmlGetName(pFirstChild);
 		const wchar_t *szXmlns = XmlGetAttrValue(pFirstChild, L"xmlns");
+		if (szTagName != szHashedTag)
+			uTagHash = mir_hashstrW(szHashedTag = szTagName);
+		if (szXmlns != szHashedXmlns)
+			uXmlnsHash = mir_hashstrW(szHashedXmlns = szXmlns);
+
+		if (pInfo->m_szXmlns && (!szXmlns || pInfo->m_uXmlnsHash != uXmlnsHash || mir_wstrcmp(pInfo->m_szXmlns, szXmlns)))
+			continue;
+
+		if (pInfo->m_szTag && (pInfo->m_uTagHash != uTagHash || mir_wstrcmp(pInfo->m_szTag, szTagName)))
+			continue;
 
-		if ((!pInfo->m_szXmlns || (szXmlns && !mir_wstrcmp(pInfo->m_szXmlns, szXmlns))) &&
-			 (!pInfo->m_szTag || !mir_wstrcmp(pInfo->m_szTag, szTagName)))
-		{
-			// node suits handler criteria, call the handler
-			iqInfo.m_pChildNode = pFirstChild;
-			iqInfo.m_szChildTagName = (wchar_t*)szTagName;
-			iqInfo.m_szChildTagXmlns = (wchar_t*)szXmlns;
-			iqInfo.m_szId = (wchar_t*)XmlGetAttrValue(pNode, L"id");
-			iqInfo.m_pUserData = pInfo->m_pUserData;
+		// node suits handler criteria, call the handler
+		iqInfo.m_pChildNode = pFirstChild;
+		iqInfo.m_szChildTagName = (wchar_t*)szTagName;
+		iqInfo.m_szChildTagXmlns = (wchar_t*)szXmlns;
+		iqInfo.m_szId = (wchar_t*)XmlGetAttrValue(pNode, L"id");
+		iqInfo.m_pUserData = pInfo->m_pUserData;
 
-			if (pInfo->m_dwParamsToParse & JABBER_IQ_PARSE_TO)
-				iqInfo.m_szTo = (wchar_t*)XmlGetAttrValue(pNode, L"to");
+		if (pInfo->m_dwParamsToParse & JABBER_IQ_PARSE_TO)
+			iqInfo.m_szTo = (wchar_t*)XmlGetAttrValue(pNode, L"to");
 
-			if (pInfo->m_dwParamsToParse & JABBER_IQ_PARSE_FROM)
-				iqInfo.m_szFrom = (wchar_t*)XmlGetAttrValue(pNode, L"from");
+		if (pInfo->m_dwParamsToParse & JABBER_IQ_PARSE_FROM)
+			iqInfo.m_szFrom = (wchar_t*)XmlGetAttrValue(pNode, L"from");
 
-			if ((pInfo->m_dwParamsToParse & JABBER_IQ_PARSE_HCONTACT) && (iqInfo.m_szFrom))
-				iqInfo.m_hContact = ppro->HContactFromJID(iqInfo.m_szFrom);
+		if ((pInfo->m_dwParamsToParse & JABBER_IQ_PARSE_HCONTACT) && (iqInfo.m_szFrom))
+			iqInfo.m_hContact = ppro->HContactFromJID(iqInfo.m_szFrom);
 
-			ppro->debugLogW(L"Handling iq id %s, type %s, from %s", iqInfo.m_szId, szType, iqInfo.m_szFrom);
-			if ((ppro->*(pInfo->m_pHandler))(pNode, &iqInfo))
-				return true;
-		}
+		ppro->debugLogW(L"Handling iq id %s, type %s, from %s", iqInfo.m_szId, szType, iqInfo.m_szFrom);
+		if ((ppro->*(pInfo->m_pHandler))(pNode, &iqInfo))
+			return true;
 	}
 
 	return false;
@@ -354,13 +451,22 @@ CJabberIqInfo* CJabberIqManager::DetachInfo()
 
 CJabberIqInfo* CJabberIqManager::DetachInfo(int nIqId)
 {
+	// the key with the lowest possible priority points to the first iq with this id
+	CJabberIqInfo tmp;
+	tmp.m_nIqId = nIqId;
+	tmp.m_iPriority = INT_MIN;
+
 	mir_cslock lck(m_cs);
 
-	for (auto &it : m_arIqs)
-		if (it->m_nIqId == nIqId)
-			return m_arIqs.removeItem(&it);
+	int idx;
+	List_GetIndex((SortedList*)&m_arIqs, &tmp, &idx);
 
-	return nullptr;
+	CJabberIqInfo *pInfo = m_arIqs[idx];
+	if (pInfo == nullptr || pInfo->m_nIqId != nIqId)
+		return nullptr;
+
+	m_arIqs.remove(idx);
+	return pInfo;
 }
 
 CJabberIqInfo* CJabberIqManager::DetachInfo(void *pUserData)
@@ -374,17 +480,23 @@ CJabberIqInfo* CJabberIqManager::DetachInfo(void *pUserData)
 	return nullptr;
 }
 
-CJabberIqInfo* CJabberIqManager::DetachExpired()
+// moves all expired iqs to arExpired and returns the time till the next expiration
+DWORD CJabberIqManager::DetachExpired(LIST<CJabberIqInfo> &arExpired)
 {
-	DWORD dwCurrentTime = GetTickCount();
+	DWORD dwCurrentTime = GetTickCount(), dwWait = JABBER_IQ_EXPIRER_MAX_WAIT;
 
 	mir_cslock lck(m_cs);
 
-	for (auto &it : m_arIqs)
-		if (dwCurrentTime - it->m_dwRequestTime > it->m_dwTimeout)
-			return m_arIqs.removeItem(&it);
+	for (auto &it : m_arIqs.rev_iter()) {
+		DWORD dwElapsed = dwCurrentTime - it->m_dwRequestTime;
+		if (dwElapsed > it->m_dwTimeout)
+			arExpired.insert(m_arIqs.removeItem(&it), 0);
+		else if (it->m_dwTimeout - dwElapsed < dwWait)
+			dwWait = it->m_dwTimeout - dwElapsed;
+	}
 
-	return nullptr;
+	m_dwNextExpire = dwCurrentTime + dwWait;
+	return dwWait;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -404,8 +516,10 @@ CJabberIqPermanentInfo* CJabberIqManager::AddPermanentHandler(
 	pInfo->m_pHandler = pHandler;
 	pInfo->m_nIqTypes = nIqTypes ? nIqTypes : JABBER_IQ_TYPE_ANY;
 	pInfo->m_szXmlns = mir_wstrdup(szXmlns);
+	pInfo->m_uXmlnsHash = mir_hashstrW(szXmlns);
 	pInfo->m_bAllowPartialNs = bAllowPartialNs;
 	pInfo->m_szTag = mir_wstrdup(szTag);
+	pInfo->m_uTagHash = mir_hashstrW(szTag);
 	pInfo->m_dwParamsToParse = dwParamsToParse;
 	pInfo->m_pUserData = pUserData;
 	pInfo->m_pUserDataFree = pUserDataFree;
@@ -413,6 +527,7 @@ CJabberIqPermanentInfo* CJabberIqManager::AddPermanentHandler(
 
 	mir_cslock lck(m_cs);
 	m_arHandlers.insert(pInfo);
+	m_bIndexValid = false;
 	return pInfo;
 }
 
@@ -420,5 +535,6 @@ CJabberIqPermanentInfo* CJabberIqManager::AddPermanentHandler(
 bool CJabberIqManager::DeletePermanentHandler(CJabberIqPermanentInfo *pInfo)
 {		
 	mir_cslock lck(m_cs);
+	m_bIndexValid = false;
 	return m_arHandlers.remove(pInfo) == 1;
 }
@@ -36,6 +36,9 @@ typedef void (*IQ_USER_DATA_FREE_FUNC)(void *pUserData);
 // 2 minutes, milliseconds
 #define JABBER_DEFAULT_IQ_REQUEST_TIMEOUT		120000
 
+// the longest time the expirer thread sleeps between two checks, milliseconds
+#define JABBER_IQ_EXPIRER_MAX_WAIT			1000
+
 typedef void (CJabberProto::*JABBER_IQ_HANDLER)(HXML iqNode, CJabberIqInfo *pInfo);
 typedef BOOL (CJabberProto::*JABBER_PERMANENT_IQ_HANDLER)(HXML iqNode, CJabberIqInfo *pInfo);
 
@@ -119,10 +122,12 @@ class CJabberIqPermanentInfo : public MZeroedObject
 	int m_nIqTypes;
 	wchar_t *m_szXmlns;
 	wchar_t *m_szTag;
+	unsigned m_uXmlnsHash, m_uTagHash; // precalculated hashes of m_szXmlns & m_szTag, 0 if absent
 	BOOL m_bAllowPartialNs;
 	void *m_pUserData;
 	IQ_USER_DATA_FREE_FUNC m_pUserDataFree;
 	int m_iPriority;
+	int m_iOrder; // position in CJabberIqManager::m_arHandlers, set when the index is built
 
 public:
 	~CJabberIqPermanentInfo()
@@ -134,6 +139,21 @@ public:
 	}
 
 	__forceinline int getPriority() const { return m_iPriority; }
+	__forceinline int getOrder() const { return m_iOrder; }
+};
+
+// permanent handlers with the same xmlns & tag hashes, in the order of m_arHandlers.
+// uTagHash is 0 for the handlers which accept any tag
+struct CJabberIqHandlerBucket
+{
+	CJabberIqHandlerBucket(unsigned _xmlns, unsigned _tag) :
+		uXmlnsHash(_xmlns),
+		uTagHash(_tag),
+		arHandlers(1)
+	{}
+
+	unsigned uXmlnsHash, uTagHash;
+	LIST<CJabberIqPermanentInfo> arHandlers;
 };
 
 class CJabberIqManager
@@ -144,16 +164,25 @@ protected:
 	mir_cs m_cs;
 	DWORD  m_dwLastUsedHandle;
 
-	HANDLE m_hExpirerThread;
+	HANDLE m_hExpirerThread, m_hExpirerEvent;
+	DWORD  m_dwNextExpire; // tick count when the expirer wakes up next, protected by m_cs
 	BOOL   m_bExpirerThreadShutdownRequest;
 
-	LIST<CJabberIqInfo> m_arIqs;
+	LIST<CJabberIqInfo> m_arIqs; // sorted by iq id, then by priority
 	OBJLIST<CJabberIqPermanentInfo> m_arHandlers;
 
+	// index of m_arHandlers, rebuilt on demand after a handler was added or removed
+	OBJLIST<CJabberIqHandlerBucket> m_arBuckets;
+	LIST<CJabberIqPermanentInfo> m_arAnyXmlns; // handlers without xmlns are checked for every iq
+	bool m_bIndexValid;
+
+	void BuildIndex();
+	void AddCandidates(LIST<CJabberIqPermanentInfo> &arCandidates, unsigned uXmlnsHash, unsigned uTagHash);
+
 	CJabberIqInfo* DetachInfo();
 	CJabberIqInfo* DetachInfo(int nIqId);
 	CJabberIqInfo* DetachInfo(void *pUserData);
-	CJabberIqInfo* DetachExpired();
+	DWORD DetachExpired(LIST<CJabberIqInfo> &arExpired);
 
 	void ExpireInfo(CJabberIqInfo *pInfo);
 
@@ -257,7 +257,7 @@ public:
 		mir_free(headers);
 	}
 
-	virtual NETLIBHTTPREQUEST* Send(HNETLIBUSER nlu)
+	void Prepare(HNETLIBUSER nlu)
 	{
 		if (url.Find("://") == -1)
 			url.Insert(0, ((flags & NLHRF_SSL) ? "https://" : "http://"));
@@ -269,7 +269,11 @@ public:
 		}
 
 		Netlib_Logf(nlu, "Send request to %s", szUrl);
+	}
 
+	virtual NETLIBHTTPREQUEST* Send(HNETLIBUSER nlu)
+	{
+		Prepare(nlu);
 		return Netlib_HttpTransaction(nlu, this);
 	}
 };
@@ -17,103 +17,133 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "stdafx.h"
 
-RequestQueue::RequestQueue(HNETLIBUSER _nlu) :
-	nlu(_nlu), requests(1)
+// requests are executed by the shared netlib scheduler. pushed requests keep their
+// order and are sent one after another, sent ones are executed in parallel
+
+RequestQueue::RequestQueue(HNETLIBUSER _nlu, HttpArgFreeCallback _pfnFreeArg) :
+	nlu(_nlu), pfnFreeArg(_pfnFreeArg), requests(1)
 {
 	isTerminated = true;
-	hRequestQueueThread = nullptr;
+	isBusy = isDestroying = false;
 }
 
+// the owner is being destroyed, so no response callback is called anymore:
+// pending items are freed, cancelled & running ones are freed in AsyncCallback
 RequestQueue::~RequestQueue()
 {
-	if (hRequestQueueThread) {
-		WaitForSingleObject(hRequestQueueThread, INFINITE);
-		hRequestQueueThread = nullptr;
+	isTerminated = isDestroying = true;
+	{
+		mir_cslock lock(requestQueueLock);
+		for (auto &it : requests)
+			Discard(it);
+		requests.destroy();
 	}
 
-	requests.destroy();
+	Netlib_CancelHttpRequests(nlu);
 }
 
-void RequestQueue::Start()
+void RequestQueue::Discard(RequestQueueItem *item)
 {
-	if (!isTerminated)
-		return;
+	if (pfnFreeArg != nullptr && item->arg != nullptr)
+		pfnFreeArg(item->arg);
+	delete item;
+}
 
+void RequestQueue::Start()
+{
 	isTerminated = false;
-	if (hRequestQueueThread == nullptr)
-		hRequestQueueThread = mir_forkThread<RequestQueue>(&RequestQueue::WorkerThread, this);
 }
 
 void RequestQueue::Stop()
 {
-	if (isTerminated)
-		return;
-
 	isTerminated = true;
-	hRequestQueueEvent.Set();
 }
 
 void RequestQueue::Push(HttpRequest *request, HttpResponseCallback response, void *arg)
 {
-	if (isTerminated)
+	if (isTerminated) {
+		if (pfnFreeArg != nullptr && arg != nullptr)
+			pfnFreeArg(arg);
+		delete request;
 		return;
+	}
 
-	RequestQueueItem *item = new RequestQueueItem(request, response, arg);
+	RequestQueueItem *item = new RequestQueueItem(request, response, arg, this, true);
 	{
 		mir_cslock lock(requestQueueLock);
-
-		requests.insert(item);
+		if (isBusy) {
+			requests.insert(item);
+			return;
+		}
+		isBusy = true;
 	}
-	hRequestQueueEvent.Set();
+	Execute(item);
 }
 
 void RequestQueue::Send(HttpRequest *request, HttpResponseCallback response, void *arg)
 {
-	RequestQueueItem *item = new RequestQueueItem(request, response, arg);
-	mir_forkthreadowner(&RequestQueue::AsyncSendThread, this, item, nullptr);
+	Execute(new RequestQueueItem(request, response, arg, this, false));
 }
 
 void RequestQueue::Execute(RequestQueueItem *item)
 {
-	NETLIBHTTPREQUEST *response = item->request->Send(nlu);
-	if (item->responseCallback != nullptr)
-		item->responseCallback(response, item->arg);
-	Netlib_FreeHttpRequest(response);
-	requests.remove(item);
-	delete item;
+	item->request->Prepare(nlu);
+
+	NETLIBASYNCHTTP nlah = {};
+	nlah.pRequest = item->request;
+	nlah.pfnCallback = &RequestQueue::AsyncCallback;
+	nlah.param = item;
+	nlah.iPriority = NLHA_INTERACTIVE;
+	if (Netlib_HttpTransactionAsync(nlu, &nlah))
+		AsyncCallback(nullptr, item->request, item);
 }
 
-unsigned RequestQueue::AsyncSendThread(void *owner, void *arg)
+void RequestQueue::ExecuteNext()
 {
-	RequestQueue *that = (RequestQueue*)owner;
-	RequestQueueItem *item = (RequestQueueItem*)arg;
+	LIST<RequestQueueItem> dropped(1);
+	RequestQueueItem *item = nullptr;
+	{
+		mir_cslock lock(requestQueueLock);
+
+		// after logoff the rest of the queue isn't sent anymore
+		if (isTerminated) {
+			for (auto &it : requests)
+				dropped.insert(it);
+			requests.destroy();
+		}
 
-	that->Execute(item);
-	return 0;
+		if (requests.getCount() == 0)
+			isBusy = false;
+		else {
+			item = requests[0];
+			requests.remove(0);
+		}
+	}
+
+	// their callbacks get no response, like for a failed request
+	for (auto &it : dropped) {
+		it->Finish(nullptr);
+		delete it;
+	}
+
+	if (item != nullptr)
+		Execute(item);
 }
 
-void RequestQueue::WorkerThread(RequestQueue *queue)
+void RequestQueue::AsyncCallback(NETLIBHTTPREQUEST *response, NETLIBHTTPREQUEST*, void *arg)
 {
-	while (true) {
-		queue->hRequestQueueEvent.Wait();
-		if (queue->isTerminated)
-			break;
-
-		while (true) {
-			RequestQueueItem *item = nullptr;
-			{
-				mir_cslock lock(queue->requestQueueLock);
-
-				if (queue->requests.getCount() == 0)
-					break;
-
-				item = queue->requests[0];
-				queue->requests.remove(0);
-			}
-			if (item != nullptr)
-				queue->Execute(item);
-		}
+	RequestQueueItem *item = (RequestQueueItem*)arg;
+	RequestQueue *queue = item->queue;
+	bool isOrdered = item->isOrdered;
+
+	if (queue->isDestroying) {
+		queue->Discard(item);
+		return;
 	}
 
-	queue->hRequestQueueThread = nullptr;
+	item->Finish(response);
+	delete item;
+
+	if (isOrdered)
+		queue->ExecuteNext();
 }
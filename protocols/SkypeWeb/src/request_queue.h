@@ -19,18 +19,20 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define _SKYPE_REQUEST_QUEUE_H_
 
 typedef void(*HttpResponseCallback)(const NETLIBHTTPREQUEST *response, void *arg);
+typedef void(*HttpArgFreeCallback)(void *arg);
+
+class RequestQueue;
 
 struct RequestQueueItem
 {
 	void *arg;
 	HttpRequest *request;
 	HttpResponseCallback responseCallback;
+	RequestQueue *queue;
+	bool isOrdered;      // pushed requests are sent one by one
 
-	RequestQueueItem(HttpRequest *request, void *arg) :
-		 arg(arg), request(request), responseCallback(NULL) { }
-
-	RequestQueueItem(HttpRequest *request, HttpResponseCallback response, void *arg) :
-		 arg(arg), request(request), responseCallback(response) { }
+	RequestQueueItem(HttpRequest *request, HttpResponseCallback response, void *arg, RequestQueue *queue, bool isOrdered) :
+		 arg(arg), request(request), responseCallback(response), queue(queue), isOrdered(isOrdered) { }
 
 	~RequestQueueItem()
 	{
@@ -38,24 +40,30 @@ struct RequestQueueItem
 		request = NULL;
 		responseCallback = NULL;
 	}
+
+	void Finish(const NETLIBHTTPREQUEST *response)
+	{
+		if (responseCallback != NULL)
+			responseCallback(response, arg);
+	}
 };
 
 class RequestQueue
 {
-	bool isTerminated;
+	bool isTerminated, isBusy, isDestroying;
 	HNETLIBUSER nlu;
+	HttpArgFreeCallback pfnFreeArg; // frees an argument whose response callback must not be called
 	mir_cs requestQueueLock;
 	LIST<RequestQueueItem> requests;
-	EventHandle hRequestQueueEvent;
-	HANDLE hRequestQueueThread;
 
 	void Execute(RequestQueueItem *item);
+	void ExecuteNext();
+	void Discard(RequestQueueItem *item);
 
-	static unsigned __cdecl AsyncSendThread(void*, void*);
-	static void __cdecl WorkerThread(RequestQueue *queue);
+	static void AsyncCallback(NETLIBHTTPREQUEST *response, NETLIBHTTPREQUEST *request, void *arg);
 
 public:
-	RequestQueue(HNETLIBUSER nlu);
+	RequestQueue(HNETLIBUSER nlu, HttpArgFreeCallback pfnFreeArg = NULL);
 	~RequestQueue();
 
 	void Start();
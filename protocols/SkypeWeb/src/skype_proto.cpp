@@ -31,7 +31,7 @@ CSkypeProto::CSkypeProto(const char* protoName, const wchar_t* userName) :
 {
 	InitNetwork();
 
-	requestQueue = new RequestQueue(m_hNetlibUser);
+	requestQueue = new RequestQueue(m_hNetlibUser, SkypeHttpFree);
 
 	CreateProtoService(PS_CREATEACCMGRUI, &CSkypeProto::OnAccountManagerInit);
 	CreateProtoService(PS_GETAVATARINFO, &CSkypeProto::SvcGetAvatarInfo);
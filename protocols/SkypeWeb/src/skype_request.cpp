@@ -24,6 +24,11 @@ void SkypeHttpResponse(const NETLIBHTTPREQUEST *response, void *arg)
 	delete delegate;
 }
 
+void SkypeHttpFree(void *arg)
+{
+	delete (SkypeResponseDelegateBase*)arg;
+}
+
 void CSkypeProto::PushRequest(HttpRequest *request)
 {
 	requestQueue->Push(request);
@@ -134,6 +134,7 @@ struct MessageId
 #include "skype_proto.h"
 
 void SkypeHttpResponse(const NETLIBHTTPREQUEST *response, void *arg);
+void SkypeHttpFree(void *arg);
 
 class SkypeResponseDelegateBase
 {
@@ -50,6 +50,7 @@ struct CToxProto;
 
 #define TOX_DEFAULT_INTERVAL 50
 #define TOX_CHECKING_INTERVAL 1000
+#define TOX_FILE_BUFFER_SIZE 65536
 
 #define TOX_MAX_CONNECT_RETRIES 10
 #define TOX_MAX_RECONNECT_RETRIES 10
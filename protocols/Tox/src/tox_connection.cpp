@@ -69,13 +69,41 @@ void CToxProto::OnToxCheck(void *arg, BYTE)
 		proto->CheckConnection();
 }
 
-void CToxProto::OnToxPoll(void *arg, BYTE)
+void CToxProto::PollingThread(void*)
 {
-	CToxProto *proto = (CToxProto*)arg;
+	Thread_SetName("TOX: PollingThread");
+
+	while (!m_bPollingTerminated) {
+		tox_iterate(m_tox, this);
+
+		// sleep as long as toxcore allows, queued outgoing work wakes us up earlier
+		uint32_t interval = tox_iteration_interval(m_tox);
+		WaitForSingleObject(m_hPollingEvent, interval ? interval : TOX_DEFAULT_INTERVAL);
+	}
+}
+
+void CToxProto::StartPolling()
+{
+	m_bPollingTerminated = false;
+	m_hPollingThread = ForkThreadEx(&CToxProto::PollingThread, nullptr, &m_pollingThreadId);
+}
 
-	tox_iterate(proto->m_tox, arg);
-	/*uint32_t interval = tox_iteration_interval(proto->m_tox);
-	interval = interval
-		? interval
-		: TOX_DEFAULT_INTERVAL;*/
+void CToxProto::StopPolling()
+{
+	if (m_hPollingThread == nullptr)
+		return;
+
+	m_bPollingTerminated = true;
+	SetEvent(m_hPollingEvent);
+
+	// tox core must not be killed while the loop is inside tox_iterate
+	if (GetCurrentThreadId() != m_pollingThreadId)
+		WaitForSingleObject(m_hPollingThread, INFINITE);
+	CloseHandle(m_hPollingThread);
+	m_hPollingThread = nullptr;
+}
+
+void CToxProto::WakeToxLoop()
+{
+	SetEvent(m_hPollingEvent);
 }
@@ -101,6 +101,8 @@ void CToxProto::SendMessageAsync(void *arg)
 		debugLogA(__FUNCTION__": failed to send message for %d (%d)", friendNumber, sendError);
 		ProtoBroadcastAck(param->hContact, ACKTYPE_MESSAGE, ACKRESULT_FAILED, (HANDLE)param->hMessage, (LPARAM)ToxErrorToString(sendError));
 	}
+	else WakeToxLoop();
+
 	uint64_t messageId = (((int64_t)friendNumber) << 32) | ((int64_t)messageNumber);
 	messages[messageId] = param->hMessage;
 
@@ -4,8 +4,10 @@ CToxProto::CToxProto(const char* protoName, const wchar_t* userName)
 	: PROTO<CToxProto>(protoName, userName),
 	m_tox(nullptr),
 	m_hTimerQueue(nullptr),
-	m_hPollingTimer(nullptr),
 	m_hCheckingTimer(nullptr),
+	m_hPollingThread(nullptr),
+	m_pollingThreadId(0),
+	m_bPollingTerminated(false),
 	hMessageProcess(1)
 {
 	InitNetlib();
@@ -39,11 +41,13 @@ CToxProto::CToxProto(const char* protoName, const wchar_t* userName)
 	HookProtoEvent(ME_PROTO_ACCLISTCHANGED, &CToxProto::OnAccountRenamed);
 
 	m_hTimerQueue = CreateTimerQueue();
+	m_hPollingEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 }
 
 CToxProto::~CToxProto()
 {
 	DeleteTimerQueue(m_hTimerQueue);
+	CloseHandle(m_hPollingEvent);
 	UninitNetlib();
 }
 
@@ -166,15 +170,9 @@ int CToxProto::SetStatus(int iNewStatus)
 
 	// logout
 	if (iNewStatus == ID_STATUS_OFFLINE) {
-		/*if (m_toxThread != nullptr) {
-			m_toxThread->Terminate();
-			SetEvent(hTerminateEvent);
-		}*/
-
 		DeleteTimerQueueTimer(m_hTimerQueue, m_hCheckingTimer, nullptr);
-		DeleteTimerQueueTimer(m_hTimerQueue, m_hPollingTimer, nullptr);
-		m_hPollingTimer = nullptr;
 		m_hCheckingTimer = nullptr;
+		StopPolling();
 		if (m_tox) {
 			UninitToxCore(m_tox);
 			tox_kill(m_tox);
@@ -217,7 +215,7 @@ int CToxProto::SetStatus(int iNewStatus)
 		}
 
 		InitToxCore(m_tox);
-		CreateTimerQueueTimer(&m_hPollingTimer, m_hTimerQueue, &CToxProto::OnToxPoll, this, TOX_DEFAULT_INTERVAL, TOX_DEFAULT_INTERVAL, WT_EXECUTEINPERSISTENTTHREAD);
+		StartPolling();
 		CreateTimerQueueTimer(&m_hCheckingTimer, m_hTimerQueue, &CToxProto::OnToxCheck, this, TOX_CHECKING_INTERVAL, TOX_CHECKING_INTERVAL, WT_EXECUTEINPERSISTENTTHREAD);
 		return 0;
 	}
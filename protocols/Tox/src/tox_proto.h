@@ -70,9 +70,13 @@ private:
 
 	int m_retriesCount;
 	HANDLE m_hTimerQueue;
-	HANDLE m_hPollingTimer;
 	HANDLE m_hCheckingTimer;
 
+	HANDLE m_hPollingThread;
+	HANDLE m_hPollingEvent;
+	UINT m_pollingThreadId;
+	bool m_bPollingTerminated;
+
 	static HANDLE hProfileFolderPath;
 
 	// tox profile
@@ -112,7 +116,11 @@ private:
 	void CheckConnection();
 
 	static void __stdcall OnToxCheck(void*, BYTE);
-	static void __stdcall OnToxPoll(void*, BYTE);
+
+	void __cdecl PollingThread(void*);
+	void StartPolling();
+	void StopPolling();
+	void WakeToxLoop();
 
 	// accounts
 	int __cdecl OnAccountRenamed(WPARAM, LPARAM);
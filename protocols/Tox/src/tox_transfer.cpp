@@ -126,6 +126,7 @@ int CToxProto::OnFileResume(Tox *tox, HANDLE hTransfer, int *action, const wchar
 		ProtoBroadcastAck(transfer->pfts.hContact, ACKTYPE_FILE, ACKRESULT_FAILED, (HANDLE)transfer, 0);
 		transfers.Remove(transfer);
 	}
+	else WakeToxLoop();
 
 	return 0;
 }
@@ -173,8 +174,8 @@ void CToxProto::OnDataReceiving(Tox *tox, uint32_t friendNumber, uint32_t fileNu
 		return;
 	}
 
-	transfer->pfts.totalProgress = transfer->pfts.currentFileProgress += length;
-	proto->ProtoBroadcastAck(transfer->pfts.hContact, ACKTYPE_FILE, ACKRESULT_DATA, (HANDLE)transfer, (LPARAM)&transfer->pfts);
+	if (transfer->AddProgress(length))
+		proto->ProtoBroadcastAck(transfer->pfts.hContact, ACKTYPE_FILE, ACKRESULT_DATA, (HANDLE)transfer, (LPARAM)&transfer->pfts);
 }
 
 void CToxProto::OnTransferCompleted(Tox *tox, FileTransferParam *transfer)
@@ -253,6 +254,8 @@ HANDLE CToxProto::OnSendFile(Tox *tox, MCONTACT hContact, const wchar_t*, wchar_
 		debugLogA(__FUNCTION__": cannot open file %s", ppszFiles[0]);
 		return nullptr;
 	}
+	// chunks are small, read the file in larger blocks
+	setvbuf(hFile, nullptr, _IOFBF, TOX_FILE_BUFFER_SIZE);
 
 	wchar_t *fileName = wcsrchr(ppszFiles[0], '\\') + 1;
 	size_t fileDirLength = fileName - ppszFiles[0];
@@ -283,6 +286,7 @@ HANDLE CToxProto::OnSendFile(Tox *tox, MCONTACT hContact, const wchar_t*, wchar_
 	transfer->hFile = hFile;
 	transfers.Add(transfer);
 
+	WakeToxLoop();
 	return (HANDLE)transfer;
 }
 
@@ -340,8 +344,8 @@ void CToxProto::OnFileSendData(Tox *tox, uint32_t friendNumber, uint32_t fileNum
 		return;
 	}
 
-	transfer->pfts.totalProgress = transfer->pfts.currentFileProgress += length;
-	proto->ProtoBroadcastAck(transfer->pfts.hContact, ACKTYPE_FILE, ACKRESULT_DATA, (HANDLE)transfer, (LPARAM)&transfer->pfts);
+	if (transfer->AddProgress(length))
+		proto->ProtoBroadcastAck(transfer->pfts.hContact, ACKTYPE_FILE, ACKRESULT_DATA, (HANDLE)transfer, (LPARAM)&transfer->pfts);
 }
 
 /* COMMON */
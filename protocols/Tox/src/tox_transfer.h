@@ -49,11 +49,22 @@ struct FileTransferParam
 		if (hFile)
 			return true;
 		hFile = _wfopen(pfts.szCurrentFile.w, L"wb+");
-		if (hFile)
+		if (hFile) {
+			setvbuf(hFile, nullptr, _IOFBF, TOX_FILE_BUFFER_SIZE);
 			_chsize_s(_fileno(hFile), pfts.currentFileSize);
+		}
 		return hFile != nullptr;
 	}
 
+	// returns true when the progress should be reported: once per buffer and at the end
+	bool AddProgress(size_t length)
+	{
+		uint64_t prevProgress = pfts.currentFileProgress;
+		pfts.totalProgress = pfts.currentFileProgress += length;
+		return prevProgress / TOX_FILE_BUFFER_SIZE != pfts.currentFileProgress / TOX_FILE_BUFFER_SIZE
+			|| pfts.currentFileProgress == pfts.currentFileSize;
+	}
+
 	void Pause()
 	{
 		if (hFile) {
@@ -690,6 +690,12 @@ bool UM_SortUser(SESSION_INFO *si, const wchar_t *pszUID)
 	return true;
 }
 
+void UM_SortUsers(SESSION_INFO *si)
+{
+	auto &arUsers = si->getUserList();
+	qsort(arUsers.getArray(), arUsers.getCount(), sizeof(void*), compareStub);
+}
+
 USERINFO* UM_AddUser(STATUSINFO *pStatusList, SESSION_INFO *si, const wchar_t *pszUID, const wchar_t *pszNick, WORD wStatus)
 {
 	if (pStatusList == nullptr || si == nullptr || pszNick == nullptr)
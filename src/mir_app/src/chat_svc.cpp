@@ -573,6 +573,90 @@ EXTERN_C MIR_APP_DLL(int) Chat_Event(GCEVENT *gce)
 	return CallFunctionSync(sttEventStub, gce);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// adds a batch of users, sorts & redraws the nicklist once
+
+struct ChatAddUsersParam
+{
+	const char *szModule;
+	const wchar_t *wszId;
+	const GCUSER *pUsers;
+	int nUsers;
+};
+
+static int CompareUid(const USERINFO *u1, const USERINFO *u2)
+{
+	return mir_wstrcmpi(u1->pszUID, u2->pszUID);
+}
+
+static INT_PTR CALLBACK stubAddUsers(void *param)
+{
+	ChatAddUsersParam *p = (ChatAddUsersParam*)param;
+
+	SESSION_INFO *si = SM_FindSession(p->wszId, p->szModule);
+	if (si == nullptr || si->pStatuses == nullptr)
+		return 0;
+
+	auto &arUsers = si->getUserList();
+
+	// temporary index by uid to skip duplicates without scanning the nicklist
+	LIST<USERINFO> arByUid(arUsers.getCount() + p->nUsers, CompareUid);
+	for (auto &it : arUsers)
+		arByUid.insert(it);
+
+	int nAdded = 0;
+	USERINFO *pLast = nullptr;
+	for (int i = 0; i < p->nUsers; i++) {
+		const GCUSER &u = p->pUsers[i];
+		if (u.ptszUID == nullptr || u.ptszNick == nullptr)
+			continue;
+
+		USERINFO tmp;
+		tmp.pszUID = (wchar_t*)u.ptszUID;
+		if (arByUid.find(&tmp))
+			continue;
+
+		USERINFO *ui = new USERINFO();
+		ui->pszUID = mir_wstrdup(u.ptszUID);
+		ui->pszNick = mir_wstrdup(u.ptszNick);
+		ui->Status = TM_StringToWord(si->pStatuses, u.ptszStatus) | si->pStatuses->iStatus;
+		ui->ContactStatus = u.wContactStatus;
+
+		// append now, the list is sorted once below
+		arUsers.insert(ui, arUsers.getCount());
+		arByUid.insert(ui);
+
+		if (g_chatApi.OnAddUser)
+			g_chatApi.OnAddUser(si, ui);
+
+		if (u.bIsMe)
+			si->pMe = ui;
+		pLast = ui;
+		nAdded++;
+	}
+
+	if (nAdded == 0)
+		return 0;
+
+	UM_SortUsers(si);
+
+	if (si->pDlg)
+		si->pDlg->UpdateNickList();
+
+	if (g_chatApi.OnNewUser)
+		g_chatApi.OnNewUser(si, pLast);
+	return nAdded;
+}
+
+MIR_APP_DLL(int) Chat_AddUsers(const char *szModule, const wchar_t *wszId, const GCUSER *pUsers, int nUsers)
+{
+	if (pUsers == nullptr || nUsers <= 0)
+		return 0;
+
+	ChatAddUsersParam param = { szModule, wszId, pUsers, nUsers };
+	return CallFunctionSync(stubAddUsers, &param);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // chat control functions
 
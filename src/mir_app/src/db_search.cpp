@@ -0,0 +1,1136 @@
+/*
+
+Miranda NG: the free IM client for Microsoft* Windows*
+
+Copyright (c) 2012-18 Miranda NG team (https://miranda-ng.org),
+Copyright (c) 2000-12 Miranda IM project,
+all portions of this codebase are copyrighted to the people
+listed in contributors.txt.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "stdafx.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Full-text index over the message history
+//
+// Each term (a case folded word) keeps the list of events containing it: ascending event
+// ids packed as delta varints plus an unsorted tail for the ids which came out of order.
+// Each contact is a pseudo-term too, that's how a search is narrowed to one contact.
+// Deleted events are filtered out by a tombstone set, edited ones are verified against
+// their current text; both sets are folded into postings when they grow big.
+// The index is kept in memory and saved to %miranda_userdata%\history.fts on exit
+
+#define FTS_SIGNATURE  0x5354464D // 'MFTS'
+#define FTS_VERSION    2
+#define FTS_MAXTERM    32         // longer words are truncated
+#define FTS_FILENAME   L"%miranda_userdata%\\history.fts"
+
+static bool IsIndexable(const DBEVENTINFO &dbei)
+{
+	return dbei.eventType == EVENTTYPE_MESSAGE || dbei.eventType == EVENTTYPE_URL;
+}
+
+static int __cdecl CompareIds(const void *p1, const void *p2)
+{
+	MEVENT id1 = *(MEVENT*)p1, id2 = *(MEVENT*)p2;
+	return (id1 < id2) ? -1 : (id1 > id2);
+}
+
+static int __cdecl CompareStrings(const void *p1, const void *p2)
+{
+	return wcscmp(*(wchar_t**)p1, *(wchar_t**)p2);
+}
+
+// sorts an array of ids and removes duplicates, returns the new number of elements
+static int SortUnique(MEVENT *pIds, int nIds)
+{
+	if (nIds < 2)
+		return nIds;
+
+	qsort(pIds, nIds, sizeof(MEVENT), CompareIds);
+
+	int n = 1;
+	for (int i = 1; i < nIds; i++)
+		if (pIds[i] != pIds[n - 1])
+			pIds[n++] = pIds[i];
+	return n;
+}
+
+static bool ContainsId(const MEVENT *pIds, int nIds, MEVENT id)
+{
+	return bsearch(&id, pIds, nIds, sizeof(MEVENT), CompareIds) != nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// text tokenizer: folds the text and splits it into words
+
+struct FtsTokens : public MNonCopyable
+{
+	wchar_t *pBuf = nullptr;      // folded text, each token is zero terminated
+	wchar_t **pTokens = nullptr;
+	int nTokens = 0;
+
+	~FtsTokens()
+	{
+		mir_free(pBuf);
+		mir_free(pTokens);
+	}
+
+	void parse(const wchar_t *pwszText, int cchText = -1)
+	{
+		if (cchText == -1)
+			cchText = (int)mir_wstrlen(pwszText);
+		if (cchText == 0)
+			return;
+
+		pBuf = (wchar_t*)mir_alloc(sizeof(wchar_t) * (cchText + 1));
+		if (LCMapStringW(LOCALE_INVARIANT, LCMAP_LOWERCASE, pwszText, cchText, pBuf, cchText) != cchText)
+			memcpy(pBuf, pwszText, sizeof(wchar_t) * cchText);
+		pBuf[cchText] = 0;
+
+		mir_ptr<WORD> pTypes((WORD*)mir_alloc(sizeof(WORD) * cchText));
+		if (!GetStringTypeW(CT_CTYPE1, pBuf, cchText, pTypes))
+			return;
+
+		pTokens = (wchar_t**)mir_alloc(sizeof(wchar_t*) * (cchText / 2 + 1));
+		for (int i = 0; i < cchText;) {
+			if (!(pTypes[i] & (C1_ALPHA | C1_DIGIT))) {
+				pBuf[i++] = 0;
+				continue;
+			}
+
+			int iStart = i;
+			while (i < cchText && (pTypes[i] & (C1_ALPHA | C1_DIGIT)))
+				i++;
+
+			if (i - iStart > FTS_MAXTERM)
+				pBuf[iStart + FTS_MAXTERM] = 0;
+			pTokens[nTokens++] = pBuf + iStart;
+		}
+	}
+
+	// sorts tokens for bsearch(), destroys their order
+	void sort()
+	{
+		if (nTokens > 1)
+			qsort(pTokens, nTokens, sizeof(wchar_t*), CompareStrings);
+	}
+
+	bool contains(const wchar_t *pwszTerm) const
+	{
+		return bsearch(&pwszTerm, pTokens, nTokens, sizeof(wchar_t*), CompareStrings) != nullptr;
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// a set of event ids, sorted on demand
+
+struct CFtsIdSet : public MNonCopyable
+{
+	MEVENT *m_pIds = nullptr;
+	int m_count = 0, m_alloc = 0;
+	bool m_bSorted = true;
+
+	~CFtsIdSet()
+	{
+		mir_free(m_pIds);
+	}
+
+	void add(MEVENT id)
+	{
+		if (m_count == m_alloc) {
+			m_alloc = (m_alloc == 0) ? 16 : m_alloc * 2;
+			m_pIds = (MEVENT*)mir_realloc(m_pIds, sizeof(MEVENT) * m_alloc);
+		}
+
+		if (m_count && m_pIds[m_count - 1] >= id)
+			m_bSorted = false;
+		m_pIds[m_count++] = id;
+	}
+
+	void sort()
+	{
+		if (!m_bSorted) {
+			m_count = SortUnique(m_pIds, m_count);
+			m_bSorted = true;
+		}
+	}
+
+	bool contains(MEVENT id)
+	{
+		sort();
+		return ContainsId(m_pIds, m_count, id);
+	}
+
+	void remove(MEVENT id)
+	{
+		sort();
+		MEVENT *p = (MEVENT*)bsearch(&id, m_pIds, m_count, sizeof(MEVENT), CompareIds);
+		if (p != nullptr) {
+			memmove(p, p + 1, sizeof(MEVENT) * (m_count - (p - m_pIds) - 1));
+			m_count--;
+		}
+	}
+
+	void clear()
+	{
+		m_count = 0;
+		m_bSorted = true;
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// a term with its postings
+
+static bool ReadVarint(const BYTE *&p, const BYTE *pEnd, MEVENT &id)
+{
+	MEVENT delta = 0;
+	for (int shift = 0; p < pEnd && shift < 35; shift += 7) {
+		BYTE b = *p++;
+		delta |= MEVENT(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			id += delta;
+			return true;
+		}
+	}
+	return false;
+}
+
+struct CFtsTerm : public MNonCopyable
+{
+	CFtsTerm(const wchar_t *pwszTerm) :
+		m_pwszTerm(mir_wstrdup(pwszTerm))
+	{}
+
+	~CFtsTerm()
+	{
+		mir_free(m_pwszTerm);
+		mir_free(m_pData);
+	}
+
+	wchar_t *m_pwszTerm;
+	BYTE *m_pData = nullptr;     // ascending ids, delta varints
+	int m_cbData = 0, m_cbAlloc = 0;
+	int m_nDocs = 0;             // number of packed ids
+	MEVENT m_lastId = 0;         // the last packed id
+	CFtsIdSet m_tail;            // ids that came out of order
+
+	void append(MEVENT id)
+	{
+		if (m_cbData + 5 > m_cbAlloc) {
+			m_cbAlloc = (m_cbAlloc < 8) ? 8 : m_cbAlloc * 2;
+			m_pData = (BYTE*)mir_realloc(m_pData, m_cbAlloc);
+		}
+
+		MEVENT delta = id - m_lastId;
+		while (delta >= 0x80) {
+			m_pData[m_cbData++] = BYTE(delta | 0x80);
+			delta >>= 7;
+		}
+		m_pData[m_cbData++] = BYTE(delta);
+
+		m_lastId = id;
+		m_nDocs++;
+	}
+
+	void put(MEVENT id)
+	{
+		if (m_tail.m_count == 0 && id > m_lastId) {
+			append(id);
+			return;
+		}
+
+		if (id == m_lastId)
+			return;
+
+		m_tail.add(id);
+		if (m_tail.m_count >= 1024 && m_tail.m_count > m_nDocs / 2)
+			normalize();
+	}
+
+	// merges the tail into the packed list, optionally dropping deleted & stale ids
+	typedef bool (*pfnFilter)(MEVENT id, const wchar_t *pwszTerm);
+
+	void normalize(pfnFilter pFilter = nullptr)
+	{
+		if (m_tail.m_count == 0 && pFilter == nullptr)
+			return;
+
+		m_tail.sort();
+
+		BYTE *pOld = m_pData;
+		const BYTE *p = pOld, *pEnd = pOld + m_cbData;
+		m_pData = nullptr;
+		m_cbData = m_cbAlloc = m_nDocs = 0;
+		m_lastId = 0;
+
+		MEVENT idOld = 0;
+		bool bOld = ReadVarint(p, pEnd, idOld);
+		for (int i = 0; bOld || i < m_tail.m_count;) {
+			MEVENT id;
+			if (!bOld || (i < m_tail.m_count && m_tail.m_pIds[i] < idOld))
+				id = m_tail.m_pIds[i++];
+			else {
+				id = idOld;
+				if (i < m_tail.m_count && m_tail.m_pIds[i] == idOld)
+					i++;
+				bOld = ReadVarint(p, pEnd, idOld);
+			}
+
+			if (pFilter == nullptr || pFilter(id, m_pwszTerm))
+				append(id);
+		}
+
+		mir_free(pOld);
+		m_tail.clear();
+	}
+
+	// unpacks ids to pDest, there should be at least m_nDocs elements
+	void decode(MEVENT *pDest) const
+	{
+		const BYTE *p = m_pData, *pEnd = m_pData + m_cbData;
+		MEVENT id = 0;
+		while (ReadVarint(p, pEnd, id))
+			*pDest++ = id;
+	}
+};
+
+static int __cdecl CompareTerms(const void *p1, const void *p2)
+{
+	return wcscmp((*(CFtsTerm**)p1)->m_pwszTerm, (*(CFtsTerm**)p2)->m_pwszTerm);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// the index itself: a hash table of terms plus a sorted array for prefix queries
+
+struct FtsFingerprint;
+
+class CFtsIndex : public MNonCopyable
+{
+	CFtsTerm **m_pHash = nullptr;
+	int m_hashSize = 0, m_nTerms = 0;
+
+	CFtsTerm **m_pSorted = nullptr; // all terms except fresh ones, sorted by wcscmp
+	int m_nSorted = 0;
+	CFtsTerm **m_pFresh = nullptr;  // terms created since the last sorting
+	int m_nFresh = 0, m_freshAlloc = 0;
+
+	void rehash(int newSize)
+	{
+		CFtsTerm **pOld = m_pHash;
+		int oldSize = m_hashSize;
+
+		m_hashSize = newSize;
+		m_pHash = (CFtsTerm**)mir_calloc(sizeof(CFtsTerm*) * newSize);
+		for (int i = 0; i < oldSize; i++)
+			if (CFtsTerm *p = pOld[i]) {
+				int j = mir_hashstrW(p->m_pwszTerm) & (m_hashSize - 1);
+				while (m_pHash[j])
+					j = (j + 1) & (m_hashSize - 1);
+				m_pHash[j] = p;
+			}
+		mir_free(pOld);
+	}
+
+	CFtsTerm* create(const wchar_t *pwszTerm, bool bFresh)
+	{
+		if ((m_nTerms + 1) * 2 > m_hashSize)
+			rehash((m_hashSize == 0) ? 4096 : m_hashSize * 2);
+
+		int i = mir_hashstrW(pwszTerm) & (m_hashSize - 1);
+		while (m_pHash[i])
+			i = (i + 1) & (m_hashSize - 1);
+
+		CFtsTerm *p = m_pHash[i] = new CFtsTerm(pwszTerm);
+		m_nTerms++;
+
+		if (bFresh) {
+			if (m_nFresh == m_freshAlloc) {
+				m_freshAlloc = (m_freshAlloc == 0) ? 256 : m_freshAlloc * 2;
+				m_pFresh = (CFtsTerm**)mir_realloc(m_pFresh, sizeof(CFtsTerm*) * m_freshAlloc);
+			}
+			m_pFresh[m_nFresh++] = p;
+		}
+		return p;
+	}
+
+	void ensureSorted()
+	{
+		if (m_nFresh == 0)
+			return;
+
+		qsort(m_pFresh, m_nFresh, sizeof(CFtsTerm*), CompareTerms);
+
+		CFtsTerm **pNew = (CFtsTerm**)mir_alloc(sizeof(CFtsTerm*) * (m_nSorted + m_nFresh));
+		int i = 0, j = 0, k = 0;
+		while (i < m_nSorted && j < m_nFresh)
+			pNew[k++] = (wcscmp(m_pSorted[i]->m_pwszTerm, m_pFresh[j]->m_pwszTerm) < 0) ? m_pSorted[i++] : m_pFresh[j++];
+		while (i < m_nSorted)
+			pNew[k++] = m_pSorted[i++];
+		while (j < m_nFresh)
+			pNew[k++] = m_pFresh[j++];
+
+		mir_free(m_pSorted);
+		m_pSorted = pNew;
+		m_nSorted = k;
+		m_nFresh = 0;
+	}
+
+public:
+	CFtsIdSet m_deleted, m_edited;
+
+	~CFtsIndex()
+	{
+		for (int i = 0; i < m_hashSize; i++)
+			delete m_pHash[i];
+
+		mir_free(m_pHash);
+		mir_free(m_pSorted);
+		mir_free(m_pFresh);
+	}
+
+	CFtsTerm* find(const wchar_t *pwszTerm) const
+	{
+		if (m_hashSize == 0)
+			return nullptr;
+
+		for (int i = mir_hashstrW(pwszTerm) & (m_hashSize - 1); m_pHash[i]; i = (i + 1) & (m_hashSize - 1))
+			if (!wcscmp(m_pHash[i]->m_pwszTerm, pwszTerm))
+				return m_pHash[i];
+
+		return nullptr;
+	}
+
+	CFtsTerm* get(const wchar_t *pwszTerm)
+	{
+		CFtsTerm *p = find(pwszTerm);
+		return (p != nullptr) ? p : create(pwszTerm, true);
+	}
+
+	static void getContactTerm(MCONTACT hContact, wchar_t *pwszDest)
+	{
+		mir_snwprintf(pwszDest, 20, L"\x01%x", hContact);
+	}
+
+	void addEvent(MCONTACT hContact, MEVENT hDbEvent, const FtsTokens &tokens)
+	{
+		wchar_t wszContact[20];
+		getContactTerm(hContact, wszContact);
+		get(wszContact)->put(hDbEvent);
+
+		if (MCONTACT hMeta = db_mc_getMeta(hContact)) {
+			getContactTerm(hMeta, wszContact);
+			get(wszContact)->put(hDbEvent);
+		}
+
+		for (int i = 0; i < tokens.nTokens; i++)
+			get(tokens.pTokens[i])->put(hDbEvent);
+	}
+
+	// returns sorted ids of events containing the term or a word starting with it
+	int lookup(const wchar_t *pwszTerm, bool bPrefix, MEVENT *&pIds)
+	{
+		pIds = nullptr;
+
+		if (!bPrefix) {
+			CFtsTerm *p = find(pwszTerm);
+			if (p == nullptr)
+				return 0;
+
+			p->normalize();
+			pIds = (MEVENT*)mir_alloc(sizeof(MEVENT) * (p->m_nDocs + 1));
+			p->decode(pIds);
+			return p->m_nDocs;
+		}
+
+		ensureSorted();
+
+		// the first term not less than the prefix
+		int lo = 0, hi = m_nSorted;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (wcscmp(m_pSorted[mid]->m_pwszTerm, pwszTerm) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		size_t cchPrefix = mir_wstrlen(pwszTerm);
+		int nIds = 0, nAlloc = 0;
+		for (int i = lo; i < m_nSorted && !wcsncmp(m_pSorted[i]->m_pwszTerm, pwszTerm, cchPrefix); i++) {
+			CFtsTerm *p = m_pSorted[i];
+			p->normalize();
+			if (nIds + p->m_nDocs > nAlloc) {
+				nAlloc = max(nAlloc * 2, nIds + p->m_nDocs);
+				pIds = (MEVENT*)mir_realloc(pIds, sizeof(MEVENT) * nAlloc);
+			}
+			p->decode(pIds + nIds);
+			nIds += p->m_nDocs;
+		}
+		return SortUnique(pIds, nIds);
+	}
+
+	// moves all data collected by another index into this one
+	void merge(CFtsIndex &src)
+	{
+		for (int i = 0; i < src.m_hashSize; i++) {
+			CFtsTerm *pSrc = src.m_pHash[i];
+			if (pSrc == nullptr)
+				continue;
+
+			pSrc->normalize();
+			mir_ptr<MEVENT> pIds((MEVENT*)mir_alloc(sizeof(MEVENT) * (pSrc->m_nDocs + 1)));
+			pSrc->decode(pIds);
+
+			CFtsTerm *pDest = get(pSrc->m_pwszTerm);
+			for (int j = 0; j < pSrc->m_nDocs; j++)
+				pDest->put(pIds[j]);
+		}
+
+		for (int i = 0; i < src.m_deleted.m_count; i++)
+			m_deleted.add(src.m_deleted.m_pIds[i]);
+		for (int i = 0; i < src.m_edited.m_count; i++)
+			m_edited.add(src.m_edited.m_pIds[i]);
+	}
+
+	bool load(const wchar_t *pwszFileName, const FtsFingerprint &fp);
+	bool save(const wchar_t *pwszFileName, const FtsFingerprint &fp);
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// index file
+
+#pragma pack(push, 1)
+struct FtsFingerprint
+{
+	DWORD dwEvents;               // total number of events
+	DWORD dwContacts;             // hash of every contact's handle, event count & last event
+	DWORD dwDatabase;             // hash of the profile's file name & creation time
+};
+
+struct FtsFileHeader
+{
+	DWORD dwSignature, dwVersion;
+	FtsFingerprint fp;            // the history when the index was saved
+	DWORD nTerms, nDeleted, nEdited;
+};
+
+struct FtsFileTerm
+{
+	WORD  cchTerm;                // followed by the term & packed ids
+	DWORD nDocs, dwLastId, cbData;
+};
+#pragma pack(pop)
+
+bool CFtsIndex::load(const wchar_t *pwszFileName, const FtsFingerprint &fp)
+{
+	HANDLE hFile = CreateFile(pwszFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool bResult = false;
+	DWORD dwSize = GetFileSize(hFile, nullptr);
+	HANDLE hMap = (dwSize != INVALID_FILE_SIZE && dwSize >= sizeof(FtsFileHeader)) ? CreateFileMapping(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	BYTE *pBase = (hMap) ? (BYTE*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (pBase != nullptr) {
+		const BYTE *p = pBase, *pEnd = pBase + dwSize;
+		const FtsFileHeader *pHdr = (FtsFileHeader*)p;
+		p += sizeof(FtsFileHeader);
+
+		// the history was changed without us, the index is useless
+		if (pHdr->dwSignature == FTS_SIGNATURE && pHdr->dwVersion == FTS_VERSION && !memcmp(&pHdr->fp, &fp, sizeof(fp))) {
+			size_t cbSets = (size_t(pHdr->nDeleted) + pHdr->nEdited) * sizeof(MEVENT);
+			if (cbSets <= size_t(pEnd - p) && pHdr->nTerms <= dwSize / sizeof(FtsFileTerm)) {
+				for (DWORD i = 0; i < pHdr->nDeleted; i++, p += sizeof(MEVENT))
+					m_deleted.add(*(MEVENT*)p);
+				for (DWORD i = 0; i < pHdr->nEdited; i++, p += sizeof(MEVENT))
+					m_edited.add(*(MEVENT*)p);
+
+				// terms are stored sorted, so they go directly to the sorted array
+				m_pSorted = (CFtsTerm**)mir_alloc(sizeof(CFtsTerm*) * (pHdr->nTerms + 1));
+
+				DWORD i;
+				for (i = 0; i < pHdr->nTerms; i++) {
+					const FtsFileTerm *pRec = (FtsFileTerm*)p;
+					if (size_t(pEnd - p) < sizeof(FtsFileTerm))
+						break;
+					p += sizeof(FtsFileTerm);
+
+					size_t cbTerm = pRec->cchTerm * sizeof(wchar_t);
+					if (pRec->cchTerm == 0 || pRec->cchTerm > FTS_MAXTERM + 1 || size_t(pEnd - p) < cbTerm + pRec->cbData)
+						break;
+
+					wchar_t wszTerm[FTS_MAXTERM + 2];
+					memcpy(wszTerm, p, cbTerm);
+					wszTerm[pRec->cchTerm] = 0;
+					p += cbTerm;
+
+					CFtsTerm *pTerm = create(wszTerm, false);
+					if (pRec->cbData) {
+						pTerm->m_pData = (BYTE*)mir_alloc(pRec->cbData);
+						memcpy(pTerm->m_pData, p, pRec->cbData);
+					}
+					pTerm->m_cbData = pTerm->m_cbAlloc = pRec->cbData;
+					pTerm->m_nDocs = pRec->nDocs;
+					pTerm->m_lastId = pRec->dwLastId;
+					p += pRec->cbData;
+
+					m_pSorted[m_nSorted++] = pTerm;
+				}
+				bResult = (i == pHdr->nTerms);
+			}
+		}
+		UnmapViewOfFile(pBase);
+	}
+
+	if (hMap)
+		CloseHandle(hMap);
+	CloseHandle(hFile);
+	return bResult;
+}
+
+// folding of the deleted & edited events into postings
+
+struct FtsEditedEvent
+{
+	MEVENT hDbEvent;
+	FtsTokens tokens;
+	wchar_t wszContact[20], wszMeta[20]; // pseudo-terms of the event's current owner
+};
+
+static CFtsIdSet *g_pCompactDeleted;
+static OBJLIST<FtsEditedEvent> *g_pCompactEdited;
+
+static bool CompactFilter(MEVENT id, const wchar_t *pwszTerm)
+{
+	if (ContainsId(g_pCompactDeleted->m_pIds, g_pCompactDeleted->m_count, id))
+		return false;
+
+	FtsEditedEvent *pEdited = g_pCompactEdited->find((FtsEditedEvent*)&id);
+	if (pEdited == nullptr)
+		return true;
+
+	// a reused handle is still listed in the pseudo-term of its previous contact
+	if (*pwszTerm == 1)
+		return !wcscmp(pwszTerm, pEdited->wszContact) || !wcscmp(pwszTerm, pEdited->wszMeta);
+
+	return pEdited->tokens.contains(pwszTerm);
+}
+
+static wchar_t* GetIndexableText(MEVENT hDbEvent);
+
+bool CFtsIndex::save(const wchar_t *pwszFileName, const FtsFingerprint &fp)
+{
+	ensureSorted();
+	m_deleted.sort();
+	m_edited.sort();
+
+	// fold the changes, if there're many of them
+	OBJLIST<FtsEditedEvent> arEdited(50, NumericKeySortT);
+	bool bCompact = (m_deleted.m_count + m_edited.m_count) > max(4096, int(fp.dwEvents / 100));
+	if (bCompact) {
+		for (int i = 0; i < m_edited.m_count; i++) {
+			FtsEditedEvent *pEdited = new FtsEditedEvent();
+			pEdited->hDbEvent = m_edited.m_pIds[i];
+			ptrW wszText(GetIndexableText(pEdited->hDbEvent));
+			if (wszText)
+				pEdited->tokens.parse(wszText);
+			pEdited->tokens.sort();
+
+			MCONTACT hContact = db_event_getContact(pEdited->hDbEvent);
+			getContactTerm(hContact, pEdited->wszContact);
+			if (MCONTACT hMeta = db_mc_getMeta(hContact))
+				getContactTerm(hMeta, pEdited->wszMeta);
+			arEdited.insert(pEdited);
+		}
+
+		g_pCompactDeleted = &m_deleted;
+		g_pCompactEdited = &arEdited;
+	}
+
+	CMStringW wszTempName(FORMAT, L"%s.tmp", pwszFileName);
+	HANDLE hFile = CreateFile(wszTempName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	MStreamBuffer buf;
+	bool bResult = true;
+	DWORD dwWritten;
+	auto flush = [&]() {
+		if (!buf.isEmpty()) {
+			if (!WriteFile(hFile, buf.data(), (DWORD)buf.length(), &dwWritten, nullptr) || dwWritten != buf.length())
+				bResult = false;
+			buf.remove(buf.length());
+		}
+	};
+
+	FtsFileHeader hdr = { FTS_SIGNATURE, FTS_VERSION, fp };
+	buf.append(&hdr, sizeof(hdr));
+	if (!bCompact) {
+		hdr.nDeleted = m_deleted.m_count;
+		hdr.nEdited = m_edited.m_count;
+		buf.append(m_deleted.m_pIds, sizeof(MEVENT) * m_deleted.m_count);
+		buf.append(m_edited.m_pIds, sizeof(MEVENT) * m_edited.m_count);
+	}
+
+	for (int i = 0; i < m_nSorted; i++) {
+		CFtsTerm *p = m_pSorted[i];
+		p->normalize(bCompact ? CompactFilter : nullptr);
+		if (p->m_nDocs == 0)
+			continue;
+
+		FtsFileTerm rec = { (WORD)mir_wstrlen(p->m_pwszTerm), (DWORD)p->m_nDocs, p->m_lastId, (DWORD)p->m_cbData };
+		buf.append(&rec, sizeof(rec));
+		buf.append(p->m_pwszTerm, rec.cchTerm * sizeof(wchar_t));
+		buf.append(p->m_pData, p->m_cbData);
+		hdr.nTerms++;
+
+		if (buf.length() >= 1024 * 1024)
+			flush();
+	}
+	flush();
+
+	// now the header is complete
+	SetFilePointer(hFile, 0, nullptr, FILE_BEGIN);
+	if (!WriteFile(hFile, &hdr, sizeof(hdr), &dwWritten, nullptr) || dwWritten != sizeof(hdr))
+		bResult = false;
+	CloseHandle(hFile);
+
+	if (bCompact) {
+		m_deleted.clear();
+		m_edited.clear();
+	}
+
+	if (!bResult || !MoveFileEx(wszTempName, pwszFileName, MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFile(wszTempName);
+		return false;
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// index maintenance
+
+static mir_cs csIndex;
+static CFtsIndex *g_pIndex;
+static bool g_bIndexReady, g_bIndexDirty;
+static volatile bool g_bTerminate;
+static HANDLE g_hIndexThread, hevIndexDone;
+
+static wchar_t* GetIndexableText(MEVENT hDbEvent)
+{
+	int cbBlob = db_event_getBlobSize(hDbEvent);
+	if (cbBlob == -1)
+		return nullptr;
+
+	DBEVENTINFO dbei = {};
+	dbei.cbBlob = cbBlob;
+	mir_ptr<BYTE> pBlob((BYTE*)mir_alloc(cbBlob + 1));
+	dbei.pBlob = pBlob;
+	if (db_event_get(hDbEvent, &dbei) || !IsIndexable(dbei))
+		return nullptr;
+
+	return DbEvent_GetTextW(&dbei, CP_ACP);
+}
+
+// the index is trusted only if it was saved for the same database in the same state
+static void GetHistoryFingerprint(FtsFingerprint &fp)
+{
+	memset(&fp, 0, sizeof(fp));
+
+	MStreamBuffer buf;
+	auto addContact = [&](MCONTACT hContact) {
+		DWORD dwData[3] = { hContact, (DWORD)db_event_count(hContact), db_event_last(hContact) };
+		fp.dwEvents += dwData[1];
+		buf.append(dwData, sizeof(dwData));
+	};
+
+	addContact(0);
+	for (auto &hContact : Contacts())
+		addContact(hContact);
+	fp.dwContacts = mir_hash(buf.data(), (unsigned)buf.length());
+
+	VARSW wszProfile(L"%miranda_userdata%\\%miranda_profilename%.dat");
+	fp.dwDatabase = mir_hashstrW(wszProfile);
+
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (GetFileAttributesExW(wszProfile, GetFileExInfoStandard, &fad))
+		fp.dwDatabase ^= mir_hash(&fad.ftCreationTime, sizeof(fad.ftCreationTime));
+}
+
+static void IndexEvent(MCONTACT hContact, MEVENT hDbEvent, bool bEdited)
+{
+	ptrW wszText(GetIndexableText(hDbEvent));
+
+	FtsTokens tokens;
+	if (wszText)
+		tokens.parse(wszText);
+
+	mir_cslock lck(csIndex);
+	if (g_pIndex == nullptr)
+		return;
+
+	// a handle of the deleted event was reused, old postings are still there
+	if (g_pIndex->m_deleted.contains(hDbEvent)) {
+		g_pIndex->m_deleted.remove(hDbEvent);
+		bEdited = true;
+	}
+
+	if (bEdited)
+		g_pIndex->m_edited.add(hDbEvent);
+
+	if (wszText)
+		g_pIndex->addEvent(hContact, hDbEvent, tokens);
+	g_bIndexDirty = true;
+}
+
+static bool BuildContactIndex(MCONTACT hContact)
+{
+	for (MEVENT hDbEvent = db_event_first(hContact); hDbEvent; hDbEvent = db_event_next(hContact, hDbEvent)) {
+		if (g_bTerminate)
+			return false;
+
+		ptrW wszText(GetIndexableText(hDbEvent));
+		if (wszText == nullptr)
+			continue;
+
+		FtsTokens tokens;
+		tokens.parse(wszText);
+
+		mir_cslock lck(csIndex);
+		g_pIndex->addEvent(hContact, hDbEvent, tokens);
+	}
+	return true;
+}
+
+static void BuildIndex()
+{
+	if (!BuildContactIndex(0))
+		return;
+
+	for (auto &hContact : Contacts()) {
+		// metacontacts' events belong to their subcontacts
+		if (db_mc_isMeta(hContact))
+			continue;
+
+		if (!BuildContactIndex(hContact))
+			return;
+	}
+
+	mir_cslock lck(csIndex);
+	g_bIndexReady = g_bIndexDirty = true;
+}
+
+static void __cdecl IndexThread(void*)
+{
+	Thread_SetName("History search index");
+
+	FtsFingerprint fp;
+	GetHistoryFingerprint(fp);
+
+	CFtsIndex *pLoaded = new CFtsIndex();
+	if (pLoaded->load(VARSW(FTS_FILENAME), fp)) {
+		// events which came while the index was loading
+		mir_cslock lck(csIndex);
+		pLoaded->merge(*g_pIndex);
+		delete g_pIndex;
+		g_pIndex = pLoaded;
+		g_bIndexReady = true;
+	}
+	else {
+		delete pLoaded;
+		BuildIndex();
+	}
+
+	SetEvent(hevIndexDone);
+}
+
+static int OnEventAdded(WPARAM hContact, LPARAM hDbEvent)
+{
+	IndexEvent(hContact, (MEVENT)hDbEvent, false);
+	return 0;
+}
+
+static int OnEventEdited(WPARAM hContact, LPARAM hDbEvent)
+{
+	IndexEvent(hContact, (MEVENT)hDbEvent, true);
+	return 0;
+}
+
+static int OnEventDeleted(WPARAM, LPARAM hDbEvent)
+{
+	mir_cslock lck(csIndex);
+	if (g_pIndex) {
+		g_pIndex->m_deleted.add((MEVENT)hDbEvent);
+		g_bIndexDirty = true;
+	}
+	return 0;
+}
+
+static int OnContactDeleted(WPARAM hContact, LPARAM)
+{
+	wchar_t wszContact[20];
+	CFtsIndex::getContactTerm(hContact, wszContact);
+
+	mir_cslock lck(csIndex);
+	if (g_pIndex == nullptr)
+		return 0;
+
+	MEVENT *pIds;
+	int nIds = g_pIndex->lookup(wszContact, false, pIds);
+	for (int i = 0; i < nIds; i++) {
+		// a reused handle listed under this contact may belong to another one now
+		if (g_pIndex->m_edited.contains(pIds[i])) {
+			MCONTACT hOwner = db_event_getContact(pIds[i]);
+			if (hOwner != INVALID_CONTACT_ID && hOwner != hContact)
+				continue;
+		}
+		g_pIndex->m_deleted.add(pIds[i]);
+	}
+	mir_free(pIds);
+
+	g_bIndexDirty = true;
+	return 0;
+}
+
+static int OnModulesLoaded(WPARAM, LPARAM)
+{
+	hevIndexDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	mir_forkthread(IndexThread);
+	return 0;
+}
+
+static int OnPreShutdown(WPARAM, LPARAM)
+{
+	g_bTerminate = true;
+	if (hevIndexDone)
+		WaitForSingleObject(hevIndexDone, INFINITE);
+
+	FtsFingerprint fp;
+	GetHistoryFingerprint(fp);
+
+	mir_cslock lck(csIndex);
+	if (g_bIndexReady && g_bIndexDirty)
+		if (g_pIndex->save(VARSW(FTS_FILENAME), fp))
+			g_bIndexDirty = false;
+	return 0;
+}
+
+int LoadHistorySearchModule(void)
+{
+	g_pIndex = new CFtsIndex();
+
+	HookEvent(ME_SYSTEM_MODULESLOADED, OnModulesLoaded);
+	HookEvent(ME_SYSTEM_PRESHUTDOWN, OnPreShutdown);
+	HookEvent(ME_DB_EVENT_ADDED, OnEventAdded);
+	HookEvent(ME_DB_EVENT_EDITED, OnEventEdited);
+	HookEvent(ME_DB_EVENT_DELETED, OnEventDeleted);
+	HookEvent(ME_DB_CONTACT_DELETED, OnContactDeleted);
+	return 0;
+}
+
+void UnloadHistorySearchModule(void)
+{
+	delete g_pIndex;
+	g_pIndex = nullptr;
+
+	if (hevIndexDone)
+		CloseHandle(hevIndexDone);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// search
+
+struct FtsPhrase
+{
+	FtsTokens tokens;
+	bool bPrefix;                 // the last word is a prefix
+
+	bool matches(const FtsTokens &text) const
+	{
+		for (int i = 0; i + tokens.nTokens <= text.nTokens; i++) {
+			int j;
+			for (j = 0; j < tokens.nTokens; j++) {
+				const wchar_t *pwszWord = tokens.pTokens[j], *pwszToken = text.pTokens[i + j];
+				bool bMatch = (bPrefix && j == tokens.nTokens - 1) ? !wcsncmp(pwszToken, pwszWord, mir_wstrlen(pwszWord)) : !wcscmp(pwszToken, pwszWord);
+				if (!bMatch)
+					break;
+			}
+			if (j == tokens.nTokens)
+				return true;
+		}
+		return false;
+	}
+};
+
+struct FtsPostings
+{
+	MEVENT *pIds;
+	int nIds;
+};
+
+static int __cdecl ComparePostings(const void *p1, const void *p2)
+{
+	return ((FtsPostings*)p1)->nIds - ((FtsPostings*)p2)->nIds;
+}
+
+static bool MatchEvent(MEVENT hDbEvent, OBJLIST<FtsPhrase> &arPhrases)
+{
+	ptrW wszText(GetIndexableText(hDbEvent));
+	if (wszText == nullptr)
+		return false;
+
+	FtsTokens text;
+	text.parse(wszText);
+	for (auto &it : arPhrases)
+		if (!it->matches(text))
+			return false;
+
+	return true;
+}
+
+MIR_APP_DLL(int) DbEvent_Search(MCONTACT hContact, const wchar_t *pwszQuery, DBEVENTSEARCHPROC pFunc, void *param)
+{
+	if (pwszQuery == nullptr || pFunc == nullptr)
+		return 0;
+
+	// parse a query: words, prefixes (word*) & phrases ("a b c")
+	OBJLIST<FtsPhrase> arPhrases(5);
+	bool bVerifyAll = false;
+	for (const wchar_t *p = pwszQuery; *p;) {
+		if (iswspace(*p)) {
+			p++;
+			continue;
+		}
+
+		const wchar_t *pEnd, *pNext;
+		if (*p == '"') {
+			pEnd = wcschr(++p, '"');
+			if (pEnd == nullptr)
+				pEnd = pNext = p + mir_wstrlen(p);
+			else
+				pNext = pEnd + 1;
+		}
+		else {
+			for (pEnd = p; *pEnd && !iswspace(*pEnd) && *pEnd != '"'; pEnd++);
+			pNext = pEnd;
+		}
+
+		FtsPhrase *pPhrase = new FtsPhrase();
+		pPhrase->bPrefix = (pEnd > p && pEnd[-1] == '*');
+		pPhrase->tokens.parse(p, int(pEnd - p));
+		if (pPhrase->tokens.nTokens == 0)
+			delete pPhrase;
+		else {
+			if (pPhrase->tokens.nTokens > 1)
+				bVerifyAll = true;
+			arPhrases.insert(pPhrase);
+		}
+		p = pNext;
+	}
+
+	if (arPhrases.getCount() == 0)
+		return 0;
+
+	MEVENT *pResult = nullptr;
+	int nResult = 0;
+	mir_ptr<bool> pVerify;
+	{
+		mir_cslock lck(csIndex);
+		if (!g_bIndexReady)
+			return -1;
+
+		// collect postings of all words, the shortest goes first
+		int nPostings = 0;
+		for (auto &it : arPhrases)
+			nPostings += it->tokens.nTokens;
+
+		mir_ptr<FtsPostings> pPostings((FtsPostings*)mir_calloc(sizeof(FtsPostings) * (nPostings + 1)));
+		int n = 0;
+		for (auto &it : arPhrases)
+			for (int j = 0; j < it->tokens.nTokens; j++, n++)
+				pPostings[n].nIds = g_pIndex->lookup(it->tokens.pTokens[j], it->bPrefix && j == it->tokens.nTokens - 1, pPostings[n].pIds);
+
+		if (hContact != INVALID_CONTACT_ID) {
+			wchar_t wszContact[20];
+			CFtsIndex::getContactTerm(hContact, wszContact);
+			pPostings[n].nIds = g_pIndex->lookup(wszContact, false, pPostings[n].pIds);
+			n++;
+		}
+
+		qsort(pPostings, n, sizeof(FtsPostings), ComparePostings);
+
+		// intersect them, the result is written over the shortest list
+		pResult = pPostings[0].pIds;
+		nResult = pPostings[0].nIds;
+		for (int i = 1; i < n && nResult; i++) {
+			const MEVENT *pIds = pPostings[i].pIds;
+			int k = 0, nIds = pPostings[i].nIds;
+			for (int j = 0, m = 0; j < nResult && m < nIds;) {
+				if (pResult[j] < pIds[m])
+					j++;
+				else if (pResult[j] > pIds[m])
+					m++;
+				else {
+					pResult[k++] = pResult[j++];
+					m++;
+				}
+			}
+			nResult = k;
+		}
+
+		for (int i = 1; i < n; i++)
+			mir_free(pPostings[i].pIds);
+
+		// drop deleted events, mark the edited ones for verification
+		pVerify = (bool*)mir_alloc(sizeof(bool) * (nResult + 1));
+		int k = 0;
+		for (int i = 0; i < nResult; i++) {
+			if (g_pIndex->m_deleted.contains(pResult[i]))
+				continue;
+
+			pVerify[k] = bVerifyAll || g_pIndex->m_edited.contains(pResult[i]);
+			pResult[k++] = pResult[i];
+		}
+		nResult = k;
+	}
+
+	// callbacks are called outside of the lock, they could do anything
+	int nFound = 0;
+	for (int i = 0; i < nResult; i++) {
+		if (pVerify[i] && !MatchEvent(pResult[i], arPhrases))
+			continue;
+
+		// an edited event may be a reused handle, still listed under its previous contact
+		if (pVerify[i] && hContact != INVALID_CONTACT_ID) {
+			MCONTACT hOwner = db_event_getContact(pResult[i]);
+			if (hOwner != hContact && db_mc_getMeta(hOwner) != hContact)
+				continue;
+		}
+
+		MCONTACT hEventContact = (hContact != INVALID_CONTACT_ID) ? hContact : db_event_getContact(pResult[i]);
+		if (hEventContact == INVALID_CONTACT_ID)
+			continue;
+
+		nFound++;
+		if (pFunc(hEventContact, pResult[i], param))
+			break;
+	}
+
+	mir_free(pResult);
+	return nFound;
+}
@@ -25,30 +25,31 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 #include "stdafx.h"
 #include "plugins.h"
 
-DWORD dwVersion = 0;
+// the version resource offset is passed thru the parameter, not via a global variable,
+// because dlls are sniffed in several threads simultaneously
 
-static void ProcessResourcesDirectory(PIMAGE_RESOURCE_DIRECTORY pIRD, PBYTE pBase, DWORD dwType);
+static void ProcessResourcesDirectory(PIMAGE_RESOURCE_DIRECTORY pIRD, PBYTE pBase, DWORD dwType, DWORD &dwVersion);
 
-static void ProcessResourceEntry(PIMAGE_RESOURCE_DIRECTORY_ENTRY pIRDE, PBYTE pBase, DWORD dwType)
+static void ProcessResourceEntry(PIMAGE_RESOURCE_DIRECTORY_ENTRY pIRDE, PBYTE pBase, DWORD dwType, DWORD &dwVersion)
 {
 	if (pIRDE->DataIsDirectory)
-		ProcessResourcesDirectory(PIMAGE_RESOURCE_DIRECTORY(pBase + pIRDE->OffsetToDirectory), pBase, dwType == 0 ? pIRDE->Name : dwType);
+		ProcessResourcesDirectory(PIMAGE_RESOURCE_DIRECTORY(pBase + pIRDE->OffsetToDirectory), pBase, dwType == 0 ? pIRDE->Name : dwType, dwVersion);
 	else if (dwType == 16) {
 		PIMAGE_RESOURCE_DATA_ENTRY pItem = PIMAGE_RESOURCE_DATA_ENTRY(pBase + pIRDE->OffsetToData);
 		dwVersion = pItem->OffsetToData;
 	}
 }
 
-static void ProcessResourcesDirectory(PIMAGE_RESOURCE_DIRECTORY pIRD, PBYTE pBase, DWORD dwType)
+static void ProcessResourcesDirectory(PIMAGE_RESOURCE_DIRECTORY pIRD, PBYTE pBase, DWORD dwType, DWORD &dwVersion)
 {
 	UINT i;
 
 	PIMAGE_RESOURCE_DIRECTORY_ENTRY pIRDE = PIMAGE_RESOURCE_DIRECTORY_ENTRY(pIRD + 1);
 	for (i = 0; i < pIRD->NumberOfNamedEntries; i++, pIRDE++)
-		ProcessResourceEntry(pIRDE, pBase, dwType);
+		ProcessResourceEntry(pIRDE, pBase, dwType, dwVersion);
 
 	for (i = 0; i < pIRD->NumberOfIdEntries; i++, pIRDE++)
-		ProcessResourceEntry(pIRDE, pBase, dwType);
+		ProcessResourceEntry(pIRDE, pBase, dwType, dwVersion);
 }
 
 __forceinline bool Contains(PIMAGE_SECTION_HEADER pISH, DWORD address, DWORD size = 0)
@@ -172,11 +173,11 @@ MUUID* GetPluginInterfaces(const wchar_t *ptszFileName, bool &bIsPlugin)
 
 				// process resource version
 				if (resSize > 0 && Contains(pISH, resAddr, resSize)) {
-					dwVersion = 0;
+					DWORD dwVersion = 0;
 
 					BYTE *pSecStart = ptr + pISH->PointerToRawData - pISH->VirtualAddress;
 					IMAGE_RESOURCE_DIRECTORY *pIRD = (IMAGE_RESOURCE_DIRECTORY*)&pSecStart[resAddr];
-					ProcessResourcesDirectory(pIRD, &pSecStart[resAddr], 0);
+					ProcessResourcesDirectory(pIRD, &pSecStart[resAddr], 0, dwVersion);
 
 					// patch version
 					if (dwVersion) {
@@ -208,3 +209,331 @@ MUUID* GetPluginInterfaces(const wchar_t *ptszFileName, bool &bIsPlugin)
 	bIsPlugin = nChecks == 2;
 	return pResult;
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Plugin catalog
+// keeps the results of GetPluginInterfaces() between runs, so that only new or changed
+// dlls are mapped & parsed at startup. an entry is valid while the file's size and
+// modification time remain the same
+
+#define CATALOG_SIGNATURE 0x4C43504D // 'MPCL'
+#define CATALOG_VERSION   1
+
+#pragma pack(push, 1)
+struct CatalogHeader
+{
+	DWORD dwSignature, dwVersion;
+	UINT  coreVersion[4];         // nChecks in GetPluginInterfaces() depends on it
+};
+
+struct CatalogRecord
+{
+	DWORD    dwSize;
+	FILETIME ftWrite;
+	WORD     cchPath, nIds;        // followed by the path & the interfaces list
+	BYTE     bIsPlugin;
+};
+#pragma pack(pop)
+
+struct CatalogItem : public MZeroedObject
+{
+	CatalogItem(const wchar_t *_path) :
+		pwszPath(mir_wstrdup(_path))
+	{}
+
+	~CatalogItem()
+	{
+		mir_free(pwszPath);
+		mir_free(pIds);
+	}
+
+	wchar_t *pwszPath;            // search key, should be the first field
+	DWORD dwSize;
+	FILETIME ftWrite;
+	MUUID *pIds;                  // zero-terminated list of interfaces or nullptr
+	bool bIsPlugin, bUsed;
+
+	__forceinline bool isActual(DWORD _size, const FILETIME &_ft) const
+	{	return dwSize == _size && !CompareFileTime(&ftWrite, &_ft);
+	}
+};
+
+static int CompareCatalogItems(const CatalogItem *p1, const CatalogItem *p2)
+{
+	return mir_wstrcmpi(p1->pwszPath, p2->pwszPath);
+}
+
+static OBJLIST<CatalogItem> arCatalog(50, CompareCatalogItems);
+static mir_cs csCatalog;
+static bool bCatalogDirty = false;
+
+static MUUID* DupInterfaces(const MUUID *pIds, int nIds = -1)
+{
+	if (pIds == nullptr)
+		return nullptr;
+
+	if (nIds == -1)
+		for (nIds = 0; pIds[nIds] != miid_last; nIds++);
+
+	MUUID *pResult = (MUUID*)mir_alloc(sizeof(MUUID) * (nIds + 1));
+	if (pResult) {
+		memcpy(pResult, pIds, sizeof(MUUID) * nIds);
+		pResult[nIds] = miid_last;
+	}
+	return pResult;
+}
+
+static void GetCatalogPath(wchar_t *pwszPath)
+{
+	GetModuleFileName(nullptr, pwszPath, MAX_PATH);
+	wchar_t *p = wcsrchr(pwszPath, '\\'); if (p) *p = 0;
+	mir_wstrncat(pwszPath, L"\\Plugins\\plugins.cache", MAX_PATH - mir_wstrlen(pwszPath));
+}
+
+// adds or replaces an entry, takes ownership of pIds. should be called under csCatalog
+static CatalogItem* UpdateCatalog(const wchar_t *pwszPath, DWORD dwSize, const FILETIME &ftWrite, MUUID *pIds, bool bIsPlugin)
+{
+	CatalogItem *p = arCatalog.find((CatalogItem*)&pwszPath);
+	if (p == nullptr)
+		arCatalog.insert(p = new CatalogItem(pwszPath));
+	else
+		mir_free(p->pIds);
+
+	p->dwSize = dwSize;
+	p->ftWrite = ftWrite;
+	p->pIds = pIds;
+	p->bIsPlugin = bIsPlugin;
+	p->bUsed = true;
+	bCatalogDirty = true;
+	return p;
+}
+
+void LoadPluginCatalog()
+{
+	wchar_t wszPath[MAX_PATH];
+	GetCatalogPath(wszPath);
+
+	HANDLE hFile = CreateFile(wszPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	DWORD dwSize = GetFileSize(hFile, nullptr), dwRead = 0;
+	if (dwSize == INVALID_FILE_SIZE || dwSize < sizeof(CatalogHeader)) {
+		CloseHandle(hFile);
+		return;
+	}
+
+	mir_ptr<BYTE> buf((BYTE*)mir_alloc(dwSize));
+	BOOL bRead = ReadFile(hFile, buf, dwSize, &dwRead, nullptr);
+	CloseHandle(hFile);
+	if (!bRead || dwRead != dwSize)
+		return;
+
+	// the cache made by another core version is useless
+	UINT v[4] = { MIRANDA_VERSION_COREVERSION };
+	CatalogHeader *pHdr = (CatalogHeader*)buf.get();
+	if (pHdr->dwSignature != CATALOG_SIGNATURE || pHdr->dwVersion != CATALOG_VERSION || memcmp(pHdr->coreVersion, v, sizeof(v)))
+		return;
+
+	mir_cslock lck(csCatalog);
+
+	BYTE *p = buf + sizeof(CatalogHeader), *pEnd = buf + dwSize;
+	while (p + sizeof(CatalogRecord) <= pEnd) {
+		CatalogRecord *pRec = (CatalogRecord*)p;
+		p += sizeof(CatalogRecord);
+
+		size_t cbPath = pRec->cchPath * sizeof(wchar_t), cbIds = pRec->nIds * sizeof(MUUID);
+		if (pRec->cchPath == 0 || pRec->cchPath >= MAX_PATH || p + cbPath + cbIds > pEnd)
+			break;
+
+		wchar_t wszFile[MAX_PATH];
+		memcpy(wszFile, p, cbPath);
+		wszFile[pRec->cchPath] = 0;
+		p += cbPath;
+
+		CatalogItem *pItem = new CatalogItem(wszFile);
+		pItem->dwSize = pRec->dwSize;
+		pItem->ftWrite = pRec->ftWrite;
+		pItem->bIsPlugin = pRec->bIsPlugin != 0;
+		if (pRec->nIds)
+			pItem->pIds = DupInterfaces((MUUID*)p, pRec->nIds);
+		p += cbIds;
+
+		if (!arCatalog.insert(pItem))
+			delete pItem;
+	}
+}
+
+void SavePluginCatalog()
+{
+	mir_cslock lck(csCatalog);
+	if (!bCatalogDirty)
+		return;
+
+	UINT v[4] = { MIRANDA_VERSION_COREVERSION };
+	CatalogHeader hdr = { CATALOG_SIGNATURE, CATALOG_VERSION };
+	memcpy(hdr.coreVersion, v, sizeof(v));
+
+	MStreamBuffer buf;
+	buf.append(&hdr, sizeof(hdr));
+
+	for (auto &it : arCatalog) {
+		// entries for the deleted files aren't needed anymore
+		if (!it->bUsed && GetFileAttributes(it->pwszPath) == INVALID_FILE_ATTRIBUTES)
+			continue;
+
+		CatalogRecord rec = {};
+		rec.dwSize = it->dwSize;
+		rec.ftWrite = it->ftWrite;
+		rec.cchPath = (WORD)mir_wstrlen(it->pwszPath);
+		rec.bIsPlugin = it->bIsPlugin;
+		if (it->pIds)
+			for (MUUID *p = it->pIds; *p != miid_last; p++)
+				rec.nIds++;
+
+		buf.append(&rec, sizeof(rec));
+		buf.append(it->pwszPath, rec.cchPath * sizeof(wchar_t));
+		if (rec.nIds)
+			buf.append(it->pIds, rec.nIds * sizeof(MUUID));
+	}
+
+	wchar_t wszPath[MAX_PATH];
+	GetCatalogPath(wszPath);
+
+	// the Plugins folder might be read-only, that's not an error
+	HANDLE hFile = CreateFile(wszPath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, 0, nullptr);
+	if (hFile != INVALID_HANDLE_VALUE) {
+		DWORD dwWritten;
+		WriteFile(hFile, buf.data(), (DWORD)buf.length(), &dwWritten, nullptr);
+		CloseHandle(hFile);
+	}
+	bCatalogDirty = false;
+}
+
+// returns the cached value if the file wasn't changed since the last check,
+// otherwise sniffs the dll and remembers the result
+MUUID* GetCachedPluginInterfaces(const wchar_t *pwszFileName, bool &bIsPlugin)
+{
+	bIsPlugin = false;
+
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (!GetFileAttributesEx(pwszFileName, GetFileExInfoStandard, &fad) || fad.nFileSizeHigh != 0)
+		return GetPluginInterfaces(pwszFileName, bIsPlugin);
+
+	{
+		mir_cslock lck(csCatalog);
+		CatalogItem *p = arCatalog.find((CatalogItem*)&pwszFileName);
+		if (p != nullptr && p->isActual(fad.nFileSizeLow, fad.ftLastWriteTime)) {
+			p->bUsed = true;
+			bIsPlugin = p->bIsPlugin;
+			return DupInterfaces(p->pIds);
+		}
+	}
+
+	MUUID *pIds = GetPluginInterfaces(pwszFileName, bIsPlugin);
+
+	mir_cslock lck(csCatalog);
+	UpdateCatalog(pwszFileName, fad.nFileSizeLow, fad.ftLastWriteTime, DupInterfaces(pIds), bIsPlugin);
+	return pIds;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// parallel sniffing of new & changed dlls
+
+#define MAX_SNIFF_THREADS 8
+
+struct SniffTask
+{
+	wchar_t wszPath[MAX_PATH];
+	DWORD dwSize;
+	FILETIME ftWrite;
+	MUUID *pIds;
+	bool bIsPlugin;
+};
+
+struct SniffQueue
+{
+	SniffQueue() :
+		arTasks(20)
+	{}
+
+	OBJLIST<SniffTask> arTasks;
+	volatile LONG iNext, nThreads;
+	HANDLE hDoneEvent;
+};
+
+static BOOL CollectStaleDlls(WIN32_FIND_DATA *fd, wchar_t *path, WPARAM wParam, LPARAM)
+{
+	if (fd->nFileSizeHigh != 0)
+		return TRUE;
+
+	wchar_t wszPath[MAX_PATH];
+	mir_snwprintf(wszPath, L"%s\\Plugins\\%s", path, fd->cFileName);
+
+	const wchar_t *pwszPath = wszPath;
+	CatalogItem *p = arCatalog.find((CatalogItem*)&pwszPath);
+	if (p != nullptr && p->isActual(fd->nFileSizeLow, fd->ftLastWriteTime))
+		return TRUE;
+
+	SniffTask *pTask = new SniffTask();
+	wcsncpy_s(pTask->wszPath, wszPath, _TRUNCATE);
+	pTask->dwSize = fd->nFileSizeLow;
+	pTask->ftWrite = fd->ftLastWriteTime;
+	((SniffQueue*)wParam)->arTasks.insert(pTask);
+	return TRUE;
+}
+
+static void __cdecl SniffThread(SniffQueue *q)
+{
+	LONG i;
+	while ((i = InterlockedIncrement(&q->iNext) - 1) < q->arTasks.getCount()) {
+		SniffTask &t = q->arTasks[i];
+		t.pIds = GetPluginInterfaces(t.wszPath, t.bIsPlugin);
+	}
+
+	if (InterlockedDecrement(&q->nThreads) == 0 && q->hDoneEvent)
+		SetEvent(q->hDoneEvent);
+}
+
+// sniffs all new or changed dlls in the Plugins folder at once, so that the following
+// enumPlugins() pass takes everything from the catalog. returns the number of sniffed dlls
+int RefreshPluginCatalog()
+{
+	SniffQueue q;
+	{
+		mir_cslock lck(csCatalog);
+		enumPlugins(CollectStaleDlls, (WPARAM)&q, 0);
+	}
+
+	int nTasks = q.arTasks.getCount();
+	if (nTasks == 0)
+		return 0;
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int nThreads = min(min((int)si.dwNumberOfProcessors, MAX_SNIFF_THREADS), nTasks);
+
+	q.iNext = 0;
+	q.nThreads = nThreads;
+	q.hDoneEvent = (nThreads > 1) ? CreateEvent(nullptr, TRUE, FALSE, nullptr) : nullptr;
+	if (q.hDoneEvent == nullptr)
+		q.nThreads = nThreads = 1;
+
+	// the main thread works as one of the sniffers
+	for (int i = 1; i < nThreads; i++)
+		if (mir_forkThread<SniffQueue>(SniffThread, &q) == nullptr)
+			InterlockedDecrement(&q.nThreads);
+
+	SniffThread(&q);
+
+	if (q.hDoneEvent) {
+		WaitForSingleObject(q.hDoneEvent, INFINITE);
+		CloseHandle(q.hDoneEvent);
+	}
+
+	mir_cslock lck(csCatalog);
+	for (auto &it : q.arTasks)
+		UpdateCatalog(it->wszPath, it->dwSize, it->ftWrite, it->pIds, it->bIsPlugin);
+
+	return nTasks;
+}
@@ -336,8 +336,9 @@ int WINAPI mir_main(LPTSTR cmdLine)
 	}
 	else {
 		InitPathVar();
-		NotifyEventHooks(hModulesLoadedEvent, 0, 0);
+		NotifyEventHooksTimed(hModulesLoadedEvent, StartupTimelineHook);
 		g_bModulesLoadedFired = true;
+		ReportStartupTimeline();
 
 		// ensure that the kernel hooks the SystemShutdownProc() after all plugins
 		HookEvent(ME_SYSTEM_SHUTDOWN, SystemShutdownProc);
@@ -77,6 +77,9 @@ char* GetPluginNameByInstance(HINSTANCE hInstance);
 int   LoadStdPlugins(void);
 int   LaunchServicePlugin(pluginEntry *p);
 
+void  StartupTimelineHook(HINSTANCE hOwner, __int64 iTicks);
+void  ReportStartupTimeline(void);
+
 /**** path.cpp *************************************************************************/
 
 void InitPathVar(void);
@@ -46,6 +46,7 @@ int  LoadProtocolPlugins(void);
 int  LoadContactsModule(void);
 int  LoadDatabaseModule(void);
 int  LoadMetacontacts(void);
+int  LoadHistorySearchModule(void);
 int  LoadOptionsModule(void);	// ui: options dialog
 int  LoadFindAddModule(void);	// ui: search/add users
 int  LoadSkinIcons(void);
@@ -65,6 +66,7 @@ void UnloadClcModule(void);
 void UnloadContactListModule(void);
 void UnloadDatabase(void);
 void UnloadEventsModule(void);
+void UnloadHistorySearchModule(void);
 void UnloadExtraIconsModule(void);
 void UnloadIcoLibModule(void);
 void UnloadMetacontacts(void);
@@ -144,6 +146,7 @@ int LoadDefaultModules(void)
 	LoadDbAccounts();                    // retrieves the account array from a database
 	if (LoadContactsModule()) return 1;
 	if (LoadMetacontacts()) return 1;
+	if (LoadHistorySearchModule()) return 1;
 
 	if (LoadNewPluginsModule()) return 1;    // will call Load(void) on everything, clist will load first
 	if (LoadHelpModule()) return 1;
@@ -178,5 +181,6 @@ void UnloadDefaultModules(void)
 	UnloadClcModule();
 	UnloadContactListModule();
 	UnloadEventsModule();
+	UnloadHistorySearchModule();
 	UnloadNetlibModule();
 }
@@ -293,6 +293,7 @@ MIR_APP_DLL(int) Netlib_CloseHandle(HANDLE hNetlib)
 	case NLH_USER:
 	{
 		NetlibUser *nlu = (NetlibUser*)hNetlib;
+		Netlib_CancelHttpRequests(nlu);
 		{
 			mir_cslock lck(csNetlibUser);
 			int i = netlibUser.getIndex(nlu);
@@ -310,6 +311,8 @@ MIR_APP_DLL(int) Netlib_CloseHandle(HANDLE hNetlib)
 	break;
 
 	case NLH_CONNECTION:
+		Netlib_PollRemove((NetlibConnection*)hNetlib);
+
 		WaitForSingleObject(hConnectionHeaderMutex, INFINITE);
 		{
 			NetlibConnection *nlc = (NetlibConnection*)hNetlib;
@@ -429,6 +432,8 @@ void UnloadNetlibModule(void)
 {
 	if (!bModuleInitialized || hConnectionHeaderMutex == nullptr) return;
 
+	NetlibHttpQueueShutdown();
+	NetlibPollShutdown();
 	NetlibUnloadIeProxy();
 	NetlibUPnPDestroy();
 	NetlibLogShutdown();
@@ -456,6 +461,7 @@ int LoadNetlibModule(void)
 
 	hConnectionHeaderMutex = CreateMutex(nullptr, FALSE, nullptr);
 	NetlibLogInit();
+	NetlibHttpQueueInit();
 
 	connectionTimeout = 0;
 
@@ -104,6 +104,12 @@ struct NetlibConnection : public MZeroedObject
 
 	int pollingTimeout;
 	unsigned lastPost;
+
+	// websocket support
+	struct NetlibWebSocket *pWebSocket;
+
+	// readiness notifications, see Netlib_PollAdd()
+	struct NetlibPollEntry *pPoll;
 };
 
 struct NetlibBoundPort : public MZeroedObject
@@ -164,6 +170,13 @@ void NetlibHttpSetLastErrorUsingHttpResult(int result);
 NETLIBHTTPREQUEST* NetlibHttpRecv(NetlibConnection* nlc, DWORD hflags, DWORD dflags, bool isConnect = false);
 void NetlibConnFromUrl(const char* szUrl, bool secur, NETLIBOPENCONNECTION &nloc);
 
+// netlibhttpqueue.cpp
+void NetlibHttpQueueInit(void);
+void NetlibHttpQueueShutdown(void);
+
+// netlibpoll.cpp
+void NetlibPollShutdown(void);
+
 // netlibhttpproxy.c
 int NetlibInitHttpConnection(NetlibConnection *nlc, NetlibUser *nlu, NETLIBOPENCONNECTION *nloc);
 int NetlibHttpGatewayRecv(NetlibConnection *nlc, char *buf, int len, int flags);
@@ -192,6 +205,9 @@ void NetlibSaveUserSettingsStruct(const char *szSettingsModule, const NETLIBUSER
 #define NL_SELECT_WRITE 0x0002
 #define NL_SELECT_ALL   (NL_SELECT_READ+NL_SELECT_WRITE)
 
+// netlibwebsocket.c
+void NetlibDestroyWebSocket(NetlibWebSocket *pWs);
+
 // netlibupnp.c
 bool NetlibUPnPAddPortMapping(WORD intport, char *proto, WORD *extport, DWORD *extip, bool search);
 void NetlibUPnPDeletePortMapping(WORD extport, char* proto);
@@ -745,11 +745,18 @@ MIR_APP_DLL(NETLIBHTTPREQUEST*) Netlib_RecvHttpHeaders(HNETLIBCONN hConnection,
 	}
 
 	// Make sure all headers arrived
-	MBinBuffer buf;
+	MStreamBuffer buf;
 	int headersCount = 0;
 	bytesPeeked = 0;
 	for (bool headersCompleted = false; !headersCompleted;) {
-		bytesPeeked = RecvWithTimeoutTime(nlc, dwRequestTimeoutTime, buffer, NHRV_BUF_SIZE, flags | MSG_DUMPASTEXT | MSG_NOTITLE);
+		// data is received directly into the free tail of the buffer
+		char *pDest = buf.reserve(NHRV_BUF_SIZE);
+		if (pDest == nullptr) {
+			bytesPeeked = 0;
+			break;
+		}
+
+		bytesPeeked = RecvWithTimeoutTime(nlc, dwRequestTimeoutTime, pDest, NHRV_BUF_SIZE, flags | MSG_DUMPASTEXT | MSG_NOTITLE);
 		if (bytesPeeked == 0)
 			break;
 
@@ -758,7 +765,7 @@ MIR_APP_DLL(NETLIBHTTPREQUEST*) Netlib_RecvHttpHeaders(HNETLIBCONN hConnection,
 			break;
 		}
 		
-		buf.append(buffer, bytesPeeked);
+		buf.commit(bytesPeeked);
 
 		headersCount = 0;
 		for (char *pbuffer = (char*)buf.data();; headersCount++) {
@@ -965,15 +972,19 @@ char* gzip_decode(char *gzip_data, int *len_ptr, int window)
 
 static int NetlibHttpRecvChunkHeader(NetlibConnection *nlc, bool first, DWORD flags)
 {
-	MBinBuffer buf;
+	MStreamBuffer buf;
 
 	while (true) {
-		char data[1000];
-		int recvResult = Netlib_Recv(nlc, data, _countof(data) - 1, MSG_RAW | flags);
-		if (recvResult <= 0 || recvResult >= _countof(data))
+		const int cbChunk = 1000;
+		char *pDest = buf.reserve(cbChunk);
+		if (pDest == nullptr)
+			return SOCKET_ERROR;
+
+		int recvResult = Netlib_Recv(nlc, pDest, cbChunk - 1, MSG_RAW | flags);
+		if (recvResult <= 0 || recvResult >= cbChunk)
 			return SOCKET_ERROR;
 
-		buf.append(data, recvResult); // add chunk
+		buf.commit(recvResult); // add chunk
 
 		const char *peol1 = (const char*)memchr(buf.data(), '\n', buf.length());
 		if (peol1 == nullptr)
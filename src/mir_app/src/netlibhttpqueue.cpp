@@ -0,0 +1,357 @@
+/*
+
+Miranda NG: the free IM client for Microsoft* Windows*
+
+Copyright (c) 2012-18 Miranda NG team (https://miranda-ng.org),
+all portions of this codebase are copyrighted to the people
+listed in contributors.txt.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "stdafx.h"
+#include "netlib.h"
+
+#define MAX_WORKERS       8      // threads in the shared pool
+#define MAX_PER_HOST      4      // requests running at once against the same host
+#define RETRY_BASE_DELAY  500    // ms, doubled with every attempt
+#define RETRY_MAX_DELAY   30000
+
+struct HttpJob : public MZeroedObject
+{
+	NetlibUser *nlu;
+	NETLIBHTTPREQUEST *pRequest;
+	NETLIBHTTPCALLBACK pfnCallback;
+	void *param;
+
+	int iPriority, nRetries, nAttempt;
+	unsigned seq;
+	DWORD dwDue;        // tick count when the job may be started
+	DWORD dwDeadline;   // tick count after which the job is dropped, 0 = never
+	DWORD dwThreadId;   // worker executing the job
+	bool bFinishing;    // the request is done, its callback is being called
+	char szHost[128];
+
+	__forceinline void finish(NETLIBHTTPREQUEST *pReply)
+	{
+		if (pfnCallback)
+			pfnCallback(pReply, pRequest, param);
+	}
+};
+
+static int CompareJobs(const HttpJob *p1, const HttpJob *p2)
+{
+	if (p1->iPriority != p2->iPriority)
+		return p1->iPriority - p2->iPriority;
+	return (p1->seq < p2->seq) ? -1 : (p1->seq != p2->seq);
+}
+
+static LIST<HttpJob> arQueue(50, CompareJobs), arRunning(10, PtrKeySortT);
+static mir_cs csQueue;
+static HANDLE hQueueEvent, hWorkersDone;
+static int nWorkers, nIdle;
+static unsigned g_seq;
+static bool bTerminate;
+
+// signed difference of two tick counts, safe against wraparound
+static __forceinline int TickDiff(DWORD a, DWORD b)
+{
+	return int(a - b);
+}
+
+static void GetHostFromUrl(const char *szUrl, char *szHost, size_t cbHost)
+{
+	const char *p = strstr(szUrl, "://");
+	p = (p) ? p + 3 : szUrl;
+
+	size_t len = strcspn(p, "/?#");
+	if (len >= cbHost)
+		len = cbHost - 1;
+	memcpy(szHost, p, len);
+	szHost[len] = 0;
+	_strlwr(szHost);
+}
+
+static int GetHostLoad(const char *szHost)
+{
+	int nCount = 0;
+	for (auto &it : arRunning)
+		if (!it->bFinishing && !mir_strcmp(it->szHost, szHost))
+			nCount++;
+	return nCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// picks the first job which is due and whose host has a free slot.
+// expired jobs are moved into arExpired, dwWait receives the time until the next event
+
+static HttpJob* PickJob(LIST<HttpJob> &arExpired, DWORD &dwWait)
+{
+	DWORD dwNow = GetTickCount();
+	dwWait = INFINITE;
+
+	for (int i = 0; i < arQueue.getCount(); i++) {
+		HttpJob *p = arQueue[i];
+		if (p->dwDeadline) {
+			int iLeft = TickDiff(p->dwDeadline, dwNow);
+			if (iLeft <= 0) {
+				arExpired.insert(p);
+				arQueue.remove(i--);
+				continue;
+			}
+			dwWait = min(dwWait, (DWORD)iLeft);
+		}
+
+		int iDue = TickDiff(p->dwDue, dwNow);
+		if (iDue > 0) {
+			dwWait = min(dwWait, (DWORD)iDue);
+			continue;
+		}
+
+		// a finished job of the same host will wake us up
+		if (GetHostLoad(p->szHost) >= MAX_PER_HOST)
+			continue;
+
+		arQueue.remove(i);
+		return p;
+	}
+	return nullptr;
+}
+
+static void ExecuteJob(HttpJob *job)
+{
+	// the deadline shortens the request's timeout only for this attempt, the caller's value is restored
+	int iTimeout = job->pRequest->timeout;
+	if (job->dwDeadline) {
+		int iLeft = TickDiff(job->dwDeadline, GetTickCount());
+		if (iTimeout <= 0 || iTimeout > iLeft)
+			job->pRequest->timeout = max(iLeft, 1);
+	}
+
+	NETLIBHTTPREQUEST *pReply = Netlib_HttpTransaction(job->nlu, job->pRequest);
+	job->pRequest->timeout = iTimeout;
+
+	bool bFailed = (pReply == nullptr || pReply->resultCode >= 500 || pReply->resultCode == 429);
+	bool bRequeued = false, bCallback;
+	{
+		mir_cslock lck(csQueue);
+
+		// the job stays in arRunning until its callback returns, Netlib_CancelHttpRequests waits for that
+		job->bFinishing = true;
+		bCallback = !bTerminate;
+
+		if (bFailed && job->nAttempt < job->nRetries && !bTerminate) {
+			DWORD dwDelay = (job->nAttempt < 6) ? RETRY_BASE_DELAY << job->nAttempt : RETRY_MAX_DELAY;
+			if (dwDelay > RETRY_MAX_DELAY)
+				dwDelay = RETRY_MAX_DELAY;
+
+			// random jitter from 50% to 100% of the delay, so that clients don't retry in sync
+			DWORD dwRandom;
+			Utils_GetRandom(&dwRandom, sizeof(dwRandom));
+			dwDelay = dwDelay / 2 + dwRandom % (dwDelay / 2 + 1);
+
+			job->nAttempt++;
+			job->dwDue = GetTickCount() + dwDelay;
+			if (!job->dwDeadline || TickDiff(job->dwDeadline, job->dwDue) > 0) {
+				job->dwThreadId = 0;
+				job->bFinishing = false;
+				arRunning.remove(job);
+				arQueue.insert(job);
+				bRequeued = true;
+			}
+		}
+
+		// a host slot was freed or a retry was scheduled
+		SetEvent(hQueueEvent);
+	}
+
+	// plugins are unloaded during the shutdown, their callbacks cannot be called
+	if (!bRequeued && bCallback)
+		job->finish(pReply);
+
+	if (pReply)
+		Netlib_FreeHttpRequest(pReply);
+
+	if (!bRequeued) {
+		{
+			mir_cslock lck(csQueue);
+			arRunning.remove(job);
+		}
+		delete job;
+	}
+}
+
+static void __cdecl HttpQueueWorker(void*)
+{
+	Thread_SetName("Netlib: HTTP queue worker");
+
+	while (true) {
+		LIST<HttpJob> arExpired(1);
+		HttpJob *job;
+		DWORD dwWait;
+		{
+			mir_cslock lck(csQueue);
+			if (bTerminate)
+				break;
+
+			job = PickJob(arExpired, dwWait);
+			if (job) {
+				job->dwThreadId = GetCurrentThreadId();
+				arRunning.insert(job);
+
+				// let another idle worker look at the rest of the queue
+				if (arQueue.getCount() && nIdle)
+					SetEvent(hQueueEvent);
+			}
+			else if (!arExpired.getCount())
+				nIdle++;
+		}
+
+		for (auto &it : arExpired) {
+			it->finish(nullptr);
+			delete it;
+		}
+
+		if (job != nullptr)
+			ExecuteJob(job);
+		else if (!arExpired.getCount()) {
+			WaitForSingleObject(hQueueEvent, dwWait);
+
+			mir_cslock lck(csQueue);
+			nIdle--;
+		}
+	}
+
+	// wake up the next idle worker, so that they all see bTerminate
+	mir_cslock lck(csQueue);
+	SetEvent(hQueueEvent);
+	if (--nWorkers == 0)
+		SetEvent(hWorkersDone);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+MIR_APP_DLL(int) Netlib_HttpTransactionAsync(HNETLIBUSER nlu, const NETLIBASYNCHTTP *pDescr)
+{
+	if (GetNetlibHandleType(nlu) != NLH_USER || !(nlu->user.flags & NUF_OUTGOING) || pDescr == nullptr ||
+		pDescr->pRequest == nullptr || pDescr->pRequest->szUrl == nullptr || pDescr->pRequest->szUrl[0] == 0)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return 1;
+	}
+
+	HttpJob *job = new HttpJob();
+	job->nlu = nlu;
+	job->pRequest = pDescr->pRequest;
+	job->pfnCallback = pDescr->pfnCallback;
+	job->param = pDescr->param;
+	job->iPriority = pDescr->iPriority;
+	job->nRetries = pDescr->nRetries;
+	job->dwDue = GetTickCount();
+	if (pDescr->dwTimeout)
+		job->dwDeadline = (job->dwDue + pDescr->dwTimeout) | 1;
+	GetHostFromUrl(pDescr->pRequest->szUrl, job->szHost, sizeof(job->szHost));
+
+	mir_cslock lck(csQueue);
+	if (bTerminate || hQueueEvent == nullptr) {
+		delete job;
+		SetLastError(ERROR_SHUTDOWN_IN_PROGRESS);
+		return 1;
+	}
+
+	job->seq = ++g_seq;
+	arQueue.insert(job);
+
+	if (nIdle == 0 && nWorkers < MAX_WORKERS) {
+		nWorkers++;
+		mir_forkthread(HttpQueueWorker);
+	}
+	SetEvent(hQueueEvent);
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// drops all queued requests of a user and waits for the running ones to complete
+
+MIR_APP_DLL(void) Netlib_CancelHttpRequests(HNETLIBUSER nlu)
+{
+	if (hQueueEvent == nullptr)
+		return;
+
+	LIST<HttpJob> arCancelled(10);
+	{
+		mir_cslock lck(csQueue);
+		for (auto &it : arQueue.rev_iter())
+			if (it->nlu == nlu)
+				arCancelled.insert(arQueue.removeItem(&it));
+	}
+
+	for (auto &it : arCancelled) {
+		it->finish(nullptr);
+		delete it;
+	}
+
+	DWORD dwThreadId = GetCurrentThreadId();
+	while (true) {
+		bool bBusy = false;
+		{
+			mir_cslock lck(csQueue);
+			for (auto &it : arRunning)
+				// a callback may cancel requests of its own user, do not wait for ourselves
+				if (it->nlu == nlu && it->dwThreadId != dwThreadId)
+					bBusy = true;
+		}
+		if (!bBusy)
+			break;
+
+		SleepEx(50, TRUE);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+void NetlibHttpQueueInit()
+{
+	hQueueEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	hWorkersDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+}
+
+void NetlibHttpQueueShutdown()
+{
+	if (hQueueEvent == nullptr)
+		return;
+
+	bool bWait;
+	{
+		mir_cslock lck(csQueue);
+		bTerminate = true;
+
+		// plugins are already unloaded, so no callbacks are called here
+		for (auto &it : arQueue)
+			delete it;
+		arQueue.destroy();
+
+		bWait = (nWorkers != 0);
+		SetEvent(hQueueEvent);
+	}
+
+	// workers run the code of this module, so all of them must exit before it's unloaded.
+	// running transactions don't last long: they stop reading once Miranda is terminated
+	if (bWait)
+		WaitForSingleObject(hWorkersDone, INFINITE);
+
+	CloseHandle(hWorkersDone); hWorkersDone = nullptr;
+	CloseHandle(hQueueEvent); hQueueEvent = nullptr;
+}
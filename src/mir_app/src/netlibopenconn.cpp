@@ -917,6 +917,9 @@ NetlibConnection::~NetlibConnection()
 
 	mir_free((char*)nloc.szHost);
 
+	if (pWebSocket)
+		NetlibDestroyWebSocket(pWebSocket);
+
 	NetlibDeleteNestedCS(&ncsSend);
 	NetlibDeleteNestedCS(&ncsRecv);
 
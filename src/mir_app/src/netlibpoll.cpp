@@ -0,0 +1,359 @@
+/*
+
+Miranda NG: the free IM client for Microsoft* Windows*
+
+Copyright (c) 2012-18 Miranda NG team (https://miranda-ng.org),
+all portions of this codebase are copyrighted to the people
+listed in contributors.txt.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "stdafx.h"
+#include "netlib.h"
+
+// Readiness notifications for registered connections.
+// Sockets are spread over a few I/O threads (shards), each one waits on its set with WSAPoll
+// and calls the handlers. A shard is woken up by a datagram sent to its own loopback socket
+// when the set of registered sockets changes.
+
+#define MAX_SHARD_SOCKETS 512
+
+struct NetlibPollShard;
+
+struct NetlibPollEntry : public MZeroedObject
+{
+	NetlibConnection *nlc;
+	NetlibPollShard *pShard;
+	NETLIBPOLLCALLBACK pfnCallback;
+	void *pUserInfo;
+	int iEvents;
+	bool bRemoved, bFailed;
+};
+
+struct NetlibPollShard : public MZeroedObject
+{
+	NetlibPollShard() :
+		arEntries(50)
+	{}
+
+	LIST<NetlibPollEntry> arEntries;
+	int nActive;                     // entries not marked for removal
+	bool bChanged, bTerminate;
+
+	SOCKET sWake;
+	HANDLE hThread;
+	unsigned dwThreadId;
+	NetlibPollEntry *pCurrent;       // entry whose handler is running now
+	HANDLE hIdle;                    // manual reset event, signalled while no handler is running
+
+	void wake()
+	{
+		char c = 0;
+		send(sWake, &c, 1, 0);
+	}
+};
+
+static LIST<NetlibPollShard> arShards(1);
+static mir_cs csPoll;
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static SOCKET CreateWakeSocket()
+{
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCKET)
+		return s;
+
+	SOCKADDR_IN sin = {};
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int len = sizeof(sin);
+	if (bind(s, (PSOCKADDR)&sin, len) || getsockname(s, (PSOCKADDR)&sin, &len) || connect(s, (PSOCKADDR)&sin, len)) {
+		closesocket(s);
+		return INVALID_SOCKET;
+	}
+
+	u_long nonBlocking = 1;
+	ioctlsocket(s, FIONBIO, &nonBlocking);
+	return s;
+}
+
+static bool HasPendingData(NetlibConnection *nlc)
+{
+	return !nlc->foreBuf.isEmpty() || sslApi.pending(nlc->hSsl);
+}
+
+static unsigned __stdcall PollThread(void *param)
+{
+	Thread_SetName("Netlib: PollThread");
+
+	NetlibPollShard *pShard = (NetlibPollShard*)param;
+	WSAPOLLFD fds[MAX_SHARD_SOCKETS + 1];
+	NetlibPollEntry *entries[MAX_SHARD_SOCKETS + 1];
+	int nFds = 1, iTimeout;
+
+	fds[0].fd = pShard->sWake;
+	fds[0].events = POLLRDNORM;
+
+	while (true) {
+		{	mir_cslock lck(csPoll);
+			if (pShard->bTerminate)
+				break;
+
+			// rebuild the socket set only if something was changed
+			if (pShard->bChanged) {
+				pShard->bChanged = false;
+				nFds = 1;
+				for (int i = pShard->arEntries.getCount() - 1; i >= 0; i--) {
+					NetlibPollEntry *p = pShard->arEntries[i];
+					if (p->bRemoved) {
+						pShard->arEntries.remove(i);
+						delete p;
+						continue;
+					}
+
+					if (p->bFailed || p->iEvents == 0)
+						continue;
+
+					fds[nFds].fd = p->nlc->s;
+					fds[nFds].events = ((p->iEvents & NLPOLL_READ) ? POLLRDNORM : 0) | ((p->iEvents & NLPOLL_WRITE) ? POLLWRNORM : 0);
+					entries[nFds++] = p;
+				}
+			}
+
+			// data already buffered by SSL or by netlib itself doesn't signal the socket
+			iTimeout = -1;
+			for (int i = 1; i < nFds; i++)
+				if ((entries[i]->iEvents & NLPOLL_READ) && HasPendingData(entries[i]->nlc)) {
+					iTimeout = 0;
+					break;
+				}
+		}
+
+		if (WSAPoll(fds, nFds, iTimeout) == SOCKET_ERROR) {
+			Netlib_Logf(nullptr, "PollThread: WSAPoll failed (%d)", WSAGetLastError());
+			Sleep(10);
+			continue;
+		}
+
+		if (fds[0].revents) {
+			char buf[16];
+			while (recv(pShard->sWake, buf, sizeof(buf), 0) > 0);
+		}
+
+		for (int i = 1; i < nFds; i++) {
+			NetlibPollEntry *p = entries[i];
+
+			int iEvents = 0;
+			if (fds[i].revents & POLLRDNORM)
+				iEvents |= NLPOLL_READ;
+			if (fds[i].revents & POLLWRNORM)
+				iEvents |= NLPOLL_WRITE;
+			if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+				iEvents |= NLPOLL_ERROR;
+
+			{	mir_cslock lck(csPoll);
+				if (p->bRemoved)
+					continue;
+
+				if ((p->iEvents & NLPOLL_READ) && HasPendingData(p->nlc))
+					iEvents |= NLPOLL_READ;
+
+				iEvents &= (p->iEvents | NLPOLL_ERROR);
+				if (iEvents == 0)
+					continue;
+
+				// a broken socket would be signalled forever, so it leaves the set until Netlib_PollModify()
+				if (iEvents & NLPOLL_ERROR) {
+					p->bFailed = true;
+					pShard->bChanged = true;
+				}
+				pShard->pCurrent = p;
+				ResetEvent(pShard->hIdle);
+			}
+
+			p->pfnCallback(p->nlc, iEvents, p->pUserInfo);
+
+			mir_cslock lck(csPoll);
+			pShard->pCurrent = nullptr;
+			SetEvent(pShard->hIdle);
+		}
+	}
+
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+MIR_APP_DLL(int) Netlib_PollAdd(HNETLIBCONN nlc, int iEvents, NETLIBPOLLCALLBACK pfnCallback, void *pUserInfo)
+{
+	if (GetNetlibHandleType(nlc) != NLH_CONNECTION || nlc->usingHttpGateway || pfnCallback == nullptr) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return 1;
+	}
+
+	mir_cslock lck(csPoll);
+	if (nlc->pPoll != nullptr) {
+		SetLastError(ERROR_ALREADY_EXISTS);
+		return 1;
+	}
+
+	// find a shard with a free slot or start a new one
+	NetlibPollShard *pShard = nullptr;
+	for (auto &it : arShards)
+		if (it->nActive < MAX_SHARD_SOCKETS) {
+			pShard = it;
+			break;
+		}
+
+	if (pShard == nullptr) {
+		SOCKET sWake = CreateWakeSocket();
+		if (sWake == INVALID_SOCKET) {
+			Netlib_Logf(nlc->nlu, "%s %d: %s() failed (%u)", __FILE__, __LINE__, "CreateWakeSocket", WSAGetLastError());
+			return 1;
+		}
+
+		pShard = new NetlibPollShard();
+		pShard->sWake = sWake;
+		pShard->hIdle = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+		pShard->hThread = mir_forkthreadex(PollThread, pShard, &pShard->dwThreadId);
+		arShards.insert(pShard);
+	}
+
+	NetlibPollEntry *p = new NetlibPollEntry();
+	p->nlc = nlc;
+	p->pShard = pShard;
+	p->pfnCallback = pfnCallback;
+	p->pUserInfo = pUserInfo;
+	p->iEvents = iEvents & (NLPOLL_READ | NLPOLL_WRITE);
+	pShard->arEntries.insert(p);
+	pShard->nActive++;
+	pShard->bChanged = true;
+	pShard->wake();
+
+	nlc->pPoll = p;
+	return 0;
+}
+
+MIR_APP_DLL(int) Netlib_PollModify(HNETLIBCONN nlc, int iEvents)
+{
+	if (GetNetlibHandleType(nlc) != NLH_CONNECTION) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return 1;
+	}
+
+	mir_cslock lck(csPoll);
+	NetlibPollEntry *p = nlc->pPoll;
+	if (p == nullptr) {
+		SetLastError(ERROR_NOT_FOUND);
+		return 1;
+	}
+
+	p->iEvents = iEvents & (NLPOLL_READ | NLPOLL_WRITE);
+	p->bFailed = false;
+	p->pShard->bChanged = true;
+	if (p->pShard->dwThreadId != GetCurrentThreadId())
+		p->pShard->wake();
+	return 0;
+}
+
+// the main thread keeps processing messages & APCs while waiting, because a handler
+// might be blocked in CallFunctionSync() or SendMessage() to a window of the main thread
+
+static void WaitForHandler(HANDLE hEvent)
+{
+	if (GetCurrentThreadId() != hMainThreadId) {
+		WaitForSingleObject(hEvent, INFINITE);
+		return;
+	}
+
+	while (true) {
+		DWORD rc = MsgWaitForMultipleObjectsEx(1, &hEvent, INFINITE, QS_ALLINPUT, MWMO_ALERTABLE);
+		if (rc == WAIT_OBJECT_0 + 1) {
+			MSG msg;
+			while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+		}
+		else if (rc != WAIT_IO_COMPLETION)
+			break;
+	}
+}
+
+MIR_APP_DLL(void) Netlib_PollRemove(HNETLIBCONN nlc)
+{
+	if (GetNetlibHandleType(nlc) != NLH_CONNECTION)
+		return;
+
+	NetlibPollShard *pShard;
+	NetlibPollEntry *p;
+	{
+		mir_cslock lck(csPoll);
+		if ((p = nlc->pPoll) == nullptr)
+			return;
+
+		// the entry itself is destroyed by the shard's thread
+		nlc->pPoll = nullptr;
+		p->bRemoved = true;
+		pShard = p->pShard;
+		pShard->nActive--;
+		pShard->bChanged = true;
+		pShard->wake();
+
+		if (pShard->pCurrent != p || pShard->dwThreadId == GetCurrentThreadId())
+			return;
+	}
+
+	// the handler is running in another thread, wait until it returns.
+	// the removed entry never becomes current again, so one signal is enough,
+	// the loop only protects against a handler of another entry started meanwhile
+	while (true) {
+		WaitForHandler(pShard->hIdle);
+
+		mir_cslock lck(csPoll);
+		if (pShard->pCurrent != p)
+			break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+void NetlibPollShutdown(void)
+{
+	{
+		mir_cslock lck(csPoll);
+		for (auto &it : arShards) {
+			it->bTerminate = true;
+			it->wake();
+		}
+	}
+
+	for (auto &it : arShards) {
+		WaitForSingleObject(it->hThread, INFINITE);
+		CloseHandle(it->hThread);
+		CloseHandle(it->hIdle);
+		closesocket(it->sWake);
+
+		for (auto &p : it->arEntries) {
+			if (!p->bRemoved)
+				p->nlc->pPoll = nullptr;
+			delete p;
+		}
+		delete it;
+	}
+	arShards.destroy();
+}
@@ -93,101 +93,119 @@ MIR_APP_DLL(int) Netlib_Recv(HNETLIBCONN nlc, char *buf, int len, int flags)
 
 /////////////////////////////////////////////////////////////////////////////////////////
 
-static int ConnectionListToSocketList(const HNETLIBCONN *hConns, fd_set *fd, int& pending)
+// Netlib_Select & Netlib_SelectEx are thin wrappers over WSAPoll: unlike fd_set, a poll set
+// is filled and checked in one pass. For long-living connections use Netlib_PollAdd() instead
+
+#define NL_POLL_EXCEPT (POLLRDBAND | POLLERR)
+
+static bool ConnectionListToPollSet(const HNETLIBCONN *hConns, SHORT events, WSAPOLLFD *fds, int &nFds, int &pending)
 {
-	FD_ZERO(fd);
-	for (int i = 0; hConns[i] && hConns[i] != INVALID_HANDLE_VALUE && i < FD_SETSIZE; i++) {
+	for (int i = 0; i < FD_SETSIZE && hConns[i] && hConns[i] != INVALID_HANDLE_VALUE; i++) {
 		NetlibConnection *nlcCheck = hConns[i];
-		if (nlcCheck->handleType != NLH_CONNECTION && nlcCheck->handleType != NLH_BOUNDPORT) {
+		switch (nlcCheck->handleType) {
+		case NLH_CONNECTION:
+			fds[nFds].fd = nlcCheck->s;
+			if (!nlcCheck->foreBuf.isEmpty() || sslApi.pending(nlcCheck->hSsl))
+				pending++;
+			break;
+
+		case NLH_BOUNDPORT:
+			fds[nFds].fd = ((NetlibBoundPort*)nlcCheck)->s;
+			break;
+
+		default:
 			SetLastError(ERROR_INVALID_DATA);
-			return 0;
+			return false;
 		}
-		FD_SET(nlcCheck->s, fd);
-		if (!nlcCheck->foreBuf.isEmpty() || sslApi.pending(nlcCheck->hSsl))
-			pending++;
+
+		fds[nFds].events = events;
+		fds[nFds].revents = 0;
+		nFds++;
 	}
-	return 1;
+	return true;
 }
 
-MIR_APP_DLL(int) Netlib_Select(NETLIBSELECT *nls)
+static int PollConnections(const HNETLIBCONN *hReadConns, const HNETLIBCONN *hWriteConns, const HNETLIBCONN *hExceptConns, DWORD dwTimeout, WSAPOLLFD *fds, int &nRead, int &nWrite, int &nFds)
 {
-	if (nls == nullptr) {
-		SetLastError(ERROR_INVALID_PARAMETER);
-		return SOCKET_ERROR;
-	}
-
 	int pending = 0;
-	fd_set readfd, writefd, exceptfd;
+	nFds = 0;
+
 	WaitForSingleObject(hConnectionHeaderMutex, INFINITE);
-	if (!ConnectionListToSocketList(nls->hReadConns, &readfd, pending)
-		 || !ConnectionListToSocketList(nls->hWriteConns, &writefd, pending)
-		 || !ConnectionListToSocketList(nls->hExceptConns, &exceptfd, pending))
-	{
-		ReleaseMutex(hConnectionHeaderMutex);
-		return SOCKET_ERROR;
-	}
+	bool bSuccess = ConnectionListToPollSet(hReadConns, POLLRDNORM, fds, nFds, pending);
+	nRead = nFds;
+	bSuccess = bSuccess && ConnectionListToPollSet(hWriteConns, POLLWRNORM, fds, nFds, pending);
+	nWrite = nFds - nRead;
+	bSuccess = bSuccess && ConnectionListToPollSet(hExceptConns, POLLRDBAND, fds, nFds, pending);
 	ReleaseMutex(hConnectionHeaderMutex);
+	if (!bSuccess)
+		return SOCKET_ERROR;
+
 	if (pending)
-		return 1;
+		return pending;
+
+	if (WSAPoll(fds, nFds, (dwTimeout == INFINITE) ? -1 : (INT)dwTimeout) == SOCKET_ERROR)
+		return SOCKET_ERROR;
 
-	TIMEVAL tv;
-	tv.tv_sec = nls->dwTimeout / 1000;
-	tv.tv_usec = (nls->dwTimeout % 1000) * 1000;
-	return select(0, &readfd, &writefd, &exceptfd, nls->dwTimeout == INFINITE ? nullptr : &tv);
+	// count ready sockets the way select() does it, once per list
+	int rc = 0;
+	for (int i = 0; i < nFds; i++) {
+		if (fds[i].revents & POLLNVAL) {
+			SetLastError(WSAENOTSOCK);
+			return SOCKET_ERROR;
+		}
+
+		SHORT ready = (i < nRead) ? POLLRDNORM | POLLHUP | POLLERR : (i < nRead + nWrite) ? POLLWRNORM | POLLERR : NL_POLL_EXCEPT;
+		if (fds[i].revents & ready)
+			rc++;
+	}
+	return rc;
 }
 
-MIR_APP_DLL(int) Netlib_SelectEx(NETLIBSELECTEX *nls)
+MIR_APP_DLL(int) Netlib_Select(NETLIBSELECT *nls)
 {
 	if (nls == nullptr) {
 		SetLastError(ERROR_INVALID_PARAMETER);
 		return SOCKET_ERROR;
 	}
 
-	TIMEVAL tv;
-	tv.tv_sec = nls->dwTimeout / 1000;
-	tv.tv_usec = (nls->dwTimeout % 1000) * 1000;
-	WaitForSingleObject(hConnectionHeaderMutex, INFINITE);
+	WSAPOLLFD fds[FD_SETSIZE * 3];
+	int nRead, nWrite, nFds;
+	return PollConnections(nls->hReadConns, nls->hWriteConns, nls->hExceptConns, nls->dwTimeout, fds, nRead, nWrite, nFds);
+}
 
-	int pending = 0;
-	fd_set readfd, writefd, exceptfd;
-	if (!ConnectionListToSocketList(nls->hReadConns, &readfd, pending)
-		|| !ConnectionListToSocketList(nls->hWriteConns, &writefd, pending)
-		|| !ConnectionListToSocketList(nls->hExceptConns, &exceptfd, pending))
-	{
-		ReleaseMutex(hConnectionHeaderMutex);
+MIR_APP_DLL(int) Netlib_SelectEx(NETLIBSELECTEX *nls)
+{
+	if (nls == nullptr) {
+		SetLastError(ERROR_INVALID_PARAMETER);
 		return SOCKET_ERROR;
 	}
-	ReleaseMutex(hConnectionHeaderMutex);
 
-	int rc = (pending) ? pending : select(0, &readfd, &writefd, &exceptfd, nls->dwTimeout == INFINITE ? nullptr : &tv);
+	WSAPOLLFD fds[FD_SETSIZE * 3];
+	int nRead, nWrite, nFds;
+	int rc = PollConnections(nls->hReadConns, nls->hWriteConns, nls->hExceptConns, nls->dwTimeout, fds, nRead, nWrite, nFds);
+	if (rc == SOCKET_ERROR)
+		return rc;
 
+	/* poll set contains the read, write & except lists one after another, so the n-th handle
+	of a list corresponds to the n-th poll entry of its part. If the wait was skipped because
+	of buffered data, revents are zero and only the buffers are taken into account */
 	WaitForSingleObject(hConnectionHeaderMutex, INFINITE);
-	/* go thru each passed HCONN array and grab its socket handle, then give it to FD_ISSET()
-	to see if an event happened for that socket, if it has it will be returned as TRUE (otherwise not)
-	This happens for read/write/except */
-	NetlibConnection *conn = nullptr;
-	int j;
-	for (j = 0; j < FD_SETSIZE; j++) {
-		conn = (NetlibConnection*)nls->hReadConns[j];
-		if (conn == nullptr || conn == INVALID_HANDLE_VALUE) break;
-
-		if (sslApi.pending(conn->hSsl))
-			nls->hReadStatus[j] = TRUE;
-		if (conn->usingHttpGateway && conn->nlhpi.szHttpGetUrl == nullptr && conn->szProxyBuf.IsEmpty())
-			nls->hReadStatus[j] = (conn->pHttpProxyPacketQueue != nullptr);
-		else
-			nls->hReadStatus[j] = FD_ISSET(conn->s, &readfd);
-	}
-	for (j = 0; j < FD_SETSIZE; j++) {
-		conn = (NetlibConnection*)nls->hWriteConns[j];
-		if (conn == nullptr || conn == INVALID_HANDLE_VALUE) break;
-		nls->hWriteStatus[j] = FD_ISSET(conn->s, &writefd);
-	}
-	for (j = 0; j < FD_SETSIZE; j++) {
-		conn = (NetlibConnection*)nls->hExceptConns[j];
-		if (conn == nullptr || conn == INVALID_HANDLE_VALUE) break;
-		nls->hExceptStatus[j] = FD_ISSET(conn->s, &exceptfd);
+	for (int j = 0; j < nRead; j++) {
+		NetlibConnection *conn = (NetlibConnection*)nls->hReadConns[j];
+
+		BOOL bReady = (fds[j].revents & (POLLRDNORM | POLLHUP | POLLERR)) != 0;
+		if (conn->handleType == NLH_CONNECTION) {
+			if (conn->usingHttpGateway && conn->nlhpi.szHttpGetUrl == nullptr && conn->szProxyBuf.IsEmpty())
+				bReady = (conn->pHttpProxyPacketQueue != nullptr);
+			if (!conn->foreBuf.isEmpty() || sslApi.pending(conn->hSsl))
+				bReady = TRUE;
+		}
+		nls->hReadStatus[j] = bReady;
 	}
+	for (int j = 0; j < nWrite; j++)
+		nls->hWriteStatus[j] = (fds[nRead + j].revents & (POLLWRNORM | POLLERR)) != 0;
+	for (int j = 0; j < nFds - nRead - nWrite; j++)
+		nls->hExceptStatus[j] = (fds[nRead + nWrite + j].revents & NL_POLL_EXCEPT) != 0;
 	ReleaseMutex(hConnectionHeaderMutex);
 	return rc;
 }
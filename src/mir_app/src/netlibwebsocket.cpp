@@ -0,0 +1,509 @@
+/*
+
+Miranda NG: the free IM client for Microsoft* Windows*
+
+Copyright (c) 2012-18 Miranda NG team (https://miranda-ng.org),
+Copyright (c) 2000-12 Miranda IM project,
+all portions of this codebase are copyrighted to the people
+listed in contributors.txt.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "stdafx.h"
+#include "netlib.h"
+
+#include "../libs/zlib/src/zlib.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_RECV_CHUNK 16384
+#define WS_MAX_MESSAGE_SIZE (64 * 1024 * 1024) // limits frames, assembled & inflated messages
+
+static BYTE sttDeflateTail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// websocket frame header
+
+struct WSHeader
+{
+	WSHeader()
+	{
+		memset(this, 0, sizeof(*this));
+	}
+
+	// returns false if the header isn't complete yet. frames longer than WS_MAX_MESSAGE_SIZE
+	// are marked with bIsTooLarge, the connection is to be dropped then
+	bool init(const void *pBuf, size_t bufSize)
+	{
+		if (bufSize < 2)
+			return false;
+
+		const BYTE *buf = (const BYTE*)pBuf;
+		bIsFinal = (buf[0] & 0x80) != 0;
+		bIsCompressed = (buf[0] & 0x40) != 0;
+		bIsMasked = (buf[1] & 0x80) != 0;
+		opCode = buf[0] & 0x0F;
+
+		int firstByte = buf[1] & 0x7F;
+		headerSize = 2 + (firstByte == 0x7E ? 2 : 0) + (firstByte == 0x7F ? 8 : 0) + (bIsMasked ? 4 : 0);
+		if (bufSize < headerSize)
+			return false;
+
+		uint64_t tmpSize = 0;
+		switch (firstByte) {
+		case 0x7F:
+			for (int i = 2; i < 10; i++)
+				tmpSize = (tmpSize << 8) + buf[i];
+			break;
+
+		case 0x7E:
+			tmpSize = (buf[2] << 8) + buf[3];
+			break;
+
+		default:
+			tmpSize = firstByte;
+		}
+
+		if (tmpSize > WS_MAX_MESSAGE_SIZE || tmpSize > SIZE_MAX - headerSize) {
+			bIsTooLarge = true;
+			return true;
+		}
+		payloadSize = (size_t)tmpSize;
+
+		if (bIsMasked)
+			memcpy(mask, buf + headerSize - 4, 4);
+		return true;
+	}
+
+	bool bIsFinal, bIsMasked, bIsCompressed, bIsTooLarge;
+	int opCode;
+	BYTE mask[4];
+	size_t payloadSize, headerSize;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// per-connection state of a websocket
+
+struct NetlibWebSocket : public MZeroedObject
+{
+	NetlibWebSocket(int _flags) :
+		flags(_flags)
+	{}
+
+	~NetlibWebSocket()
+	{
+		if (bDeflate) {
+			inflateEnd(&zIn);
+			deflateEnd(&zOut);
+		}
+		if (bZlibStream)
+			inflateEnd(&zStream);
+	}
+
+	int  flags;
+	bool bDeflate, bZlibStream;       // negotiated compression modes
+	bool bResetIn, bResetOut;         // no_context_takeover parameters
+
+	z_stream zIn, zOut, zStream;
+
+	mir_cs csSend;                    // guards zOut & the frame sending
+
+	MStreamBuffer netBuf;             // raw data read from a socket
+	size_t cbConsumed;                // the number of netBuf bytes to be dropped on the next call
+
+	int msgOpCode;                    // the opcode of a fragmented message being assembled
+	bool msgCompressed;
+	MStreamBuffer msgBuf, streamBuf, outBuf;
+};
+
+void NetlibDestroyWebSocket(NetlibWebSocket *pWs)
+{
+	delete pWs;
+}
+
+static NetlibWebSocket* sttGetWebSocket(HNETLIBCONN hConn)
+{
+	if (GetNetlibHandleType(hConn) != NLH_CONNECTION || hConn->pWebSocket == nullptr) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return nullptr;
+	}
+	return hConn->pWebSocket;
+}
+
+static const char* sttFindHeader(NETLIBHTTPREQUEST *nlhr, const char *szName)
+{
+	for (int i = 0; i < nlhr->headersCount; i++)
+		if (!mir_strcmpi(nlhr->headers[i].szName, szName))
+			return nlhr->headers[i].szValue;
+
+	return nullptr;
+}
+
+// inflates the whole buffer using the zlib stream passed, appends the result to the output buffer.
+// zlib writes directly into the free tail of the output buffer
+static bool sttInflate(z_stream &zstr, const void *pData, size_t dataLen, MStreamBuffer &out)
+{
+	zstr.next_in = (Bytef*)pData;
+	zstr.avail_in = (uInt)dataLen;
+	do {
+		BYTE *pOut = (BYTE*)out.reserve(WS_RECV_CHUNK);
+		if (pOut == nullptr)
+			return false;
+
+		zstr.next_out = pOut;
+		zstr.avail_out = WS_RECV_CHUNK;
+		int ret = inflate(&zstr, Z_SYNC_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+			return false;
+
+		out.commit(WS_RECV_CHUNK - zstr.avail_out);
+		if (out.length() > WS_MAX_MESSAGE_SIZE)
+			return false;
+	}
+		while (zstr.avail_in != 0 || zstr.avail_out == 0);
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// connects to ws:// or wss:// url and performs the protocol handshake
+
+MIR_APP_DLL(HNETLIBCONN) WebSocket_Connect(HNETLIBUSER nlu, const char *szUrl, int flags, const char *szExtraHeaders)
+{
+	if (szUrl == nullptr) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return nullptr;
+	}
+
+	NETLIBOPENCONNECTION nloc;
+	NetlibConnFromUrl(szUrl, _strnicmp(szUrl, "wss", 3) == 0, nloc);
+	ptrA szHost((char*)nloc.szHost);
+	nloc.flags |= NLOCF_V2;
+	nloc.timeout = 5;
+
+	const char *pszPath = strstr(szUrl, "://");
+	pszPath = strchr(pszPath ? pszPath + 3 : szUrl, '/');
+
+	HNETLIBCONN hConn = Netlib_OpenConnection(nlu, &nloc);
+	if (hConn == nullptr) {
+		Netlib_Logf(nlu, "WebSocket connection to %s:%d failed", szHost.get(), nloc.wPort);
+		return nullptr;
+	}
+
+	BYTE binKey[16];
+	Utils_GetRandom(binKey, sizeof(binKey));
+	ptrA szKey(mir_base64_encode(binKey, sizeof(binKey)));
+
+	CMStringA szBuf;
+	szBuf.AppendFormat("GET %s HTTP/1.1\r\n", pszPath ? pszPath : "/");
+	szBuf.AppendFormat("Host: %s\r\n", szHost.get());
+	szBuf.Append("Upgrade: websocket\r\n");
+	szBuf.Append("Connection: Upgrade\r\n");
+	szBuf.Append("Pragma: no-cache\r\n");
+	szBuf.Append("Cache-Control: no-cache\r\n");
+	szBuf.AppendFormat("Sec-WebSocket-Key: %s\r\n", szKey.get());
+	szBuf.Append("Sec-WebSocket-Version: 13\r\n");
+	if (flags & NLWS_DEFLATE)
+		szBuf.Append("Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n");
+	if (szExtraHeaders)
+		szBuf.Append(szExtraHeaders);
+	szBuf.Append("\r\n");
+
+	if (Netlib_Send(hConn, szBuf, szBuf.GetLength(), MSG_DUMPASTEXT) == SOCKET_ERROR) {
+		Netlib_Logf(nlu, "WebSocket connection to %s:%d failed: handshake send error", szHost.get(), nloc.wPort);
+		Netlib_CloseHandle(hConn);
+		return nullptr;
+	}
+
+	// all the data beyond headers remains inside a connection
+	NLHR_PTR nlhr(Netlib_RecvHttpHeaders(hConn, MSG_DUMPASTEXT));
+	if (nlhr == nullptr || nlhr->resultCode != 101) {
+		Netlib_Logf(nlu, "WebSocket connection to %s:%d failed: status %d", szHost.get(), nloc.wPort, nlhr ? nlhr->resultCode : 0);
+		Netlib_CloseHandle(hConn);
+		return nullptr;
+	}
+
+	// validate Sec-WebSocket-Accept = base64(sha1(key + GUID))
+	CMStringA szAccept(szKey.get());
+	szAccept.Append(WS_GUID);
+	BYTE digest[MIR_SHA1_HASH_SIZE];
+	mir_sha1_hash((BYTE*)szAccept.GetBuffer(), szAccept.GetLength(), digest);
+	ptrA szExpected(mir_base64_encode(digest, sizeof(digest)));
+	if (mir_strcmp(sttFindHeader(nlhr, "Sec-WebSocket-Accept"), szExpected)) {
+		Netlib_Logf(nlu, "WebSocket connection to %s:%d failed: invalid accept key", szHost.get(), nloc.wPort);
+		Netlib_CloseHandle(hConn);
+		return nullptr;
+	}
+
+	NetlibWebSocket *pWs = new NetlibWebSocket(flags);
+
+	const char *pszExt = sttFindHeader(nlhr, "Sec-WebSocket-Extensions");
+	if ((flags & NLWS_DEFLATE) && pszExt && strstr(pszExt, "permessage-deflate")) {
+		int windowBits = 15, level = Z_DEFAULT_COMPRESSION;
+		if (const char *p = strstr(pszExt, "client_max_window_bits=")) {
+			windowBits = atoi(p + 23);
+			if (windowBits > 15)
+				windowBits = 15;
+		}
+
+		// zlib cannot produce raw streams with a 256-byte window. stored blocks don't refer
+		// to a window at all, so such a peer gets them instead of a larger window than it allows
+		int zlibBits = windowBits;
+		if (zlibBits < 9) {
+			zlibBits = 9;
+			level = Z_NO_COMPRESSION;
+		}
+
+		pWs->bResetIn = strstr(pszExt, "server_no_context_takeover") != nullptr;
+		pWs->bResetOut = strstr(pszExt, "client_no_context_takeover") != nullptr;
+		pWs->bDeflate = inflateInit2(&pWs->zIn, -15) == Z_OK && deflateInit2(&pWs->zOut, level, Z_DEFLATED, -zlibBits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+		Netlib_Logf(nlu, "WebSocket: permessage-deflate negotiated, client window %d bits", windowBits);
+	}
+
+	if (flags & NLWS_ZLIB_STREAM)
+		pWs->bZlibStream = inflateInit(&pWs->zStream) == Z_OK;
+
+	hConn->pWebSocket = pWs;
+	Netlib_Logf(nlu, "WebSocket connection to %s:%d succeeded", szHost.get(), nloc.wPort);
+	return hConn;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// sends one masked frame, compresses data frames if permessage-deflate is enabled
+
+MIR_APP_DLL(int) WebSocket_Send(HNETLIBCONN hConn, const void *pData, size_t dataLen, int opCode)
+{
+	NetlibWebSocket *pWs = sttGetWebSocket(hConn);
+	if (pWs == nullptr)
+		return SOCKET_ERROR;
+
+	mir_cslock lck(pWs->csSend);
+
+	BYTE header[14];
+	header[0] = 0x80 + (opCode & 0x0F);
+
+	// control frames are never compressed
+	MStreamBuffer compressed;
+	if (pWs->bDeflate && opCode < WSOP_CLOSE && dataLen != 0) {
+		z_stream &zstr = pWs->zOut;
+		zstr.next_in = (Bytef*)pData;
+		zstr.avail_in = (uInt)dataLen;
+		do {
+			BYTE *pOut = (BYTE*)compressed.reserve(WS_RECV_CHUNK);
+			if (pOut == nullptr)
+				return SOCKET_ERROR;
+
+			zstr.next_out = pOut;
+			zstr.avail_out = WS_RECV_CHUNK;
+			deflate(&zstr, Z_SYNC_FLUSH);
+			compressed.commit(WS_RECV_CHUNK - zstr.avail_out);
+		}
+			while (zstr.avail_out == 0);
+
+		if (pWs->bResetOut)
+			deflateReset(&zstr);
+
+		// RFC 7692: the trailing 00 00 FF FF of a sync flush isn't transmitted
+		if (compressed.length() >= 4 && !memcmp(compressed.data() + compressed.length() - 4, sttDeflateTail, 4)) {
+			pData = compressed.data();
+			dataLen = compressed.length() - 4;
+			header[0] |= 0x40;
+		}
+	}
+
+	size_t hdrLen;
+	uint64_t len = dataLen;
+	if (len < 126) {
+		header[1] = (BYTE)len;
+		hdrLen = 2;
+	}
+	else if (len < 65536) {
+		header[1] = 0x7E;
+		header[2] = (len >> 8) & 0xFF;
+		header[3] = len & 0xFF;
+		hdrLen = 4;
+	}
+	else {
+		header[1] = 0x7F;
+		for (int i = 0; i < 8; i++)
+			header[2 + i] = (len >> (56 - i * 8)) & 0xFF;
+		hdrLen = 10;
+	}
+
+	// client frames must always be masked
+	BYTE *pMask = header + hdrLen;
+	Utils_GetRandom(pMask, 4);
+	header[1] |= 0x80;
+	hdrLen += 4;
+
+	ptrA sendBuf((char*)mir_alloc(hdrLen + dataLen));
+	memcpy(sendBuf, header, hdrLen);
+
+	BYTE *dst = (BYTE*)sendBuf.get() + hdrLen;
+	const BYTE *src = (const BYTE*)pData;
+	for (size_t i = 0; i < dataLen; i++)
+		dst[i] = src[i] ^ pMask[i & 3];
+
+	return Netlib_Send(hConn, sendBuf, int(hdrLen + dataLen), MSG_NODUMP);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// receives the next complete data message
+
+MIR_APP_DLL(int) WebSocket_Recv(HNETLIBCONN hConn, const char **ppData, int *pOpCode)
+{
+	NetlibWebSocket *pWs = sttGetWebSocket(hConn);
+	if (pWs == nullptr || ppData == nullptr)
+		return SOCKET_ERROR;
+
+	NetlibUser *nlu = hConn->nlu;
+
+	// drop a frame returned by the previous call
+	if (pWs->cbConsumed) {
+		pWs->netBuf.remove(pWs->cbConsumed);
+		pWs->cbConsumed = 0;
+	}
+
+	while (true) {
+		// read the socket until the whole frame gets available
+		WSHeader hdr;
+		while (true) {
+			if (hdr.init(pWs->netBuf.data(), pWs->netBuf.length())) {
+				if (hdr.bIsTooLarge) {
+					Netlib_Logf(nlu, "WebSocket: frame exceeds %d bytes, exiting", WS_MAX_MESSAGE_SIZE);
+					return SOCKET_ERROR;
+				}
+				if (pWs->netBuf.length() >= hdr.headerSize + hdr.payloadSize)
+					break;
+			}
+
+			// read directly into the buffer's tail
+			char *buf = pWs->netBuf.reserve(WS_RECV_CHUNK);
+			if (buf == nullptr)
+				return SOCKET_ERROR;
+
+			int bufSize = Netlib_Recv(hConn, buf, WS_RECV_CHUNK, MSG_NODUMP);
+			if (bufSize <= 0) {
+				Netlib_Logf(nlu, (bufSize == 0) ? "WebSocket connection gracefully closed" : "WebSocket connection error");
+				return bufSize;
+			}
+			pWs->netBuf.commit(bufSize);
+		}
+
+		size_t cbFrame = hdr.headerSize + hdr.payloadSize;
+		BYTE *pPayload = (BYTE*)pWs->netBuf.data() + hdr.headerSize;
+		if (hdr.bIsMasked)
+			for (size_t i = 0; i < hdr.payloadSize; i++)
+				pPayload[i] ^= hdr.mask[i & 3];
+
+		switch (hdr.opCode) {
+		case WSOP_PING:
+			WebSocket_Send(hConn, pPayload, hdr.payloadSize, WSOP_PONG);
+			break;
+
+		case WSOP_PONG:
+			break;
+
+		case WSOP_CLOSE:
+			Netlib_Logf(nlu, "WebSocket: server requested to close connection (%d)", (hdr.payloadSize >= 2) ? (pPayload[0] << 8) + pPayload[1] : 0);
+			WebSocket_Send(hConn, pPayload, (hdr.payloadSize >= 2) ? 2 : 0, WSOP_CLOSE);
+			pWs->netBuf.remove(cbFrame);
+			return 0;
+
+		case WSOP_CONTINUATION:
+		case WSOP_TEXT:
+		case WSOP_BINARY:
+			{
+				if (hdr.opCode != WSOP_CONTINUATION) {
+					pWs->msgOpCode = hdr.opCode;
+					pWs->msgCompressed = pWs->bDeflate && hdr.bIsCompressed;
+					pWs->msgBuf.remove(pWs->msgBuf.length());
+				}
+
+				if (pWs->msgBuf.length() + hdr.payloadSize > WS_MAX_MESSAGE_SIZE) {
+					Netlib_Logf(nlu, "WebSocket: message exceeds %d bytes, exiting", WS_MAX_MESSAGE_SIZE);
+					return SOCKET_ERROR;
+				}
+
+				if (!hdr.bIsFinal) {
+					pWs->msgBuf.append(pPayload, hdr.payloadSize);
+					break;
+				}
+
+				const void *pMsg;
+				size_t cbMsg;
+
+				// the most common case: one uncompressed frame is returned right from the network buffer
+				if (hdr.opCode != WSOP_CONTINUATION && !pWs->msgCompressed) {
+					pMsg = pPayload;
+					cbMsg = hdr.payloadSize;
+				}
+				else {
+					pWs->msgBuf.append(pPayload, hdr.payloadSize);
+					pMsg = pWs->msgBuf.data();
+					cbMsg = pWs->msgBuf.length();
+				}
+
+				if (pWs->msgCompressed) {
+					pWs->outBuf.remove(pWs->outBuf.length());
+					if (!sttInflate(pWs->zIn, pMsg, cbMsg, pWs->outBuf) || !sttInflate(pWs->zIn, sttDeflateTail, sizeof(sttDeflateTail), pWs->outBuf)) {
+						Netlib_Logf(nlu, "WebSocket: invalid compressed message, exiting");
+						return SOCKET_ERROR;
+					}
+					if (pWs->bResetIn)
+						inflateReset(&pWs->zIn);
+
+					pMsg = pWs->outBuf.data();
+					cbMsg = pWs->outBuf.length();
+				}
+
+				int opCode = pWs->msgOpCode;
+
+				// zlib-stream: binary messages are chunks of one stream, each flushed chunk ends with 00 00 FF FF
+				if (pWs->bZlibStream && opCode == WSOP_BINARY) {
+					if (pWs->streamBuf.length() + cbMsg > WS_MAX_MESSAGE_SIZE) {
+						Netlib_Logf(nlu, "WebSocket: zlib stream chunk exceeds %d bytes, exiting", WS_MAX_MESSAGE_SIZE);
+						return SOCKET_ERROR;
+					}
+					pWs->streamBuf.append((void*)pMsg, cbMsg);
+					pWs->netBuf.remove(cbFrame);
+					size_t cbStream = pWs->streamBuf.length();
+					if (cbStream < 4 || memcmp(pWs->streamBuf.data() + cbStream - 4, sttDeflateTail, 4))
+						continue;
+
+					pWs->outBuf.remove(pWs->outBuf.length());
+					bool bSuccess = sttInflate(pWs->zStream, pWs->streamBuf.data(), cbStream, pWs->outBuf);
+					pWs->streamBuf.remove(cbStream);
+					if (!bSuccess) {
+						Netlib_Logf(nlu, "WebSocket: invalid zlib stream, exiting");
+						return SOCKET_ERROR;
+					}
+
+					pMsg = pWs->outBuf.data();
+					cbMsg = pWs->outBuf.length();
+					opCode = WSOP_TEXT;
+				}
+				else pWs->cbConsumed = cbFrame;
+
+				if (pOpCode)
+					*pOpCode = opCode;
+				*ppData = (const char*)pMsg;
+				return (int)cbMsg;
+			}
+		}
+
+		pWs->netBuf.remove(cbFrame);
+	}
+}
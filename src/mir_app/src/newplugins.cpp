@@ -330,9 +330,9 @@ pluginEntry* OpenPlugin(wchar_t *tszFileName, wchar_t *dir, wchar_t *path)
 	wchar_t tszFullPath[MAX_PATH];
 	mir_snwprintf(tszFullPath, L"%s\\%s\\%s", path, dir, tszFileName);
 
-	// map dll into the memory and check its exports
+	// map dll into the memory and check its exports, unless it's already known
 	bool bIsPlugin = false;
-	mir_ptr<MUUID> pIds(GetPluginInterfaces(tszFullPath, bIsPlugin));
+	mir_ptr<MUUID> pIds(GetCachedPluginInterfaces(tszFullPath, bIsPlugin));
 	if (!bIsPlugin)
 		return nullptr;
 
@@ -724,10 +724,98 @@ int LoadNewPluginsModule(void)
 		if (!isPluginOnWhiteList(it->pluginname))
 			Plugin_Uninit(it);
 
+	// core plugins are sniffed on demand, so the catalog could be changed since the scan
+	SavePluginCatalog();
+
 	HookEvent(ME_OPT_INITIALISE, PluginOptionsInit);
 	return 0;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// Startup timeline
+// collects the time spent in each plugin's Load() and ME_SYSTEM_MODULESLOADED handlers,
+// the report is written to the network log when the startup is over
+
+struct TimelineItem
+{
+	TimelineItem(HINSTANCE _1) :
+		hInst(_1)
+	{}
+
+	HINSTANCE hInst;
+	__int64 iLoad = 0, iModulesLoaded = 0;
+
+	__forceinline __int64 total() const { return iLoad + iModulesLoaded; }
+};
+
+static OBJLIST<TimelineItem> arTimeline(50, HandleKeySortT);
+static bool bTimelineActive = true;
+static __int64 iScanTicks;
+static int nSniffedDlls;
+
+static TimelineItem* getTimelineItem(HINSTANCE hInst)
+{
+	TimelineItem *p = arTimeline.find((TimelineItem*)&hInst);
+	if (p == nullptr)
+		arTimeline.insert(p = new TimelineItem(hInst));
+	return p;
+}
+
+int pluginEntry::load()
+{
+	if (!bTimelineActive)
+		return (pfnLoad == nullptr) ? m_pPlugin->Load() : pfnLoad();
+
+	LARGE_INTEGER tsStart, tsEnd;
+	QueryPerformanceCounter(&tsStart);
+	int res = (pfnLoad == nullptr) ? m_pPlugin->Load() : pfnLoad();
+	QueryPerformanceCounter(&tsEnd);
+
+	getTimelineItem(m_pPlugin->getInst())->iLoad += tsEnd.QuadPart - tsStart.QuadPart;
+	return res;
+}
+
+void StartupTimelineHook(HINSTANCE hOwner, __int64 iTicks)
+{
+	if (bTimelineActive)
+		getTimelineItem(hOwner)->iModulesLoaded += iTicks;
+}
+
+static int CompareTimelineCost(const TimelineItem *p1, const TimelineItem *p2)
+{
+	// the most expensive plugins go first
+	if (p1->total() != p2->total())
+		return (p1->total() < p2->total()) ? 1 : -1;
+	return (p1->hInst < p2->hInst) ? -1 : (p1->hInst > p2->hInst);
+}
+
+void ReportStartupTimeline(void)
+{
+	bTimelineActive = false;
+
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	double dScale = 1000.0 / freq.QuadPart;
+
+	Netlib_Logf(nullptr, "Startup: plugins folder scanned in %.1f ms, %d dll(s) sniffed", iScanTicks * dScale, nSniffedDlls);
+
+	LIST<TimelineItem> arSorted(arTimeline.getCount(), CompareTimelineCost);
+	for (auto &it : arTimeline)
+		arSorted.insert(it);
+
+	for (auto &it : arSorted) {
+		char szName[MAX_PATH];
+		if (char *pszName = GetPluginNameByInstance(it->hInst))
+			strncpy_s(szName, pszName, _TRUNCATE);
+		else if (it->hInst == nullptr || !GetModuleFileNameA(it->hInst, szName, _countof(szName)))
+			strncpy_s(szName, "<unknown>", _TRUNCATE);
+
+		Netlib_Logf(nullptr, "Startup: %s: Load %.1f ms, ModulesLoaded %.1f ms", szName, it->iLoad * dScale, it->iModulesLoaded * dScale);
+	}
+
+	arTimeline.destroy();
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // Plugins module initialization
 // called before anything real is loaded, incl. database
@@ -748,8 +836,15 @@ int LoadNewPluginsModuleInfos(void)
 	// remember where the mirandaboot.ini lays
 	PathToAbsoluteW(L"mirandaboot.ini", mirandabootini);
 
-	// look for all *.dll's
+	// sniff all new or changed dlls in parallel, then look for all *.dll's
+	LoadPluginCatalog();
+
+	LARGE_INTEGER tsStart, tsEnd;
+	QueryPerformanceCounter(&tsStart);
+	nSniffedDlls = RefreshPluginCatalog();
 	enumPlugins(scanPluginsDir, 0, 0);
+	QueryPerformanceCounter(&tsEnd);
+	iScanTicks = tsEnd.QuadPart - tsStart.QuadPart;
 
 	MuuidReplacement stdCrypt = { MIID_CRYPTO, L"stdcrypt", nullptr };
 	if (!LoadCorePlugin(stdCrypt))
@@ -781,6 +876,7 @@ void UnloadNewPluginsModule(void)
 		return;
 
 	UnloadPluginOptions();
+	SavePluginCatalog();
 
 	// unload everything but the DB
 	for (auto &it : pluginList.rev_iter())
@@ -79,7 +79,7 @@ static BOOL dialogListPlugins(WIN32_FIND_DATA *fd, wchar_t *path, WPARAM, LPARAM
 	HINSTANCE hInst = GetModuleHandle(buf);
 
 	bool bIsPlugin = false, bNeedsFree = false;
-	mir_ptr<MUUID> pIds(GetPluginInterfaces(buf, bIsPlugin));
+	mir_ptr<MUUID> pIds(GetCachedPluginInterfaces(buf, bIsPlugin));
 	if (!bIsPlugin)
 		return true;
 
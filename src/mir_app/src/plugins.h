@@ -44,9 +44,7 @@ struct pluginEntry
 
 	bool checkAPI(wchar_t *plugin);
 
-	int load()
-	{	return (pfnLoad == nullptr) ? m_pPlugin->Load() : pfnLoad();
-	}
+	int load(); // also measures the time spent in Load() for the startup timeline
 
 	int unload()
 	{	return (pfnUnload == nullptr) ? m_pPlugin->Unload() : pfnUnload();
@@ -86,3 +84,9 @@ struct MuuidReplacement
 bool LoadCorePlugin(MuuidReplacement&);
 
 MUUID* GetPluginInterfaces(const wchar_t *ptszFileName, bool &bIsPlugin);
+
+// plugin catalog, see dll_sniffer.cpp
+void   LoadPluginCatalog();
+void   SavePluginCatalog();
+int    RefreshPluginCatalog();
+MUUID* GetCachedPluginInterfaces(const wchar_t *ptszFileName, bool &bIsPlugin);
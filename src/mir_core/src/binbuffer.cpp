@@ -69,3 +69,109 @@ void MBinBuffer::remove(size_t sz)
 		m_len -= sz;
 	}
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// MStreamBuffer
+
+#define MIN_BLOCK_SIZE 256
+#define MAX_IDLE_BLOCK_SIZE 65536
+
+MStreamBuffer::MStreamBuffer() :
+	m_buf(nullptr),
+	m_len(0),
+	m_pBlock(nullptr),
+	m_size(0)
+{
+}
+
+MStreamBuffer::~MStreamBuffer()
+{
+	mir_free(m_pBlock);
+}
+
+// makes room for bufLen more bytes (plus a terminating zero) after the data.
+// consumed space at the beginning is reused only when it's not smaller than data itself,
+// so that compaction costs are amortized, otherwise the block grows twice
+
+static bool GrowBlock(char *&pBlock, size_t &blockSize, char *&pData, size_t dataLen, size_t bufLen)
+{
+	size_t offset = pData - pBlock, needed = dataLen + bufLen + 1;
+	if (needed <= dataLen) // overflow
+		return false;
+
+	if (offset + needed <= blockSize)
+		return true;
+
+	if (offset >= dataLen && needed <= blockSize) {
+		memmove(pBlock, pData, dataLen);
+		pData = pBlock;
+		return true;
+	}
+
+	size_t newSize = (blockSize < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : blockSize;
+	while (newSize < needed)
+		newSize *= 2;
+
+	// only the live data is copied into a new block, the consumed prefix is dropped
+	char *pNew = (char*)mir_alloc(newSize);
+	if (pNew == nullptr)
+		return false;
+
+	if (dataLen != 0)
+		memcpy(pNew, pData, dataLen);
+	mir_free(pBlock);
+
+	pBlock = pData = pNew;
+	blockSize = newSize;
+	return true;
+}
+
+void MStreamBuffer::append(void *pBuf, size_t bufLen)
+{
+	if (pBuf == nullptr || bufLen == 0)
+		return;
+
+	char *p = reserve(bufLen);
+	if (p != nullptr) {
+		memcpy(p, pBuf, bufLen);
+		commit(bufLen);
+	}
+}
+
+void MStreamBuffer::remove(size_t sz)
+{
+	if (sz >= m_len) {
+		// nothing left: a large block is released, a small one is rewound for reuse
+		m_len = 0;
+		if (m_size > MAX_IDLE_BLOCK_SIZE) {
+			mir_free(m_pBlock);
+			m_pBlock = m_buf = nullptr;
+			m_size = 0;
+		}
+		else if (m_pBlock != nullptr) {
+			m_buf = m_pBlock;
+			m_buf[0] = 0;
+		}
+		return;
+	}
+
+	m_buf += sz;
+	m_len -= sz;
+}
+
+char* MStreamBuffer::reserve(size_t bufLen)
+{
+	if (!GrowBlock(m_pBlock, m_size, m_buf, m_len, bufLen))
+		return nullptr;
+
+	return m_buf + m_len;
+}
+
+void MStreamBuffer::commit(size_t bufLen)
+{
+	if (m_buf == nullptr || m_buf + m_len + bufLen >= m_pBlock + m_size)
+		return;
+
+	m_len += bufLen;
+	m_buf[m_len] = 0;
+}
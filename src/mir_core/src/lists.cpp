@@ -26,6 +26,47 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 /* a simple sorted list implementation */
 
+// the array grows geometrically, by half of its size but at least by increment items,
+// so a series of inserts costs amortized O(1) reallocations
+static int List_Grow(SortedList* p_list, int p_count)
+{
+	if (p_count <= p_list->limit)
+		return 1;
+
+	int newLimit = p_list->limit + max(p_list->limit / 2, max(p_list->increment, 1));
+	return List_Reserve(p_list, max(newLimit, p_count));
+}
+
+// compares two items the same way as List_GetIndex does it
+static int List_Compare(SortedList* p_list, void* p1, void* p2)
+{
+	switch ((INT_PTR)p_list->sortFunc) {
+	case HandleKeySortT:
+	#ifdef _WIN64
+		{
+			const unsigned __int64 val1 = *(unsigned __int64 *)p1, val2 = *(unsigned __int64 *)p2;
+			return (val1 < val2) ? -1 : (val1 != val2);
+		}
+	#endif
+
+	case NumericKeySortT:
+		{
+			const unsigned val1 = *(unsigned *)p1, val2 = *(unsigned *)p2;
+			return (val1 < val2) ? -1 : (val1 != val2);
+		}
+
+	case PtrKeySortT:
+		return (p1 < p2) ? -1 : (p1 != p2);
+	}
+
+	return p_list->sortFunc(p1, p2);
+}
+
+static int __cdecl List_SortProc(void* p_list, const void* p1, const void* p2)
+{
+	return List_Compare((SortedList*)p_list, *(void**)p1, *(void**)p2);
+}
+
 MIR_CORE_DLL(SortedList*) List_Create(int p_limit, int p_increment)
 {
 	SortedList* result = (SortedList*)mir_calloc(sizeof(SortedList));
@@ -33,10 +74,24 @@ MIR_CORE_DLL(SortedList*) List_Create(int p_limit, int p_increment)
 		return(nullptr);
 
 	result->increment = p_increment;
-	result->limit = p_limit;
+	List_Reserve(result, p_limit);
 	return result;
 }
 
+MIR_CORE_DLL(int) List_Reserve(SortedList* p_list, int p_count)
+{
+	if (p_count <= p_list->limit)
+		return 1;
+
+	void **items = (void**)mir_realloc(p_list->items, sizeof(void*)*p_count);
+	if (items == nullptr)
+		return 0;
+
+	p_list->items = items;
+	p_list->limit = p_count;
+	return 1;
+}
+
 MIR_CORE_DLL(void) List_Destroy(SortedList* p_list)
 {
 	if (p_list == nullptr)
@@ -174,10 +229,8 @@ MIR_CORE_DLL(int) List_Insert(SortedList* p_list, void* p_value, int p_index)
 	if (p_value == nullptr || p_index > p_list->realCount)
 		return 0;
 
-	if (p_list->realCount == p_list->limit) {
-		p_list->items = (void**)mir_realloc(p_list->items, sizeof(void*)*(p_list->realCount + p_list->increment));
-		p_list->limit += p_list->increment;
-	}
+	if (!List_Grow(p_list, p_list->realCount + 1))
+		return 0;
 
 	if (p_index < p_list->realCount)
 		memmove(p_list->items + p_index + 1, p_list->items + p_index, sizeof(void*)*(p_list->realCount - p_index));
@@ -193,14 +246,92 @@ MIR_CORE_DLL(int) List_InsertPtr(SortedList* list, void* p)
 	if (p == nullptr)
 		return -1;
 
+	// ordered input is simply appended, without binary search
 	int idx;
 	if (list->sortFunc == nullptr)
 		idx = list->realCount;
+	else if (list->realCount > 0 && List_Compare(list, list->items[list->realCount - 1], p) < 0)
+		idx = list->realCount;
 	else
 		List_GetIndex(list, p, &idx);
 	return List_Insert(list, p, idx);
 }
 
+MIR_CORE_DLL(int) List_InsertMany(SortedList* p_list, void** p_items, int p_count)
+{
+	if (p_items == nullptr || p_count <= 0)
+		return 0;
+
+	int oldCount = p_list->realCount;
+	if (!List_Reserve(p_list, oldCount + p_count))
+		return 0;
+
+	// append new items to the tail
+	void **pNew = p_list->items + oldCount;
+	int n = 0;
+	for (int i = 0; i < p_count; i++)
+		if (p_items[i] != nullptr)
+			pNew[n++] = p_items[i];
+
+	if (p_list->sortFunc != nullptr && n > 0) {
+		// sort them, unless they're already ordered
+		bool bOneByOne = false;
+		for (int i = 1; i < n && !bOneByOne; i++) {
+			int result = List_Compare(p_list, pNew[i - 1], pNew[i]);
+			if (result == 0)
+				bOneByOne = true;
+			else if (result > 0) {
+				qsort_s(pNew, n, sizeof(void*), List_SortProc, p_list);
+				for (int j = 1; j < n && !bOneByOne; j++)
+					bOneByOne = List_Compare(p_list, pNew[j - 1], pNew[j]) == 0;
+				break;
+			}
+		}
+
+		// equal items must land exactly where List_InsertPtr would put them,
+		// so such input is inserted one by one, as it is when the merge buffer isn't available
+		void **pTemp = nullptr;
+		if (!bOneByOne && oldCount > 0) {
+			int result = List_Compare(p_list, p_list->items[oldCount - 1], pNew[0]);
+			if (result == 0)
+				bOneByOne = true;
+			else if (result > 0) {
+				for (int i = 0, idx; i < n && !bOneByOne; i++)
+					bOneByOne = List_GetIndex(p_list, pNew[i], &idx) != 0;
+
+				if (!bOneByOne && (pTemp = (void**)mir_alloc(sizeof(void*)*n)) == nullptr)
+					bOneByOne = true;
+			}
+		}
+
+		// the memory is already reserved, so no insertion below can fail
+		if (bOneByOne) {
+			n = 0;
+			for (int i = 0; i < p_count; i++)
+				if (List_InsertPtr(p_list, p_items[i]) == 1)
+					n++;
+			return n;
+		}
+
+		// merge with the old ones from the end
+		if (pTemp != nullptr) {
+			memcpy(pTemp, pNew, sizeof(void*)*n);
+
+			int i = oldCount - 1, j = n - 1, k = oldCount + n - 1;
+			while (j >= 0) {
+				if (i >= 0 && List_Compare(p_list, p_list->items[i], pTemp[j]) > 0)
+					p_list->items[k--] = p_list->items[i--];
+				else
+					p_list->items[k--] = pTemp[j--];
+			}
+			mir_free(pTemp);
+		}
+	}
+
+	p_list->realCount = oldCount + n;
+	return n;
+}
+
 MIR_CORE_DLL(int) List_Remove(SortedList* p_list, int index)
 {
 	if (index < 0 || index > p_list->realCount)
@@ -226,8 +357,8 @@ MIR_CORE_DLL(int) List_RemovePtr(SortedList* list, void* p)
 MIR_CORE_DLL(void) List_Copy(SortedList* s, SortedList* d, size_t)
 {
 	d->increment = s->increment;
-	d->limit = s->limit;
-	d->realCount = s->realCount;
+	d->sortFunc = s->sortFunc;
+	d->limit = d->realCount = s->realCount;
 	d->items = (void**)mir_alloc(sizeof(void*) * d->realCount);
 	memcpy(d->items, s->items, sizeof(void*) * d->realCount);
 }
@@ -237,6 +368,7 @@ MIR_CORE_DLL(void) List_ObjCopy(SortedList* s, SortedList* d, size_t itemSize)
 	d->increment = s->increment;
 	d->sortFunc = s->sortFunc;
 
+	List_Reserve(d, s->realCount);
 	for (int i = 0; i < s->realCount; i++) {
 		void* item = new char[itemSize];
 		memcpy(item, s->items[i], itemSize);
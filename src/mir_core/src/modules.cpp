@@ -219,7 +219,7 @@ MIR_CORE_DLL(int) CallObjectEventHook(void *pObject, HANDLE hEvent, WPARAM wPara
 	return 0;
 }
 
-static int CallHookSubscribers(THook *p, WPARAM wParam, LPARAM lParam)
+static int CallHookSubscribers(THook *p, WPARAM wParam, LPARAM lParam, MIRANDAHOOKTIMER pfnTimer = nullptr)
 {
 	if (p == nullptr)
 		return -1;
@@ -230,6 +230,10 @@ static int CallHookSubscribers(THook *p, WPARAM wParam, LPARAM lParam)
 	for (int i = 0; i < p->subscriberCount; i++) {
 		THookSubscriber* s = &p->subscriber[i];
 
+		LARGE_INTEGER tsStart;
+		if (pfnTimer)
+			QueryPerformanceCounter(&tsStart);
+
 		int returnVal;
 		switch (s->type) {
 		case 1:	returnVal = s->pfnHook(wParam, lParam);	break;
@@ -239,6 +243,13 @@ static int CallHookSubscribers(THook *p, WPARAM wParam, LPARAM lParam)
 		case 5:	returnVal = SendMessage(s->hwnd, s->message, wParam, lParam); break;
 		default: continue;
 		}
+
+		if (pfnTimer) {
+			LARGE_INTEGER tsEnd;
+			QueryPerformanceCounter(&tsEnd);
+			pfnTimer(s->hOwner, tsEnd.QuadPart - tsStart.QuadPart);
+		}
+
 		if (returnVal)
 			return returnVal;
 	}
@@ -310,6 +321,21 @@ MIR_CORE_DLL(int) NotifyFastHook(HANDLE hEvent, WPARAM wParam, LPARAM lParam)
 	return CallHookSubscribers((THook*)hEvent, wParam, lParam);
 }
 
+// the same as NotifyEventHooks, but reports the time spent by each subscriber.
+// the timing is available in the main thread only, other threads are served as usual
+MIR_CORE_DLL(int) NotifyEventHooksTimed(HANDLE hEvent, MIRANDAHOOKTIMER pfnTimer, WPARAM wParam, LPARAM lParam)
+{
+	if (pfnTimer == nullptr || GetCurrentThreadId() != mainThreadId)
+		return NotifyEventHooks(hEvent, wParam, lParam);
+
+	switch (checkHook((THook*)hEvent)) {
+	case hookInvalid: return -1;
+	case hookEmpty: return 0;
+	}
+
+	return CallHookSubscribers((THook*)hEvent, wParam, lParam, pfnTimer);
+}
+
 extern "C" MIR_CORE_DLL(int) GetSubscribersCount(THook* pHook)
 {
 	switch (checkHook(pHook)) {